@@ -12,6 +12,9 @@
 // Imports
 //==================================================================================================
 
+#[cfg(target_os = "linux")]
+use crate::kvm::vmem::VirtualMemory;
+
 use crate::config;
 use ::anyhow::Result;
 use ::std::{
@@ -34,12 +37,40 @@ pub struct Args {
     kernel_filename: String,
     /// Initrd filename.
     initrd_filename: Option<String>,
-    /// Memory size.
-    memory_size: usize,
+    /// Memory size, or `None` if it is computed from the kernel and the initrd.
+    memory_size: Option<usize>,
+    /// Memory that is left free for the kernel when the memory size is computed.
+    memory_headroom: usize,
     /// Standard error.
     vm_stderr: Option<String>,
     /// Gateway address.
     gateway_addr: Option<SocketAddr>,
+    /// Print execution statistics?
+    stats: bool,
+    /// Message recording file.
+    record: Option<String>,
+    /// Control socket of the daemon.
+    daemon: Option<String>,
+    /// Control group of the virtual machine monitor.
+    cgroup: Option<String>,
+    /// CPU bandwidth limit, as a quota (`None` if unlimited) and a period, in microseconds.
+    cpu_max: Option<(Option<u64>, u64)>,
+    /// CPU weight.
+    cpu_weight: Option<u32>,
+    /// Memory usage throttle limit.
+    memory_high: Option<usize>,
+    /// Manifest of batch jobs.
+    batch: Option<String>,
+    /// Results file of batch jobs.
+    results: Option<String>,
+    /// Number of batch jobs that run at once.
+    jobs: Option<usize>,
+    /// Serve function invocations?
+    function: bool,
+    /// Enter the kernel with paging enabled?
+    paging: bool,
+    /// Disable exits on `hlt`, `pause` and `mwait`?
+    disable_exits: bool,
 }
 
 //==================================================================================================
@@ -55,10 +86,42 @@ impl Args {
     const OPT_KERNEL: &'static str = "-kernel";
     /// Command-line option for the memory size.
     const OPT_MEMORY_SIZE: &'static str = "-memory";
+    /// Command-line option for the memory headroom.
+    const OPT_MEMORY_HEADROOM: &'static str = "-memory-headroom";
+    /// Memory size that is computed from the kernel and the initrd.
+    const MEMORY_SIZE_AUTO: &'static str = "auto";
     /// Command-line option for the standard error.
     const OPT_STDERR: &'static str = "-stderr";
     /// Command-line option for gateway address.
     const OPT_GATEWAY: &'static str = "-gateway";
+    /// Command-line option for printing execution statistics.
+    const OPT_STATS: &'static str = "-stats";
+    /// Command-line option for message recording file.
+    const OPT_RECORD: &'static str = "-record";
+    /// Command-line option for running as a daemon.
+    const OPT_DAEMON: &'static str = "-daemon";
+    /// Command-line option for the control group.
+    const OPT_CGROUP: &'static str = "-cgroup";
+    /// Command-line option for the CPU bandwidth limit.
+    const OPT_CPU_MAX: &'static str = "-cpu-max";
+    /// Command-line option for the CPU weight.
+    const OPT_CPU_WEIGHT: &'static str = "-cpu-weight";
+    /// Command-line option for the memory usage throttle limit.
+    const OPT_MEMORY_HIGH: &'static str = "-memory-high";
+    /// Command-line option for running batch jobs.
+    const OPT_BATCH: &'static str = "-batch";
+    /// Command-line option for the results file of batch jobs.
+    const OPT_RESULTS: &'static str = "-results";
+    /// Command-line option for the number of batch jobs that run at once.
+    const OPT_JOBS: &'static str = "-jobs";
+    /// Command-line option for serving function invocations.
+    const OPT_FUNCTION: &'static str = "-function";
+    /// Command-line option for entering the kernel with paging enabled.
+    const OPT_PAGING: &'static str = "-paging";
+    /// Command-line option for disabling exits on `hlt`, `pause` and `mwait`.
+    const OPT_DISABLE_EXITS: &'static str = "-disable-exits";
+    /// Default period of the CPU bandwidth limit (in microseconds).
+    const DEFAULT_CPU_PERIOD: u64 = 100_000;
 
     ///
     /// # Description
@@ -75,9 +138,23 @@ impl Args {
 
         let mut kernel_filename: String = String::new();
         let mut initrd_filename: Option<String> = None;
-        let mut memory_size: usize = config::DEFAULT_MEMORY_SIZE;
+        let mut memory_size: Option<usize> = Some(config::DEFAULT_MEMORY_SIZE);
+        let mut memory_headroom: Option<usize> = None;
         let mut vm_stderr: Option<String> = None;
         let mut gateway_addr: Option<SocketAddr> = None;
+        let mut stats: bool = false;
+        let mut record: Option<String> = None;
+        let mut daemon: Option<String> = None;
+        let mut cgroup: Option<String> = None;
+        let mut cpu_max: Option<(Option<u64>, u64)> = None;
+        let mut cpu_weight: Option<u32> = None;
+        let mut memory_high: Option<usize> = None;
+        let mut batch: Option<String> = None;
+        let mut results: Option<String> = None;
+        let mut jobs: Option<usize> = None;
+        let mut function: bool = false;
+        let mut paging: bool = false;
+        let mut disable_exits: bool = false;
 
         // Parse command-line arguments.
         let mut i: usize = 1;
@@ -100,37 +177,15 @@ impl Args {
                 },
                 // Set memory size.
                 Self::OPT_MEMORY_SIZE if i + 1 < args.len() => {
-                    let mem_arg: &String = &args[i + 1];
-
-                    // Parse memory size.
-                    memory_size = match mem_arg[..mem_arg.len() - 1].parse::<usize>() {
-                        Ok(size) => size,
-                        Err(e) => {
-                            let reason: String = format!("invalid memory size (error={})", e);
-                            error!("parse(): {}", reason);
-                            anyhow::bail!(reason);
-                        },
-                    };
-
-                    // Parse memory size suffix.
-                    let endptr: char = match mem_arg.chars().last() {
-                        Some(c) => c,
-                        None => {
-                            let reason: String = format!("invalid memory size '{}'", mem_arg);
-                            error!("parse(): {}", reason);
-                            anyhow::bail!(reason);
-                        },
+                    memory_size = match args[i + 1].as_str() {
+                        Self::MEMORY_SIZE_AUTO => None,
+                        size => Some(Self::parse_size(size)?),
                     };
-                    match endptr {
-                        'K' | 'k' => memory_size *= 1024,
-                        'M' | 'm' => memory_size *= 1024 * 1024,
-                        'G' | 'g' => memory_size *= 1024 * 1024 * 1024,
-                        ch => {
-                            let reason: String = format!("invalid memory size suffix '{}'", ch);
-                            error!("parse(): {}", reason);
-                            anyhow::bail!(reason);
-                        },
-                    }
+                    i += 1;
+                },
+                // Set memory headroom.
+                Self::OPT_MEMORY_HEADROOM if i + 1 < args.len() => {
+                    memory_headroom = Some(Self::parse_size(&args[i + 1])?);
                     i += 1;
                 },
                 // Set error file.
@@ -143,6 +198,82 @@ impl Args {
                     gateway_addr = Some(args[i + 1].parse()?);
                     i += 1;
                 },
+                // Print execution statistics.
+                Self::OPT_STATS => {
+                    stats = true;
+                },
+                // Serve function invocations.
+                Self::OPT_FUNCTION => {
+                    function = true;
+                },
+                // Enter the kernel with paging enabled.
+                Self::OPT_PAGING => {
+                    paging = true;
+                },
+                // Disable exits on idle instructions.
+                Self::OPT_DISABLE_EXITS => {
+                    disable_exits = true;
+                },
+                // Set message recording file.
+                Self::OPT_RECORD if i + 1 < args.len() => {
+                    record = Some(args[i + 1].clone());
+                    i += 1;
+                },
+                // Run as a daemon.
+                Self::OPT_DAEMON if i + 1 < args.len() => {
+                    daemon = Some(args[i + 1].clone());
+                    i += 1;
+                },
+                // Set control group.
+                Self::OPT_CGROUP if i + 1 < args.len() => {
+                    cgroup = Some(args[i + 1].clone());
+                    i += 1;
+                },
+                // Set CPU bandwidth limit.
+                Self::OPT_CPU_MAX if i + 1 < args.len() => {
+                    cpu_max = Some(Self::parse_cpu_max(&args[i + 1])?);
+                    i += 1;
+                },
+                // Set CPU weight.
+                Self::OPT_CPU_WEIGHT if i + 1 < args.len() => {
+                    cpu_weight = match args[i + 1].parse::<u32>() {
+                        Ok(weight) if (1..=10000).contains(&weight) => Some(weight),
+                        _ => {
+                            let reason: String = format!("invalid cpu weight '{}'", args[i + 1]);
+                            error!("parse(): {}", reason);
+                            anyhow::bail!(reason);
+                        },
+                    };
+                    i += 1;
+                },
+                // Set memory usage throttle limit.
+                Self::OPT_MEMORY_HIGH if i + 1 < args.len() => {
+                    memory_high = Some(Self::parse_size(&args[i + 1])?);
+                    i += 1;
+                },
+                // Run batch jobs.
+                Self::OPT_BATCH if i + 1 < args.len() => {
+                    batch = Some(args[i + 1].clone());
+                    i += 1;
+                },
+                // Set results file of batch jobs.
+                Self::OPT_RESULTS if i + 1 < args.len() => {
+                    results = Some(args[i + 1].clone());
+                    i += 1;
+                },
+                // Set number of batch jobs that run at once.
+                Self::OPT_JOBS if i + 1 < args.len() => {
+                    jobs = match args[i + 1].parse::<usize>() {
+                        Ok(jobs) if jobs > 0 => Some(jobs),
+                        _ => {
+                            let reason: String =
+                                format!("invalid number of jobs '{}'", args[i + 1]);
+                            error!("parse(): {}", reason);
+                            anyhow::bail!(reason);
+                        },
+                    };
+                    i += 1;
+                },
 
                 // Invalid argument.
                 _ => {
@@ -156,27 +287,145 @@ impl Args {
             i += 1;
         }
 
-        // Check if kernel file is missing.
-        if kernel_filename.is_empty() {
+        // Check if kernel file is missing. A daemon receives kernels along with each request, and
+        // batch jobs list kernels in their manifest.
+        if kernel_filename.is_empty() && daemon.is_none() && batch.is_none() {
             Self::usage();
             anyhow::bail!("kernel file is missing");
         }
 
         // Check if memory size is invalid.
-        if memory_size == 0 {
+        if memory_size == Some(0) {
             Self::usage();
             anyhow::bail!("invalid memory size");
         }
 
+        // Check if memory headroom was given without computing the memory size.
+        if memory_size.is_some() && memory_headroom.is_some() {
+            Self::usage();
+            anyhow::bail!("memory headroom requires automatic memory size");
+        }
+
+        // Check if batch options were given without a manifest.
+        if batch.is_none() && (results.is_some() || jobs.is_some()) {
+            Self::usage();
+            anyhow::bail!("batch options require a manifest");
+        }
+
+        // Check if resource limits were given without a control group.
+        if cgroup.is_none() && (cpu_max.is_some() || cpu_weight.is_some() || memory_high.is_some())
+        {
+            Self::usage();
+            anyhow::bail!("resource limits require a control group");
+        }
+
         Ok(Self {
             kernel_filename,
             initrd_filename,
             memory_size,
+            memory_headroom: memory_headroom.unwrap_or(config::DEFAULT_MEMORY_HEADROOM),
             vm_stderr,
             gateway_addr,
+            stats,
+            record,
+            daemon,
+            cgroup,
+            cpu_max,
+            cpu_weight,
+            memory_high,
+            batch,
+            results,
+            jobs,
+            function,
+            paging,
+            disable_exits,
         })
     }
 
+    ///
+    /// # Description
+    ///
+    /// Parses a size with a `K`, `M` or `G` suffix.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the size in bytes. Otherwise, it returns an
+    /// error.
+    ///
+    fn parse_size(arg: &str) -> Result<usize> {
+        // Parse size suffix.
+        let endptr: char = match arg.chars().last() {
+            Some(c) => c,
+            None => {
+                let reason: String = format!("invalid memory size '{}'", arg);
+                error!("parse_size(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+        let multiplier: usize = match endptr {
+            'K' | 'k' => 1024,
+            'M' | 'm' => 1024 * 1024,
+            'G' | 'g' => 1024 * 1024 * 1024,
+            ch => {
+                let reason: String = format!("invalid memory size suffix '{}'", ch);
+                error!("parse_size(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+
+        // Parse size.
+        match arg[..arg.len() - 1].parse::<usize>() {
+            Ok(size) => Ok(size * multiplier),
+            Err(e) => {
+                let reason: String = format!("invalid memory size (error={})", e);
+                error!("parse_size(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Parses a CPU bandwidth limit, given as `max`, `<quota>` or `<quota>/<period>`, in
+    /// microseconds.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the quota (`None` if unlimited) and the
+    /// period. Otherwise, it returns an error.
+    ///
+    fn parse_cpu_max(arg: &str) -> Result<(Option<u64>, u64)> {
+        let (quota, period): (&str, Option<&str>) = match arg.split_once('/') {
+            Some((quota, period)) => (quota, Some(period)),
+            None => (arg, None),
+        };
+
+        let quota: Option<u64> = match quota {
+            "max" => None,
+            quota => match quota.parse::<u64>() {
+                Ok(quota) if quota > 0 => Some(quota),
+                _ => {
+                    let reason: String = format!("invalid cpu quota '{}'", arg);
+                    error!("parse_cpu_max(): {}", reason);
+                    anyhow::bail!(reason);
+                },
+            },
+        };
+
+        let period: u64 = match period.map(|period| period.parse::<u64>()) {
+            None => Self::DEFAULT_CPU_PERIOD,
+            Some(Ok(period)) if period > 0 => period,
+            Some(_) => {
+                let reason: String = format!("invalid cpu period '{}'", arg);
+                error!("parse_cpu_max(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+
+        Ok((quota, period))
+    }
+
     ///
     /// # Description
     ///
@@ -184,15 +433,38 @@ impl Args {
     ///
     pub fn usage() {
         eprintln!(
-            "Usage: {} {} <kernel> [{} <size>] [{} <file>] [{} <file>]  [{} <socket-address>]",
+            "Usage: {} {} <kernel> [{} <size>|auto] [{} <size>] [{} <file>] [{} <file>]  [{} \
+             <socket-address>] [{}] [{} <file>] [{}] [{}] [{}]\n       {} {} <socket>\n       {} \
+             {} <manifest> [{} <file>] [{} <n>]\n\nResource limits (either mode): {} <path> [{} \
+             max|<quota>[/<period>]] [{} <weight>] [{} <size>]",
             env::args()
                 .next()
                 .unwrap_or(config::PROGRAM_NAME.to_string()),
             Self::OPT_KERNEL,
             Self::OPT_MEMORY_SIZE,
+            Self::OPT_MEMORY_HEADROOM,
             Self::OPT_INITRD,
             Self::OPT_STDERR,
-            Self::OPT_GATEWAY
+            Self::OPT_GATEWAY,
+            Self::OPT_STATS,
+            Self::OPT_RECORD,
+            Self::OPT_FUNCTION,
+            Self::OPT_PAGING,
+            Self::OPT_DISABLE_EXITS,
+            env::args()
+                .next()
+                .unwrap_or(config::PROGRAM_NAME.to_string()),
+            Self::OPT_DAEMON,
+            env::args()
+                .next()
+                .unwrap_or(config::PROGRAM_NAME.to_string()),
+            Self::OPT_BATCH,
+            Self::OPT_RESULTS,
+            Self::OPT_JOBS,
+            Self::OPT_CGROUP,
+            Self::OPT_CPU_MAX,
+            Self::OPT_CPU_WEIGHT,
+            Self::OPT_MEMORY_HIGH
         );
     }
 
@@ -226,14 +498,24 @@ impl Args {
     ///
     /// # Description
     ///
-    /// Returns the memory size that was passed as a command-line argument to the program.
+    /// Returns the memory size that was passed as a command-line argument to the program. If it
+    /// was `auto`, the smallest size that holds the kernel, the initrd and the memory headroom is
+    /// computed instead. Thus, this method must be called before the initrd filename is taken.
     ///
     /// # Returns
     ///
-    /// The memory size that was passed as a command-line argument to the program.
-    ///
-    pub fn memory_size(&self) -> usize {
-        self.memory_size
+    /// Upon successful completion, this method returns the memory size. Otherwise, it returns an
+    /// error.
+    ///
+    pub fn memory_size(&self) -> Result<usize> {
+        match self.memory_size {
+            Some(memory_size) => Ok(memory_size),
+            None => VirtualMemory::required_size(
+                &self.kernel_filename,
+                self.initrd_filename.as_deref(),
+                self.memory_headroom,
+            ),
+        }
     }
 
     ///
@@ -263,4 +545,162 @@ impl Args {
     pub fn gateway_addr(&mut self) -> Option<SocketAddr> {
         self.gateway_addr.take()
     }
+
+    ///
+    /// # Description
+    ///
+    /// Returns whether execution statistics should be printed.
+    ///
+    /// # Returns
+    ///
+    /// If execution statistics should be printed when the virtual machine stops, this method
+    /// returns `true`. Otherwise, it returns `false`.
+    ///
+    pub fn stats(&self) -> bool {
+        self.stats
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the name of the file where messages exchanged with the gateway should be recorded.
+    ///
+    /// # Returns
+    ///
+    /// The name of the message recording file that was passed as a command-line argument to the
+    /// program. If no such file was passed, this method returns `None`.
+    ///
+    pub fn take_record(&mut self) -> Option<String> {
+        self.record.take()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the path to the control socket of the daemon.
+    ///
+    /// # Returns
+    ///
+    /// If the program should run as a daemon, the path to its control socket is returned.
+    /// Otherwise, this method returns `None`.
+    ///
+    pub fn take_daemon(&mut self) -> Option<String> {
+        self.daemon.take()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the control group in which the virtual machine monitor should run.
+    ///
+    /// # Returns
+    ///
+    /// The path of the control group, relative to the root of the cgroup v2 hierarchy. If no
+    /// control group was passed, this method returns `None`.
+    ///
+    pub fn take_cgroup(&mut self) -> Option<String> {
+        self.cgroup.take()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the CPU bandwidth limit that was passed as a command-line argument to the program.
+    ///
+    /// # Returns
+    ///
+    /// The quota (`None` if unlimited) and the period of the limit, in microseconds. If no limit
+    /// was passed, this method returns `None`.
+    ///
+    pub fn cpu_max(&self) -> Option<(Option<u64>, u64)> {
+        self.cpu_max
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the CPU weight that was passed as a command-line argument to the program.
+    ///
+    pub fn cpu_weight(&self) -> Option<u32> {
+        self.cpu_weight
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the memory usage throttle limit that was passed as a command-line argument to the
+    /// program.
+    ///
+    pub fn memory_high(&self) -> Option<usize> {
+        self.memory_high
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the manifest of batch jobs that was passed as a command-line argument to the
+    /// program.
+    ///
+    /// # Returns
+    ///
+    /// If the program should run batch jobs, the path to their manifest is returned. Otherwise,
+    /// this method returns `None`.
+    ///
+    pub fn take_batch(&mut self) -> Option<String> {
+        self.batch.take()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the results file of batch jobs that was passed as a command-line argument to the
+    /// program.
+    ///
+    /// # Returns
+    ///
+    /// The path to the results file. If no results file was passed, this method returns `None`,
+    /// and results should be written to the standard output.
+    ///
+    pub fn take_results(&mut self) -> Option<String> {
+        self.results.take()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the number of batch jobs that should run at once.
+    ///
+    pub fn jobs(&self) -> Option<usize> {
+        self.jobs
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Checks if the virtual machine should serve function invocations, which are read from the
+    /// standard input of the program.
+    ///
+    pub fn function(&self) -> bool {
+        self.function
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Checks if the kernel should be entered with paging enabled, with identity page tables that
+    /// are built by the virtual machine monitor.
+    ///
+    pub fn paging(&self) -> bool {
+        self.paging
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Checks if exits on `hlt`, `pause` and `mwait` should be disabled, for virtual processors
+    /// that have dedicated host cores.
+    ///
+    pub fn disable_exits(&self) -> bool {
+        self.disable_exits
+    }
 }
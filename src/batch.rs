@@ -0,0 +1,481 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Batch Mode
+//!
+//! This module runs many short-lived MicroVMs from a manifest, one job per line:
+//!
+//! ```text
+//! # <name> <options>
+//! hello  -kernel hello.elf
+//! big    -kernel hello.elf -memory 256M -initrd data.img
+//! ```
+//!
+//! Lines that are empty or that start with `#` are skipped. Jobs accept `-kernel`, `-initrd`,
+//! `-memory`, `-memory-headroom` and `-paging`, with the same meaning as when the program runs a
+//! single MicroVM.
+//!
+//! Jobs are spread over a fixed number of worker threads. Each worker keeps the MicroVM of its
+//! last job and reuses it for the next job with the same memory size, so that the partition, the
+//! memory mapping and the virtual processor are set up once rather than once per job. A guest
+//! reports its exit status by writing it to the virtual machine monitor port.
+//!
+//! The results file receives one record per job, in completion order:
+//!
+//! ```text
+//! [<name>] job=<n> status=exited|failed exit_code=<n>|none setup_ns=<n> run_ns=<n> exits=<n> ...
+//! > <console output of the guest>
+//! ```
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Args,
+    cgroup::{
+        self,
+        ThreadGroup,
+    },
+    config,
+    io::IoReactor,
+    microvm::Statistics,
+    vmm::{
+        BootOptions,
+        Vmm,
+    },
+};
+use ::anyhow::Result;
+use ::std::{
+    fs::{
+        self,
+        File,
+    },
+    io::{
+        self,
+        BufWriter,
+        Write,
+    },
+    mem,
+    sync::{
+        atomic::{
+            AtomicUsize,
+            Ordering,
+        },
+        Arc,
+        Mutex,
+    },
+    thread,
+    time::Instant,
+};
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// A job of the manifest.
+///
+struct Job {
+    /// Name of the job.
+    name: String,
+    /// Size of the virtual memory of the MicroVM.
+    memory_size: usize,
+    /// Path to the kernel binary.
+    kernel_filename: String,
+    /// Path to the initial RAM disk, if any.
+    initrd_filename: Option<String>,
+    /// Enter the kernel with paging enabled?
+    paging: bool,
+}
+
+///
+/// # Description
+///
+/// Outcome of a job.
+///
+struct Outcome {
+    /// Exit status of the guest, if it wrote one.
+    exit_status: Option<u32>,
+    /// Time spent loading the kernel and resetting the MicroVM (in nanoseconds).
+    setup_ns: u64,
+    /// Number of exits.
+    exits: u64,
+    /// Time spent running the MicroVM (in nanoseconds).
+    run_ns: u64,
+}
+
+///
+/// # Description
+///
+/// Standard error device of a MicroVM, captured in memory.
+///
+#[derive(Clone, Default)]
+struct Console(Arc<Mutex<Vec<u8>>>);
+
+///
+/// # Description
+///
+/// A MicroVM that a worker keeps across jobs.
+///
+struct Cached {
+    /// Size of the virtual memory of the MicroVM.
+    memory_size: usize,
+    /// MicroVM.
+    vmm: Vmm,
+}
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the jobs of a manifest.
+///
+/// # Parameters
+///
+/// - `manifest`: Path to the manifest.
+/// - `results`:  Path to the results file. If `None`, results are written to standard output.
+/// - `nworkers`: Number of worker threads.
+/// - `reactor`:  I/O reactor to which MicroVMs are attached.
+///
+/// # Returns
+///
+/// If every job ran, empty is returned, regardless of the exit status of guests. Otherwise, an
+/// error is returned instead.
+///
+pub fn run(
+    manifest: &str,
+    results: Option<&str>,
+    nworkers: usize,
+    reactor: &IoReactor,
+) -> Result<()> {
+    trace!("run(): manifest={}, results={:?}, nworkers={}", manifest, results, nworkers);
+
+    let jobs: Vec<Job> = parse_manifest(manifest)?;
+
+    let writer: Box<dyn Write + Send> = match results {
+        Some(results) => Box::new(BufWriter::new(File::create(results)?)),
+        None => Box::new(io::stdout()),
+    };
+    let writer: Mutex<Box<dyn Write + Send>> = Mutex::new(writer);
+
+    let next: AtomicUsize = AtomicUsize::new(0);
+    let failed: AtomicUsize = AtomicUsize::new(0);
+    let start: Instant = Instant::now();
+
+    thread::scope(|scope| {
+        for _ in 0..nworkers.clamp(1, jobs.len().max(1)) {
+            scope.spawn(|| work(&jobs, &next, &failed, &writer, reactor));
+        }
+    });
+
+    writer.lock().unwrap().flush()?;
+
+    let failed: usize = failed.load(Ordering::Relaxed);
+    println!(
+        "batch: jobs={} failed={} elapsed_ns={}",
+        jobs.len(),
+        failed,
+        start.elapsed().as_nanos()
+    );
+
+    if failed > 0 {
+        let reason: String = format!("{} of {} jobs failed", failed, jobs.len());
+        error!("run(): {}", reason);
+        anyhow::bail!(reason);
+    }
+
+    Ok(())
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Parses a manifest.
+///
+/// # Parameters
+///
+/// - `manifest`: Path to the manifest.
+///
+/// # Returns
+///
+/// Upon success, the jobs of the manifest are returned. Otherwise, an error is returned instead.
+///
+fn parse_manifest(manifest: &str) -> Result<Vec<Job>> {
+    let contents: String = match fs::read_to_string(manifest) {
+        Ok(contents) => contents,
+        Err(e) => {
+            let reason: String =
+                format!("failed to read manifest (path={}, error={:?})", manifest, e);
+            error!("parse_manifest(): {}", reason);
+            anyhow::bail!(reason);
+        },
+    };
+
+    let mut jobs: Vec<Job> = Vec::new();
+    for (lineno, line) in contents.lines().enumerate() {
+        let line: &str = line.trim();
+        if line.is_empty() || line.starts_with('#') {
+            continue;
+        }
+
+        let mut tokens = line.split_whitespace();
+        let name: String = tokens.next().unwrap_or_default().to_string();
+        let options: Vec<String> = tokens.map(str::to_string).collect();
+
+        // Only options that describe the guest are accepted. Console output is captured in the
+        // results file and gateways are not attached to batch jobs.
+        if let Some(option) = options
+            .iter()
+            .filter(|option| option.starts_with('-'))
+            .find(|option| {
+                !matches!(
+                    option.as_str(),
+                    "-kernel" | "-initrd" | "-memory" | "-memory-headroom" | "-paging"
+                )
+            })
+        {
+            let reason: String =
+                format!("unsupported option {} (line={}, job={})", option, lineno + 1, name);
+            error!("parse_manifest(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        let mut argv: Vec<String> = vec![config::PROGRAM_NAME.to_string()];
+        argv.extend(options);
+        let mut args: Args = match Args::parse(argv) {
+            Ok(args) => args,
+            Err(e) => {
+                let reason: String =
+                    format!("invalid job (line={}, job={}, error={})", lineno + 1, name, e);
+                error!("parse_manifest(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+
+        jobs.push(Job {
+            name,
+            memory_size: args.memory_size()?,
+            kernel_filename: args.kernel_filename().to_string(),
+            initrd_filename: args.initrd_filename(),
+            paging: args.paging(),
+        });
+    }
+
+    Ok(jobs)
+}
+
+///
+/// # Description
+///
+/// Runs jobs on a worker thread, until there are no jobs left.
+///
+/// # Parameters
+///
+/// - `jobs`:    Jobs of the manifest.
+/// - `next`:    Index of the next job to run.
+/// - `failed`:  Number of jobs that failed to run.
+/// - `writer`:  Results file.
+/// - `reactor`: I/O reactor to which MicroVMs are attached.
+///
+fn work(
+    jobs: &[Job],
+    next: &AtomicUsize,
+    failed: &AtomicUsize,
+    writer: &Mutex<Box<dyn Write + Send>>,
+    reactor: &IoReactor,
+) {
+    if let Err(e) = cgroup::join(ThreadGroup::Vcpu) {
+        warn!("work(): failed to join control group (error={:?})", e);
+    }
+
+    let console: Console = Console::default();
+    let mut cached: Option<Cached> = None;
+
+    loop {
+        let index: usize = next.fetch_add(1, Ordering::Relaxed);
+        let job: &Job = match jobs.get(index) {
+            Some(job) => job,
+            None => break,
+        };
+
+        let outcome: Result<Outcome> = run_job(job, &console, &mut cached, reactor);
+        let output: Vec<u8> = mem::take(&mut *console.0.lock().unwrap());
+
+        // The state of a MicroVM that failed is unknown, thus it is not reused.
+        if outcome.is_err() {
+            failed.fetch_add(1, Ordering::Relaxed);
+            cached = None;
+        }
+
+        if let Err(e) = write_record(writer, index, job, &outcome, &output) {
+            warn!("work(): failed to write results (job={}, error={:?})", job.name, e);
+        }
+    }
+}
+
+///
+/// # Description
+///
+/// Runs a job, reusing the MicroVM of the previous job if it has the same memory size.
+///
+/// # Parameters
+///
+/// - `job`:     Job to run.
+/// - `console`: Standard error device of the MicroVM.
+/// - `cached`:  MicroVM kept by the worker.
+/// - `reactor`: I/O reactor to which MicroVMs are attached.
+///
+/// # Returns
+///
+/// Upon success, the outcome of the job is returned. Otherwise, an error is returned instead.
+///
+fn run_job(
+    job: &Job,
+    console: &Console,
+    cached: &mut Option<Cached>,
+    reactor: &IoReactor,
+) -> Result<Outcome> {
+    let start: Instant = Instant::now();
+
+    let vmm: &mut Vmm = match cached {
+        Some(cached) if cached.memory_size == job.memory_size => {
+            cached.vmm.reboot(&job.boot_options())?;
+            &mut cached.vmm
+        },
+        _ => {
+            // Release the previous MicroVM before creating another one.
+            *cached = None;
+            let mut vmm: Vmm = Vmm::with_console(
+                job.memory_size,
+                false,
+                Box::new(console.clone()),
+                None,
+                None,
+                reactor,
+            )?;
+            vmm.boot(&job.boot_options())?;
+            &mut cached
+                .insert(Cached {
+                    memory_size: job.memory_size,
+                    vmm,
+                })
+                .vmm
+        },
+    };
+
+    let setup_ns: u64 = start.elapsed().as_nanos() as u64;
+
+    vmm.run()?;
+
+    let stats: Arc<Statistics> = vmm.stats();
+    Ok(Outcome {
+        exit_status: vmm.exit_status(),
+        setup_ns,
+        exits: stats.exits.load(Ordering::Relaxed),
+        run_ns: stats.run_ns.load(Ordering::Relaxed),
+    })
+}
+
+///
+/// # Description
+///
+/// Writes the record of a job to the results file.
+///
+/// # Parameters
+///
+/// - `writer`:  Results file.
+/// - `index`:   Index of the job in the manifest.
+/// - `job`:     Job.
+/// - `outcome`: Outcome of the job.
+/// - `output`:  Console output of the guest.
+///
+/// # Returns
+///
+/// Upon success, empty is returned. Otherwise, an error is returned instead.
+///
+fn write_record(
+    writer: &Mutex<Box<dyn Write + Send>>,
+    index: usize,
+    job: &Job,
+    outcome: &Result<Outcome>,
+    output: &[u8],
+) -> Result<()> {
+    let mut record: String = match outcome {
+        Ok(outcome) => format!(
+            "[{}] job={} status=exited exit_code={} setup_ns={} run_ns={} exits={} \
+             console_bytes={}\n",
+            job.name,
+            index,
+            outcome
+                .exit_status
+                .map_or("none".to_string(), |status| status.to_string()),
+            outcome.setup_ns,
+            outcome.run_ns,
+            outcome.exits,
+            output.len()
+        ),
+        Err(e) => format!(
+            "[{}] job={} status=failed exit_code=none console_bytes={} error=\"{}\"\n",
+            job.name,
+            index,
+            output.len(),
+            e
+        ),
+    };
+
+    for line in String::from_utf8_lossy(output).lines() {
+        record.push_str("> ");
+        record.push_str(line);
+        record.push('\n');
+    }
+
+    writer.lock().unwrap().write_all(record.as_bytes())?;
+
+    Ok(())
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Job {
+    ///
+    /// # Description
+    ///
+    /// Returns what the MicroVM of the job boots.
+    ///
+    fn boot_options(&self) -> BootOptions<'_> {
+        BootOptions {
+            kernel_filename: &self.kernel_filename,
+            initrd_filename: self.initrd_filename.as_deref(),
+            paging: self.paging,
+        }
+    }
+}
+
+//==================================================================================================
+// Trait Implementations
+//==================================================================================================
+
+impl Write for Console {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.0.lock().unwrap().extend_from_slice(buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
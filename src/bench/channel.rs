@@ -0,0 +1,72 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Channel Benchmarks
+//!
+//! Measures the channels that carry messages between the virtual processor thread and the I/O
+//! thread.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::std::{
+    sync::mpsc::{
+        self,
+        Receiver,
+        Sender,
+        TryRecvError,
+    },
+    thread,
+};
+use ::sys::ipc::Message;
+use ::test::{
+    black_box,
+    Bencher,
+};
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+/// Sends and receives a message on the same thread.
+#[bench]
+fn send_recv(b: &mut Bencher) {
+    let (tx, rx): (Sender<Message>, Receiver<Message>) = mpsc::channel::<Message>();
+    b.iter(|| {
+        tx.send(Message::default()).unwrap();
+        black_box(rx.recv().unwrap())
+    });
+}
+
+/// Polls an empty channel, as the I/O thread does when there is nothing to send.
+#[bench]
+fn try_recv_empty(b: &mut Bencher) {
+    let (_tx, rx): (Sender<Message>, Receiver<Message>) = mpsc::channel::<Message>();
+    b.iter(|| matches!(rx.try_recv(), Err(TryRecvError::Empty)));
+}
+
+/// Sends a message to another thread and waits for it to be sent back.
+#[bench]
+fn roundtrip_across_threads(b: &mut Bencher) {
+    let (tx, peer_rx): (Sender<Message>, Receiver<Message>) = mpsc::channel::<Message>();
+    let (peer_tx, rx): (Sender<Message>, Receiver<Message>) = mpsc::channel::<Message>();
+
+    let peer: thread::JoinHandle<()> = thread::spawn(move || {
+        while let Ok(message) = peer_rx.recv() {
+            if peer_tx.send(message).is_err() {
+                break;
+            }
+        }
+    });
+
+    b.iter(|| {
+        tx.send(Message::default()).unwrap();
+        black_box(rx.recv().unwrap())
+    });
+
+    drop(tx);
+    peer.join().unwrap();
+}
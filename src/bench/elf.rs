@@ -0,0 +1,156 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # ELF Loader Benchmarks
+//!
+//! Measures [`elf::load`](crate::elf::load) on synthetic images with varying segment sizes and
+//! counts.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::elf;
+use ::std::mem;
+use ::test::Bencher;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of the ELF 32 file header.
+const EHDR_SIZE: usize = 52;
+
+/// Size of an ELF 32 program header.
+const PHDR_SIZE: usize = 32;
+
+/// Offset of the first segment in an image.
+const SEGMENTS_OFFSET: usize = 4096;
+
+/// Virtual address of the first segment in an image.
+const BASE_ADDRESS: usize = 0x00100000;
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// A synthetic ELF 32 executable with a number of loadable segments of the same size.
+///
+struct Image {
+    /// Contents of the image. Words are used to guarantee alignment of headers.
+    words: Vec<u64>,
+    /// Memory size required to load the image.
+    memory_size: usize,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Image {
+    ///
+    /// # Description
+    ///
+    /// Builds a synthetic image.
+    ///
+    /// # Parameters
+    ///
+    /// - `nsegments`: Number of loadable segments.
+    /// - `segment_size`: Size of each segment.
+    ///
+    fn new(nsegments: usize, segment_size: usize) -> Self {
+        let size: usize = SEGMENTS_OFFSET + nsegments * segment_size;
+        let mut bytes: Vec<u8> = vec![0xcc; size];
+
+        // File header.
+        bytes[0..EHDR_SIZE].fill(0);
+        bytes[0..4].copy_from_slice(b"\x7fELF");
+        bytes[4] = 1; // ELFCLASS32
+        bytes[5] = 1; // ELFDATA2LSB
+        bytes[6] = 1; // EV_CURRENT
+        Self::put_u16(&mut bytes, 16, 2); // e_type = ET_EXEC
+        Self::put_u16(&mut bytes, 18, 3); // e_machine = EM_386
+        Self::put_u32(&mut bytes, 20, 1); // e_version = EV_CURRENT
+        Self::put_u32(&mut bytes, 24, BASE_ADDRESS as u32); // e_entry
+        Self::put_u32(&mut bytes, 28, EHDR_SIZE as u32); // e_phoff
+        Self::put_u16(&mut bytes, 40, EHDR_SIZE as u16); // e_ehsize
+        Self::put_u16(&mut bytes, 42, PHDR_SIZE as u16); // e_phentsize
+        Self::put_u16(&mut bytes, 44, nsegments as u16); // e_phnum
+
+        // Program headers.
+        for i in 0..nsegments {
+            let phdr: usize = EHDR_SIZE + i * PHDR_SIZE;
+            let offset: usize = SEGMENTS_OFFSET + i * segment_size;
+            let vaddr: usize = BASE_ADDRESS + i * segment_size;
+            bytes[phdr..phdr + PHDR_SIZE].fill(0);
+            Self::put_u32(&mut bytes, phdr, 1); // p_type = PT_LOAD
+            Self::put_u32(&mut bytes, phdr + 4, offset as u32); // p_offset
+            Self::put_u32(&mut bytes, phdr + 8, vaddr as u32); // p_vaddr
+            Self::put_u32(&mut bytes, phdr + 12, vaddr as u32); // p_paddr
+            Self::put_u32(&mut bytes, phdr + 16, segment_size as u32); // p_filesz
+            Self::put_u32(&mut bytes, phdr + 20, segment_size as u32); // p_memsz
+            Self::put_u32(&mut bytes, phdr + 24, 0x7); // p_flags = PF_R | PF_W | PF_X
+            Self::put_u32(&mut bytes, phdr + 28, 4096); // p_align
+        }
+
+        let mut words: Vec<u64> = vec![0; size.div_ceil(mem::size_of::<u64>())];
+        unsafe {
+            ::std::ptr::copy_nonoverlapping(bytes.as_ptr(), words.as_mut_ptr() as *mut u8, size);
+        }
+
+        Self {
+            words,
+            memory_size: BASE_ADDRESS + nsegments * segment_size,
+        }
+    }
+
+    /// Writes a little-endian half word at a given offset.
+    fn put_u16(bytes: &mut [u8], offset: usize, value: u16) {
+        bytes[offset..offset + 2].copy_from_slice(&value.to_le_bytes());
+    }
+
+    /// Writes a little-endian word at a given offset.
+    fn put_u32(bytes: &mut [u8], offset: usize, value: u32) {
+        bytes[offset..offset + 4].copy_from_slice(&value.to_le_bytes());
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Benchmarks loading the image into a memory buffer that is large enough to hold it.
+    ///
+    fn bench(&self, b: &mut Bencher) {
+        let mut memory: Vec<u8> = vec![0; self.memory_size];
+        let source: *const u8 = self.words.as_ptr() as *const u8;
+        let file_size: usize = self.words.len() * mem::size_of::<u64>();
+
+        b.iter(|| {
+            let destination: *mut ::std::ffi::c_void = memory.as_mut_ptr() as *mut _;
+            unsafe { elf::load(destination, source, file_size, self.memory_size).unwrap() }
+        });
+    }
+}
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+#[bench]
+fn load_1_segment_4k(b: &mut Bencher) {
+    Image::new(1, 4096).bench(b);
+}
+
+#[bench]
+fn load_1_segment_1m(b: &mut Bencher) {
+    Image::new(1, 1024 * 1024).bench(b);
+}
+
+#[bench]
+fn load_16_segments_4k(b: &mut Bencher) {
+    Image::new(16, 4096).bench(b);
+}
@@ -0,0 +1,36 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Message Serialization Benchmarks
+//!
+//! Measures the conversion of messages to and from their wire format, which happens once per
+//! message in each direction between the guest and the gateway.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::std::mem;
+use ::sys::ipc::Message;
+use ::test::{
+    black_box,
+    Bencher,
+};
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+#[bench]
+fn message_to_bytes(b: &mut Bencher) {
+    let message: Message = Message::default();
+    b.iter(|| black_box(&message).to_bytes());
+}
+
+#[bench]
+fn message_try_from_bytes(b: &mut Bencher) {
+    let bytes: [u8; mem::size_of::<Message>()] = Message::default().to_bytes();
+    b.iter(|| Message::try_from_bytes(black_box(bytes)).is_ok());
+}
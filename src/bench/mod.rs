@@ -0,0 +1,28 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Host-Side Microbenchmarks
+//!
+//! This module contains microbenchmarks for the pieces of the virtual machine monitor that run on
+//! the host and sit on hot paths. None of them requires KVM, so they can run anywhere with:
+//!
+//! ```text
+//! cargo bench
+//! cargo bench --features profiler
+//! ```
+//!
+
+//==================================================================================================
+// Modules
+//==================================================================================================
+
+mod channel;
+mod elf;
+mod ipc;
+
+#[cfg(feature = "profiler")]
+mod profiler;
+
+#[cfg(target_os = "linux")]
+mod vmem;
@@ -0,0 +1,35 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Profiler Benchmarks
+//!
+//! Measures the overhead that the [`timer`](crate::timer) macro adds to each profiled scope.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::test::Bencher;
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+/// Enters and leaves a scope.
+#[bench]
+fn enter_leave(b: &mut Bencher) {
+    b.iter(|| {
+        crate::timer!("bench_enter_leave");
+    });
+}
+
+/// Enters and leaves a scope that is nested in another one.
+#[bench]
+fn enter_leave_nested(b: &mut Bencher) {
+    crate::timer!("bench_outer");
+    b.iter(|| {
+        crate::timer!("bench_inner");
+    });
+}
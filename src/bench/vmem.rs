@@ -0,0 +1,53 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Virtual Memory Benchmarks
+//!
+//! Measures guest memory accesses at the size of a message, which is what the virtual machine
+//! monitor copies on each message exchanged with the guest. The virtual memory is not mapped into
+//! a virtual machine, so KVM is not required.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::kvm::vmem::VirtualMemory;
+use ::std::mem;
+use ::sys::ipc::Message;
+use ::test::{
+    black_box,
+    Bencher,
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of the virtual memory.
+const MEMORY_SIZE: usize = 16 * 1024 * 1024;
+
+/// Guest address that is accessed.
+const ADDRESS: u64 = 0x00400000;
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+#[bench]
+fn write_bytes_message(b: &mut Bencher) {
+    let mut vmem: VirtualMemory = VirtualMemory::allocate(MEMORY_SIZE).unwrap();
+    let bytes: [u8; mem::size_of::<Message>()] = Message::default().to_bytes();
+    b.iter(|| vmem.write_bytes(black_box(ADDRESS), &bytes).unwrap());
+}
+
+#[bench]
+fn read_bytes_message(b: &mut Bencher) {
+    let vmem: VirtualMemory = VirtualMemory::allocate(MEMORY_SIZE).unwrap();
+    let mut bytes: [u8; mem::size_of::<Message>()] = [0; mem::size_of::<Message>()];
+    b.iter(|| {
+        vmem.read_bytes(black_box(ADDRESS), &mut bytes).unwrap();
+        black_box(&bytes);
+    });
+}
@@ -0,0 +1,113 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Arguments
+//!
+//! This module provides utilities for parsing the options that are supplied to a benchmark.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::anyhow::Result;
+use ::std::{
+    collections::HashMap,
+    str::FromStr,
+};
+
+//==================================================================================================
+// Public Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// This structure packs the options that were passed to a benchmark, in the form of `-key value`
+/// pairs.
+///
+pub struct Options {
+    /// Option values indexed by option name.
+    values: HashMap<String, String>,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Options {
+    ///
+    /// # Description
+    ///
+    /// Parses the options that were passed to a benchmark.
+    ///
+    /// # Parameters
+    ///
+    /// - `args`: Command-line arguments that follow the benchmark name.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the options that were parsed. Otherwise, it
+    /// returns an error.
+    ///
+    pub fn parse(args: &[String]) -> Result<Self> {
+        let mut values: HashMap<String, String> = HashMap::new();
+
+        let mut i: usize = 0;
+        while i < args.len() {
+            match args[i].strip_prefix('-') {
+                Some(key) if i + 1 < args.len() => {
+                    values.insert(key.to_string(), args[i + 1].clone());
+                    i += 2;
+                },
+                _ => anyhow::bail!("invalid argument {}", args[i]),
+            }
+        }
+
+        Ok(Self { values })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Gets the value of an option.
+    ///
+    /// # Parameters
+    ///
+    /// - `key`: Name of the option, without the leading dash.
+    /// - `default`: Value to use if the option was not supplied.
+    ///
+    /// # Returns
+    ///
+    /// The value of the option.
+    ///
+    pub fn get_or(&self, key: &str, default: &str) -> String {
+        self.values.get(key).cloned().unwrap_or(default.to_string())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Gets the value of an option and parses it.
+    ///
+    /// # Parameters
+    ///
+    /// - `key`: Name of the option, without the leading dash.
+    /// - `default`: Value to use if the option was not supplied.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the parsed value of the option. Otherwise,
+    /// it returns an error.
+    ///
+    pub fn parse_or<T: FromStr>(&self, key: &str, default: T) -> Result<T> {
+        match self.values.get(key) {
+            Some(value) => match value.parse::<T>() {
+                Ok(value) => Ok(value),
+                Err(_) => anyhow::bail!("invalid value for option -{} ({})", key, value),
+            },
+            None => Ok(default),
+        }
+    }
+}
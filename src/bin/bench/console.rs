@@ -0,0 +1,181 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Console Benchmark
+//!
+//! Runs the `console-bench` guest, which writes a configurable volume of console output with
+//! varied line lengths, and prints the throughput and the number of exits per byte of the console
+//! path. Each sink is measured separately:
+//!
+//! - `file`: console output is written to a temporary file.
+//! - `null`: console output is written to `/dev/null`.
+//!
+//! Numbers are taken from the execution statistics of the MicroVM (`-stats`), because the guest
+//! cannot report anything through a console that may be discarded.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Options,
+    guest::{
+        self,
+        Guest,
+        Report,
+        Run,
+    },
+};
+use ::anyhow::Result;
+use ::std::{
+    env,
+    fs,
+    path::{
+        Path,
+        PathBuf,
+    },
+    process,
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Name of the benchmark.
+pub const NAME: &str = "console";
+
+/// Description of the benchmark.
+pub const DESCRIPTION: &str = "console output throughput and exits per byte";
+
+/// Default path to the guest kernel.
+const DEFAULT_KERNEL: &str = "bin/console-bench.elf";
+
+/// Default number of bytes written by the guest.
+const DEFAULT_BYTES: u32 = 1024 * 1024;
+
+/// Default minimum line length.
+const DEFAULT_MIN_LINE: u32 = 1;
+
+/// Default maximum line length.
+const DEFAULT_MAX_LINE: u32 = 120;
+
+/// Default sinks to measure.
+const DEFAULT_SINKS: &str = "file,null";
+
+/// Tag of the parameters file.
+const TAG: &str = "console-bench";
+
+/// Tag of the execution statistics that are written by the MicroVM.
+const STATS_TAG: &str = "microvm-stats";
+
+/// Magic value that identifies benchmark parameters.
+const PARAMS_MAGIC: u32 = 0x636f6e73;
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the benchmark.
+///
+/// # Parameters
+///
+/// - `options`: Benchmark options (`-microvm <path>`, `-kernel <path>`, `-bytes <n>`,
+///   `-min <n>`, `-max <n>`, `-sinks <list>`).
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+///
+pub fn run(options: &Options) -> Result<()> {
+    let microvm: String = options.get_or("microvm", crate::DEFAULT_MICROVM);
+    let kernel: String = options.get_or("kernel", DEFAULT_KERNEL);
+    let bytes: u32 = options.parse_or("bytes", DEFAULT_BYTES)?;
+    let min_line: u32 = options.parse_or("min", DEFAULT_MIN_LINE)?;
+    let max_line: u32 = options.parse_or("max", DEFAULT_MAX_LINE)?;
+    let sinks: String = options.get_or("sinks", DEFAULT_SINKS);
+
+    if bytes == 0 || min_line == 0 || max_line < min_line {
+        anyhow::bail!("invalid parameters (bytes={}, min={}, max={})", bytes, min_line, max_line);
+    }
+
+    let params: PathBuf = guest::write_params(TAG, &[PARAMS_MAGIC, bytes, min_line, max_line])?;
+
+    println!("bytes: {}, line length: {}..{}", bytes, min_line, max_line);
+    println!("{:<6} {:>10} {:>10} {:>12}", "sink", "MB/s", "ns/byte", "exits/byte");
+
+    let mut result: Result<()> = Ok(());
+    for sink in sinks.split(',').map(|sink| sink.trim()) {
+        result = run_sink(&microvm, &kernel, &params, sink, bytes);
+        if result.is_err() {
+            break;
+        }
+    }
+
+    let _ = fs::remove_file(&params);
+
+    result
+}
+
+//==================================================================================================
+// Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Measures the console path with a given sink and prints the results.
+///
+fn run_sink(microvm: &str, kernel: &str, params: &Path, sink: &str, bytes: u32) -> Result<()> {
+    let path: PathBuf = match sink {
+        "file" => env::temp_dir().join(format!("{}-{}.out", TAG, process::id())),
+        "null" => PathBuf::from("/dev/null"),
+        _ => anyhow::bail!("invalid sink {}", sink),
+    };
+
+    let run: Result<Run> = Guest::new(microvm, kernel)
+        .arg("-initrd")
+        .arg(&params.to_string_lossy())
+        .arg("-stderr")
+        .arg(&path.to_string_lossy())
+        .arg("-stats")
+        .run();
+
+    // Check that every byte made it to the sink.
+    let written: Option<u64> = match sink {
+        "file" => {
+            let written: Result<u64> = fs::metadata(&path).map(|m| m.len()).map_err(Into::into);
+            let _ = fs::remove_file(&path);
+            Some(written?)
+        },
+        _ => None,
+    };
+
+    let run: Run = run?;
+    if let Some(written) = written {
+        if written != bytes as u64 {
+            anyhow::bail!("short console output (expected={}, written={})", bytes, written);
+        }
+    }
+
+    let stats: &Report = match run.reports(STATS_TAG).next() {
+        Some(stats) => stats,
+        None => anyhow::bail!("missing execution statistics"),
+    };
+    let ns: f64 = stats.get_u64("run_ns")? as f64;
+    let exits: f64 = stats.get_u64("pmio_exits")? as f64;
+
+    println!(
+        "{:<6} {:>10.2} {:>10.2} {:>12.3}",
+        sink,
+        bytes as f64 / ns * 1e3,
+        ns / bytes as f64,
+        exits / bytes as f64
+    );
+
+    Ok(())
+}
@@ -0,0 +1,361 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Density Benchmark
+//!
+//! Launches an increasing number of concurrent MicroVMs running the `density-bench` guest and
+//! records, at each step, the launch latency of the new VMs and the per-VM resident set size,
+//! host thread count and CPU usage while idle. The ramp stops at the knee, that is, at the first
+//! step in which the median launch latency exceeds the baseline by a given factor.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Options,
+    guest::{
+        Guest,
+        Report,
+    },
+};
+use ::anyhow::Result;
+use ::std::{
+    fs,
+    io::{
+        self,
+        BufRead,
+        BufReader,
+    },
+    process::{
+        Child,
+        ChildStderr,
+    },
+    sync::mpsc::{
+        self,
+        Sender,
+    },
+    thread,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Name of the benchmark.
+pub const NAME: &str = "density";
+
+/// Description of the benchmark.
+pub const DESCRIPTION: &str = "per-VM cost and launch latency of concurrent VMs";
+
+/// Default path to the guest kernel.
+const DEFAULT_KERNEL: &str = "bin/density-bench.elf";
+
+/// Default maximum number of concurrent VMs.
+const DEFAULT_MAX_VMS: usize = 256;
+
+/// Default memory size of each VM.
+const DEFAULT_MEMORY: &str = "16M";
+
+/// Default time over which idle CPU usage is measured (in milliseconds).
+const DEFAULT_SETTLE_MS: u64 = 1000;
+
+/// Default latency degradation factor that marks the knee.
+const DEFAULT_KNEE_FACTOR: f64 = 2.0;
+
+/// Maximum time that a VM may take to boot.
+const READY_TIMEOUT: Duration = Duration::from_secs(30);
+
+/// Tag of the reports that are written by the guest.
+const TAG: &str = "density-bench";
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// A running MicroVM.
+///
+struct Instance {
+    /// MicroVM process.
+    child: Child,
+    /// Time at which the process was spawned.
+    spawned: Instant,
+    /// Time from spawn until the guest reported that it booted.
+    latency: Option<Duration>,
+}
+
+///
+/// # Description
+///
+/// Resource usage of a set of MicroVMs, averaged per VM.
+///
+struct Usage {
+    /// Resident set size in KB.
+    rss_kb: f64,
+    /// Number of host threads.
+    threads: f64,
+    /// Fraction of a host CPU that is used.
+    cpu: f64,
+}
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the benchmark.
+///
+/// # Parameters
+///
+/// - `options`: Benchmark options (`-microvm <path>`, `-kernel <path>`, `-max <vms>`,
+///   `-memory <size>`, `-settle <ms>`, `-knee <factor>`, `-vmargs <args>`).
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+///
+pub fn run(options: &Options) -> Result<()> {
+    let microvm: String = options.get_or("microvm", crate::DEFAULT_MICROVM);
+    let kernel: String = options.get_or("kernel", DEFAULT_KERNEL);
+    let max_vms: usize = options.parse_or("max", DEFAULT_MAX_VMS)?;
+    let memory: String = options.get_or("memory", DEFAULT_MEMORY);
+    let settle: Duration = Duration::from_millis(options.parse_or("settle", DEFAULT_SETTLE_MS)?);
+    let knee_factor: f64 = options.parse_or("knee", DEFAULT_KNEE_FACTOR)?;
+    let vmargs: String = options.get_or("vmargs", "");
+
+    let guest: Guest = Guest::new(&microvm, &kernel)
+        .arg("-memory")
+        .arg(&memory)
+        .args(&vmargs);
+
+    let mut instances: Vec<Instance> = Vec::new();
+    let ret: Result<Option<usize>> = ramp(&guest, max_vms, settle, knee_factor, &mut instances);
+
+    // Tear down all VMs, regardless of the outcome.
+    for instance in instances.iter_mut() {
+        let _ = instance.child.kill();
+        let _ = instance.child.wait();
+    }
+
+    match ret? {
+        Some(knee) => println!("knee: {} vms", knee),
+        None => println!("knee: not reached (max {} vms)", max_vms),
+    }
+
+    Ok(())
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Doubles the number of running VMs until either the maximum or the knee is reached.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the number of VMs at the knee, if it was
+/// reached. Otherwise, it returns an error.
+///
+fn ramp(
+    guest: &Guest,
+    max_vms: usize,
+    settle: Duration,
+    knee_factor: f64,
+    instances: &mut Vec<Instance>,
+) -> Result<Option<usize>> {
+    let mut baseline: Option<Duration> = None;
+
+    println!(
+        "{:>6} {:>14} {:>14} {:>10} {:>12} {:>10}",
+        "vms", "launch p50 ms", "launch max ms", "rss MB/vm", "threads/vm", "cpu %/vm"
+    );
+
+    let mut target: usize = 1;
+    while instances.len() < max_vms {
+        let first: usize = instances.len();
+        launch(guest, target.min(max_vms) - first, instances)?;
+
+        let mut latencies: Vec<Duration> = instances[first..]
+            .iter()
+            .filter_map(|i| i.latency)
+            .collect();
+        latencies.sort();
+        let p50: Duration = latencies[latencies.len() / 2];
+        let max: Duration = latencies[latencies.len() - 1];
+
+        let usage: Usage = measure(instances, settle)?;
+
+        println!(
+            "{:>6} {:>14.2} {:>14.2} {:>10.2} {:>12.1} {:>10.2}",
+            instances.len(),
+            p50.as_secs_f64() * 1e3,
+            max.as_secs_f64() * 1e3,
+            usage.rss_kb / 1024.0,
+            usage.threads,
+            usage.cpu * 100.0
+        );
+
+        match baseline {
+            None => baseline = Some(p50),
+            Some(base) if p50.as_secs_f64() > base.as_secs_f64() * knee_factor => {
+                return Ok(Some(instances.len()));
+            },
+            Some(_) => {},
+        }
+
+        target *= 2;
+    }
+
+    Ok(None)
+}
+
+///
+/// # Description
+///
+/// Launches VMs concurrently and waits for all of them to boot.
+///
+fn launch(guest: &Guest, count: usize, instances: &mut Vec<Instance>) -> Result<()> {
+    let (tx, rx) = mpsc::channel::<(usize, Instant)>();
+
+    let first: usize = instances.len();
+    for index in first..first + count {
+        let spawned: Instant = Instant::now();
+        let mut child: Child = guest.spawn()?;
+        let stderr: Option<ChildStderr> = child.stderr.take();
+        instances.push(Instance {
+            child,
+            spawned,
+            latency: None,
+        });
+
+        match stderr {
+            Some(stderr) => {
+                let tx: Sender<(usize, Instant)> = tx.clone();
+                thread::spawn(move || watch(index, stderr, tx));
+            },
+            None => anyhow::bail!("failed to capture microvm output"),
+        }
+    }
+
+    for _ in 0..count {
+        let (index, ready): (usize, Instant) = match rx.recv_timeout(READY_TIMEOUT) {
+            Ok(event) => event,
+            Err(e) => anyhow::bail!("vm did not boot (error={:?})", e),
+        };
+        let instance: &mut Instance = &mut instances[index];
+        instance.latency = Some(ready - instance.spawned);
+    }
+
+    Ok(())
+}
+
+///
+/// # Description
+///
+/// Watches the output of a VM and signals when the guest reports that it booted.
+///
+fn watch(index: usize, stderr: ChildStderr, tx: Sender<(usize, Instant)>) {
+    let mut reader: BufReader<ChildStderr> = BufReader::new(stderr);
+    let mut line: String = String::new();
+    while let Ok(n) = reader.read_line(&mut line) {
+        if n == 0 {
+            return;
+        }
+        if let Some(report) = Report::parse(&line) {
+            if report.tag() == TAG {
+                let _ = tx.send((index, Instant::now()));
+                break;
+            }
+        }
+        line.clear();
+    }
+
+    // Keep draining, so that the VM never blocks on a full pipe.
+    let _ = io::copy(&mut reader, &mut io::sink());
+}
+
+///
+/// # Description
+///
+/// Measures the resource usage of running VMs.
+///
+fn measure(instances: &[Instance], settle: Duration) -> Result<Usage> {
+    let ticks_per_sec: f64 = unsafe { ::libc::sysconf(::libc::_SC_CLK_TCK) } as f64;
+    let n: f64 = instances.len() as f64;
+
+    let before: Vec<u64> = instances
+        .iter()
+        .map(|i| cpu_ticks(i.child.id()))
+        .collect::<Result<_>>()?;
+    thread::sleep(settle);
+    let after: Vec<u64> = instances
+        .iter()
+        .map(|i| cpu_ticks(i.child.id()))
+        .collect::<Result<_>>()?;
+
+    let ticks: u64 = after.iter().zip(before.iter()).map(|(a, b)| a - b).sum();
+
+    let mut rss_kb: u64 = 0;
+    let mut threads: u64 = 0;
+    for instance in instances {
+        rss_kb += status_field(instance.child.id(), "VmRSS:")?;
+        threads += status_field(instance.child.id(), "Threads:")?;
+    }
+
+    Ok(Usage {
+        rss_kb: rss_kb as f64 / n,
+        threads: threads as f64 / n,
+        cpu: ticks as f64 / ticks_per_sec / settle.as_secs_f64() / n,
+    })
+}
+
+///
+/// # Description
+///
+/// Reads the CPU time (user and system) consumed by a process, in clock ticks.
+///
+fn cpu_ticks(pid: u32) -> Result<u64> {
+    let stat: String = fs::read_to_string(format!("/proc/{}/stat", pid))?;
+
+    // The command name may contain spaces, so fields are counted from its closing parenthesis,
+    // which is followed by field 3 (state). Fields 14 and 15 are utime and stime.
+    let fields: Vec<&str> = match stat.rfind(')') {
+        Some(end) => stat[end + 1..].split_whitespace().collect(),
+        None => anyhow::bail!("malformed stat (pid={})", pid),
+    };
+    match (fields.get(11), fields.get(12)) {
+        (Some(utime), Some(stime)) => Ok(utime.parse::<u64>()? + stime.parse::<u64>()?),
+        _ => anyhow::bail!("malformed stat (pid={})", pid),
+    }
+}
+
+///
+/// # Description
+///
+/// Reads a numeric field from the status of a process.
+///
+fn status_field(pid: u32, key: &str) -> Result<u64> {
+    let status: String = fs::read_to_string(format!("/proc/{}/status", pid))?;
+    for line in status.lines() {
+        if let Some(value) = line.strip_prefix(key) {
+            if let Some(number) = value.split_whitespace().next() {
+                return Ok(number.parse::<u64>()?);
+            }
+        }
+    }
+    anyhow::bail!("missing field in status (pid={}, key={})", pid, key)
+}
@@ -0,0 +1,87 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # VM Exit Benchmark
+//!
+//! Runs the `exit-bench` guest, which issues a tight loop of I/O port accesses for each port that
+//! the virtual machine monitor handles, and of accesses to its benchmark memory-mapped registers,
+//! and prints the round-trip cost of each kind of exit.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Options,
+    guest::{
+        Guest,
+        Run,
+    },
+    tsc,
+};
+use ::anyhow::Result;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Name of the benchmark.
+pub const NAME: &str = "exits";
+
+/// Description of the benchmark.
+pub const DESCRIPTION: &str = "round-trip cost of guest-to-host transitions";
+
+/// Default path to the guest kernel.
+const DEFAULT_KERNEL: &str = "bin/exit-bench.elf";
+
+/// Tag of the reports that are written by the guest.
+const TAG: &str = "exit-bench";
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the benchmark.
+///
+/// # Parameters
+///
+/// - `options`: Benchmark options (`-microvm <path>`, `-kernel <path>`).
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+///
+pub fn run(options: &Options) -> Result<()> {
+    let microvm: String = options.get_or("microvm", crate::DEFAULT_MICROVM);
+    let kernel: String = options.get_or("kernel", DEFAULT_KERNEL);
+
+    let frequency: u64 = tsc::frequency();
+    let run: Run = Guest::new(&microvm, &kernel).run()?;
+
+    println!("tsc frequency: {:.3} GHz", frequency as f64 / 1e9);
+    println!(
+        "{:<24} {:>10} {:>12} {:>10} {:>12}",
+        "exit", "count", "cycles/exit", "ns/exit", "exits/sec"
+    );
+    for report in run.reports(TAG) {
+        let name: &str = report.get("name")?;
+        let exits: u64 = report.get_u64("exits")?;
+        let cycles: u64 = report.get_u64("cycles")?;
+
+        let cycles_per_exit: f64 = cycles as f64 / exits as f64;
+        let ns_per_exit: f64 = tsc::cycles_to_ns(cycles_per_exit, frequency);
+        let exits_per_sec: f64 = 1e9 / ns_per_exit;
+
+        println!(
+            "{:<24} {:>10} {:>12.1} {:>10.1} {:>12.0}",
+            name, exits, cycles_per_exit, ns_per_exit, exits_per_sec
+        );
+    }
+
+    Ok(())
+}
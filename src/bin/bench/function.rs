@@ -0,0 +1,177 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Function Invocation Benchmark
+//!
+//! Runs the `function-bench` guest in function invocation mode (`-function`) and measures, for
+//! each memory size and payload length, the time spent running an invocation and the time spent
+//! rewinding the virtual machine afterwards. The guest touches one scratch page per byte of
+//! payload, thus the rewind time should grow with the payload length but not with the memory
+//! size.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Options,
+    guest::{
+        Guest,
+        Report,
+    },
+};
+use ::anyhow::Result;
+use ::std::{
+    io::{
+        BufRead,
+        BufReader,
+        Write,
+    },
+    process::{
+        Child,
+        ChildStdin,
+        ChildStdout,
+    },
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Name of the benchmark.
+pub const NAME: &str = "function";
+
+/// Description of the benchmark.
+pub const DESCRIPTION: &str = "invocation latency and rewind cost of warm VMs";
+
+/// Default path to the guest kernel.
+const DEFAULT_KERNEL: &str = "bin/function-bench.elf";
+
+/// Default memory sizes.
+const DEFAULT_MEMORY: &str = "128M,1G";
+
+/// Default payload lengths.
+const DEFAULT_PAYLOADS: &str = "1,8,64";
+
+/// Default number of invocations per payload length.
+const DEFAULT_INVOCATIONS: usize = 1000;
+
+/// Tag of the reports that are written by the MicroVM after each invocation.
+const TAG: &str = "microvm-invoke";
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the benchmark.
+///
+/// # Parameters
+///
+/// - `options`: Benchmark options (`-microvm <path>`, `-kernel <path>`, `-memory <list>`,
+///   `-payloads <list>`, `-invocations <n>`).
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+///
+pub fn run(options: &Options) -> Result<()> {
+    let microvm: String = options.get_or("microvm", crate::DEFAULT_MICROVM);
+    let kernel: String = options.get_or("kernel", DEFAULT_KERNEL);
+    let memory: String = options.get_or("memory", DEFAULT_MEMORY);
+    let payloads: String = options.get_or("payloads", DEFAULT_PAYLOADS);
+    let invocations: usize = options.parse_or("invocations", DEFAULT_INVOCATIONS)?;
+
+    if invocations == 0 {
+        anyhow::bail!("invalid number of invocations");
+    }
+
+    println!(
+        "{:>8} {:>8} {:>8} {:>12} {:>14}",
+        "memory", "payload", "pages", "run p50 us", "rewind p50 us"
+    );
+
+    for memory in memory.split(',').map(|memory| memory.trim()) {
+        let guest: Guest = Guest::new(&microvm, &kernel)
+            .arg("-memory")
+            .arg(memory)
+            .arg("-function")
+            .arg("-stats");
+
+        let mut child: Child = guest.spawn_interactive()?;
+        let result: Result<()> = run_memory(&mut child, memory, &payloads, invocations);
+        let _ = child.kill();
+        let _ = child.wait();
+        result?;
+    }
+
+    Ok(())
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Measures invocations of every payload length on a single MicroVM.
+///
+fn run_memory(child: &mut Child, memory: &str, payloads: &str, invocations: usize) -> Result<()> {
+    let (mut stdin, stdout): (ChildStdin, ChildStdout) =
+        match (child.stdin.take(), child.stdout.take()) {
+            (Some(stdin), Some(stdout)) => (stdin, stdout),
+            _ => anyhow::bail!("failed to capture microvm input and output"),
+        };
+    let mut lines = BufReader::new(stdout).lines();
+
+    for payload in payloads.split(',').map(|payload| payload.trim()) {
+        let len: usize = match payload.parse::<usize>() {
+            Ok(len) if len > 0 => len,
+            _ => anyhow::bail!("invalid payload length '{}'", payload),
+        };
+        let payload: String = "a".repeat(len);
+
+        let mut run_ns: Vec<u64> = Vec::with_capacity(invocations);
+        let mut rewind_ns: Vec<u64> = Vec::with_capacity(invocations);
+        let mut pages: u64 = 0;
+
+        for _ in 0..invocations {
+            writeln!(stdin, "{}", payload)?;
+            stdin.flush()?;
+
+            // The output of the function is followed by the statistics of the invocation.
+            let report: Report = loop {
+                match lines.next() {
+                    Some(line) => {
+                        if let Some(report) = Report::parse(&line?).filter(|r| r.tag() == TAG) {
+                            break report;
+                        }
+                    },
+                    None => anyhow::bail!("microvm exited unexpectedly"),
+                }
+            };
+
+            run_ns.push(report.get_u64("run_ns")?);
+            rewind_ns.push(report.get_u64("rewind_ns")?);
+            pages = report.get_u64("pages")?;
+        }
+
+        run_ns.sort();
+        rewind_ns.sort();
+        println!(
+            "{:>8} {:>8} {:>8} {:>12.2} {:>14.2}",
+            memory,
+            len,
+            pages,
+            run_ns[run_ns.len() / 2] as f64 / 1e3,
+            rewind_ns[rewind_ns.len() / 2] as f64 / 1e3
+        );
+    }
+
+    Ok(())
+}
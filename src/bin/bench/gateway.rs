@@ -0,0 +1,305 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Gateway Benchmark
+//!
+//! Runs the `gateway-bench` guest against the stand-in gateway and prints message throughput and
+//! round-trip latency percentiles. The following scenarios are measured:
+//!
+//! - `roundtrip`: the guest keeps a number of messages in flight and the gateway echoes them.
+//! - `send`: the guest sends messages and the gateway discards them.
+//! - `recv`: the gateway sends messages and the guest receives them.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Options,
+    guest::{
+        self,
+        Guest,
+        Report,
+        Run,
+    },
+    tsc,
+};
+use ::anyhow::Result;
+use ::std::{
+    fs,
+    io::{
+        BufRead,
+        BufReader,
+    },
+    mem,
+    path::PathBuf,
+    process::{
+        self,
+        Child,
+        ChildStdout,
+        Command,
+        Stdio,
+    },
+};
+use ::sys::ipc::Message;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Name of the benchmark.
+pub const NAME: &str = "gateway";
+
+/// Description of the benchmark.
+pub const DESCRIPTION: &str = "message throughput and latency through a stand-in gateway";
+
+/// Default path to the guest kernel.
+const DEFAULT_KERNEL: &str = "bin/gateway-bench.elf";
+
+/// Default path to the stand-in gateway.
+const DEFAULT_GATEWAY: &str = "bin/gateway.elf";
+
+/// Default number of messages exchanged in each scenario.
+const DEFAULT_COUNT: u32 = 100_000;
+
+/// Default queue depths for the round-trip scenario.
+const DEFAULT_DEPTHS: &str = "1,4,16,64";
+
+/// Tag of the reports that are written by the guest.
+const TAG: &str = "gateway-bench";
+
+/// Magic value that identifies benchmark parameters.
+const PARAMS_MAGIC: u32 = 0x67776270;
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Benchmark scenarios. Values must match the modes of the guest.
+///
+#[derive(Clone, Copy)]
+enum Scenario {
+    /// Guest sends messages and waits for them to be echoed back.
+    Roundtrip = 0,
+    /// Guest sends messages only.
+    Send = 1,
+    /// Guest receives messages only.
+    Recv = 2,
+}
+
+///
+/// # Description
+///
+/// A stand-in gateway process.
+///
+struct StandIn {
+    /// Gateway process.
+    child: Child,
+    /// Address the gateway listens on.
+    addr: String,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Scenario {
+    fn name(&self) -> &'static str {
+        match self {
+            Scenario::Roundtrip => "roundtrip",
+            Scenario::Send => "send",
+            Scenario::Recv => "recv",
+        }
+    }
+
+    /// Operating mode of the stand-in gateway for this scenario.
+    fn gateway_mode(&self) -> &'static str {
+        match self {
+            Scenario::Roundtrip => "echo",
+            Scenario::Send => "sink",
+            Scenario::Recv => "source",
+        }
+    }
+}
+
+impl StandIn {
+    ///
+    /// # Description
+    ///
+    /// Spawns a stand-in gateway and waits for it to listen.
+    ///
+    fn spawn(gateway: &str, mode: &str, count: u32) -> Result<Self> {
+        let mut child: Child = Command::new(gateway)
+            .args(["-mode", mode, "-count", &count.to_string()])
+            .stdout(Stdio::piped())
+            .spawn()?;
+
+        // The first line announces the address that the gateway listens on.
+        let stdout: &mut ChildStdout = match child.stdout.as_mut() {
+            Some(stdout) => stdout,
+            None => anyhow::bail!("failed to capture gateway output"),
+        };
+        let mut line: String = String::new();
+        BufReader::new(stdout).read_line(&mut line)?;
+        let addr: String = match line.trim().strip_prefix("listening on ") {
+            Some(addr) => addr.to_string(),
+            None => {
+                let _ = child.kill();
+                anyhow::bail!("unexpected gateway output ({})", line.trim());
+            },
+        };
+
+        Ok(Self { child, addr })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Waits for the gateway to exit.
+    ///
+    fn wait(mut self) -> Result<()> {
+        let status: process::ExitStatus = self.child.wait()?;
+        if !status.success() {
+            anyhow::bail!("gateway failed (status={})", status);
+        }
+        Ok(())
+    }
+}
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the benchmark.
+///
+/// # Parameters
+///
+/// - `options`: Benchmark options (`-microvm <path>`, `-kernel <path>`, `-gateway <path>`,
+///   `-count <messages>`, `-depths <depth,...>`).
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+///
+pub fn run(options: &Options) -> Result<()> {
+    let microvm: String = options.get_or("microvm", crate::DEFAULT_MICROVM);
+    let kernel: String = options.get_or("kernel", DEFAULT_KERNEL);
+    let gateway: String = options.get_or("gateway", DEFAULT_GATEWAY);
+    let count: u32 = options.parse_or("count", DEFAULT_COUNT)?;
+    let depths: Vec<u32> = options
+        .get_or("depths", DEFAULT_DEPTHS)
+        .split(',')
+        .map(|depth| depth.trim().parse::<u32>())
+        .collect::<Result<_, _>>()?;
+
+    let frequency: u64 = tsc::frequency();
+
+    let mut scenarios: Vec<(Scenario, u32)> = depths
+        .iter()
+        .map(|depth| (Scenario::Roundtrip, *depth))
+        .collect();
+    scenarios.push((Scenario::Send, 1));
+    scenarios.push((Scenario::Recv, 1));
+
+    println!("message size: {} bytes", mem::size_of::<Message>());
+    println!(
+        "{:<10} {:>6} {:>12} {:>10} {:>9} {:>9} {:>9} {:>9} {:>9} {:>7}",
+        "scenario",
+        "depth",
+        "msgs/sec",
+        "MB/sec",
+        "p50 us",
+        "p90 us",
+        "p99 us",
+        "p99.9 us",
+        "max us",
+        "errors"
+    );
+
+    for (scenario, depth) in scenarios {
+        let run: Run = run_scenario(&microvm, &kernel, &gateway, scenario, depth, count)?;
+        let report: &Report = match run.reports(TAG).next() {
+            Some(report) => report,
+            None => anyhow::bail!("guest did not report (scenario={})", scenario.name()),
+        };
+
+        let messages: u64 = report.get_u64("messages")?;
+        let seconds: f64 = tsc::cycles_to_ns(report.get_u64("cycles")? as f64, frequency) / 1e9;
+        let msgs_per_sec: f64 = messages as f64 / seconds;
+        let mb_per_sec: f64 = msgs_per_sec * mem::size_of::<Message>() as f64 / 1e6;
+
+        let latency = |key: &str| -> Result<String> {
+            match scenario {
+                Scenario::Roundtrip => {
+                    let cycles: u64 = report.get_u64(key)?;
+                    Ok(format!("{:.1}", tsc::cycles_to_ns(cycles as f64, frequency) / 1e3))
+                },
+                _ => Ok("-".to_string()),
+            }
+        };
+
+        println!(
+            "{:<10} {:>6} {:>12.0} {:>10.2} {:>9} {:>9} {:>9} {:>9} {:>9} {:>7}",
+            scenario.name(),
+            depth,
+            msgs_per_sec,
+            mb_per_sec,
+            latency("p50")?,
+            latency("p90")?,
+            latency("p99")?,
+            latency("p999")?,
+            latency("max")?,
+            report.get_u64("errors")?
+        );
+    }
+
+    Ok(())
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs a single scenario.
+///
+fn run_scenario(
+    microvm: &str,
+    kernel: &str,
+    gateway: &str,
+    scenario: Scenario,
+    depth: u32,
+    count: u32,
+) -> Result<Run> {
+    let fields: [u32; 5] = [
+        PARAMS_MAGIC,
+        scenario as u32,
+        mem::size_of::<Message>() as u32,
+        depth,
+        count,
+    ];
+    let params: PathBuf = guest::write_params(TAG, &fields)?;
+    let standin: StandIn = StandIn::spawn(gateway, scenario.gateway_mode(), count)?;
+
+    let run: Result<Run> = Guest::new(microvm, kernel)
+        .arg("-gateway")
+        .arg(&standin.addr)
+        .arg("-initrd")
+        .arg(&params.to_string_lossy())
+        .run();
+
+    let _ = fs::remove_file(&params);
+    standin.wait()?;
+
+    run
+}
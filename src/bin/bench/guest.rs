@@ -0,0 +1,318 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Guest Runner
+//!
+//! This module runs a benchmark guest to completion in a MicroVM and collects the reports that
+//! the guest writes to its standard output device. A report is a single line of the form:
+//!
+//! ```text
+//! <tag>: key=value key=value ...
+//! ```
+//!
+//! Numeric values may be written either in decimal or in hexadecimal with a `0x` prefix.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::anyhow::Result;
+use ::std::{
+    collections::HashMap,
+    env,
+    fs,
+    path::PathBuf,
+    process::{
+        self,
+        Child,
+        Command,
+        Output,
+        Stdio,
+    },
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of a parameters file (one page).
+const PARAMS_SIZE: usize = 4096;
+
+//==================================================================================================
+// Public Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// A benchmark guest.
+///
+pub struct Guest {
+    /// Path to the MicroVM binary.
+    microvm: String,
+    /// Path to the guest kernel.
+    kernel: String,
+    /// Additional command-line arguments for the MicroVM.
+    args: Vec<String>,
+}
+
+///
+/// # Description
+///
+/// Outcome of running a benchmark guest.
+///
+pub struct Run {
+    /// Reports that were written by the guest.
+    reports: Vec<Report>,
+}
+
+///
+/// # Description
+///
+/// A report that was written by a benchmark guest.
+///
+pub struct Report {
+    /// Tag of the report.
+    tag: String,
+    /// Fields of the report.
+    fields: HashMap<String, String>,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Guest {
+    ///
+    /// # Description
+    ///
+    /// Creates a benchmark guest.
+    ///
+    /// # Parameters
+    ///
+    /// - `microvm`: Path to the MicroVM binary.
+    /// - `kernel`: Path to the guest kernel.
+    ///
+    pub fn new(microvm: &str, kernel: &str) -> Self {
+        Self {
+            microvm: microvm.to_string(),
+            kernel: kernel.to_string(),
+            args: Vec::new(),
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Appends a command-line argument for the MicroVM.
+    ///
+    pub fn arg(mut self, arg: &str) -> Self {
+        self.args.push(arg.to_string());
+        self
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Appends whitespace-separated command-line arguments for the MicroVM.
+    ///
+    pub fn args(mut self, args: &str) -> Self {
+        self.args
+            .extend(args.split_whitespace().map(|arg| arg.to_string()));
+        self
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Runs the guest to completion. Reports are collected from both the standard output of the
+    /// MicroVM, where it writes its own statistics, and the standard error of the MicroVM, where
+    /// the standard output device of the guest is connected to by default.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the outcome of the run. Otherwise, it
+    /// returns an error.
+    ///
+    pub fn run(&self) -> Result<Run> {
+        let output: Output = self.command().output()?;
+
+        if !output.status.success() {
+            anyhow::bail!("microvm failed (status={})", output.status);
+        }
+
+        let reports: Vec<Report> = [&output.stdout, &output.stderr]
+            .iter()
+            .flat_map(|stream| {
+                String::from_utf8_lossy(stream)
+                    .lines()
+                    .filter_map(Report::parse)
+                    .collect::<Vec<Report>>()
+            })
+            .collect();
+
+        Ok(Run { reports })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Starts the guest without waiting for it to complete. The standard error of the MicroVM is
+    /// piped, so that reports can be parsed with [`Report::parse`].
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the MicroVM process. Otherwise, it returns
+    /// an error.
+    ///
+    pub fn spawn(&self) -> Result<Child> {
+        Ok(self.command().stdout(Stdio::null()).spawn()?)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Starts the guest with the standard input and the standard output of the MicroVM piped, so
+    /// that the caller can interact with it.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the MicroVM process. Otherwise, it returns
+    /// an error.
+    ///
+    pub fn spawn_interactive(&self) -> Result<Child> {
+        Ok(self
+            .command()
+            .stdin(Stdio::piped())
+            .stderr(Stdio::null())
+            .spawn()?)
+    }
+
+    /// Builds the command that runs the MicroVM.
+    fn command(&self) -> Command {
+        let mut command: Command = Command::new(&self.microvm);
+        command
+            .arg("-kernel")
+            .arg(&self.kernel)
+            .args(&self.args)
+            .stdin(Stdio::null())
+            .stdout(Stdio::piped())
+            .stderr(Stdio::piped());
+        command
+    }
+}
+
+impl Run {
+    ///
+    /// # Description
+    ///
+    /// Returns the reports that carry a given tag.
+    ///
+    pub fn reports<'a>(&'a self, tag: &'a str) -> impl Iterator<Item = &'a Report> {
+        self.reports.iter().filter(move |report| report.tag == tag)
+    }
+}
+
+impl Report {
+    ///
+    /// # Description
+    ///
+    /// Parses a line of guest output.
+    ///
+    /// # Returns
+    ///
+    /// If the line is a report, this method returns it. Otherwise, it returns `None`.
+    ///
+    pub fn parse(line: &str) -> Option<Self> {
+        // Guests may emit control characters while benchmarking the console.
+        let line: &str = line.trim_start_matches(|c: char| c.is_control());
+        let (tag, fields) = line.split_once(": ")?;
+        if tag.is_empty() || tag.contains(char::is_whitespace) {
+            return None;
+        }
+
+        let fields: HashMap<String, String> = fields
+            .split_whitespace()
+            .filter_map(|field| field.split_once('='))
+            .map(|(key, value)| (key.to_string(), value.to_string()))
+            .collect();
+
+        Some(Self {
+            tag: tag.to_string(),
+            fields,
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the tag of the report.
+    ///
+    pub fn tag(&self) -> &str {
+        &self.tag
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the value of a field.
+    ///
+    pub fn get(&self, key: &str) -> Result<&str> {
+        match self.fields.get(key) {
+            Some(value) => Ok(value.as_str()),
+            None => anyhow::bail!("missing field in report (tag={}, key={})", self.tag, key),
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the value of a numeric field.
+    ///
+    pub fn get_u64(&self, key: &str) -> Result<u64> {
+        let value: &str = self.get(key)?;
+        let number: Result<u64, _> = match value.strip_prefix("0x") {
+            Some(hex) => u64::from_str_radix(hex, 16),
+            None => value.parse::<u64>(),
+        };
+        match number {
+            Ok(number) => Ok(number),
+            Err(e) => anyhow::bail!("invalid number in report (key={}, error={})", key, e),
+        }
+    }
+}
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Writes benchmark parameters to a file that is passed to a guest as initial RAM disk. Fields are
+/// written in little-endian order and the file is padded to one page.
+///
+/// # Parameters
+///
+/// - `name`: Name of the benchmark, used to name the file.
+/// - `fields`: Parameters. By convention, the first one is a magic value.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the path to the file. Otherwise, it returns
+/// an error.
+///
+pub fn write_params(name: &str, fields: &[u32]) -> Result<PathBuf> {
+    let mut bytes: Vec<u8> = fields
+        .iter()
+        .flat_map(|field| field.to_le_bytes())
+        .collect();
+    bytes.resize(PARAMS_SIZE, 0);
+
+    let path: PathBuf = env::temp_dir().join(format!("{}-{}.params", name, process::id()));
+    fs::write(&path, bytes)?;
+
+    Ok(path)
+}
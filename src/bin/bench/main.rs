@@ -0,0 +1,94 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Benchmark Runner
+//!
+//! This program runs the benchmark guests that live in `test/` and converts the raw numbers that
+//! they report into human-readable metrics.
+//!
+
+//==================================================================================================
+// Configuration
+//==================================================================================================
+
+#![deny(clippy::all)]
+
+//==================================================================================================
+// Modules
+//==================================================================================================
+
+mod args;
+mod console;
+mod density;
+mod exits;
+mod function;
+mod gateway;
+mod guest;
+mod memory;
+mod tlb;
+mod tsc;
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::args::Options;
+use ::anyhow::Result;
+use ::std::env;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Default path to the MicroVM binary.
+const DEFAULT_MICROVM: &str = "bin/microvm.elf";
+
+//==================================================================================================
+// Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Prints program usage.
+///
+fn usage() {
+    eprintln!("Usage: {} <benchmark> [-<option> <value> ...]", env!("CARGO_BIN_NAME"));
+    eprintln!("Benchmarks:");
+    eprintln!("  {:<10} {}", console::NAME, console::DESCRIPTION);
+    eprintln!("  {:<10} {}", density::NAME, density::DESCRIPTION);
+    eprintln!("  {:<10} {}", exits::NAME, exits::DESCRIPTION);
+    eprintln!("  {:<10} {}", function::NAME, function::DESCRIPTION);
+    eprintln!("  {:<10} {}", gateway::NAME, gateway::DESCRIPTION);
+    eprintln!("  {:<10} {}", memory::NAME, memory::DESCRIPTION);
+    eprintln!("  {:<10} {}", tlb::NAME, tlb::DESCRIPTION);
+}
+
+fn main() -> Result<()> {
+    let args: Vec<String> = env::args().collect();
+
+    let benchmark: &str = match args.get(1) {
+        Some(benchmark) => benchmark.as_str(),
+        None => {
+            usage();
+            anyhow::bail!("benchmark is missing");
+        },
+    };
+
+    let options: Options = Options::parse(&args[2..])?;
+
+    match benchmark {
+        console::NAME => console::run(&options),
+        density::NAME => density::run(&options),
+        exits::NAME => exits::run(&options),
+        function::NAME => function::run(&options),
+        gateway::NAME => gateway::run(&options),
+        memory::NAME => memory::run(&options),
+        tlb::NAME => tlb::run(&options),
+        _ => {
+            usage();
+            anyhow::bail!("invalid benchmark {}", benchmark);
+        },
+    }
+}
@@ -0,0 +1,91 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Memory Benchmark
+//!
+//! Runs the `mem-bench` guest and prints streaming bandwidth and random-access latency across
+//! working-set sizes. Extra MicroVM arguments may be passed with `-vmargs`, so that
+//! memory-backing options can be compared. The guest sizes its working sets from usable guest
+//! memory, up to 64 MB.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Options,
+    guest::{
+        Guest,
+        Run,
+    },
+    tsc,
+};
+use ::anyhow::Result;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Name of the benchmark.
+pub const NAME: &str = "memory";
+
+/// Description of the benchmark.
+pub const DESCRIPTION: &str = "guest memory bandwidth and latency";
+
+/// Default path to the guest kernel.
+const DEFAULT_KERNEL: &str = "bin/mem-bench.elf";
+
+/// Tag of the reports that are written by the guest.
+const TAG: &str = "mem-bench";
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the benchmark.
+///
+/// # Parameters
+///
+/// - `options`: Benchmark options (`-microvm <path>`, `-kernel <path>`, `-vmargs <args>`).
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+///
+pub fn run(options: &Options) -> Result<()> {
+    let microvm: String = options.get_or("microvm", crate::DEFAULT_MICROVM);
+    let kernel: String = options.get_or("kernel", DEFAULT_KERNEL);
+    let vmargs: String = options.get_or("vmargs", "");
+
+    let frequency: u64 = tsc::frequency();
+    let run: Run = Guest::new(&microvm, &kernel).args(&vmargs).run()?;
+
+    // The guest sizes its working set from guest memory, and does not report if it is too small.
+    if run.reports(TAG).next().is_none() {
+        anyhow::bail!("guest did not report (is guest memory too small?)");
+    }
+
+    println!("{:<18} {:>10} {:>12}", "test", "size KB", "result");
+    for report in run.reports(TAG) {
+        let test: &str = report.get("test")?;
+        let size: u64 = report.get_u64("size")?;
+        let accesses: u64 = report.get_u64("accesses")?;
+        let ns: f64 = tsc::cycles_to_ns(report.get_u64("cycles")? as f64, frequency);
+
+        let result: String = match test {
+            // Accesses are dependent loads.
+            "latency" => format!("{:.2} ns/load", ns / accesses as f64),
+            // Accesses are bytes.
+            _ => format!("{:.2} GB/s", accesses as f64 / ns),
+        };
+
+        println!("{:<18} {:>10} {:>12}", test, size / 1024, result);
+    }
+
+    Ok(())
+}
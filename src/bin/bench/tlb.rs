@@ -0,0 +1,102 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # TLB Benchmark
+//!
+//! Runs the `tlb-bench` guest, which touches one cache line per page with paging disabled, with
+//! 4 KB pages and with 4 MB pages, and prints the cost of a page walk. The cost is estimated as the
+//! difference between the latency of a load with paging enabled and disabled. The guest sizes its
+//! working sets from usable guest memory below 128 MB.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Options,
+    guest::{
+        Guest,
+        Run,
+    },
+    tsc,
+};
+use ::anyhow::Result;
+use ::std::collections::HashMap;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Name of the benchmark.
+pub const NAME: &str = "tlb";
+
+/// Description of the benchmark.
+pub const DESCRIPTION: &str = "guest page-walk cost";
+
+/// Default path to the guest kernel.
+const DEFAULT_KERNEL: &str = "bin/tlb-bench.elf";
+
+/// Tag of the reports that are written by the guest.
+const TAG: &str = "tlb-bench";
+
+/// Paging mode that serves as baseline.
+const BASELINE: &str = "none";
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Runs the benchmark.
+///
+/// # Parameters
+///
+/// - `options`: Benchmark options (`-microvm <path>`, `-kernel <path>`, `-vmargs <args>`).
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+///
+pub fn run(options: &Options) -> Result<()> {
+    let microvm: String = options.get_or("microvm", crate::DEFAULT_MICROVM);
+    let kernel: String = options.get_or("kernel", DEFAULT_KERNEL);
+    let vmargs: String = options.get_or("vmargs", "");
+
+    let frequency: u64 = tsc::frequency();
+    let run: Run = Guest::new(&microvm, &kernel).args(&vmargs).run()?;
+
+    // The guest sizes its working set from guest memory, and does not report if it is too small.
+    if run.reports(TAG).next().is_none() {
+        anyhow::bail!("guest did not report (is guest memory too small?)");
+    }
+
+    // Latency of a load with paging disabled, indexed by number of pages.
+    let mut baseline: HashMap<u64, f64> = HashMap::new();
+
+    println!("{:<8} {:>8} {:>10} {:>14}", "paging", "pages", "ns/load", "ns/page-walk");
+    for report in run.reports(TAG) {
+        let paging: &str = report.get("paging")?;
+        let pages: u64 = report.get_u64("pages")?;
+        let loads: u64 = report.get_u64("loads")?;
+        let ns: f64 = tsc::cycles_to_ns(report.get_u64("cycles")? as f64, frequency);
+        let ns_per_load: f64 = ns / loads as f64;
+
+        let walk: String = if paging == BASELINE {
+            baseline.insert(pages, ns_per_load);
+            "-".to_string()
+        } else {
+            match baseline.get(&pages) {
+                Some(base) => format!("{:.2}", ns_per_load - base),
+                None => "-".to_string(),
+            }
+        };
+
+        println!("{:<8} {:>8} {:>10.2} {:>14}", paging, pages, ns_per_load, walk);
+    }
+
+    Ok(())
+}
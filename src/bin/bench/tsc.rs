@@ -0,0 +1,80 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Time Stamp Counter
+//!
+//! Guests report elapsed time in TSC cycles. KVM does not scale the TSC by default, so host and
+//! guest cycles are the same and the host frequency can be used for conversions.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::std::{
+    arch::x86_64,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Period over which the time stamp counter is calibrated.
+const CALIBRATION_PERIOD: Duration = Duration::from_millis(100);
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Estimates the frequency of the time stamp counter by comparing it against the monotonic clock.
+///
+/// # Returns
+///
+/// The estimated frequency of the time stamp counter in Hz.
+///
+pub fn frequency() -> u64 {
+    let start: Instant = Instant::now();
+    let start_cycles: u64 = rdtsc();
+    while start.elapsed() < CALIBRATION_PERIOD {
+        // Spin.
+    }
+    let cycles: u64 = rdtsc() - start_cycles;
+    let elapsed: u128 = start.elapsed().as_nanos();
+
+    (cycles as u128 * 1_000_000_000 / elapsed) as u64
+}
+
+///
+/// # Description
+///
+/// Converts a number of cycles into nanoseconds.
+///
+/// # Parameters
+///
+/// - `cycles`: Number of cycles.
+/// - `frequency`: Frequency of the time stamp counter in Hz.
+///
+/// # Returns
+///
+/// The number of nanoseconds that corresponds to `cycles`.
+///
+pub fn cycles_to_ns(cycles: f64, frequency: u64) -> f64 {
+    cycles * 1e9 / frequency as f64
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+/// Reads the time stamp counter.
+fn rdtsc() -> u64 {
+    unsafe { x86_64::_rdtsc() }
+}
@@ -0,0 +1,312 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Stand-In Gateway
+//!
+//! This program is a minimal gateway that a MicroVM can connect to with `-gateway`. It enables
+//! message throughput and latency to be measured on a single machine, without an external
+//! gateway. The following modes are supported:
+//!
+//! - `echo`: sends every message that is received back to the MicroVM.
+//! - `sink`: discards every message that is received.
+//! - `source`: sends messages to the MicroVM as fast as possible.
+//!
+//! The gateway serves a single connection and prints statistics when the connection is closed.
+//!
+
+//==================================================================================================
+// Configuration
+//==================================================================================================
+
+#![deny(clippy::all)]
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::anyhow::Result;
+use ::std::{
+    env,
+    io::{
+        self,
+        ErrorKind,
+        Read,
+        Write,
+    },
+    mem,
+    net::{
+        SocketAddr,
+        TcpListener,
+        TcpStream,
+    },
+    process,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+use ::sys::ipc::Message;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of a message on the wire.
+const MESSAGE_SIZE: usize = mem::size_of::<Message>();
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Operating modes of the gateway.
+///
+#[derive(Clone, Copy)]
+enum Mode {
+    /// Send every message back.
+    Echo,
+    /// Discard every message.
+    Sink,
+    /// Send messages as fast as possible.
+    Source,
+}
+
+///
+/// # Description
+///
+/// This structure packs the command-line arguments that were passed to the program.
+///
+struct Args {
+    /// Address to listen on.
+    listen: SocketAddr,
+    /// Operating mode.
+    mode: Mode,
+    /// Number of messages to send in source mode (zero means unlimited).
+    count: u64,
+}
+
+///
+/// # Description
+///
+/// Statistics of a connection.
+///
+#[derive(Default)]
+struct Stats {
+    /// Number of messages received.
+    received: u64,
+    /// Number of messages sent.
+    sent: u64,
+    /// Duration of the connection.
+    elapsed: Duration,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Mode {
+    fn name(&self) -> &'static str {
+        match self {
+            Mode::Echo => "echo",
+            Mode::Sink => "sink",
+            Mode::Source => "source",
+        }
+    }
+}
+
+impl Args {
+    /// Command-line option for printing the help message.
+    const OPT_HELP: &'static str = "-help";
+    /// Command-line option for the listen address.
+    const OPT_LISTEN: &'static str = "-listen";
+    /// Command-line option for the operating mode.
+    const OPT_MODE: &'static str = "-mode";
+    /// Command-line option for the number of messages to send.
+    const OPT_COUNT: &'static str = "-count";
+
+    ///
+    /// # Description
+    ///
+    /// Parses the command-line arguments that were passed to the program.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the command-line arguments that were passed
+    /// to the program. Otherwise, it returns an error.
+    ///
+    fn parse(args: Vec<String>) -> Result<Self> {
+        let mut listen: SocketAddr = SocketAddr::from(([127, 0, 0, 1], 0));
+        let mut mode: Mode = Mode::Echo;
+        let mut count: u64 = 0;
+
+        let mut i: usize = 1;
+        while i < args.len() {
+            match args[i].as_str() {
+                // Print help message and exit.
+                Self::OPT_HELP => {
+                    Self::usage();
+                    process::exit(0);
+                },
+                // Set listen address.
+                Self::OPT_LISTEN if i + 1 < args.len() => {
+                    listen = args[i + 1].parse()?;
+                    i += 1;
+                },
+                // Set operating mode.
+                Self::OPT_MODE if i + 1 < args.len() => {
+                    mode = match args[i + 1].as_str() {
+                        "echo" => Mode::Echo,
+                        "sink" => Mode::Sink,
+                        "source" => Mode::Source,
+                        m => {
+                            Self::usage();
+                            anyhow::bail!("invalid mode {}", m);
+                        },
+                    };
+                    i += 1;
+                },
+                // Set number of messages to send.
+                Self::OPT_COUNT if i + 1 < args.len() => {
+                    count = args[i + 1].parse()?;
+                    i += 1;
+                },
+                // Invalid argument.
+                _ => {
+                    Self::usage();
+                    anyhow::bail!("invalid argument {}", args[i]);
+                },
+            }
+
+            i += 1;
+        }
+
+        Ok(Self {
+            listen,
+            mode,
+            count,
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Prints program usage.
+    ///
+    fn usage() {
+        eprintln!(
+            "Usage: {} [{} <socket-address>] [{} echo|sink|source] [{} <messages>]",
+            env!("CARGO_BIN_NAME"),
+            Self::OPT_LISTEN,
+            Self::OPT_MODE,
+            Self::OPT_COUNT,
+        );
+    }
+}
+
+//==================================================================================================
+// Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Checks if an I/O error means that the peer has closed the connection.
+///
+fn is_disconnect(e: &io::Error) -> bool {
+    matches!(
+        e.kind(),
+        ErrorKind::UnexpectedEof | ErrorKind::BrokenPipe | ErrorKind::ConnectionReset
+    )
+}
+
+///
+/// # Description
+///
+/// Sends every message that is received back to the peer.
+///
+fn echo(conn: &mut TcpStream, stats: &mut Stats) -> io::Result<()> {
+    let mut bytes: [u8; MESSAGE_SIZE] = [0; MESSAGE_SIZE];
+    loop {
+        conn.read_exact(&mut bytes)?;
+        stats.received += 1;
+        conn.write_all(&bytes)?;
+        stats.sent += 1;
+    }
+}
+
+///
+/// # Description
+///
+/// Discards every message that is received.
+///
+fn sink(conn: &mut TcpStream, stats: &mut Stats) -> io::Result<()> {
+    let mut bytes: [u8; MESSAGE_SIZE] = [0; MESSAGE_SIZE];
+    loop {
+        conn.read_exact(&mut bytes)?;
+        stats.received += 1;
+    }
+}
+
+///
+/// # Description
+///
+/// Sends messages to the peer as fast as possible. The last four bytes of each message carry a
+/// non-zero sequence number, so that the receiver can tell messages apart from empty ones.
+///
+fn source(conn: &mut TcpStream, count: u64, stats: &mut Stats) -> io::Result<()> {
+    let mut bytes: [u8; MESSAGE_SIZE] = Message::default().to_bytes();
+    while count == 0 || stats.sent < count {
+        let seq: u32 = (stats.sent as u32).wrapping_add(1).max(1);
+        bytes[MESSAGE_SIZE - mem::size_of::<u32>()..].copy_from_slice(&seq.to_le_bytes());
+        conn.write_all(&bytes)?;
+        stats.sent += 1;
+    }
+
+    // Wait for the peer to close the connection.
+    let mut buf: [u8; MESSAGE_SIZE] = [0; MESSAGE_SIZE];
+    while conn.read(&mut buf)? > 0 {}
+
+    Ok(())
+}
+
+fn main() -> Result<()> {
+    let args: Args = Args::parse(env::args().collect())?;
+
+    let listener: TcpListener = TcpListener::bind(args.listen)?;
+
+    // Announce the actual address, as the port may have been chosen by the system.
+    println!("listening on {}", listener.local_addr()?);
+    io::stdout().flush()?;
+
+    let (mut conn, _) = listener.accept()?;
+    conn.set_nodelay(true)?;
+
+    let mut stats: Stats = Stats::default();
+    let start: Instant = Instant::now();
+    let ret: io::Result<()> = match args.mode {
+        Mode::Echo => echo(&mut conn, &mut stats),
+        Mode::Sink => sink(&mut conn, &mut stats),
+        Mode::Source => source(&mut conn, args.count, &mut stats),
+    };
+    stats.elapsed = start.elapsed();
+
+    match ret {
+        Ok(()) => {},
+        Err(e) if is_disconnect(&e) => {},
+        Err(e) => anyhow::bail!("connection failed (error={:?})", e),
+    }
+
+    println!(
+        "gateway: mode={} received={} sent={} bytes={} elapsed_ns={}",
+        args.mode.name(),
+        stats.received,
+        stats.sent,
+        (stats.received + stats.sent) * MESSAGE_SIZE as u64,
+        stats.elapsed.as_nanos()
+    );
+
+    Ok(())
+}
@@ -0,0 +1,402 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Message Replay
+//!
+//! This program is a stand-in gateway that replays a recording of the messages that a MicroVM
+//! exchanged with its gateway (see the `-record` option of the MicroVM). Once a MicroVM connects,
+//! the recorded inbound messages are sent to it and the outbound messages that it sends back are
+//! checked against the recorded ones. Inbound messages are sent at one of the following rates:
+//!
+//! - `original`: at the time that they were recorded.
+//! - `<factor>`: at the time that they were recorded, divided by `factor`.
+//! - `max`: as fast as possible.
+//!
+//! Regardless of the rate, an inbound message is sent only after the MicroVM has sent every
+//! outbound message that preceded it in the recording, so that request-response exchanges are
+//! replayed in order. The program exits with an error if the outbound messages do not match.
+//!
+
+//==================================================================================================
+// Configuration
+//==================================================================================================
+
+#![deny(clippy::all)]
+
+//==================================================================================================
+// Modules
+//==================================================================================================
+
+#[path = "../../recording.rs"]
+mod recording;
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+#[macro_use]
+extern crate log;
+
+use crate::recording::{
+    Direction,
+    Record,
+    MESSAGE_SIZE,
+};
+use ::anyhow::Result;
+use ::std::{
+    env,
+    io::{
+        self,
+        ErrorKind,
+        Read,
+        Write,
+    },
+    net::{
+        Shutdown,
+        SocketAddr,
+        TcpListener,
+        TcpStream,
+    },
+    process,
+    sync::{
+        Arc,
+        Condvar,
+        Mutex,
+    },
+    thread::{
+        self,
+        JoinHandle,
+    },
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Rates at which inbound messages are replayed.
+///
+#[derive(Clone, Copy)]
+enum Rate {
+    /// Recorded timestamps are divided by a factor (1.0 is the original rate).
+    Scaled(f64),
+    /// Recorded timestamps are ignored.
+    Max,
+}
+
+///
+/// # Description
+///
+/// This structure packs the command-line arguments that were passed to the program.
+///
+struct Args {
+    /// Address to listen on.
+    listen: SocketAddr,
+    /// Path to the recording.
+    recording: String,
+    /// Replay rate.
+    rate: Rate,
+}
+
+///
+/// # Description
+///
+/// Progress of the outbound stream, shared between the sender and the receiver.
+///
+#[derive(Default)]
+struct Progress {
+    /// Number of outbound messages received.
+    received: usize,
+    /// Number of outbound messages that did not match the recording.
+    mismatches: usize,
+    /// Index of the first outbound message that did not match the recording.
+    first_mismatch: Option<usize>,
+    /// Has the MicroVM closed the connection?
+    closed: bool,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Args {
+    /// Command-line option for printing the help message.
+    const OPT_HELP: &'static str = "-help";
+    /// Command-line option for the listen address.
+    const OPT_LISTEN: &'static str = "-listen";
+    /// Command-line option for the recording.
+    const OPT_RECORDING: &'static str = "-recording";
+    /// Command-line option for the replay rate.
+    const OPT_RATE: &'static str = "-rate";
+
+    ///
+    /// # Description
+    ///
+    /// Parses the command-line arguments that were passed to the program.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the command-line arguments that were passed
+    /// to the program. Otherwise, it returns an error.
+    ///
+    fn parse(args: Vec<String>) -> Result<Self> {
+        let mut listen: SocketAddr = SocketAddr::from(([127, 0, 0, 1], 0));
+        let mut recording: Option<String> = None;
+        let mut rate: Rate = Rate::Scaled(1.0);
+
+        let mut i: usize = 1;
+        while i < args.len() {
+            match args[i].as_str() {
+                // Print help message and exit.
+                Self::OPT_HELP => {
+                    Self::usage();
+                    process::exit(0);
+                },
+                // Set listen address.
+                Self::OPT_LISTEN if i + 1 < args.len() => {
+                    listen = args[i + 1].parse()?;
+                    i += 1;
+                },
+                // Set recording.
+                Self::OPT_RECORDING if i + 1 < args.len() => {
+                    recording = Some(args[i + 1].clone());
+                    i += 1;
+                },
+                // Set replay rate.
+                Self::OPT_RATE if i + 1 < args.len() => {
+                    rate = match args[i + 1].as_str() {
+                        "original" => Rate::Scaled(1.0),
+                        "max" => Rate::Max,
+                        factor => match factor.parse::<f64>() {
+                            Ok(factor) if factor > 0.0 => Rate::Scaled(factor),
+                            _ => {
+                                Self::usage();
+                                anyhow::bail!("invalid rate {}", factor);
+                            },
+                        },
+                    };
+                    i += 1;
+                },
+                // Invalid argument.
+                _ => {
+                    Self::usage();
+                    anyhow::bail!("invalid argument {}", args[i]);
+                },
+            }
+
+            i += 1;
+        }
+
+        let recording: String = match recording {
+            Some(recording) => recording,
+            None => {
+                Self::usage();
+                anyhow::bail!("missing recording");
+            },
+        };
+
+        Ok(Self {
+            listen,
+            recording,
+            rate,
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Prints program usage.
+    ///
+    fn usage() {
+        eprintln!(
+            "Usage: {} {} <file> [{} <socket-address>] [{} original|max|<factor>]",
+            env!("CARGO_BIN_NAME"),
+            Self::OPT_RECORDING,
+            Self::OPT_LISTEN,
+            Self::OPT_RATE,
+        );
+    }
+}
+
+//==================================================================================================
+// Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Checks if an I/O error means that the peer has closed the connection.
+///
+fn is_disconnect(e: &io::Error) -> bool {
+    matches!(
+        e.kind(),
+        ErrorKind::UnexpectedEof | ErrorKind::BrokenPipe | ErrorKind::ConnectionReset
+    )
+}
+
+///
+/// # Description
+///
+/// Sends recorded inbound messages to the MicroVM, and counts them in `sent`.
+///
+fn send(
+    conn: &mut TcpStream,
+    records: &[Record],
+    rate: Rate,
+    progress: &(Mutex<Progress>, Condvar),
+    sent: &mut usize,
+) -> io::Result<()> {
+    let (lock, cvar) = progress;
+    let start: Instant = Instant::now();
+    let mut outbound: usize = 0;
+
+    for record in records {
+        if record.direction == Direction::Outbound {
+            outbound += 1;
+            continue;
+        }
+
+        // Wait for the outbound messages that precede this one.
+        let mut state = lock.lock().unwrap();
+        while state.received < outbound && !state.closed {
+            state = cvar.wait(state).unwrap();
+        }
+        if state.closed {
+            break;
+        }
+        drop(state);
+
+        // Wait for the time at which this message should be sent.
+        if let Rate::Scaled(factor) = rate {
+            let deadline: Duration = record.timestamp.div_f64(factor);
+            if let Some(delay) = deadline.checked_sub(start.elapsed()) {
+                thread::sleep(delay);
+            }
+        }
+
+        conn.write_all(&record.message)?;
+        *sent += 1;
+    }
+
+    Ok(())
+}
+
+///
+/// # Description
+///
+/// Receives outbound messages from the MicroVM and checks them against the recording.
+///
+fn receive(
+    conn: &mut TcpStream,
+    expected: &[[u8; MESSAGE_SIZE]],
+    progress: &(Mutex<Progress>, Condvar),
+) {
+    let (lock, cvar) = progress;
+    let mut bytes: [u8; MESSAGE_SIZE] = [0; MESSAGE_SIZE];
+
+    loop {
+        let ret: io::Result<()> = conn.read_exact(&mut bytes);
+
+        let mut state = lock.lock().unwrap();
+        match ret {
+            Ok(()) => {
+                let index: usize = state.received;
+                let matches: bool = expected.get(index) == Some(&bytes);
+                if !matches {
+                    state.mismatches += 1;
+                    state.first_mismatch.get_or_insert(index);
+                }
+                state.received += 1;
+                cvar.notify_all();
+            },
+            Err(e) => {
+                if !is_disconnect(&e) {
+                    warn!("receive(): connection failed (error={:?})", e);
+                }
+                state.closed = true;
+                cvar.notify_all();
+                return;
+            },
+        }
+    }
+}
+
+fn main() -> Result<()> {
+    let args: Args = Args::parse(env::args().collect())?;
+
+    let records: Vec<Record> = recording::load(&args.recording)?;
+    let expected: Arc<Vec<[u8; MESSAGE_SIZE]>> = Arc::new(
+        records
+            .iter()
+            .filter(|record| record.direction == Direction::Outbound)
+            .map(|record| record.message)
+            .collect(),
+    );
+
+    let listener: TcpListener = TcpListener::bind(args.listen)?;
+
+    // Announce the actual address, as the port may have been chosen by the system.
+    println!("listening on {}", listener.local_addr()?);
+    io::stdout().flush()?;
+
+    let (mut conn, _) = listener.accept()?;
+    conn.set_nodelay(true)?;
+
+    let progress: Arc<(Mutex<Progress>, Condvar)> =
+        Arc::new((Mutex::new(Progress::default()), Condvar::new()));
+
+    let start: Instant = Instant::now();
+
+    // Receive outbound messages in the background.
+    let receiver: JoinHandle<()> = {
+        let mut conn: TcpStream = conn.try_clone()?;
+        let progress: Arc<(Mutex<Progress>, Condvar)> = progress.clone();
+        let expected: Arc<Vec<[u8; MESSAGE_SIZE]>> = expected.clone();
+        thread::spawn(move || receive(&mut conn, &expected, &progress))
+    };
+
+    let mut sent: usize = 0;
+    match send(&mut conn, &records, args.rate, &progress, &mut sent) {
+        Ok(()) => {},
+        Err(e) if is_disconnect(&e) => {},
+        Err(e) => anyhow::bail!("connection failed (error={:?})", e),
+    }
+
+    // Wait for the MicroVM to close the connection.
+    if receiver.join().is_err() {
+        anyhow::bail!("receiver thread panicked");
+    }
+    let elapsed: Duration = start.elapsed();
+    let _ = conn.shutdown(Shutdown::Both);
+
+    let state = progress.0.lock().unwrap();
+    println!(
+        "replay: inbound_sent={} outbound_received={} outbound_expected={} mismatches={} \
+         elapsed_ns={}",
+        sent,
+        state.received,
+        expected.len(),
+        state.mismatches,
+        elapsed.as_nanos()
+    );
+
+    if let Some(index) = state.first_mismatch {
+        anyhow::bail!("outbound message {} does not match the recording", index);
+    }
+    if state.received != expected.len() {
+        anyhow::bail!(
+            "outbound stream is incomplete (expected={}, received={})",
+            expected.len(),
+            state.received
+        );
+    }
+
+    Ok(())
+}
@@ -0,0 +1,509 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Boot Information
+//!
+//! This module describes the boot information page, which the virtual machine monitor writes into
+//! guest memory before it enters the kernel. The kernel is entered with [`config::MICROVM_MAGIC`]
+//! in the `rax` register and the address of the page in the `rbx` register.
+//!
+//! The page holds a map of guest memory, the modules that were loaded along with the kernel (the
+//! initial RAM disk is the first one), properties of the platform, and the paravirtual clock.
+//! Fields are little endian and have fixed sizes, thus 32-bit and 64-bit kernels read the same
+//! layout (see `test/include/bench.h`).
+//!
+//! [`config::MICROVM_MAGIC`]: crate::config::MICROVM_MAGIC
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::config;
+use ::anyhow::Result;
+use ::std::mem;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of the boot information page.
+pub const BOOT_INFO_PAGE_SIZE: usize = 4096;
+
+/// Version of the layout of the boot information page. Later versions only append fields, and
+/// kernels check that the version is not older than theirs (see `test/include/bench.h`).
+pub const BOOT_INFO_VERSION: u32 = 2;
+
+/// Maximum number of regions in the memory map.
+pub const BOOT_INFO_MAX_REGIONS: usize = 16;
+
+/// Maximum number of modules.
+pub const BOOT_INFO_MAX_MODULES: usize = 8;
+
+/// The kernel was entered with paging enabled, with identity page tables that were built by the
+/// virtual machine monitor.
+pub const BOOT_INFO_FLAG_PAGING: u32 = 1 << 0;
+
+/// The time-stamp counter runs at a constant rate, which is given by the `tsc_khz` field.
+pub const BOOT_INFO_FLAG_INVARIANT_TSC: u32 = 1 << 1;
+
+/// KVM updates a paravirtual clock in the boot information page, whose address is given by the
+/// `pvclock` field, and the wall-clock time at which it read zero, given by the `wall_clock` field.
+pub const BOOT_INFO_FLAG_PVCLOCK: u32 = 1 << 2;
+
+/// Offset of the wall-clock time in the boot information page, which KVM writes in the layout of
+/// `struct pvclock_wall_clock`.
+pub const BOOT_INFO_WALL_CLOCK_OFFSET: usize = 0x800;
+
+/// Offset of the paravirtual clocks in the boot information page, which KVM updates in the layout
+/// of `struct pvclock_vcpu_time_info`, one per virtual processor.
+pub const BOOT_INFO_PVCLOCK_OFFSET: usize = 0x840;
+
+/// Size of the paravirtual clock of a virtual processor.
+pub const BOOT_INFO_PVCLOCK_SIZE: usize = 32;
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Types of the regions in the memory map.
+///
+#[repr(u32)]
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+pub enum MemoryRegionType {
+    /// Memory that is free for the kernel to use.
+    Usable = 1,
+    /// Memory that holds structures of the virtual machine monitor, such as the boot information
+    /// page and page tables.
+    Reserved = 2,
+    /// Memory that holds the kernel.
+    Kernel = 3,
+    /// Memory that holds a module.
+    Module = 4,
+}
+
+///
+/// # Description
+///
+/// A region of the memory map.
+///
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct MemoryRegion {
+    /// Base address.
+    pub base: u64,
+    /// Size in bytes.
+    pub size: u64,
+    /// Type, one of [`MemoryRegionType`].
+    pub type_: u32,
+    /// Padding.
+    _padding: u32,
+}
+
+///
+/// # Description
+///
+/// A module that was loaded along with the kernel.
+///
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct Module {
+    /// Base address.
+    pub base: u64,
+    /// Size in bytes.
+    pub size: u64,
+}
+
+///
+/// # Description
+///
+/// Boot information page.
+///
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct BootInfo {
+    /// Magic value that identifies the virtual machine monitor.
+    magic: u32,
+    /// Version of the layout.
+    version: u32,
+    /// Size of the structure in bytes.
+    size: u32,
+    /// Flags, a combination of `BOOT_INFO_FLAG_*`.
+    flags: u32,
+    /// Size of guest memory in bytes.
+    memory_size: u64,
+    /// Frequency of the time-stamp counter (in kHz), or zero if it is not known.
+    tsc_khz: u64,
+    /// Number of virtual processors.
+    vcpus: u32,
+    /// Number of valid entries in `regions`.
+    nregions: u32,
+    /// Number of valid entries in `modules`.
+    nmodules: u32,
+    /// Padding.
+    _padding: u32,
+    /// Memory map, sorted by base address. Regions do not overlap and cover guest memory.
+    regions: [MemoryRegion; BOOT_INFO_MAX_REGIONS],
+    /// Modules.
+    modules: [Module; BOOT_INFO_MAX_MODULES],
+    /// Address of the wall-clock time, or zero if there is no paravirtual clock.
+    wall_clock: u64,
+    /// Address of the paravirtual clock of the first virtual processor, or zero if there is none.
+    pvclock: u64,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl BootInfo {
+    ///
+    /// # Description
+    ///
+    /// Creates boot information, with an empty memory map.
+    ///
+    /// # Parameters
+    ///
+    /// - `vcpus`: Number of virtual processors.
+    ///
+    /// # Returns
+    ///
+    /// The boot information that was created.
+    ///
+    pub fn new(vcpus: u32) -> Self {
+        Self {
+            magic: config::MICROVM_MAGIC,
+            version: BOOT_INFO_VERSION,
+            size: mem::size_of::<Self>() as u32,
+            flags: 0,
+            memory_size: 0,
+            tsc_khz: 0,
+            vcpus,
+            nregions: 0,
+            nmodules: 0,
+            _padding: 0,
+            regions: [MemoryRegion::default(); BOOT_INFO_MAX_REGIONS],
+            modules: [Module::default(); BOOT_INFO_MAX_MODULES],
+            wall_clock: 0,
+            pvclock: 0,
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Sets the size of guest memory, and resets the memory map to a single usable region.
+    ///
+    /// # Parameters
+    ///
+    /// - `memory_size`: Size of guest memory in bytes.
+    ///
+    pub fn set_memory_size(&mut self, memory_size: u64) {
+        self.memory_size = memory_size;
+        self.regions[0] = MemoryRegion::new(0, memory_size, MemoryRegionType::Usable);
+        self.nregions = 1;
+        self.nmodules = 0;
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Sets flags.
+    ///
+    /// # Parameters
+    ///
+    /// - `flags`: Flags to set, a combination of `BOOT_INFO_FLAG_*`.
+    ///
+    pub fn set_flags(&mut self, flags: u32) {
+        self.flags |= flags;
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Sets the frequency of the time-stamp counter.
+    ///
+    /// # Parameters
+    ///
+    /// - `tsc_khz`: Frequency of the time-stamp counter (in kHz).
+    ///
+    pub fn set_tsc_khz(&mut self, tsc_khz: u64) {
+        self.tsc_khz = tsc_khz;
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Sets the paravirtual clock, which lives in the boot information page.
+    ///
+    /// # Parameters
+    ///
+    /// - `base`: Address of the boot information page.
+    ///
+    pub fn set_pvclock(&mut self, base: u64) {
+        self.wall_clock = base + BOOT_INFO_WALL_CLOCK_OFFSET as u64;
+        self.pvclock = base + BOOT_INFO_PVCLOCK_OFFSET as u64;
+        self.flags |= BOOT_INFO_FLAG_PVCLOCK;
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Marks a range of guest memory with a type, carving it out of the usable region that
+    /// contains it.
+    ///
+    /// # Parameters
+    ///
+    /// - `base`: Base address of the range.
+    /// - `size`: Size of the range in bytes.
+    /// - `type_`: Type of the range.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn add_region(&mut self, base: u64, size: u64, type_: MemoryRegionType) -> Result<()> {
+        if size == 0 {
+            return Ok(());
+        }
+
+        let nregions: usize = self.nregions as usize;
+        let index: Option<usize> = base.checked_add(size).and_then(|end| {
+            self.regions[..nregions].iter().position(|region| {
+                region.type_ == MemoryRegionType::Usable as u32
+                    && region.base <= base
+                    && end <= region.base + region.size
+            })
+        });
+        let index: usize = match index {
+            Some(index) => index,
+            None => {
+                let reason: String = "region does not lie in usable memory".to_string();
+                error!("add_region(): {} (base={:#x}, size={:#x})", reason, base, size);
+                anyhow::bail!(reason);
+            },
+        };
+
+        // Split the usable region in up to three parts, dropping those that are empty.
+        let usable: MemoryRegion = self.regions[index];
+        let parts: [MemoryRegion; 3] = [
+            MemoryRegion::new(usable.base, base - usable.base, MemoryRegionType::Usable),
+            MemoryRegion::new(base, size, type_),
+            MemoryRegion::new(
+                base + size,
+                usable.base + usable.size - (base + size),
+                MemoryRegionType::Usable,
+            ),
+        ];
+        let nparts: usize = parts.iter().filter(|part| part.size > 0).count();
+        if nregions - 1 + nparts > BOOT_INFO_MAX_REGIONS {
+            let reason: String = "too many memory regions".to_string();
+            error!("add_region(): {} (base={:#x}, size={:#x})", reason, base, size);
+            anyhow::bail!(reason);
+        }
+
+        self.regions
+            .copy_within(index + 1..nregions, index + nparts);
+        for (i, part) in parts.iter().filter(|part| part.size > 0).enumerate() {
+            self.regions[index + i] = *part;
+        }
+        self.nregions = (nregions - 1 + nparts) as u32;
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Adds a module, and marks the memory that holds it in the memory map.
+    ///
+    /// # Parameters
+    ///
+    /// - `base`: Base address of the module.
+    /// - `size`: Size of the module in bytes.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn add_module(&mut self, base: u64, size: u64) -> Result<()> {
+        let nmodules: usize = self.nmodules as usize;
+        if nmodules == BOOT_INFO_MAX_MODULES {
+            let reason: String = "too many modules".to_string();
+            error!("add_module(): {} (base={:#x}, size={:#x})", reason, base, size);
+            anyhow::bail!(reason);
+        }
+
+        self.add_region(base, size, MemoryRegionType::Module)?;
+        self.modules[nmodules] = Module { base, size };
+        self.nmodules += 1;
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the boot information as it is laid out in guest memory.
+    ///
+    pub fn as_bytes(&self) -> &[u8] {
+        unsafe {
+            ::std::slice::from_raw_parts(self as *const Self as *const u8, mem::size_of::<Self>())
+        }
+    }
+}
+
+impl MemoryRegion {
+    ///
+    /// # Description
+    ///
+    /// Creates a region of the memory map.
+    ///
+    fn new(base: u64, size: u64, type_: MemoryRegionType) -> Self {
+        Self {
+            base,
+            size,
+            type_: type_ as u32,
+            _padding: 0,
+        }
+    }
+}
+
+//==================================================================================================
+// Unit Tests
+//==================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Size of guest memory in the tests.
+    const MEMORY_SIZE: u64 = 0x100000;
+
+    /// Usable region type.
+    const USABLE: u32 = MemoryRegionType::Usable as u32;
+
+    /// Reserved region type.
+    const RESERVED: u32 = MemoryRegionType::Reserved as u32;
+
+    ///
+    /// # Description
+    ///
+    /// Returns the memory map as (base, size, type) tuples.
+    ///
+    fn regions(info: &BootInfo) -> Vec<(u64, u64, u32)> {
+        info.regions[..info.nregions as usize]
+            .iter()
+            .map(|region| (region.base, region.size, region.type_))
+            .collect()
+    }
+
+    #[test]
+    fn add_region_splits_usable_memory() {
+        let mut info: BootInfo = BootInfo::new(1);
+        info.set_memory_size(MEMORY_SIZE);
+        info.add_region(0x1000, 0x2000, MemoryRegionType::Reserved)
+            .unwrap();
+        assert_eq!(
+            regions(&info),
+            vec![
+                (0, 0x1000, USABLE),
+                (0x1000, 0x2000, RESERVED),
+                (0x3000, MEMORY_SIZE - 0x3000, USABLE),
+            ]
+        );
+    }
+
+    #[test]
+    fn add_region_drops_empty_parts() {
+        let mut info: BootInfo = BootInfo::new(1);
+        info.set_memory_size(MEMORY_SIZE);
+        info.add_region(0, 0x1000, MemoryRegionType::Kernel)
+            .unwrap();
+        info.add_region(MEMORY_SIZE - 0x1000, 0x1000, MemoryRegionType::Reserved)
+            .unwrap();
+        assert_eq!(
+            regions(&info),
+            vec![
+                (0, 0x1000, MemoryRegionType::Kernel as u32),
+                (0x1000, MEMORY_SIZE - 0x2000, USABLE),
+                (MEMORY_SIZE - 0x1000, 0x1000, RESERVED),
+            ]
+        );
+
+        // An empty range leaves the memory map untouched.
+        info.add_region(0x1000, 0, MemoryRegionType::Reserved)
+            .unwrap();
+        assert_eq!(info.nregions, 3);
+    }
+
+    #[test]
+    fn add_region_rejects_ranges_outside_usable_memory() {
+        let mut info: BootInfo = BootInfo::new(1);
+        info.set_memory_size(MEMORY_SIZE);
+        info.add_region(0x1000, 0x1000, MemoryRegionType::Reserved)
+            .unwrap();
+
+        // Overlaps a reserved region.
+        assert!(info
+            .add_region(0x1800, 0x1000, MemoryRegionType::Reserved)
+            .is_err());
+        // Spans two usable regions.
+        assert!(info
+            .add_region(0, 0x3000, MemoryRegionType::Reserved)
+            .is_err());
+        // Lies past the end of guest memory.
+        assert!(info
+            .add_region(MEMORY_SIZE - 0x1000, 0x2000, MemoryRegionType::Reserved)
+            .is_err());
+        // Wraps around the address space.
+        assert!(info
+            .add_region(u64::MAX, 2, MemoryRegionType::Reserved)
+            .is_err());
+        assert_eq!(info.nregions, 3);
+    }
+
+    #[test]
+    fn add_region_bounds_memory_map() {
+        let mut info: BootInfo = BootInfo::new(1);
+        info.set_memory_size(MEMORY_SIZE);
+
+        // Each range in the middle of the last usable region adds two regions.
+        let mut base: u64 = 0x1000;
+        while info.nregions as usize + 2 <= BOOT_INFO_MAX_REGIONS {
+            info.add_region(base, 0x1000, MemoryRegionType::Reserved)
+                .unwrap();
+            base += 0x2000;
+        }
+        assert!(info
+            .add_region(base, 0x1000, MemoryRegionType::Reserved)
+            .is_err());
+
+        // A range at the base of a usable region adds a single region.
+        info.add_region(base - 0x1000, 0x1000, MemoryRegionType::Reserved)
+            .unwrap();
+        assert_eq!(info.nregions as usize, BOOT_INFO_MAX_REGIONS);
+    }
+
+    #[test]
+    fn add_module_marks_memory() {
+        let mut info: BootInfo = BootInfo::new(1);
+        info.set_memory_size(MEMORY_SIZE);
+        for i in 0..BOOT_INFO_MAX_MODULES as u64 {
+            info.add_module(0x10000 + 0x1000 * i, 0x1000).unwrap();
+        }
+        assert!(info.add_module(0x80000, 0x1000).is_err());
+        assert_eq!(info.nmodules as usize, BOOT_INFO_MAX_MODULES);
+        assert_eq!(info.modules[0].base, 0x10000);
+        assert!(regions(&info).contains(&(0x10000, 0x1000, MemoryRegionType::Module as u32)));
+
+        // Resetting the size of guest memory drops modules.
+        info.set_memory_size(MEMORY_SIZE);
+        assert_eq!(info.nmodules, 0);
+        assert_eq!(regions(&info), vec![(0, MEMORY_SIZE, USABLE)]);
+    }
+}
@@ -0,0 +1,291 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Control Groups
+//!
+//! This module places the virtual machine monitor in a cgroup v2, so that co-located virtual
+//! machines are isolated from each other at the level of the virtual machine monitor. The layout
+//! of the control group is as follows:
+//!
+//! ```text
+//! <path>/           the whole process, with cpu.max, cpu.weight and memory.high
+//! <path>/vcpu/      threads that run virtual processors (threaded)
+//! <path>/io/        threads that forward messages (threaded)
+//! ```
+//!
+//! Controllers must be delegated to the parent of `<path>`. The control group is not removed when
+//! the program exits.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::anyhow::Result;
+use ::std::{
+    fs,
+    path::{
+        Path,
+        PathBuf,
+    },
+    process,
+    sync::OnceLock,
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Mount point of the cgroup v2 hierarchy.
+const CGROUP_ROOT: &str = "/sys/fs/cgroup";
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/// Control group of the process, if any.
+static CGROUP: OnceLock<Cgroup> = OnceLock::new();
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Resource limits of a control group.
+///
+#[derive(Default)]
+pub struct Limits {
+    /// CPU bandwidth limit, as a quota (`None` if unlimited) and a period, in microseconds.
+    pub cpu_max: Option<(Option<u64>, u64)>,
+    /// CPU weight.
+    pub cpu_weight: Option<u32>,
+    /// Memory usage throttle limit.
+    pub memory_high: Option<usize>,
+}
+
+///
+/// # Description
+///
+/// Groups of threads that are placed in separate child control groups.
+///
+#[derive(Clone, Copy)]
+pub enum ThreadGroup {
+    /// Threads that run virtual processors.
+    Vcpu,
+    /// Threads that forward messages.
+    Io,
+}
+
+///
+/// # Description
+///
+/// Resource usage of a control group.
+///
+#[derive(Default)]
+pub struct Statistics {
+    /// CPU time consumed (in microseconds).
+    pub usage_usec: u64,
+    /// Number of periods in which the group was throttled.
+    pub nr_throttled: u64,
+    /// Time for which the group was throttled (in microseconds).
+    pub throttled_usec: u64,
+    /// Memory usage (in bytes).
+    pub memory_current: u64,
+    /// Number of times that memory usage exceeded the throttle limit.
+    pub memory_high_events: u64,
+}
+
+///
+/// # Description
+///
+/// Control group of the process.
+///
+struct Cgroup {
+    /// Path to the control group.
+    path: PathBuf,
+}
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Creates a control group, applies resource limits to it and moves the process into it.
+///
+/// # Parameters
+///
+/// - `path`:   Path of the control group, relative to the root of the cgroup v2 hierarchy.
+/// - `limits`: Resource limits.
+///
+/// # Returns
+///
+/// Upon success, empty is returned. Otherwise, an error is returned instead.
+///
+pub fn setup(path: &str, limits: &Limits) -> Result<()> {
+    trace!("setup(): path={}", path);
+
+    if !Path::new(CGROUP_ROOT).join("cgroup.controllers").exists() {
+        let reason: String = format!("cgroup v2 is not mounted (root={})", CGROUP_ROOT);
+        error!("setup(): {}", reason);
+        anyhow::bail!(reason);
+    }
+
+    let path: PathBuf = Path::new(CGROUP_ROOT).join(path.trim_start_matches('/'));
+    fs::create_dir_all(&path)?;
+
+    // Delegate controllers from the parent. This fails if the parent has processes of its own, in
+    // which case controllers must have been delegated beforehand.
+    if let Some(parent) = path.parent() {
+        if let Err(e) = write(&parent.join("cgroup.subtree_control"), "+cpu +memory") {
+            warn!("setup(): failed to delegate controllers (error={:?})", e);
+        }
+    }
+
+    // Apply resource limits.
+    if let Some((quota, period)) = limits.cpu_max {
+        let quota: String = quota.map_or("max".to_string(), |quota| quota.to_string());
+        write(&path.join("cpu.max"), &format!("{} {}", quota, period))?;
+    }
+    if let Some(weight) = limits.cpu_weight {
+        write(&path.join("cpu.weight"), &weight.to_string())?;
+    }
+    if let Some(memory_high) = limits.memory_high {
+        write(&path.join("memory.high"), &memory_high.to_string())?;
+    }
+
+    // Move the process into the control group.
+    write(&path.join("cgroup.procs"), &process::id().to_string())?;
+
+    // Create child control groups for threads.
+    for group in [ThreadGroup::Vcpu, ThreadGroup::Io] {
+        let child: PathBuf = path.join(group.name());
+        fs::create_dir_all(&child)?;
+        write(&child.join("cgroup.type"), "threaded")?;
+    }
+    write(&path.join("cgroup.subtree_control"), "+cpu")?;
+
+    if CGROUP.set(Cgroup { path }).is_err() {
+        let reason: String = "control group was already set up".to_string();
+        error!("setup(): {}", reason);
+        anyhow::bail!(reason);
+    }
+
+    Ok(())
+}
+
+///
+/// # Description
+///
+/// Moves the calling thread into a child control group. This function does nothing if the
+/// process was not placed in a control group.
+///
+/// # Parameters
+///
+/// - `group`: Group of the calling thread.
+///
+/// # Returns
+///
+/// Upon success, empty is returned. Otherwise, an error is returned instead.
+///
+pub fn join(group: ThreadGroup) -> Result<()> {
+    let cgroup: &Cgroup = match CGROUP.get() {
+        Some(cgroup) => cgroup,
+        None => return Ok(()),
+    };
+
+    let tid: libc::c_long = unsafe { libc::syscall(libc::SYS_gettid) };
+    write(&cgroup.path.join(group.name()).join("cgroup.threads"), &tid.to_string())
+}
+
+///
+/// # Description
+///
+/// Reads the resource usage of the control group of the process.
+///
+/// # Returns
+///
+/// If the process was placed in a control group, its resource usage is returned. Otherwise,
+/// `None` is returned.
+///
+pub fn stats() -> Option<Statistics> {
+    let cgroup: &Cgroup = CGROUP.get()?;
+    let mut stats: Statistics = Statistics::default();
+
+    for (key, value) in read_keyed(&cgroup.path.join("cpu.stat")) {
+        match key.as_str() {
+            "usage_usec" => stats.usage_usec = value,
+            "nr_throttled" => stats.nr_throttled = value,
+            "throttled_usec" => stats.throttled_usec = value,
+            _ => {},
+        }
+    }
+
+    for (key, value) in read_keyed(&cgroup.path.join("memory.events")) {
+        if key == "high" {
+            stats.memory_high_events = value;
+        }
+    }
+
+    stats.memory_current = fs::read_to_string(cgroup.path.join("memory.current"))
+        .ok()
+        .and_then(|value| value.trim().parse::<u64>().ok())
+        .unwrap_or(0);
+
+    Some(stats)
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Writes a value to a control file.
+///
+fn write(path: &Path, value: &str) -> Result<()> {
+    if let Err(e) = fs::write(path, value) {
+        let reason: String = format!(
+            "failed to write control file (path={:?}, value={}, error={:?})",
+            path, value, e
+        );
+        error!("write(): {}", reason);
+        anyhow::bail!(reason);
+    }
+    Ok(())
+}
+
+///
+/// # Description
+///
+/// Reads a control file of `key value` lines. Unreadable files and malformed lines are skipped.
+///
+fn read_keyed(path: &Path) -> Vec<(String, u64)> {
+    fs::read_to_string(path)
+        .unwrap_or_default()
+        .lines()
+        .filter_map(|line| {
+            let (key, value) = line.split_once(' ')?;
+            Some((key.to_string(), value.trim().parse::<u64>().ok()?))
+        })
+        .collect()
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl ThreadGroup {
+    /// Name of the child control group.
+    fn name(&self) -> &'static str {
+        match self {
+            ThreadGroup::Vcpu => "vcpu",
+            ThreadGroup::Io => "io",
+        }
+    }
+}
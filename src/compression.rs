@@ -0,0 +1,849 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Compressed Images
+//!
+//! This module decompresses kernels and initial RAM disks that are compressed with zstd or LZ4,
+//! straight into their destination. Images are detected by the magic number of their first frame,
+//! and may be a concatenation of zstd, LZ4 and skippable frames.
+//!
+//! When every frame of an image records its decompressed size, frames land in disjoint parts of
+//! the destination and they are decompressed in parallel. This is the case of images that are
+//! compressed by frame, for instance with `pzstd` or `zstd -B`. Otherwise, frames are
+//! decompressed one after the other.
+//!
+//! LZ4 frames are decoded in place in the destination, which also serves as the window of linked
+//! blocks. The header checksum of LZ4 frames is verified, but the checksums of their blocks and
+//! contents are not.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::anyhow::Result;
+use ::std::thread::{
+    self,
+    ScopedJoinHandle,
+};
+use ::zstd::zstd_safe::{
+    self,
+    DCtx,
+    InBuffer,
+    OutBuffer,
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Magic number of zstd frames.
+const ZSTD_MAGIC: u32 = 0xfd2fb528;
+
+/// Magic number of LZ4 frames.
+const LZ4_MAGIC: u32 = 0x184d2204;
+
+/// Magic numbers of skippable frames, which are shared by zstd and LZ4.
+const SKIPPABLE_MAGIC: u32 = 0x184d2a50;
+const SKIPPABLE_MAGIC_MASK: u32 = 0xfffffff0;
+
+/// Flags of the frame descriptor of LZ4 frames.
+const LZ4_FLG_VERSION_MASK: u8 = 0xc0;
+const LZ4_FLG_VERSION: u8 = 0x40;
+const LZ4_FLG_BLOCK_CHECKSUM: u8 = 1 << 4;
+const LZ4_FLG_CONTENT_SIZE: u8 = 1 << 3;
+const LZ4_FLG_CONTENT_CHECKSUM: u8 = 1 << 2;
+const LZ4_FLG_RESERVED: u8 = 1 << 1;
+const LZ4_FLG_DICT_ID: u8 = 1 << 0;
+
+/// Fields of the block descriptor of LZ4 frames.
+const LZ4_BD_RESERVED_MASK: u8 = 0x8f;
+const LZ4_BD_BLOCK_MAX_SIZE_SHIFT: u8 = 4;
+const LZ4_BD_BLOCK_MAX_SIZE_MIN: u8 = 4;
+
+/// Flag of LZ4 block sizes that marks uncompressed blocks.
+const LZ4_BLOCK_UNCOMPRESSED: u32 = 1 << 31;
+
+/// Minimum length of a match in LZ4 blocks.
+const LZ4_MIN_MATCH: usize = 4;
+
+/// Primes of the xxHash32 algorithm.
+const XXH32_PRIME1: u32 = 0x9e3779b1;
+const XXH32_PRIME2: u32 = 0x85ebca77;
+const XXH32_PRIME3: u32 = 0xc2b2ae3d;
+const XXH32_PRIME4: u32 = 0x27d4eb2f;
+const XXH32_PRIME5: u32 = 0x165667b1;
+
+/// Minimum size of an image for its frames to be decompressed in parallel.
+const PARALLEL_THRESHOLD: usize = 1024 * 1024;
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Formats of frames.
+///
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum Format {
+    /// zstd frame.
+    Zstd,
+    /// LZ4 frame.
+    Lz4,
+}
+
+///
+/// # Description
+///
+/// A frame of an image.
+///
+struct Frame<'a> {
+    /// Format of the frame.
+    format: Format,
+    /// Compressed data of the frame, including its header.
+    data: &'a [u8],
+    /// Decompressed size of the frame, if it is recorded.
+    size: Option<usize>,
+}
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Checks if an image is compressed.
+///
+pub fn is_compressed(source: &[u8]) -> bool {
+    matches!(read_u32(source, 0), Some(ZSTD_MAGIC) | Some(LZ4_MAGIC))
+}
+
+///
+/// # Description
+///
+/// Decompresses an image into a destination.
+///
+/// # Parameters
+///
+/// - `source`: Compressed image.
+/// - `destination`: Destination of the image.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the size of the decompressed image.
+/// Otherwise, it returns an error.
+///
+pub fn decompress(source: &[u8], destination: &mut [u8]) -> Result<usize> {
+    crate::timer!("decompress");
+
+    let frames: Vec<Frame> = split(source)?;
+    match decompress_frames(&frames, destination)? {
+        Some(size) => Ok(size),
+        None => {
+            let reason: String = "decompressed image does not fit".to_string();
+            error!("decompress(): {} (size={:#x})", reason, destination.len());
+            anyhow::bail!(reason);
+        },
+    }
+}
+
+///
+/// # Description
+///
+/// Decompresses an image into a buffer that is allocated for it.
+///
+/// # Parameters
+///
+/// - `source`: Compressed image.
+/// - `max_size`: Maximum size of the decompressed image.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the decompressed image. Otherwise, it
+/// returns an error.
+///
+pub fn decompress_to_vec(source: &[u8], max_size: usize) -> Result<Vec<u8>> {
+    crate::timer!("decompress_to_vec");
+
+    let too_large = || -> anyhow::Error {
+        let reason: String = "decompressed image is too large".to_string();
+        error!("decompress_to_vec(): {} (max_size={:#x})", reason, max_size);
+        anyhow::anyhow!(reason)
+    };
+
+    let frames: Vec<Frame> = split(source)?;
+
+    // If the size of some frame is not recorded, grow the buffer until the image fits.
+    let mut capacity: usize = match frames.iter().map(|frame| frame.size).sum::<Option<usize>>() {
+        Some(size) if size > max_size => return Err(too_large()),
+        Some(size) => size,
+        None => source.len().saturating_mul(4).min(max_size),
+    };
+    loop {
+        let mut destination: Vec<u8> = vec![0; capacity];
+        if let Some(size) = decompress_frames(&frames, &mut destination)? {
+            destination.truncate(size);
+            return Ok(destination);
+        }
+        if capacity == max_size {
+            return Err(too_large());
+        }
+        capacity = capacity.saturating_mul(2).min(max_size);
+    }
+}
+
+///
+/// # Description
+///
+/// Returns the size of an image once decompressed, if all of its frames record it.
+///
+/// # Parameters
+///
+/// - `source`: Compressed image.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the decompressed size of the image, or
+/// `None` if some frame does not record its size. Otherwise, it returns an error.
+///
+pub fn decompressed_size(source: &[u8]) -> Result<Option<usize>> {
+    let frames: Vec<Frame> = split(source)?;
+    Ok(frames.iter().map(|frame| frame.size).sum::<Option<usize>>())
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Splits an image into frames, skipping skippable frames.
+///
+fn split(source: &[u8]) -> Result<Vec<Frame<'_>>> {
+    let mut frames: Vec<Frame> = Vec::new();
+    let mut offset: usize = 0;
+
+    while offset < source.len() {
+        let data: &[u8] = &source[offset..];
+        let length: usize = match read_u32(data, 0) {
+            Some(ZSTD_MAGIC) => {
+                let length: usize = match zstd_safe::find_frame_compressed_size(data) {
+                    Ok(length) => length,
+                    Err(code) => {
+                        let reason: String = format!(
+                            "invalid zstd frame (offset={:#x}, error={})",
+                            offset,
+                            zstd_safe::get_error_name(code)
+                        );
+                        error!("split(): {}", reason);
+                        anyhow::bail!(reason);
+                    },
+                };
+                let size: Option<usize> = zstd_safe::get_frame_content_size(data)
+                    .ok()
+                    .flatten()
+                    .map(|size| size as usize);
+                frames.push(Frame {
+                    format: Format::Zstd,
+                    data: &data[..length],
+                    size,
+                });
+                length
+            },
+            Some(LZ4_MAGIC) => {
+                let (length, size): (usize, Option<usize>) = lz4_frame_bounds(data, offset)?;
+                frames.push(Frame {
+                    format: Format::Lz4,
+                    data: &data[..length],
+                    size,
+                });
+                length
+            },
+            Some(magic) if magic & SKIPPABLE_MAGIC_MASK == SKIPPABLE_MAGIC => {
+                match read_u32(data, 4).and_then(|size| (size as usize).checked_add(8)) {
+                    Some(length) if length <= data.len() => length,
+                    _ => {
+                        let reason: String =
+                            format!("truncated skippable frame (offset={:#x})", offset);
+                        error!("split(): {}", reason);
+                        anyhow::bail!(reason);
+                    },
+                }
+            },
+            _ => {
+                let reason: String = format!("unknown frame (offset={:#x})", offset);
+                error!("split(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+        offset += length;
+    }
+
+    Ok(frames)
+}
+
+///
+/// # Description
+///
+/// Decompresses frames into a destination, in parallel if the size of every frame is recorded.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the size of the decompressed image, or
+/// `None` if it does not fit in the destination. Otherwise, it returns an error.
+///
+fn decompress_frames(frames: &[Frame], destination: &mut [u8]) -> Result<Option<usize>> {
+    let sizes: Option<Vec<usize>> = frames.iter().map(|frame| frame.size).collect();
+
+    if let Some(sizes) = sizes.filter(|sizes| sizes.len() > 1) {
+        let total: usize = sizes.iter().sum();
+        if total > destination.len() {
+            return Ok(None);
+        }
+
+        if total >= PARALLEL_THRESHOLD {
+            // Give each frame its own part of the destination.
+            let mut parts: Vec<(&Frame, &mut [u8])> = Vec::with_capacity(frames.len());
+            let mut rest: &mut [u8] = &mut destination[..total];
+            for (frame, size) in frames.iter().zip(sizes) {
+                let (part, tail): (&mut [u8], &mut [u8]) = rest.split_at_mut(size);
+                parts.push((frame, part));
+                rest = tail;
+            }
+
+            let nthreads: usize = thread::available_parallelism()
+                .map_or(1, |n| n.get())
+                .min(parts.len());
+            let chunk_size: usize = parts.len().div_ceil(nthreads);
+            thread::scope(|scope| -> Result<()> {
+                let handles: Vec<ScopedJoinHandle<Result<()>>> = parts
+                    .chunks_mut(chunk_size)
+                    .map(|chunk| scope.spawn(move || decompress_parts(chunk)))
+                    .collect();
+                for handle in handles {
+                    handle.join().unwrap()?;
+                }
+                Ok(())
+            })?;
+
+            return Ok(Some(total));
+        }
+    }
+
+    let mut offset: usize = 0;
+    for frame in frames {
+        match decompress_frame(frame, &mut destination[offset..])? {
+            Some(size) => offset += size,
+            None => return Ok(None),
+        }
+    }
+
+    Ok(Some(offset))
+}
+
+///
+/// # Description
+///
+/// Decompresses frames into parts of a destination that match their recorded size.
+///
+fn decompress_parts(parts: &mut [(&Frame, &mut [u8])]) -> Result<()> {
+    for (frame, part) in parts.iter_mut() {
+        if decompress_frame(frame, part)? != Some(part.len()) {
+            let reason: String = "decompressed size of frame does not match".to_string();
+            error!("decompress_parts(): {}", reason);
+            anyhow::bail!(reason);
+        }
+    }
+
+    Ok(())
+}
+
+///
+/// # Description
+///
+/// Decompresses a frame into a destination.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the decompressed size of the frame, or
+/// `None` if it does not fit in the destination. Otherwise, it returns an error.
+///
+fn decompress_frame(frame: &Frame, destination: &mut [u8]) -> Result<Option<usize>> {
+    match frame.format {
+        Format::Zstd => zstd_decompress_frame(frame.data, destination),
+        Format::Lz4 => lz4_decompress_frame(frame.data, destination),
+    }
+}
+
+///
+/// # Description
+///
+/// Decompresses a zstd frame into a destination.
+///
+fn zstd_decompress_frame(data: &[u8], destination: &mut [u8]) -> Result<Option<usize>> {
+    let mut dctx: DCtx = DCtx::create();
+    let mut input: InBuffer = InBuffer::around(data);
+    let mut output: OutBuffer<[u8]> = OutBuffer::around(destination);
+
+    loop {
+        match dctx.decompress_stream(&mut output, &mut input) {
+            // The frame is complete.
+            Ok(0) => return Ok(Some(output.pos())),
+            // The destination is full.
+            Ok(_) if output.pos() == output.capacity() => return Ok(None),
+            // The frame is truncated.
+            Ok(_) if input.pos() == data.len() => {
+                let reason: String = "truncated zstd frame".to_string();
+                error!("zstd_decompress_frame(): {}", reason);
+                anyhow::bail!(reason);
+            },
+            Ok(_) => {},
+            Err(code) => {
+                let reason: String = format!(
+                    "failed to decompress zstd frame ({})",
+                    zstd_safe::get_error_name(code)
+                );
+                error!("zstd_decompress_frame(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        }
+    }
+}
+
+///
+/// # Description
+///
+/// Finds the length and the decompressed size of a LZ4 frame.
+///
+fn lz4_frame_bounds(data: &[u8], offset: usize) -> Result<(usize, Option<usize>)> {
+    let invalid = |what: &str| -> anyhow::Error {
+        let reason: String = format!("{} (offset={:#x})", what, offset);
+        error!("lz4_frame_bounds(): {}", reason);
+        anyhow::anyhow!(reason)
+    };
+
+    let (flags, header): (u8, usize) =
+        lz4_frame_header(data).ok_or_else(|| invalid("invalid lz4 frame"))?;
+    let max_block_size: usize = lz4_max_block_size(data[5]);
+    let size: Option<usize> = if flags & LZ4_FLG_CONTENT_SIZE != 0 {
+        read_u64(data, 6).map(|size| size as usize)
+    } else {
+        None
+    };
+
+    let mut position: usize = header;
+    loop {
+        let block: u32 = read_u32(data, position).ok_or_else(|| invalid("truncated lz4 frame"))?;
+        position += 4;
+        if block == 0 {
+            break;
+        }
+        let length: usize = (block & !LZ4_BLOCK_UNCOMPRESSED) as usize;
+        if length > max_block_size {
+            return Err(invalid("invalid lz4 block size"));
+        }
+        position += length;
+        if flags & LZ4_FLG_BLOCK_CHECKSUM != 0 {
+            position += 4;
+        }
+    }
+    if flags & LZ4_FLG_CONTENT_CHECKSUM != 0 {
+        position += 4;
+    }
+
+    if position > data.len() {
+        return Err(invalid("truncated lz4 frame"));
+    }
+
+    Ok((position, size))
+}
+
+///
+/// # Description
+///
+/// Parses the header of a LZ4 frame, and checks its checksum.
+///
+/// # Returns
+///
+/// If the header is valid, this function returns the flags of the frame and the length of the
+/// header. Otherwise, it returns `None`.
+///
+fn lz4_frame_header(data: &[u8]) -> Option<(u8, usize)> {
+    let flags: u8 = *data.get(4)?;
+    if flags & LZ4_FLG_VERSION_MASK != LZ4_FLG_VERSION
+        || flags & (LZ4_FLG_RESERVED | LZ4_FLG_DICT_ID) != 0
+    {
+        return None;
+    }
+
+    // Block descriptor.
+    let descriptor: u8 = *data.get(5)?;
+    if descriptor & LZ4_BD_RESERVED_MASK != 0
+        || descriptor >> LZ4_BD_BLOCK_MAX_SIZE_SHIFT < LZ4_BD_BLOCK_MAX_SIZE_MIN
+    {
+        return None;
+    }
+
+    // Magic number, flags, block descriptor, content size and header checksum.
+    let header: usize = 4
+        + 2
+        + if flags & LZ4_FLG_CONTENT_SIZE != 0 {
+            8
+        } else {
+            0
+        }
+        + 1;
+    if header > data.len() {
+        return None;
+    }
+
+    // The checksum is the second byte of the hash of the frame descriptor.
+    if (xxh32(&data[4..header - 1], 0) >> 8) as u8 != data[header - 1] {
+        return None;
+    }
+
+    Some((flags, header))
+}
+
+///
+/// # Description
+///
+/// Returns the maximum size of the blocks of a LZ4 frame, from its block descriptor.
+///
+fn lz4_max_block_size(descriptor: u8) -> usize {
+    1 << (8 + 2 * (descriptor >> LZ4_BD_BLOCK_MAX_SIZE_SHIFT) as usize)
+}
+
+///
+/// # Description
+///
+/// Decompresses a LZ4 frame into a destination. The frame must have been checked by
+/// [`lz4_frame_bounds`].
+///
+fn lz4_decompress_frame(data: &[u8], destination: &mut [u8]) -> Result<Option<usize>> {
+    let (flags, mut position): (u8, usize) = match lz4_frame_header(data) {
+        Some(header) => header,
+        None => anyhow::bail!("invalid lz4 frame"),
+    };
+
+    let mut offset: usize = 0;
+    while let Some(block) = read_u32(data, position).filter(|block| *block != 0) {
+        position += 4;
+        let length: usize = (block & !LZ4_BLOCK_UNCOMPRESSED) as usize;
+        let contents: &[u8] = &data[position..position + length];
+        position += length;
+        if flags & LZ4_FLG_BLOCK_CHECKSUM != 0 {
+            position += 4;
+        }
+
+        if block & LZ4_BLOCK_UNCOMPRESSED != 0 {
+            if offset + length > destination.len() {
+                return Ok(None);
+            }
+            destination[offset..offset + length].copy_from_slice(contents);
+            offset += length;
+        } else {
+            match lz4_decompress_block(contents, destination, offset)? {
+                Some(end) => offset = end,
+                None => return Ok(None),
+            }
+        }
+    }
+
+    Ok(Some(offset))
+}
+
+///
+/// # Description
+///
+/// Decompresses a LZ4 block into a destination, at a given offset. Matches may refer to data
+/// before that offset, which holds previous blocks of the frame.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the offset that follows the decompressed
+/// block, or `None` if it does not fit in the destination. Otherwise, it returns an error.
+///
+fn lz4_decompress_block(
+    block: &[u8],
+    destination: &mut [u8],
+    offset: usize,
+) -> Result<Option<usize>> {
+    let corrupted = || -> anyhow::Error {
+        let reason: String = "corrupted lz4 block".to_string();
+        error!("lz4_decompress_block(): {}", reason);
+        anyhow::anyhow!(reason)
+    };
+
+    let mut input: usize = 0;
+    let mut output: usize = offset;
+    while input < block.len() {
+        let token: u8 = block[input];
+        input += 1;
+
+        // Copy literals.
+        let literals: usize =
+            lz4_length(block, &mut input, (token >> 4) as usize).ok_or_else(corrupted)?;
+        let end: usize = input
+            .checked_add(literals)
+            .filter(|end| *end <= block.len())
+            .ok_or_else(corrupted)?;
+        if output + literals > destination.len() {
+            return Ok(None);
+        }
+        destination[output..output + literals].copy_from_slice(&block[input..end]);
+        input = end;
+        output += literals;
+
+        // The last sequence has no match.
+        if input == block.len() {
+            break;
+        }
+
+        // Copy match, which may overlap with its own output.
+        let distance: usize = read_u16(block, input).ok_or_else(corrupted)? as usize;
+        input += 2;
+        if distance == 0 || distance > output {
+            return Err(corrupted());
+        }
+        let length: usize = lz4_length(block, &mut input, (token & 0xf) as usize)
+            .ok_or_else(corrupted)?
+            + LZ4_MIN_MATCH;
+        if output + length > destination.len() {
+            return Ok(None);
+        }
+        if distance >= length {
+            destination.copy_within(output - distance..output - distance + length, output);
+        } else {
+            for i in output..output + length {
+                destination[i] = destination[i - distance];
+            }
+        }
+        output += length;
+    }
+
+    Ok(Some(output))
+}
+
+///
+/// # Description
+///
+/// Reads the length of literals or of a match in a LZ4 block, which is extended by extra bytes
+/// when its four bits in the token are all set.
+///
+fn lz4_length(block: &[u8], input: &mut usize, mut length: usize) -> Option<usize> {
+    if length == 0xf {
+        loop {
+            let byte: u8 = *block.get(*input)?;
+            *input += 1;
+            length = length.checked_add(byte as usize)?;
+            if byte != 0xff {
+                break;
+            }
+        }
+    }
+    Some(length)
+}
+
+///
+/// # Description
+///
+/// Computes the xxHash32 hash of some data.
+///
+fn xxh32(data: &[u8], seed: u32) -> u32 {
+    let round = |accumulator: u32, lane: u32| -> u32 {
+        accumulator
+            .wrapping_add(lane.wrapping_mul(XXH32_PRIME2))
+            .rotate_left(13)
+            .wrapping_mul(XXH32_PRIME1)
+    };
+
+    let mut stripes: ::std::slice::ChunksExact<u8> = data.chunks_exact(16);
+    let mut hash: u32 = if data.len() >= 16 {
+        let mut accumulators: [u32; 4] = [
+            seed.wrapping_add(XXH32_PRIME1).wrapping_add(XXH32_PRIME2),
+            seed.wrapping_add(XXH32_PRIME2),
+            seed,
+            seed.wrapping_sub(XXH32_PRIME1),
+        ];
+        for stripe in stripes.by_ref() {
+            for (i, accumulator) in accumulators.iter_mut().enumerate() {
+                *accumulator = round(*accumulator, read_u32(stripe, 4 * i).unwrap());
+            }
+        }
+        accumulators[0]
+            .rotate_left(1)
+            .wrapping_add(accumulators[1].rotate_left(7))
+            .wrapping_add(accumulators[2].rotate_left(12))
+            .wrapping_add(accumulators[3].rotate_left(18))
+    } else {
+        seed.wrapping_add(XXH32_PRIME5)
+    };
+    hash = hash.wrapping_add(data.len() as u32);
+
+    let mut words: ::std::slice::ChunksExact<u8> = stripes.remainder().chunks_exact(4);
+    for word in words.by_ref() {
+        hash = hash
+            .wrapping_add(read_u32(word, 0).unwrap().wrapping_mul(XXH32_PRIME3))
+            .rotate_left(17)
+            .wrapping_mul(XXH32_PRIME4);
+    }
+    for byte in words.remainder() {
+        hash = hash
+            .wrapping_add((*byte as u32).wrapping_mul(XXH32_PRIME5))
+            .rotate_left(11)
+            .wrapping_mul(XXH32_PRIME1);
+    }
+
+    hash ^= hash >> 15;
+    hash = hash.wrapping_mul(XXH32_PRIME2);
+    hash ^= hash >> 13;
+    hash = hash.wrapping_mul(XXH32_PRIME3);
+    hash ^ (hash >> 16)
+}
+
+/// Reads a little-endian half word at a given offset.
+fn read_u16(data: &[u8], offset: usize) -> Option<u16> {
+    Some(u16::from_le_bytes(data.get(offset..offset.checked_add(2)?)?.try_into().ok()?))
+}
+
+/// Reads a little-endian word at a given offset.
+fn read_u32(data: &[u8], offset: usize) -> Option<u32> {
+    Some(u32::from_le_bytes(data.get(offset..offset.checked_add(4)?)?.try_into().ok()?))
+}
+
+/// Reads a little-endian double word at a given offset.
+fn read_u64(data: &[u8], offset: usize) -> Option<u64> {
+    Some(u64::from_le_bytes(data.get(offset..offset.checked_add(8)?)?.try_into().ok()?))
+}
+
+//==================================================================================================
+// Unit Tests
+//==================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Contents of the test frames.
+    const CONTENTS: &[u8] = b"abcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcd";
+
+    /// LZ4 frame of the contents, as written by the reference implementation. Its single match
+    /// overlaps with its own output.
+    const FRAME: &[u8] = &[
+        0x04, 0x22, 0x4d, 0x18, 0x64, 0x40, 0xa7, 0x0e, 0x00, 0x00, 0x00, 0x4f, 0x61, 0x62, 0x63,
+        0x64, 0x04, 0x00, 0x24, 0x50, 0x64, 0x61, 0x62, 0x63, 0x64, 0x00, 0x00, 0x00, 0x00, 0xd5,
+        0xea, 0x84, 0x45,
+    ];
+
+    /// Same frame as [`FRAME`], which also records the size of its contents.
+    const FRAME_WITH_SIZE: &[u8] = &[
+        0x04, 0x22, 0x4d, 0x18, 0x6c, 0x40, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xda,
+        0x0e, 0x00, 0x00, 0x00, 0x4f, 0x61, 0x62, 0x63, 0x64, 0x04, 0x00, 0x24, 0x50, 0x64, 0x61,
+        0x62, 0x63, 0x64, 0x00, 0x00, 0x00, 0x00, 0xd5, 0xea, 0x84, 0x45,
+    ];
+
+    ///
+    /// # Description
+    ///
+    /// Builds a LZ4 frame with a single block.
+    ///
+    fn lz4_frame(descriptor: u8, block: &[u8]) -> Vec<u8> {
+        let flags: u8 = LZ4_FLG_VERSION | (1 << 5);
+        let mut frame: Vec<u8> = LZ4_MAGIC.to_le_bytes().to_vec();
+        frame.extend_from_slice(&[
+            flags,
+            descriptor,
+            (xxh32(&[flags, descriptor], 0) >> 8) as u8,
+        ]);
+        frame.extend_from_slice(&(block.len() as u32).to_le_bytes());
+        frame.extend_from_slice(block);
+        frame.extend_from_slice(&0u32.to_le_bytes());
+        frame
+    }
+
+    #[test]
+    fn computes_xxh32() {
+        assert_eq!(xxh32(b"", 0), 0x02cc5d05);
+        assert_eq!(xxh32(b"a", 0), 0x550d7456);
+        assert_eq!(xxh32(b"abc", 0), 0x32d153ff);
+        assert_eq!(xxh32(b"Nobody inspects the spammish repetition", 0), 0xe2293b2f);
+    }
+
+    #[test]
+    fn decompresses_lz4_frames() {
+        assert_eq!(decompress_to_vec(FRAME, usize::MAX).unwrap(), CONTENTS);
+        assert_eq!(decompress_to_vec(FRAME_WITH_SIZE, usize::MAX).unwrap(), CONTENTS);
+        assert_eq!(decompressed_size(FRAME).unwrap(), None);
+        assert_eq!(decompressed_size(FRAME_WITH_SIZE).unwrap(), Some(CONTENTS.len()));
+
+        let mut destination: Vec<u8> = vec![0; CONTENTS.len()];
+        assert_eq!(decompress(FRAME, &mut destination).unwrap(), CONTENTS.len());
+        assert_eq!(destination, CONTENTS);
+        assert!(decompress(FRAME, &mut destination[1..]).is_err());
+    }
+
+    #[test]
+    fn round_trips_zstd_frames() {
+        let mut image: Vec<u8> = ::zstd::bulk::compress(CONTENTS, 3).unwrap();
+        image.extend_from_slice(FRAME_WITH_SIZE);
+        image.extend_from_slice(&::zstd::bulk::compress(&CONTENTS[1..], 3).unwrap());
+
+        let mut expected: Vec<u8> = [CONTENTS, CONTENTS].concat();
+        expected.extend_from_slice(&CONTENTS[1..]);
+        assert_eq!(decompress_to_vec(&image, usize::MAX).unwrap(), expected);
+    }
+
+    #[test]
+    fn copies_overlapping_matches() {
+        // One literal, followed by a match at distance one that repeats it 19 times.
+        let frame: Vec<u8> = lz4_frame(0x40, &[0x1f, b'x', 0x01, 0x00, 0x00]);
+        assert_eq!(decompress_to_vec(&frame, usize::MAX).unwrap(), [b'x'; 20]);
+    }
+
+    #[test]
+    fn rejects_truncated_frames() {
+        for length in 1..FRAME.len() {
+            assert!(decompress_to_vec(&FRAME[..length], usize::MAX).is_err(), "length={}", length);
+        }
+    }
+
+    #[test]
+    fn rejects_bad_header_checksum() {
+        let mut frame: Vec<u8> = FRAME.to_vec();
+        frame[6] ^= 1;
+        assert!(decompress_to_vec(&frame, usize::MAX).is_err());
+    }
+
+    #[test]
+    fn rejects_bad_block_descriptor() {
+        let block: &[u8] = &[0x10, b'x'];
+        assert_eq!(decompress_to_vec(&lz4_frame(0x40, block), usize::MAX).unwrap(), b"x");
+
+        // Reserved bits, and maximum block sizes below 64 KB.
+        for descriptor in [0xc0, 0x41, 0x30] {
+            let frame: Vec<u8> = lz4_frame(descriptor, block);
+            assert!(decompress_to_vec(&frame, usize::MAX).is_err(), "bd={:#x}", descriptor);
+        }
+    }
+
+    #[test]
+    fn rejects_corrupted_blocks() {
+        // Match that refers to data before the start of the frame.
+        let frame: Vec<u8> = lz4_frame(0x40, &[0x10, b'x', 0x02, 0x00, 0x00]);
+        assert!(decompress_to_vec(&frame, usize::MAX).is_err());
+    }
+
+    #[test]
+    fn limits_decompressed_size() {
+        for frame in [FRAME, FRAME_WITH_SIZE] {
+            assert!(decompress_to_vec(frame, CONTENTS.len() - 1).is_err());
+            assert_eq!(decompress_to_vec(frame, CONTENTS.len()).unwrap(), CONTENTS);
+        }
+    }
+}
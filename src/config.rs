@@ -13,11 +13,13 @@ pub const PROGRAM_NAME: &str = "microvm";
 /// Default memory size.
 pub const DEFAULT_MEMORY_SIZE: usize = 128 * 1024 * 1024;
 
-/// Magic value that identifies the virtual machine monitor.
-pub const MICROVM_MAGIC: u32 = 0x0c00ffee;
+/// Magic value that identifies the virtual machine monitor and its boot protocol, in which `rbx`
+/// holds the address of the boot information page. Kernels that were entered with `0x0c00ffee`
+/// found the location of the initial RAM disk in `rbx` instead.
+pub const MICROVM_MAGIC: u32 = 0x0decaf02;
 
-/// Base address of the RAM disk.
-pub const INITRD_BASE: usize = 0x00800000;
+/// Memory that is left free for the kernel to use when the memory size is computed.
+pub const DEFAULT_MEMORY_HEADROOM: usize = 8 * 1024 * 1024;
 
 /// I/O port that is connected to the standard output of the virtual machine.
 pub const STDOUT_PORT: u16 = 0xe9;
@@ -27,3 +29,35 @@ pub const STDIN_PORT: u16 = 0xea;
 
 /// I/O port that enables the guest to invoke functionalities of the virtual machine monitor.
 pub const VMM_PORT: u16 = 0x604;
+
+/// I/O port that is ignored by the virtual machine monitor. Used to measure the cost of VM exits.
+pub const BENCH_PORT: u16 = 0xeb;
+
+/// Base address of the memory-mapped registers that are ignored by the virtual machine monitor.
+/// Used to measure the cost of VM exits. They are only attached if guest memory lies below them.
+pub const BENCH_MMIO_BASE: u64 = 0xfeb0_0000;
+
+/// Size of the memory-mapped registers that are ignored by the virtual machine monitor.
+pub const BENCH_MMIO_SIZE: u64 = 0x1000;
+
+/// I/O port through which the guest waits for function invocations. The guest writes the address
+/// of its invocation buffer to it.
+pub const FUNCTION_PORT: u16 = 0xec;
+
+/// Size of the invocation buffer of the guest, including its 32-bit length header.
+pub const FUNCTION_BUFFER_SIZE: usize = 4096;
+
+/// Time for which a virtual processor runs before it is preempted, when several virtual processors
+/// share host threads (in milliseconds).
+pub const TIME_SLICE_MS: u64 = 10;
+
+/// Maximum number of parsed kernels that are kept by the process.
+pub const KERNEL_CACHE_SIZE: usize = 16;
+
+/// Fill uncompressed initial RAM disks on first access? Otherwise, they are copied into the guest
+/// memory when loaded, as they are when `userfaultfd` is not available.
+pub const DEMAND_PAGING: bool = true;
+
+/// Maximum number of pages that the demand pager fills at once on sequential faults. One disables
+/// read-ahead.
+pub const DEMAND_PAGING_READ_AHEAD: usize = 256;
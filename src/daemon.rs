@@ -0,0 +1,721 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Daemon
+//!
+//! This module runs the virtual machine monitor as a long-lived daemon that hosts several MicroVMs
+//! at once. Clients control the daemon through a Unix socket, using a line-based protocol:
+//!
+//! ```text
+//! create <options>  ->  ok id=<id>
+//! start <id>        ->  ok
+//! stop <id>         ->  ok
+//! stats <id>        ->  ok id=<id> state=<state> exits=<n> pmio_exits=<n> mmio_exits=<n> ...
+//! cgroup            ->  ok usage_usec=<n> nr_throttled=<n> throttled_usec=<n> ...
+//! ```
+//!
+//! The options of `create` are the same that the program accepts when it runs a single MicroVM.
+//! A request that fails is answered with `error <reason>`. A MicroVM that is stopped, or that
+//! has exited, is removed from the daemon by `stop`.
+//!
+//! Resources that are expensive to set up are shared by all MicroVMs: the handle to KVM is opened
+//! once, messages exchanged with gateways are forwarded by a single I/O reactor, and virtual
+//! processors are multiplexed over a fixed pool of worker threads (see [`crate::scheduler`]).
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    args::Args,
+    cgroup,
+    config,
+    io::IoReactor,
+    kvm::vcpu::Preempter,
+    microvm::{
+        Statistics,
+        Yield,
+    },
+    scheduler::{
+        Scheduler,
+        Slice,
+        Task,
+    },
+    vmm::{
+        BootOptions,
+        Vmm,
+    },
+};
+use ::anyhow::Result;
+use ::std::{
+    collections::HashMap,
+    fs,
+    io::{
+        BufRead,
+        BufReader,
+        Write,
+    },
+    os::unix::net::{
+        UnixListener,
+        UnixStream,
+    },
+    path::Path,
+    sync::{
+        atomic::{
+            AtomicBool,
+            Ordering,
+        },
+        Arc,
+        Condvar,
+        Mutex,
+        MutexGuard,
+    },
+    thread,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Maximum time that a MicroVM may take to stop.
+const STOP_TIMEOUT: Duration = Duration::from_secs(5);
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// A daemon that hosts MicroVMs.
+///
+pub struct Daemon {
+    /// Path to the control socket.
+    socket_path: String,
+    /// Control socket.
+    listener: UnixListener,
+    /// State shared with client threads.
+    context: Arc<Context>,
+}
+
+///
+/// # Description
+///
+/// State of the daemon that is shared with client threads.
+///
+struct Context {
+    /// I/O reactor shared by all MicroVMs.
+    reactor: IoReactor,
+    /// Scheduler that runs MicroVMs.
+    scheduler: Scheduler,
+    /// MicroVMs hosted by the daemon.
+    registry: Mutex<Registry>,
+}
+
+///
+/// # Description
+///
+/// MicroVMs hosted by the daemon.
+///
+#[derive(Default)]
+struct Registry {
+    /// Identifier of the next MicroVM.
+    next_id: u64,
+    /// MicroVMs, indexed by identifier.
+    instances: HashMap<u64, Arc<Instance>>,
+}
+
+///
+/// # Description
+///
+/// A MicroVM hosted by the daemon.
+///
+struct Instance {
+    /// State of the MicroVM.
+    state: Mutex<InstanceState>,
+    /// Signaled whenever the state changes.
+    changed: Condvar,
+}
+
+///
+/// # Description
+///
+/// Life cycle of a MicroVM.
+///
+#[derive(Clone, PartialEq, Eq)]
+enum Status {
+    /// The MicroVM was created and waits to be started.
+    Created,
+    /// The MicroVM is running.
+    Running,
+    /// The MicroVM has exited.
+    Exited,
+    /// The MicroVM has failed.
+    Failed(String),
+}
+
+///
+/// # Description
+///
+/// State of a MicroVM.
+///
+struct InstanceState {
+    /// Life cycle of the MicroVM.
+    status: Status,
+    /// MicroVM, until it is started.
+    vmm: Option<Vmm>,
+    /// Flag that stops the MicroVM.
+    stop_flag: Arc<AtomicBool>,
+    /// Execution statistics.
+    stats: Arc<Statistics>,
+    /// Time at which the MicroVM started.
+    started_at: Option<Instant>,
+    /// Time at which the MicroVM stopped.
+    stopped_at: Option<Instant>,
+}
+
+///
+/// # Description
+///
+/// A MicroVM that was submitted to the scheduler.
+///
+struct InstanceTask {
+    /// MicroVM.
+    vmm: Vmm,
+    /// Status of the MicroVM, once it has stopped.
+    status: Option<Status>,
+    /// Forces the MicroVM out of the guest.
+    preempter: Preempter,
+    /// State of the MicroVM.
+    instance: Arc<Instance>,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Daemon {
+    ///
+    /// # Description
+    ///
+    /// Creates a new daemon.
+    ///
+    /// # Parameters
+    ///
+    /// - `socket_path`: Path to the control socket. A stale socket is replaced.
+    /// - `reactor`:     I/O reactor shared by all MicroVMs.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, the daemon is returned. Otherwise, an error is returned instead.
+    ///
+    pub fn new(socket_path: &str, reactor: IoReactor) -> Result<Self> {
+        // Open KVM before accepting requests, so that a missing device is reported early.
+        crate::kvm::partition::VirtualPartition::kvm()?;
+
+        let nworkers: usize = thread::available_parallelism()?.get();
+        let scheduler: Scheduler =
+            Scheduler::new(nworkers, Duration::from_millis(config::TIME_SLICE_MS))?;
+
+        if Path::new(socket_path).exists() {
+            if UnixStream::connect(socket_path).is_ok() {
+                let reason: String =
+                    format!("daemon is already running (socket_path={})", socket_path);
+                error!("new(): {}", reason);
+                anyhow::bail!(reason);
+            }
+            fs::remove_file(socket_path)?;
+        }
+
+        let listener: UnixListener = match UnixListener::bind(socket_path) {
+            Ok(listener) => listener,
+            Err(e) => {
+                let reason: String = format!(
+                    "failed to bind control socket (socket_path={}, error={:?})",
+                    socket_path, e
+                );
+                error!("new(): {}", reason);
+                anyhow::bail!(reason)
+            },
+        };
+
+        Ok(Self {
+            socket_path: socket_path.to_string(),
+            listener,
+            context: Arc::new(Context {
+                reactor,
+                scheduler,
+                registry: Mutex::new(Registry::default()),
+            }),
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Serves clients until the control socket fails. Each client is served by a dedicated thread.
+    ///
+    /// # Returns
+    ///
+    /// This method only returns on failure, with an error.
+    ///
+    pub fn run(&self) -> Result<()> {
+        info!("run(): listening on {}", self.socket_path);
+
+        for conn in self.listener.incoming() {
+            let conn: UnixStream = match conn {
+                Ok(conn) => conn,
+                Err(e) => {
+                    warn!("run(): failed to accept client (error={:?})", e);
+                    continue;
+                },
+            };
+
+            let context: Arc<Context> = self.context.clone();
+            if let Err(e) = thread::Builder::new()
+                .name("daemon-client".to_string())
+                .spawn(move || context.serve(conn))
+            {
+                warn!("run(): failed to spawn client thread (error={:?})", e);
+            }
+        }
+
+        let reason: String = "control socket has failed".to_string();
+        error!("run(): {}", reason);
+        anyhow::bail!(reason)
+    }
+}
+
+impl Drop for Daemon {
+    fn drop(&mut self) {
+        if let Err(e) = fs::remove_file(&self.socket_path) {
+            warn!("drop(): failed to remove control socket (error={:?})", e);
+        }
+    }
+}
+
+impl Context {
+    ///
+    /// # Description
+    ///
+    /// Serves requests of a client until it disconnects.
+    ///
+    /// # Parameters
+    ///
+    /// - `conn`: Connection to the client.
+    ///
+    fn serve(&self, conn: UnixStream) {
+        let mut writer: UnixStream = match conn.try_clone() {
+            Ok(writer) => writer,
+            Err(e) => {
+                warn!("serve(): failed to clone connection (error={:?})", e);
+                return;
+            },
+        };
+
+        for line in BufReader::new(conn).lines() {
+            let line: String = match line {
+                Ok(line) => line,
+                Err(_) => break,
+            };
+
+            let response: String = match self.handle(&line) {
+                Ok(response) => format!("ok{}", response),
+                Err(e) => format!("error {}", e),
+            };
+
+            if writeln!(writer, "{}", response).is_err() {
+                break;
+            }
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Handles a request.
+    ///
+    /// # Parameters
+    ///
+    /// - `request`: Request line.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, the payload of the response is returned. Otherwise, an error is returned.
+    ///
+    fn handle(&self, request: &str) -> Result<String> {
+        let mut tokens: std::str::SplitWhitespace = request.split_whitespace();
+        let command: &str = tokens.next().unwrap_or("");
+
+        match command {
+            "create" => {
+                let id: u64 = self.create(tokens.map(|token| token.to_string()).collect())?;
+                Ok(format!(" id={}", id))
+            },
+            "start" => {
+                self.start(Self::parse_id(tokens.next())?)?;
+                Ok(String::new())
+            },
+            "stop" => {
+                self.stop(Self::parse_id(tokens.next())?)?;
+                Ok(String::new())
+            },
+            "stats" => self.stats(Self::parse_id(tokens.next())?),
+            "cgroup" => Self::cgroup_stats(),
+            _ => {
+                let reason: String = format!("invalid request '{}'", request);
+                error!("handle(): {}", reason);
+                anyhow::bail!(reason)
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Creates a MicroVM.
+    ///
+    /// # Parameters
+    ///
+    /// - `options`: Command-line options of the MicroVM.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, the identifier of the MicroVM is returned. Otherwise, an error is returned.
+    ///
+    fn create(&self, options: Vec<String>) -> Result<u64> {
+        // These options would otherwise terminate or re-enter the daemon, or they apply to the
+        // daemon as a whole.
+        if let Some(option) = options.iter().find(|option| {
+            matches!(
+                option.as_str(),
+                "-help"
+                    | "-daemon"
+                    | "-batch"
+                    | "-results"
+                    | "-jobs"
+                    | "-function"
+                    | "-cgroup"
+                    | "-cpu-max"
+                    | "-cpu-weight"
+                    | "-memory-high"
+            )
+        }) {
+            let reason: String = format!("unsupported option {}", option);
+            error!("create(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        let mut argv: Vec<String> = vec![config::PROGRAM_NAME.to_string()];
+        argv.extend(options);
+        let mut args: Args = Args::parse(argv)?;
+
+        let kernel_filename: String = args.kernel_filename().to_string();
+        let memory_size: usize = args.memory_size()?;
+        let initrd_filename: Option<String> = args.initrd_filename();
+        let options: BootOptions = BootOptions {
+            kernel_filename: &kernel_filename,
+            initrd_filename: initrd_filename.as_deref(),
+            paging: args.paging(),
+        };
+        let vmm: Vmm = match Vmm::new(
+            memory_size,
+            args.disable_exits(),
+            &options,
+            args.take_vm_stderr(),
+            args.gateway_addr(),
+            args.take_record(),
+            &self.reactor,
+        ) {
+            Ok(vmm) => vmm,
+            Err(e) => {
+                let reason: String = format!("failed to create microvm ({})", e);
+                error!("create(): {}", reason);
+                anyhow::bail!(reason)
+            },
+        };
+
+        let instance: Arc<Instance> = Arc::new(Instance::new(vmm));
+        let mut registry: MutexGuard<Registry> = self.registry.lock().unwrap();
+        let id: u64 = registry.next_id;
+        registry.next_id += 1;
+        registry.instances.insert(id, instance);
+
+        Ok(id)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Starts a MicroVM.
+    ///
+    /// # Parameters
+    ///
+    /// - `id`: Identifier of the MicroVM.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, empty is returned. Otherwise, an error is returned instead.
+    ///
+    fn start(&self, id: u64) -> Result<()> {
+        let instance: Arc<Instance> = self.lookup(id)?;
+        let mut state: MutexGuard<InstanceState> = instance.state.lock().unwrap();
+
+        let vmm: Vmm = match state.vmm.take() {
+            Some(vmm) if state.status == Status::Created => vmm,
+            _ => {
+                let reason: String = format!("microvm cannot be started (id={})", id);
+                error!("start(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+        state.status = Status::Running;
+        state.started_at = Some(Instant::now());
+        drop(state);
+
+        self.scheduler.submit(Box::new(InstanceTask {
+            preempter: vmm.preempter(),
+            vmm,
+            status: None,
+            instance,
+        }));
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Stops a MicroVM and removes it from the daemon.
+    ///
+    /// # Parameters
+    ///
+    /// - `id`: Identifier of the MicroVM.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, empty is returned. Otherwise, an error is returned instead.
+    ///
+    fn stop(&self, id: u64) -> Result<()> {
+        let instance: Arc<Instance> = self.lookup(id)?;
+        let deadline: Instant = Instant::now() + STOP_TIMEOUT;
+
+        let mut state: MutexGuard<InstanceState> = instance.state.lock().unwrap();
+        state.stop_flag.store(true, Ordering::Relaxed);
+
+        // A MicroVM that was not started is simply released.
+        if state.status == Status::Created {
+            state.vmm = None;
+            state.status = Status::Exited;
+        }
+
+        // A running MicroVM notices the request once it is preempted, at the latest.
+        while state.status == Status::Running {
+            let now: Instant = Instant::now();
+            if now >= deadline {
+                let reason: String = format!("timed out stopping microvm (id={})", id);
+                error!("stop(): {}", reason);
+                anyhow::bail!(reason);
+            }
+            state = instance
+                .changed
+                .wait_timeout(state, deadline - now)
+                .unwrap()
+                .0;
+        }
+        drop(state);
+
+        self.registry.lock().unwrap().instances.remove(&id);
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Collects execution statistics of a MicroVM.
+    ///
+    /// # Parameters
+    ///
+    /// - `id`: Identifier of the MicroVM.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, the payload of the response is returned. Otherwise, an error is returned.
+    ///
+    fn stats(&self, id: u64) -> Result<String> {
+        let instance: Arc<Instance> = self.lookup(id)?;
+        let state: MutexGuard<InstanceState> = instance.state.lock().unwrap();
+
+        let stats: &Statistics = &state.stats;
+        let uptime: Duration = match (state.started_at, state.stopped_at) {
+            (Some(started_at), Some(stopped_at)) => stopped_at - started_at,
+            (Some(started_at), None) => started_at.elapsed(),
+            _ => Duration::ZERO,
+        };
+        let status: &str = match state.status {
+            Status::Created => "created",
+            Status::Running => "running",
+            Status::Exited => "exited",
+            Status::Failed(_) => "failed",
+        };
+
+        Ok(format!(
+            " id={} state={} exits={} pmio_exits={} mmio_exits={} halt_exits={} preemptions={} \
+             run_ns={} uptime_ns={}",
+            id,
+            status,
+            stats.exits.load(Ordering::Relaxed),
+            stats.pmio_exits.load(Ordering::Relaxed),
+            stats.mmio_exits.load(Ordering::Relaxed),
+            stats.halt_exits.load(Ordering::Relaxed),
+            stats.preemptions.load(Ordering::Relaxed),
+            stats.run_ns.load(Ordering::Relaxed),
+            uptime.as_nanos()
+        ))
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Collects the resource usage of the control group of the daemon.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, the payload of the response is returned. Otherwise, an error is returned.
+    ///
+    fn cgroup_stats() -> Result<String> {
+        match cgroup::stats() {
+            Some(stats) => Ok(format!(
+                " usage_usec={} nr_throttled={} throttled_usec={} memory_current={} \
+                 memory_high_events={}",
+                stats.usage_usec,
+                stats.nr_throttled,
+                stats.throttled_usec,
+                stats.memory_current,
+                stats.memory_high_events
+            )),
+            None => {
+                let reason: String = "daemon is not in a control group".to_string();
+                error!("cgroup_stats(): {}", reason);
+                anyhow::bail!(reason)
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Looks up a MicroVM.
+    ///
+    fn lookup(&self, id: u64) -> Result<Arc<Instance>> {
+        match self.registry.lock().unwrap().instances.get(&id) {
+            Some(instance) => Ok(instance.clone()),
+            None => {
+                let reason: String = format!("no such microvm (id={})", id);
+                error!("lookup(): {}", reason);
+                anyhow::bail!(reason)
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Parses the identifier of a MicroVM.
+    ///
+    fn parse_id(token: Option<&str>) -> Result<u64> {
+        match token.map(|token| token.parse::<u64>()) {
+            Some(Ok(id)) => Ok(id),
+            _ => {
+                let reason: String = "missing or invalid microvm identifier".to_string();
+                error!("parse_id(): {}", reason);
+                anyhow::bail!(reason)
+            },
+        }
+    }
+}
+
+impl Instance {
+    ///
+    /// # Description
+    ///
+    /// Creates the state of a MicroVM that waits to be started.
+    ///
+    fn new(vmm: Vmm) -> Self {
+        Self {
+            state: Mutex::new(InstanceState {
+                status: Status::Created,
+                stop_flag: vmm.stop_flag(),
+                stats: vmm.stats(),
+                vmm: Some(vmm),
+                started_at: None,
+                stopped_at: None,
+            }),
+            changed: Condvar::new(),
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Records that a MicroVM no longer runs.
+    ///
+    fn finish(&self, status: Status) {
+        let mut state: MutexGuard<InstanceState> = self.state.lock().unwrap();
+        if let Status::Failed(ref reason) = status {
+            warn!("finish(): microvm has failed ({})", reason);
+        }
+        state.status = status;
+        state.stopped_at = Some(Instant::now());
+        self.changed.notify_all();
+    }
+}
+
+impl Task for InstanceTask {
+    fn preempter(&self) -> Preempter {
+        self.preempter
+    }
+
+    fn run(&mut self) -> Slice {
+        if self.status.is_some() {
+            return Slice::Finished;
+        }
+
+        let status: Status = match self.vmm.run_slice() {
+            Ok(Yield::Preempted) => return Slice::Preempted,
+            Ok(Yield::Blocked) => return Slice::Blocked,
+            Ok(Yield::PoweredOff) => Status::Exited,
+            Ok(Yield::Function(_)) => {
+                Status::Failed("function invocations are not supported".to_string())
+            },
+            Err(e) => Status::Failed(e.to_string()),
+        };
+
+        // The MicroVM is released once the scheduler no longer preempts it.
+        self.status = Some(status);
+
+        Slice::Finished
+    }
+
+    fn finish(self: Box<Self>) {
+        let InstanceTask {
+            vmm,
+            instance,
+            status,
+            ..
+        } = *self;
+
+        // Release the MicroVM before reporting that it has stopped.
+        drop(vmm);
+        if let Some(status) = status {
+            instance.finish(status);
+        }
+    }
+}
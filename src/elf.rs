@@ -66,6 +66,7 @@ const EM_68K: u16 = 4; // Motorola 68000.
 const EM_88K: u16 = 5; // Motorola 88000.
 const EM_860: u16 = 7; // Intel 80860.
 const EM_MIPS: u16 = 8; // MIPS RS3000.
+const EM_X86_64: u16 = 62; // AMD x86-64.
 
 // Object file versions.
 const EV_NONE: u32 = 0; // Invalid version.
@@ -82,6 +83,12 @@ const PT_PHDR: u32 = 6; // Program header table.
 const PT_LOPROC: u32 = 0x70000000; // Low limit for processor-specific.
 const PT_HIPROC: u32 = 0x7fffffff; // High limit for processor-specific.
 
+// Note types.
+const XEN_ELFNOTE_PHYS32_ENTRY: u32 = 18; // Physical address of the 32-bit entry point.
+
+// Owner of Xen notes.
+const XEN_NOTE_NAME: &[u8] = b"Xen\0";
+
 // ELF 32 file header.
 #[repr(C)]
 pub struct Elf32Fhdr {
@@ -120,6 +127,96 @@ struct Elf32Phdr {
     p_align: u32,  // Alignment value.
 }
 
+// ELF 64 file header.
+#[repr(C)]
+struct Elf64Fhdr {
+    e_ident: [u8; EI_NIDENT], // ELF magic numbers and other info.
+    e_type: u16,              // Object file type.
+    e_machine: u16,           // Required machine architecture type.
+    e_version: u32,           // Object file version.
+    e_entry: u64,             // Virtual address of process's entry point.
+    e_phoff: u64,             // Program header table file offset.
+    e_shoff: u64,             // Section header table file offset.
+    e_flags: u32,             // Processor-specific flags.
+    e_ehsize: u16,            // ELF header’s size in bytes.
+    e_phentsize: u16,         // Program header table entry size.
+    e_phnum: u16,             // Entries in the program header table.
+    e_shentsize: u16,         // Section header table size.
+    e_shnum: u16,             // Entries in the section header table.
+    e_shstrndx: u16,          // Index for the section name string table.
+}
+
+// ELF note header, which is the same for all classes.
+#[repr(C)]
+struct ElfNhdr {
+    n_namesz: u32, // Size of the name of the owner.
+    n_descsz: u32, // Size of the descriptor.
+    n_type: u32,   // Type of the note.
+}
+
+// ELF 64 program header.
+#[repr(C)]
+struct Elf64Phdr {
+    p_type: u32,   // Segment type.
+    p_flags: u32,  // Segment flags.
+    p_offset: u64, // Offset of the first byte.
+    p_vaddr: u64,  // Virtual address of the first byte.
+    p_paddr: u64,  // Physical address of the first byte.
+    p_filesz: u64, // Bytes in the file image.
+    p_memsz: u64,  // Bytes in the memory image.
+    p_align: u64,  // Alignment value.
+}
+
+///
+/// # Description
+///
+/// Classes of ELF files that can be loaded.
+///
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum ElfClass {
+    /// 32-bit x86 program, entered in protected mode.
+    Elf32,
+    /// 64-bit x86 program, entered in long mode.
+    Elf64,
+}
+
+///
+/// # Description
+///
+/// A program that was loaded into memory.
+///
+#[derive(Clone, Copy, Debug)]
+pub struct Program {
+    /// Entry point.
+    pub entry: usize,
+    /// Lowest address of the program.
+    pub first_address: usize,
+    /// Size of the program, from its lowest to its highest address.
+    pub size: usize,
+    /// Class of the program.
+    pub class: ElfClass,
+    /// Entry point in 32-bit protected mode with paging disabled, if the program has a PVH note
+    /// (`XEN_ELFNOTE_PHYS32_ENTRY`).
+    pub phys32_entry: Option<usize>,
+}
+
+///
+/// # Description
+///
+/// A loadable segment of a program.
+///
+#[derive(Clone, Copy, Debug)]
+pub struct Segment {
+    /// Offset of the segment in the file.
+    pub offset: usize,
+    /// Address of the segment in memory.
+    pub address: usize,
+    /// Size of the segment in the file.
+    pub file_size: usize,
+    /// Size of the segment in memory.
+    pub memory_size: usize,
+}
+
 // Rust equivalent of the C functions.
 impl Elf32Fhdr {
     fn is_valid(&self) -> bool {
@@ -138,18 +235,21 @@ impl Elf32Fhdr {
 ///
 /// # Description
 ///
-/// Loads an ELF file into memory.
+/// Loads an ELF file into memory. Both 32-bit (`EM_386`) and 64-bit (`EM_X86_64`) executables are
+/// supported. Segments are loaded at their virtual address, thus programs must be linked at the
+/// physical address at which they run.
 ///
 /// # Parameters
 ///
 /// - `destination`: Destination address in memory.
 /// - `source`: Source address in memory.
+/// - `file_size`: Size of the file at `source`.
 /// - `max_offset`: Maximum offset in memory.
 ///
 /// # Returns
 ///
-/// Upon successful completion, this function returns a tuple containing the entry point, the first
-/// address, and the size of the program that was loaded into memory. Otherwise, it returns an error.
+/// Upon successful completion, this function returns the program that was loaded into memory.
+/// Otherwise, it returns an error.
 ///
 /// # Safety
 ///
@@ -157,121 +257,639 @@ impl Elf32Fhdr {
 /// that the following conditions are met:
 ///
 /// - The `destination` address is valid.
-/// - The `source` address is valid.
+/// - The `source` address is valid for reads of `file_size` bytes.
 /// - The `max_offset` is valid.
 ///
 pub unsafe fn load(
     destination: *mut std::ffi::c_void,
     source: *const u8,
+    file_size: usize,
     max_offset: usize,
-) -> Result<(usize, usize, usize)> {
-    let mut first_address: usize = usize::MAX;
-    let mut last_address: usize = 0;
+) -> Result<Program> {
+    let (program, segments): (Program, Vec<Segment>) = parse(source, file_size, max_offset)?;
+
+    // Copy segments to memory.
+    for segment in segments.iter() {
+        let src: *const u8 = source.add(segment.offset);
+        let dst: *mut u8 = (destination as *mut u8).add(segment.address);
+        std::ptr::copy_nonoverlapping(src, dst, segment.file_size);
+    }
 
-    // Get entry point.
-    let ehdr: *const Elf32Fhdr = source as *const Elf32Fhdr;
+    Ok(program)
+}
 
-    let entry: usize = (*ehdr).e_entry as usize;
-    trace!("entry point: {:#010x}", entry);
+///
+/// # Description
+///
+/// Parses an ELF file, without loading it into memory. Headers, notes and loadable segments are
+/// checked to lie within the file.
+///
+/// # Parameters
+///
+/// - `source`: Source address in memory.
+/// - `file_size`: Size of the file at `source`.
+/// - `max_offset`: Maximum offset in memory.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the program and its loadable segments.
+/// Otherwise, it returns an error.
+///
+/// # Safety
+///
+/// This function is unsafe because it manipulates raw pointers and is up to the caller to ensure
+/// that the `source` address is valid for reads of `file_size` bytes.
+///
+pub unsafe fn parse(
+    source: *const u8,
+    file_size: usize,
+    max_offset: usize,
+) -> Result<(Program, Vec<Segment>)> {
+    let e_ident: [u8; EI_NIDENT] = read(source, file_size, 0)?;
 
     // Check if ELF magic number is valid.
-    if (*ehdr).e_ident[0] != ELFMAG0
-        || (*ehdr).e_ident[1] != ELFMAG1 as u8
-        || (*ehdr).e_ident[2] != ELFMAG2 as u8
-        || (*ehdr).e_ident[3] != ELFMAG3 as u8
+    if e_ident[0] != ELFMAG0
+        || e_ident[1] != ELFMAG1 as u8
+        || e_ident[2] != ELFMAG2 as u8
+        || e_ident[3] != ELFMAG3 as u8
     {
         let reason: String = "header is null or invalid magic".to_string();
-        error!("load(): {} (e_ident={:?})", reason, (*ehdr).e_ident);
+        error!("parse(): {} (e_ident={:?})", reason, e_ident);
+        return Err(anyhow::anyhow!(reason));
+    }
+
+    // Check data encoding.
+    if e_ident[5] != ELFDATA2LSB {
+        let reason: String = "invalid data encoding".to_string();
+        error!("parse(): {} (e_ident={:?})", reason, e_ident);
         return Err(anyhow::anyhow!(reason));
     }
 
     // Check ELF class.
-    if (*ehdr).e_ident[4] != ELFCLASS32 {
-        let reason: String = "invalid elf class".to_string();
-        error!("load(): {} (e_ident={:?})", reason, (*ehdr).e_ident);
+    match e_ident[4] {
+        ELFCLASS32 => parse32(source, file_size, max_offset),
+        ELFCLASS64 => parse64(source, file_size, max_offset),
+        _ => {
+            let reason: String = "invalid elf class".to_string();
+            error!("parse(): {} (e_ident={:?})", reason, e_ident);
+            Err(anyhow::anyhow!(reason))
+        },
+    }
+}
+
+///
+/// # Description
+///
+/// Parses a 32-bit ELF file.
+///
+/// # Safety
+///
+/// See [`parse`].
+///
+unsafe fn parse32(
+    source: *const u8,
+    file_size: usize,
+    max_offset: usize,
+) -> Result<(Program, Vec<Segment>)> {
+    let ehdr: Elf32Fhdr = read(source, file_size, 0)?;
+
+    check_header(ehdr.e_version, ehdr.e_type, ehdr.e_machine, EM_386)?;
+
+    let entry: usize = ehdr.e_entry as usize;
+    trace!("entry point: {:#010x}", entry);
+
+    // Get program header table.
+    let phoff: usize = check_program_headers::<Elf32Phdr>(
+        file_size,
+        ehdr.e_phoff as u64,
+        ehdr.e_phnum,
+        ehdr.e_phentsize,
+    )?;
+
+    // Parse program segments.
+    let mut segments: Vec<Segment> = Vec::new();
+    let mut range: (usize, usize) = (usize::MAX, 0);
+    let mut phys32_entry: Option<usize> = None;
+    for i in 0..ehdr.e_phnum as usize {
+        let phdr: Elf32Phdr = read(source, file_size, phoff + i * ehdr.e_phentsize as usize)?;
+
+        // Loadable segment.
+        if phdr.p_type == PT_LOAD {
+            segments.push(parse_segment(
+                file_size,
+                max_offset,
+                phdr.p_offset as u64,
+                phdr.p_vaddr as u64,
+                phdr.p_filesz as u64,
+                phdr.p_memsz as u64,
+                &mut range,
+            )?);
+        }
+
+        // Auxiliary information.
+        if phdr.p_type == PT_NOTE {
+            phys32_entry = phys32_entry.or(parse_notes(
+                source,
+                file_size,
+                phdr.p_offset as u64,
+                phdr.p_filesz as u64,
+            )?);
+        }
+    }
+
+    if range.0 > range.1 {
+        let reason: String = "no loadable segments".to_string();
+        error!("parse32(): {}", reason);
         return Err(anyhow::anyhow!(reason));
     }
 
-    // Check data encoding.
-    if (*ehdr).e_ident[5] != ELFDATA2LSB {
-        let reason: String = "invalid data encoding".to_string();
-        error!("load(): {} (e_ident={:?})", reason, (*ehdr).e_ident);
+    let program: Program = Program {
+        entry,
+        first_address: range.0,
+        size: range.1 - range.0,
+        class: ElfClass::Elf32,
+        phys32_entry,
+    };
+
+    Ok((program, segments))
+}
+
+///
+/// # Description
+///
+/// Parses a 64-bit ELF file.
+///
+/// # Safety
+///
+/// See [`parse`].
+///
+unsafe fn parse64(
+    source: *const u8,
+    file_size: usize,
+    max_offset: usize,
+) -> Result<(Program, Vec<Segment>)> {
+    let ehdr: Elf64Fhdr = read(source, file_size, 0)?;
+
+    check_header(ehdr.e_version, ehdr.e_type, ehdr.e_machine, EM_X86_64)?;
+
+    let entry: usize = ehdr.e_entry as usize;
+    trace!("entry point: {:#018x}", entry);
+
+    // Check if entry point lies within memory.
+    if entry >= max_offset {
+        let reason: String = "entry point does not lie in memory".to_string();
+        error!("parse64(): {} (entry={:#018x}, max_offset={:#018x})", reason, entry, max_offset);
         return Err(anyhow::anyhow!(reason));
     }
 
+    // Get program header table.
+    let phoff: usize = check_program_headers::<Elf64Phdr>(
+        file_size,
+        ehdr.e_phoff,
+        ehdr.e_phnum,
+        ehdr.e_phentsize,
+    )?;
+
+    // Parse program segments.
+    let mut segments: Vec<Segment> = Vec::new();
+    let mut range: (usize, usize) = (usize::MAX, 0);
+    let mut phys32_entry: Option<usize> = None;
+    for i in 0..ehdr.e_phnum as usize {
+        let phdr: Elf64Phdr = read(source, file_size, phoff + i * ehdr.e_phentsize as usize)?;
+
+        // Loadable segment.
+        if phdr.p_type == PT_LOAD {
+            segments.push(parse_segment(
+                file_size,
+                max_offset,
+                phdr.p_offset,
+                phdr.p_vaddr,
+                phdr.p_filesz,
+                phdr.p_memsz,
+                &mut range,
+            )?);
+        }
+
+        // Auxiliary information.
+        if phdr.p_type == PT_NOTE {
+            phys32_entry =
+                phys32_entry.or(parse_notes(source, file_size, phdr.p_offset, phdr.p_filesz)?);
+        }
+    }
+
+    if range.0 > range.1 {
+        let reason: String = "no loadable segments".to_string();
+        error!("parse64(): {}", reason);
+        return Err(anyhow::anyhow!(reason));
+    }
+
+    let program: Program = Program {
+        entry,
+        first_address: range.0,
+        size: range.1 - range.0,
+        class: ElfClass::Elf64,
+        phys32_entry,
+    };
+
+    Ok((program, segments))
+}
+
+///
+/// # Description
+///
+/// Checks fields of an ELF header that are common to all classes.
+///
+fn check_header(e_version: u32, e_type: u16, e_machine: u16, expected_machine: u16) -> Result<()> {
     // Check version.
-    if (*ehdr).e_version != EV_CURRENT {
+    if e_version != EV_CURRENT {
         let reason: String = "invalid version".to_string();
-        error!("load(): {} (e_version={})", reason, (*ehdr).e_version);
+        error!("check_header(): {} (e_version={})", reason, e_version);
         return Err(anyhow::anyhow!(reason));
     }
 
     // Check ELF type.
-    if (*ehdr).e_type != ET_EXEC {
+    if e_type != ET_EXEC {
         let reason: String = "invalid elf type".to_string();
-        error!("load(): {} (e_type={})", reason, (*ehdr).e_type);
+        error!("check_header(): {} (e_type={})", reason, e_type);
         return Err(anyhow::anyhow!(reason));
     }
 
     // Check ELF machine architecture.
-    if (*ehdr).e_machine != EM_386 {
+    if e_machine != expected_machine {
         let reason: String = "invalid machine architecture".to_string();
-        error!("load(): {} (e_machine={})", reason, (*ehdr).e_machine);
+        error!("check_header(): {} (e_machine={})", reason, e_machine);
         return Err(anyhow::anyhow!(reason));
     }
 
-    // Get program header table.
-    let phdr: *const Elf32Phdr = (source as usize + (*ehdr).e_phoff as usize) as *const Elf32Phdr;
+    Ok(())
+}
 
-    // Load program segments.
-    for i in 0..(*ehdr).e_phnum {
-        let phdr = &*phdr.add(i as usize);
+///
+/// # Description
+///
+/// Looks for the 32-bit entry point of a program in a note segment.
+///
+/// # Parameters
+///
+/// - `source`: Source address in memory.
+/// - `file_size`: Size of the file at `source`.
+/// - `offset`: Offset of the segment in the file.
+/// - `size`: Size of the segment in the file.
+///
+/// # Returns
+///
+/// If the segment has a `XEN_ELFNOTE_PHYS32_ENTRY` note, this function returns the entry point
+/// that it holds, and `None` otherwise. If the segment does not lie within the file, it returns an
+/// error.
+///
+/// # Safety
+///
+/// See [`parse`].
+///
+unsafe fn parse_notes(
+    source: *const u8,
+    file_size: usize,
+    offset: u64,
+    size: u64,
+) -> Result<Option<usize>> {
+    const NHDR_SIZE: usize = ::std::mem::size_of::<ElfNhdr>();
+
+    // Check if segment lies within the file.
+    let (offset, size): (usize, usize) = match offset.checked_add(size) {
+        Some(end) if end <= file_size as u64 => (offset as usize, size as usize),
+        _ => {
+            let reason: String = "note segment does not lie in file".to_string();
+            error!(
+                "parse_notes(): {} (offset={:#010x}, size={:#010x}, file_size={:#010x})",
+                reason, offset, size, file_size
+            );
+            anyhow::bail!(reason);
+        },
+    };
+
+    // Notes are checked against the segment, which lies within the file.
+    let mut position: usize = 0;
+    while position + NHDR_SIZE <= size {
+        let nhdr: ElfNhdr = read(source, file_size, offset + position)?;
+        let name: usize = position + NHDR_SIZE;
+        let desc: usize = name + (nhdr.n_namesz as usize).next_multiple_of(4);
+        let next: usize = desc + (nhdr.n_descsz as usize).next_multiple_of(4);
+        if next > size {
+            break;
+        }
 
-        // Loadable segment.
-        if phdr.p_type == PT_LOAD {
-            let offset: usize = phdr.p_offset as usize;
-            let vaddr: usize = phdr.p_vaddr as usize;
-            let filesz: usize = phdr.p_filesz as usize;
-            let memsz: usize = phdr.p_memsz as usize;
-
-            // Check if segment fits in memory.
-            if vaddr + memsz > max_offset {
-                let reason: String = "segment does not fit in memory".to_string();
-                error!(
-                    "load(): {} (vaddr={:#010x}, memsz={:#010x}, max_offset={:#010x})",
-                    reason, vaddr, memsz, max_offset
-                );
-                return Err(anyhow::anyhow!(reason));
-            }
-
-            trace!(
-                "loading segment: offset={:#010x} vaddr={:#010x} filesz={:#010x} memsz={:#010x}",
+        let owner: &[u8] =
+            ::std::slice::from_raw_parts(source.add(offset + name), nhdr.n_namesz as usize);
+        if owner == XEN_NOTE_NAME && nhdr.n_type == XEN_ELFNOTE_PHYS32_ENTRY && nhdr.n_descsz >= 4 {
+            // The entry point is a 32-bit physical address, which some kernels store in 64 bits.
+            let entry: u32 = read(source, file_size, offset + desc)?;
+            trace!("phys32 entry point: {:#010x}", entry);
+            return Ok(Some(entry as usize));
+        }
+
+        position = next;
+    }
+
+    Ok(None)
+}
+
+///
+/// # Description
+///
+/// Checks that the program header table lies within the file.
+///
+/// # Parameters
+///
+/// - `file_size`: Size of the file.
+/// - `phoff`: Offset of the program header table in the file.
+/// - `phnum`: Number of entries in the program header table.
+/// - `phentsize`: Size of an entry in the program header table.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the offset of the program header table.
+/// Otherwise, it returns an error.
+///
+fn check_program_headers<T>(
+    file_size: usize,
+    phoff: u64,
+    phnum: u16,
+    phentsize: u16,
+) -> Result<usize> {
+    let end: Option<u64> = (phnum as u64)
+        .checked_mul(phentsize as u64)
+        .and_then(|size| size.checked_add(phoff));
+    match end {
+        Some(end)
+            if end <= file_size as u64
+                && (phnum == 0 || phentsize as usize >= ::std::mem::size_of::<T>()) =>
+        {
+            Ok(phoff as usize)
+        },
+        _ => {
+            let reason: String = "program header table does not lie in file".to_string();
+            error!(
+                "check_program_headers(): {} (phoff={:#010x}, phnum={}, phentsize={}, \
+                 file_size={:#010x})",
+                reason, phoff, phnum, phentsize, file_size
+            );
+            anyhow::bail!(reason);
+        },
+    }
+}
+
+///
+/// # Description
+///
+/// Reads a structure from a file. The structure may not be aligned.
+///
+/// # Parameters
+///
+/// - `source`: Source address in memory.
+/// - `file_size`: Size of the file at `source`.
+/// - `offset`: Offset of the structure in the file.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the structure. If it does not lie within the
+/// file, it returns an error.
+///
+/// # Safety
+///
+/// See [`parse`]. Any bit pattern must be a valid value of `T`.
+///
+unsafe fn read<T>(source: *const u8, file_size: usize, offset: usize) -> Result<T> {
+    match offset.checked_add(::std::mem::size_of::<T>()) {
+        Some(end) if end <= file_size => {
+            Ok(::std::ptr::read_unaligned(source.add(offset) as *const T))
+        },
+        _ => {
+            let reason: String = "file is truncated".to_string();
+            error!(
+                "read(): {} (offset={:#010x}, size={}, file_size={:#010x})",
+                reason,
                 offset,
-                vaddr,
-                filesz,
-                memsz
+                ::std::mem::size_of::<T>(),
+                file_size
             );
+            anyhow::bail!(reason);
+        },
+    }
+}
 
-            // Copy segment to memory.
-            let src: *const u8 = ehdr as *const u8;
-            let src: *const u8 = src.add(offset);
-            let dst: *mut u8 = destination as *mut u8;
-            let dst: *mut u8 = dst.add(vaddr);
-            std::ptr::copy_nonoverlapping(src, dst, filesz);
-
-            // Update first address.
-            if vaddr < first_address {
-                first_address = vaddr;
-            }
-
-            // Update last address.
-            if vaddr + memsz > last_address {
-                last_address = vaddr + memsz;
-            }
+///
+/// # Description
+///
+/// Checks a loadable segment.
+///
+/// # Parameters
+///
+/// - `file_size`: Size of the file.
+/// - `max_offset`: Maximum offset in memory.
+/// - `offset`: Offset of the segment in the file.
+/// - `vaddr`: Address of the segment in memory.
+/// - `filesz`: Size of the segment in the file.
+/// - `memsz`: Size of the segment in memory.
+/// - `range`: Lowest and highest addresses of the program, which are updated.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the segment. Otherwise, it returns an error.
+///
+fn parse_segment(
+    file_size: usize,
+    max_offset: usize,
+    offset: u64,
+    vaddr: u64,
+    filesz: u64,
+    memsz: u64,
+    range: &mut (usize, usize),
+) -> Result<Segment> {
+    // Check if segment fits in memory.
+    let end: u64 = match vaddr.checked_add(memsz) {
+        Some(end) if end <= max_offset as u64 && filesz <= memsz => end,
+        _ => {
+            let reason: String = "segment does not fit in memory".to_string();
+            error!(
+                "parse_segment(): {} (vaddr={:#010x}, memsz={:#010x}, max_offset={:#010x})",
+                reason, vaddr, memsz, max_offset
+            );
+            return Err(anyhow::anyhow!(reason));
+        },
+    };
+
+    // Check if segment lies within the file.
+    let file_end: Option<u64> = offset.checked_add(filesz);
+    if file_end.is_none_or(|end| end > file_size as u64) {
+        let reason: String = "segment does not lie in file".to_string();
+        error!(
+            "parse_segment(): {} (offset={:#010x}, filesz={:#010x}, file_size={:#010x})",
+            reason, offset, filesz, file_size
+        );
+        return Err(anyhow::anyhow!(reason));
+    }
+
+    trace!(
+        "parsed segment: offset={:#010x} vaddr={:#010x} filesz={:#010x} memsz={:#010x}",
+        offset,
+        vaddr,
+        filesz,
+        memsz
+    );
+
+    // Update first and last addresses.
+    range.0 = range.0.min(vaddr as usize);
+    range.1 = range.1.max(end as usize);
+
+    Ok(Segment {
+        offset: offset as usize,
+        address: vaddr as usize,
+        file_size: filesz as usize,
+        memory_size: memsz as usize,
+    })
+}
+
+//==================================================================================================
+// Unit Tests
+//==================================================================================================
+
+#[cfg(test)]
+pub(crate) mod tests {
+    use super::*;
+
+    /// Offset of the program header table in test images.
+    const PHOFF: usize = 52;
+    /// Offset of the note segment in test images.
+    const NOTE_OFFSET: usize = PHOFF + 2 * 32;
+    /// Offset of the loadable segment in test images.
+    const LOAD_OFFSET: usize = NOTE_OFFSET + 20;
+    /// Size of the loadable segment in the file.
+    const LOAD_SIZE: usize = 16;
+    /// Entry point in the PVH note of test images.
+    const PHYS32_ENTRY: u32 = 0x0010_0000;
+
+    /// Writes a little-endian half word at a given offset.
+    fn put_u16(bytes: &mut [u8], offset: usize, value: u16) {
+        bytes[offset..offset + 2].copy_from_slice(&value.to_le_bytes());
+    }
+
+    /// Writes a little-endian word at a given offset.
+    fn put_u32(bytes: &mut [u8], offset: usize, value: u32) {
+        bytes[offset..offset + 4].copy_from_slice(&value.to_le_bytes());
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Builds a 32-bit executable with a note segment that holds a PVH entry point, followed by a
+    /// loadable segment.
+    ///
+    pub(crate) fn image() -> Vec<u8> {
+        let mut bytes: Vec<u8> = vec![0; LOAD_OFFSET + LOAD_SIZE];
+
+        // File header.
+        bytes[0..4].copy_from_slice(&[ELFMAG0, ELFMAG1 as u8, ELFMAG2 as u8, ELFMAG3 as u8]);
+        bytes[4] = ELFCLASS32;
+        bytes[5] = ELFDATA2LSB;
+        bytes[6] = EV_CURRENT as u8;
+        put_u16(&mut bytes, 16, ET_EXEC);
+        put_u16(&mut bytes, 18, EM_386);
+        put_u32(&mut bytes, 20, EV_CURRENT);
+        put_u32(&mut bytes, 24, 0x1000);
+        put_u32(&mut bytes, 28, PHOFF as u32);
+        put_u16(&mut bytes, 40, PHOFF as u16);
+        put_u16(&mut bytes, 42, 32);
+        put_u16(&mut bytes, 44, 2);
+
+        // Program header of the note segment.
+        put_u32(&mut bytes, PHOFF, PT_NOTE);
+        put_u32(&mut bytes, PHOFF + 4, NOTE_OFFSET as u32);
+        put_u32(&mut bytes, PHOFF + 16, 20);
+
+        // Program header of the loadable segment.
+        let phdr: usize = PHOFF + 32;
+        put_u32(&mut bytes, phdr, PT_LOAD);
+        put_u32(&mut bytes, phdr + 4, LOAD_OFFSET as u32);
+        put_u32(&mut bytes, phdr + 8, 0x1000);
+        put_u32(&mut bytes, phdr + 16, LOAD_SIZE as u32);
+        put_u32(&mut bytes, phdr + 20, 0x100);
+
+        // PVH note.
+        put_u32(&mut bytes, NOTE_OFFSET, XEN_NOTE_NAME.len() as u32);
+        put_u32(&mut bytes, NOTE_OFFSET + 4, 4);
+        put_u32(&mut bytes, NOTE_OFFSET + 8, XEN_ELFNOTE_PHYS32_ENTRY);
+        bytes[NOTE_OFFSET + 12..NOTE_OFFSET + 16].copy_from_slice(XEN_NOTE_NAME);
+        put_u32(&mut bytes, NOTE_OFFSET + 16, PHYS32_ENTRY);
+
+        bytes
+    }
+
+    /// Parses an image, with enough memory to hold it.
+    fn parse_image(bytes: &[u8]) -> Result<(Program, Vec<Segment>)> {
+        unsafe { parse(bytes.as_ptr(), bytes.len(), 1 << 20) }
+    }
+
+    /// Asserts that parsing an image fails with a given reason.
+    fn assert_rejected(bytes: &[u8], reason: &str) {
+        match parse_image(bytes) {
+            Ok(_) => panic!("image was not rejected (reason={})", reason),
+            Err(error) => assert_eq!(error.to_string(), reason),
         }
     }
 
-    let size: usize = last_address - first_address;
+    #[test]
+    fn parses_pvh_note() {
+        let (program, segments): (Program, Vec<Segment>) = parse_image(&image()).unwrap();
+        assert_eq!(program.phys32_entry, Some(PHYS32_ENTRY as usize));
+        assert_eq!(program.first_address, 0x1000);
+        assert_eq!(segments.len(), 1);
+        assert_eq!(segments[0].offset, LOAD_OFFSET);
+        assert_eq!(segments[0].file_size, LOAD_SIZE);
+    }
+
+    #[test]
+    fn skips_notes_that_overrun_their_segment() {
+        let mut bytes: Vec<u8> = image();
+        put_u32(&mut bytes, NOTE_OFFSET + 4, 8);
+        let (program, _): (Program, Vec<Segment>) = parse_image(&bytes).unwrap();
+        assert_eq!(program.phys32_entry, None);
+    }
+
+    #[test]
+    fn rejects_truncated_header() {
+        assert_rejected(&image()[..EI_NIDENT - 1], "file is truncated");
+        assert_rejected(&image()[..PHOFF - 1], "file is truncated");
+    }
+
+    #[test]
+    fn rejects_program_headers_past_file() {
+        let mut bytes: Vec<u8> = image();
+        put_u16(&mut bytes, 44, u16::MAX);
+        assert_rejected(&bytes, "program header table does not lie in file");
 
-    Ok((entry, first_address, size))
+        let mut bytes: Vec<u8> = image();
+        put_u32(&mut bytes, 28, u32::MAX);
+        assert_rejected(&bytes, "program header table does not lie in file");
+
+        let mut bytes: Vec<u8> = image();
+        put_u16(&mut bytes, 42, 16);
+        assert_rejected(&bytes, "program header table does not lie in file");
+    }
+
+    #[test]
+    fn rejects_note_segment_past_file() {
+        let mut bytes: Vec<u8> = image();
+        put_u32(&mut bytes, PHOFF + 16, u32::MAX);
+        assert_rejected(&bytes, "note segment does not lie in file");
+
+        let mut bytes: Vec<u8> = image();
+        put_u32(&mut bytes, PHOFF + 4, u32::MAX);
+        assert_rejected(&bytes, "note segment does not lie in file");
+    }
+
+    #[test]
+    fn rejects_loadable_segment_past_file() {
+        let bytes: Vec<u8> = image();
+        assert_rejected(&bytes[..bytes.len() - 1], "segment does not lie in file");
+    }
 }
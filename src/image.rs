@@ -0,0 +1,380 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Kernel Image Cache
+//!
+//! This module keeps kernels that were parsed, so that launching a known kernel again skips
+//! mapping, validating and walking its ELF file. A kernel image holds the program, its loadable
+//! segments and their contents, ready to be copied into guest memory. Kernels that are compressed
+//! are decompressed once, when they are parsed.
+//!
+//! The cache is shared by all MicroVMs of the process, thus a daemon, the workers of a batch and
+//! reboots of a MicroVM all hit it. Kernels are identified by the device and inode of their file,
+//! and an entry is discarded when the size or the modification time of the file changes.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    compression,
+    config,
+    elf::{
+        self,
+        Program,
+        Segment,
+    },
+    pal::FileMapping,
+};
+use ::anyhow::Result;
+use ::std::{
+    collections::HashMap,
+    fs::{
+        self,
+        Metadata,
+    },
+    os::unix::fs::MetadataExt,
+    sync::{
+        Arc,
+        Mutex,
+        MutexGuard,
+        OnceLock,
+    },
+    time::SystemTime,
+};
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/// Kernel images, shared by all MicroVMs of the process.
+static CACHE: OnceLock<Mutex<Cache>> = OnceLock::new();
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// A kernel that was parsed.
+///
+pub struct KernelImage {
+    /// Program.
+    program: Program,
+    /// Loadable segments. Their offsets refer to `contents`.
+    segments: Vec<Segment>,
+    /// Contents of the loadable segments, one after the other.
+    contents: Vec<u8>,
+}
+
+///
+/// # Description
+///
+/// Identity of a kernel file.
+///
+#[derive(Clone, Copy, PartialEq, Eq, Hash)]
+struct FileId {
+    /// Device that holds the file.
+    dev: u64,
+    /// Inode of the file.
+    ino: u64,
+}
+
+///
+/// # Description
+///
+/// An entry of the cache.
+///
+struct Entry {
+    /// Size of the file when it was parsed.
+    len: u64,
+    /// Modification time of the file when it was parsed.
+    modified: SystemTime,
+    /// Last time the entry was used, in lookups of the cache.
+    last_used: u64,
+    /// Kernel image.
+    image: Arc<KernelImage>,
+}
+
+///
+/// # Description
+///
+/// Cache of kernel images.
+///
+#[derive(Default)]
+struct Cache {
+    /// Entries of the cache.
+    entries: HashMap<FileId, Entry>,
+    /// Number of lookups of the cache.
+    clock: u64,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl KernelImage {
+    ///
+    /// # Description
+    ///
+    /// Looks up a kernel in the cache, parsing it if it is not there or if its file changed.
+    ///
+    /// # Parameters
+    ///
+    /// - `kernel_filename`: Path to the kernel binary.
+    /// - `max_size`: Maximum size of the kernel binary once decompressed.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns the kernel image. Otherwise, it returns
+    /// an error.
+    ///
+    pub fn get(kernel_filename: &str, max_size: usize) -> Result<Arc<KernelImage>> {
+        crate::timer!("image_get");
+
+        let metadata: Metadata = match fs::metadata(kernel_filename) {
+            Ok(metadata) => metadata,
+            Err(e) => {
+                let reason: String =
+                    format!("failed to stat kernel (path={}, error={:?})", kernel_filename, e);
+                error!("get(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+        let id: FileId = FileId {
+            dev: metadata.dev(),
+            ino: metadata.ino(),
+        };
+        let modified: SystemTime = metadata.modified()?;
+
+        let cache: &Mutex<Cache> = CACHE.get_or_init(|| Mutex::new(Cache::default()));
+
+        {
+            let mut cache: MutexGuard<Cache> = cache.lock().unwrap();
+            cache.clock += 1;
+            let clock: u64 = cache.clock;
+            if let Some(entry) = cache.entries.get_mut(&id) {
+                if entry.len == metadata.len() && entry.modified == modified {
+                    trace!("get(): hit (path={})", kernel_filename);
+                    entry.last_used = clock;
+                    return Ok(entry.image.clone());
+                }
+            }
+        }
+
+        // Parse the kernel without holding the lock, so that lookups of other kernels proceed.
+        trace!("get(): miss (path={})", kernel_filename);
+        let image: Arc<KernelImage> = Arc::new(Self::parse(kernel_filename, max_size)?);
+
+        let mut cache: MutexGuard<Cache> = cache.lock().unwrap();
+        let clock: u64 = cache.clock;
+        if !cache.entries.contains_key(&id) && cache.entries.len() >= config::KERNEL_CACHE_SIZE {
+            cache.evict();
+        }
+        cache.entries.insert(
+            id,
+            Entry {
+                len: metadata.len(),
+                modified,
+                last_used: clock,
+                image: image.clone(),
+            },
+        );
+
+        Ok(image)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the program of the kernel.
+    ///
+    pub fn program(&self) -> Program {
+        self.program
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns an iterator over the loadable segments of the kernel, as pairs of an address in
+    /// memory and the contents to copy there. The remainder of a segment in memory is not part of
+    /// its contents, and should be zero.
+    ///
+    pub fn segments(&self) -> impl Iterator<Item = (usize, &[u8])> {
+        self.segments.iter().map(|segment| {
+            (segment.address, &self.contents[segment.offset..segment.offset + segment.file_size])
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Parses a kernel.
+    ///
+    /// # Parameters
+    ///
+    /// - `kernel_filename`: Path to the kernel binary.
+    /// - `max_size`: Maximum size of the kernel binary once decompressed.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns the kernel image. Otherwise, it returns
+    /// an error.
+    ///
+    fn parse(kernel_filename: &str, max_size: usize) -> Result<Self> {
+        crate::timer!("image_parse");
+
+        let file: FileMapping = FileMapping::mmap(kernel_filename)?;
+        let source: &[u8] = unsafe { ::std::slice::from_raw_parts(file.ptr(), file.size()) };
+
+        // Compressed kernels are decompressed once.
+        let decompressed: Option<Vec<u8>> = if compression::is_compressed(source) {
+            Some(compression::decompress_to_vec(source, max_size)?)
+        } else {
+            None
+        };
+        let bytes: &[u8] = decompressed.as_deref().unwrap_or(source);
+
+        // Segments are checked against the file here, and against the memory of a MicroVM when
+        // they are loaded.
+        let (program, mut segments): (Program, Vec<Segment>) =
+            unsafe { elf::parse(bytes.as_ptr(), bytes.len(), usize::MAX)? };
+
+        let mut contents: Vec<u8> =
+            Vec::with_capacity(segments.iter().map(|segment| segment.file_size).sum());
+        for segment in segments.iter_mut() {
+            let data: &[u8] = &bytes[segment.offset..segment.offset + segment.file_size];
+            segment.offset = contents.len();
+            contents.extend_from_slice(data);
+        }
+
+        Ok(Self {
+            program,
+            segments,
+            contents,
+        })
+    }
+}
+
+impl Cache {
+    ///
+    /// # Description
+    ///
+    /// Evicts the entry that was used least recently.
+    ///
+    fn evict(&mut self) {
+        if let Some(id) = self
+            .entries
+            .iter()
+            .min_by_key(|(_, entry)| entry.last_used)
+            .map(|(id, _)| *id)
+        {
+            self.entries.remove(&id);
+        }
+    }
+}
+
+//==================================================================================================
+// Unit Tests
+//==================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::elf::tests::image;
+    use ::std::path::PathBuf;
+
+    ///
+    /// # Description
+    ///
+    /// A kernel file that is removed when it goes out of scope.
+    ///
+    struct KernelFile {
+        /// Path to the file.
+        path: PathBuf,
+    }
+
+    impl KernelFile {
+        /// Writes a kernel file with a name that is unique to the calling test.
+        fn new(name: &str, contents: &[u8]) -> Self {
+            let path: PathBuf = ::std::env::temp_dir().join(format!(
+                "microvm-image-{}-{}.elf",
+                ::std::process::id(),
+                name
+            ));
+            fs::write(&path, contents).unwrap();
+            Self { path }
+        }
+
+        /// Returns the path to the file.
+        fn path(&self) -> &str {
+            self.path.to_str().unwrap()
+        }
+    }
+
+    impl Drop for KernelFile {
+        fn drop(&mut self) {
+            let _ = fs::remove_file(&self.path);
+        }
+    }
+
+    #[test]
+    fn hits_unchanged_kernel() {
+        let file: KernelFile = KernelFile::new("hit", &image());
+        let first: Arc<KernelImage> = KernelImage::get(file.path(), usize::MAX).unwrap();
+        let second: Arc<KernelImage> = KernelImage::get(file.path(), usize::MAX).unwrap();
+        assert!(Arc::ptr_eq(&first, &second));
+    }
+
+    #[test]
+    fn invalidates_changed_kernel() {
+        let file: KernelFile = KernelFile::new("changed", &image());
+        let first: Arc<KernelImage> = KernelImage::get(file.path(), usize::MAX).unwrap();
+
+        // Trailing bytes change the size of the file, but not its segments.
+        let mut contents: Vec<u8> = image();
+        contents.extend_from_slice(&[0; 8]);
+        fs::write(file.path(), &contents).unwrap();
+
+        let second: Arc<KernelImage> = KernelImage::get(file.path(), usize::MAX).unwrap();
+        assert!(!Arc::ptr_eq(&first, &second));
+        assert_eq!(
+            first.segments().collect::<Vec<(usize, &[u8])>>(),
+            second.segments().collect::<Vec<(usize, &[u8])>>()
+        );
+    }
+
+    #[test]
+    fn does_not_cache_invalid_kernel() {
+        let file: KernelFile = KernelFile::new("invalid", &image()[..100]);
+        assert!(KernelImage::get(file.path(), usize::MAX).is_err());
+
+        fs::write(file.path(), image()).unwrap();
+        assert!(KernelImage::get(file.path(), usize::MAX).is_ok());
+    }
+
+    #[test]
+    fn evicts_least_recently_used_entry() {
+        let file: KernelFile = KernelFile::new("evict", &image());
+        let image: Arc<KernelImage> =
+            Arc::new(KernelImage::parse(file.path(), usize::MAX).unwrap());
+
+        let mut cache: Cache = Cache::default();
+        for (ino, last_used) in [(1, 2), (2, 1), (3, 3)] {
+            let entry: Entry = Entry {
+                len: 0,
+                modified: SystemTime::UNIX_EPOCH,
+                last_used,
+                image: image.clone(),
+            };
+            cache.entries.insert(FileId { dev: 0, ino }, entry);
+        }
+
+        cache.evict();
+        assert!(!cache.entries.contains_key(&FileId { dev: 0, ino: 2 }));
+        assert_eq!(cache.entries.len(), 2);
+    }
+}
@@ -1,13 +1,30 @@
 // Copyright(c) The Maintainers of Nanvix.
 // Licensed under the MIT License.
 
+//!
+//! # I/O Reactor
+//!
+//! This module forwards messages between virtual machines and their gateways. A single reactor
+//! thread serves any number of virtual machines: it waits on the connections of all of them at
+//! once, and on an event that virtual machines signal when they queue a message. Connections are
+//! non-blocking, and messages that a gateway is not ready to receive are buffered per connection,
+//! thus a slow gateway does not stall other virtual machines. The thread is only spawned once a
+//! virtual machine that has a gateway or records its messages is registered.
+//!
+
 //==================================================================================================
 // Imports
 //==================================================================================================
 
+use crate::recording::{
+    Direction,
+    Recorder,
+};
 use ::anyhow::Result;
 use ::std::{
     io::{
+        self,
+        ErrorKind,
         Read,
         Write,
     },
@@ -16,213 +33,569 @@ use ::std::{
         SocketAddr,
         TcpStream,
     },
-    sync::mpsc::{
-        Receiver,
-        Sender,
-        TryRecvError,
+    os::fd::{
+        AsRawFd,
+        FromRawFd,
+        OwnedFd,
+        RawFd,
     },
-    thread::{
-        self,
-        JoinHandle,
+    sync::{
+        mpsc::{
+            self,
+            Receiver,
+            Sender,
+            TryRecvError,
+        },
+        Arc,
+        OnceLock,
     },
-    time::Duration,
+    thread,
 };
 use ::sys::ipc::Message;
 
 //==================================================================================================
-// Structure
+// Constants
+//==================================================================================================
+
+/// Size of a message on the wire.
+const MESSAGE_SIZE: usize = mem::size_of::<Message>();
+
+//==================================================================================================
+// Structures
 //==================================================================================================
 
 ///
 /// # Description
 ///
-/// Private data of the I/O thread.
+/// Handle to an I/O reactor. Handles may be cloned and shared by several virtual machines. The
+/// reactor thread is spawned on first use, and it exits once all handles are dropped and all
+/// virtual machines are gone.
+///
+#[derive(Clone, Default)]
+pub struct IoReactor {
+    /// Reactor thread, once it is spawned.
+    thread: Arc<OnceLock<ReactorThread>>,
+}
+
+///
+/// # Description
+///
+/// Channels to a running reactor thread.
+///
+struct ReactorThread {
+    /// Channel for registering endpoints.
+    endpoints: Sender<IoEndpoint>,
+    /// Event that wakes up the reactor thread.
+    waker: Arc<Waker>,
+}
+
+///
+/// # Description
+///
+/// Channel through which a virtual machine sends messages to its gateway.
+///
+pub struct Outbox {
+    /// Channel to the reactor thread, if the virtual machine is registered in it.
+    tx: Option<Sender<Message>>,
+    /// Event that wakes up the reactor thread, if the virtual machine is registered in it.
+    waker: Option<Arc<Waker>>,
+    /// Sender of inbound messages of a virtual machine that is not registered in the reactor
+    /// thread, which keeps its inbox open.
+    _inbound: Option<Sender<Message>>,
+}
+
+///
+/// # Description
+///
+/// An event that wakes up the reactor thread when it waits for I/O.
+///
+struct Waker {
+    /// Underlying event file descriptor.
+    fd: OwnedFd,
+}
+
+///
+/// # Description
+///
+/// Connection between a virtual machine and its gateway.
 ///
-pub struct IoThread {
+struct IoEndpoint {
     /// Connection to the gateway.
     conn: Option<TcpStream>,
     /// Gateway receiver.
     gateway_rx: Receiver<Message>,
     /// Gateway sender.
     gateway_tx: Sender<Message>,
+    /// If present, recorder of exchanged messages.
+    recorder: Option<Recorder>,
+    /// Messages that are waiting for the connection to become writable.
+    outbound: Vec<u8>,
+    /// Partially received message.
+    partial: [u8; MESSAGE_SIZE],
+    /// Number of bytes of the partially received message.
+    partial_len: usize,
 }
 
 //==================================================================================================
 // Implementations
 //==================================================================================================
 
-impl IoThread {
+impl IoReactor {
     ///
     /// # Description
     ///
-    /// Spawns a new I/O thread.
+    /// Creates a handle to an I/O reactor. No thread is spawned until it is needed.
+    ///
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Registers a virtual machine in the I/O reactor.
     ///
     /// # Parameters
     ///
     /// - `gateway_addr`: Gateway address.
-    /// - `gateway_rx`:   Gateway receiver.
-    /// - `gateway_tx`:   Gateway sender.
-    /// - `read_timeout`: Read timeout.
+    /// - `record`:       If present, path to a file where exchanged messages are recorded.
     ///
     /// # Returns
     ///
-    /// A handle to the I/O thread.
+    /// Upon success, the channels through which the virtual machine sends messages to its gateway
+    /// and receives messages from it are returned. Otherwise, an error is returned.
+    ///
+    /// # Notes
     ///
-    pub fn spawn(
+    /// The connection to the gateway is established before this function returns, so that no
+    /// message sent by the guest is dropped while the I/O reactor is still connecting. Virtual
+    /// machines that have no gateway and do not record messages are not registered in the reactor
+    /// thread, and the messages that they send are dropped.
+    ///
+    pub fn register(
+        &self,
         gateway_addr: Option<SocketAddr>,
-        gateway_rx: Receiver<Message>,
-        gateway_tx: Sender<Message>,
-        read_timeout: Duration,
-    ) -> JoinHandle<Result<()>> {
-        thread::spawn(move || {
-            let mut io_thread: IoThread =
-                IoThread::new(gateway_addr, gateway_rx, gateway_tx, read_timeout)?;
-            io_thread.run()?;
-            Ok(())
+        record: Option<String>,
+    ) -> Result<(Outbox, Receiver<Message>)> {
+        let (vm_tx, gateway_rx) = mpsc::channel::<Message>();
+        let (gateway_tx, vm_rx) = mpsc::channel::<Message>();
+
+        if gateway_addr.is_none() && record.is_none() {
+            let outbox: Outbox = Outbox {
+                tx: None,
+                waker: None,
+                _inbound: Some(gateway_tx),
+            };
+            return Ok((outbox, vm_rx));
+        }
+
+        let endpoint: IoEndpoint = IoEndpoint::new(gateway_addr, gateway_rx, gateway_tx, record)?;
+        let thread: &ReactorThread = self.thread()?;
+        if thread.endpoints.send(endpoint).is_err() {
+            let reason: String = "i/o reactor has stopped".to_string();
+            error!("register(): {}", reason);
+            anyhow::bail!(reason);
+        }
+        thread.waker.wake();
+
+        let outbox: Outbox = Outbox {
+            tx: Some(vm_tx),
+            waker: Some(thread.waker.clone()),
+            _inbound: None,
+        };
+        Ok((outbox, vm_rx))
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the reactor thread, and spawns it if it is not running yet.
+    ///
+    fn thread(&self) -> Result<&ReactorThread> {
+        if let Some(thread) = self.thread.get() {
+            return Ok(thread);
+        }
+
+        let waker: Arc<Waker> = Arc::new(Waker::new()?);
+        let (endpoints, new_endpoints) = mpsc::channel::<IoEndpoint>();
+        let thread_waker: Arc<Waker> = waker.clone();
+        thread::Builder::new()
+            .name("io-reactor".to_string())
+            .spawn(move || Self::run(new_endpoints, &thread_waker))?;
+
+        // If another thread won the race, its reactor thread is used, and this one exits once it
+        // sees that its channel is closed.
+        Ok(self
+            .thread
+            .get_or_init(|| ReactorThread { endpoints, waker }))
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Runs the I/O reactor.
+    ///
+    /// # Parameters
+    ///
+    /// - `new_endpoints`: Channel for registering endpoints.
+    /// - `waker`:         Event that wakes up the reactor.
+    ///
+    fn run(new_endpoints: Receiver<IoEndpoint>, waker: &Waker) {
+        #[cfg(target_os = "linux")]
+        if let Err(e) = crate::cgroup::join(crate::cgroup::ThreadGroup::Io) {
+            warn!("run(): failed to join control group (error={:?})", e);
+        }
+
+        let mut endpoints: Vec<IoEndpoint> = Vec::new();
+        let mut fds: Vec<libc::pollfd> = Vec::new();
+
+        loop {
+            // Register new endpoints. Block if there is nothing else to do.
+            if endpoints.is_empty() {
+                match new_endpoints.recv() {
+                    Ok(endpoint) => endpoints.push(endpoint),
+                    Err(_) => return,
+                }
+            }
+            while let Ok(endpoint) = new_endpoints.try_recv() {
+                endpoints.push(endpoint);
+            }
+
+            // Forward outbound messages.
+            endpoints.retain_mut(|endpoint| endpoint.send().unwrap_or(false));
+
+            // Wait for inbound messages, for connections to become writable, or to be woken up.
+            fds.clear();
+            fds.push(libc::pollfd {
+                fd: waker.fd.as_raw_fd(),
+                events: libc::POLLIN,
+                revents: 0,
+            });
+            fds.extend(endpoints.iter().map(|endpoint| libc::pollfd {
+                // Negative descriptors are ignored.
+                fd: endpoint.conn.as_ref().map_or(-1, |conn| conn.as_raw_fd()),
+                events: if endpoint.outbound.is_empty() {
+                    libc::POLLIN
+                } else {
+                    libc::POLLIN | libc::POLLOUT
+                },
+                revents: 0,
+            }));
+            let ret: libc::c_int =
+                unsafe { libc::poll(fds.as_mut_ptr(), fds.len() as libc::nfds_t, -1) };
+            if ret <= 0 {
+                continue;
+            }
+            if fds[0].revents != 0 {
+                waker.clear();
+            }
+
+            // Forward inbound messages, and flush buffered outbound messages.
+            let mut ready: std::slice::Iter<libc::pollfd> = fds[1..].iter();
+            endpoints.retain_mut(|endpoint| match ready.next() {
+                Some(fd) if fd.revents != 0 => {
+                    let writable: bool = fd.revents & libc::POLLOUT != 0;
+                    let readable: bool = fd.revents & !libc::POLLOUT != 0;
+                    (!writable || endpoint.flush().is_ok())
+                        && (!readable || endpoint.receive().unwrap_or(false))
+                },
+                _ => true,
+            });
+        }
+    }
+}
+
+impl Outbox {
+    ///
+    /// # Description
+    ///
+    /// Queues a message for the gateway, and wakes up the reactor thread to forward it.
+    ///
+    /// # Parameters
+    ///
+    /// - `message`: Message to send.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, empty is returned. Otherwise, an error is returned.
+    ///
+    pub fn send(&self, message: Message) -> Result<()> {
+        match (&self.tx, &self.waker) {
+            (Some(tx), Some(waker)) => {
+                if tx.send(message).is_err() {
+                    let reason: String = "i/o reactor has stopped".to_string();
+                    error!("send(): {}", reason);
+                    anyhow::bail!(reason);
+                }
+                waker.wake();
+            },
+            _ => {
+                warn!("send(): the microvm is not connected to a gateway");
+            },
+        }
+
+        Ok(())
+    }
+}
+
+impl Drop for Outbox {
+    fn drop(&mut self) {
+        // Close the channel before waking up the reactor thread, so that it sees the virtual
+        // machine is gone and drops its endpoint.
+        drop(self.tx.take());
+        if let Some(waker) = &self.waker {
+            waker.wake();
+        }
+    }
+}
+
+impl Waker {
+    ///
+    /// # Description
+    ///
+    /// Creates a new event.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, the new event is returned. Otherwise, an error is returned.
+    ///
+    fn new() -> Result<Self> {
+        let fd: RawFd = unsafe { libc::eventfd(0, libc::EFD_NONBLOCK | libc::EFD_CLOEXEC) };
+        if fd < 0 {
+            let reason: String =
+                format!("failed to create event (error={:?})", io::Error::last_os_error());
+            error!("new(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        Ok(Self {
+            fd: unsafe { OwnedFd::from_raw_fd(fd) },
         })
     }
 
     ///
     /// # Description
     ///
-    /// Creates a new I/O thread.
+    /// Signals the event. If the counter of the event is saturated, the event is already
+    /// signaled, thus failures are ignored.
+    ///
+    fn wake(&self) {
+        let value: u64 = 1;
+        unsafe {
+            libc::write(
+                self.fd.as_raw_fd(),
+                &value as *const u64 as *const libc::c_void,
+                mem::size_of::<u64>(),
+            )
+        };
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Clears the event.
+    ///
+    fn clear(&self) {
+        let mut value: u64 = 0;
+        unsafe {
+            libc::read(
+                self.fd.as_raw_fd(),
+                &mut value as *mut u64 as *mut libc::c_void,
+                mem::size_of::<u64>(),
+            )
+        };
+    }
+}
+
+impl IoEndpoint {
+    ///
+    /// # Description
+    ///
+    /// Creates a new endpoint.
     ///
     /// # Parameters
     ///
     /// - `gateway_addr`: Gateway address.
     /// - `gateway_rx`:   Gateway receiver.
     /// - `gateway_tx`:   Gateway sender.
-    /// - `read_timeout`: Read timeout.
+    /// - `record`:       If present, path to a file where exchanged messages are recorded.
     ///
     /// # Returns
     ///
-    /// Upon success, a new I/O thread is returned. Otherwise, an error is returned.
+    /// Upon success, a new endpoint is returned. Otherwise, an error is returned.
     ///
     fn new(
         gateway_addr: Option<SocketAddr>,
         gateway_rx: Receiver<Message>,
         gateway_tx: Sender<Message>,
-        read_timeout: Duration,
+        record: Option<String>,
     ) -> Result<Self> {
         let conn: Option<TcpStream> = match gateway_addr {
-            Some(addr) => match TcpStream::connect(addr) {
-                Ok(conn) => {
-                    conn.set_read_timeout(Some(read_timeout))?;
-                    Some(conn)
-                },
+            Some(addr) => match TcpStream::connect(addr).and_then(|conn| {
+                conn.set_nonblocking(true)?;
+                Ok(conn)
+            }) {
+                Ok(conn) => Some(conn),
                 Err(e) => {
                     let reason: String = format!("failed to connect to gateway (error={:?})", e);
-                    error!("io_thread(): {}", reason);
+                    error!("new(): {}", reason);
                     anyhow::bail!(reason)
                 },
             },
             None => None,
         };
 
+        let recorder: Option<Recorder> = match record {
+            Some(filename) => Some(Recorder::create(&filename)?),
+            None => None,
+        };
+
         Ok(Self {
             conn,
             gateway_rx,
             gateway_tx,
+            recorder,
+            outbound: Vec::new(),
+            partial: [0; MESSAGE_SIZE],
+            partial_len: 0,
         })
     }
 
     ///
     /// # Description
     ///
-    /// Runs the I/O thread.
+    /// Queues pending messages for the gateway, and sends as many of them as the connection
+    /// accepts without blocking.
     ///
     /// # Returns
     ///
-    /// Upon success, empty is returned. Otherwise, an error is returned instead.
+    /// Upon success, this method returns `true` if the virtual machine is still alive and `false`
+    /// otherwise. If the messages could not be sent, an error is returned instead.
     ///
-    fn run(&mut self) -> Result<()> {
+    fn send(&mut self) -> Result<bool> {
         loop {
-            self.send()?;
-            self.receive()?;
+            match self.gateway_rx.try_recv() {
+                Ok(msg) => {
+                    let bytes: [u8; MESSAGE_SIZE] = msg.to_bytes();
+
+                    if let Some(ref mut recorder) = self.recorder {
+                        recorder.record(Direction::Outbound, &bytes)?;
+                    }
+
+                    match self.conn {
+                        Some(_) => self.outbound.extend_from_slice(&bytes),
+                        None => {
+                            warn!("send(): the microvm is not connected to a gateway");
+                        },
+                    }
+                },
+                Err(TryRecvError::Empty) => {
+                    // No message available.
+                    self.flush()?;
+                    return Ok(true);
+                },
+                Err(TryRecvError::Disconnected) => {
+                    trace!("send(): the microvm has disconnected");
+                    return Ok(false);
+                },
+            }
         }
     }
 
     ///
     /// # Description
     ///
-    /// Attempts to send pending messages to the gateway.
+    /// Sends buffered messages to the gateway, as long as the connection accepts them without
+    /// blocking.
     ///
     /// # Returns
     ///
-    /// Upon success, empty is returned. Otherwise, an error is returned instead.
-    ///
-    /// # Errors
-    ///
-    /// If the message could not be sent, an error is returned.
+    /// Upon success, empty is returned. If the messages could not be sent, an error is returned
+    /// instead.
     ///
-    fn send(&mut self) -> Result<()> {
-        match self.gateway_rx.try_recv() {
-            Ok(msg) => {
-                let bytes: [u8; mem::size_of::<Message>()] = msg.to_bytes();
+    fn flush(&mut self) -> Result<()> {
+        let conn: &mut TcpStream = match self.conn {
+            Some(ref mut conn) => conn,
+            None => return Ok(()),
+        };
 
-                match self.conn {
-                    Some(ref mut conn) => conn.write_all(&bytes)?,
-                    None => {
-                        warn!("send(): the microvm is not connected to a gateway");
-                    },
-                }
-            },
-            Err(TryRecvError::Empty) => {
-                // No message available.
-            },
-            Err(TryRecvError::Disconnected) => {
-                let reason: String = "the microvm has disconnected".to_string();
-                error!("send(): {}", reason);
-                anyhow::bail!(reason);
-            },
+        let mut sent: usize = 0;
+        while sent < self.outbound.len() {
+            match conn.write(&self.outbound[sent..]) {
+                Ok(n) => sent += n,
+                Err(e) if e.kind() == ErrorKind::Interrupted => {},
+                Err(e) if e.kind() == ErrorKind::WouldBlock => break,
+                Err(e) => {
+                    let reason: String = format!("failed to send message (error={:?})", e);
+                    error!("flush(): {}", reason);
+                    anyhow::bail!(reason);
+                },
+            }
         }
+        self.outbound.drain(..sent);
+
         Ok(())
     }
 
     ///
     /// # Description
     ///
-    /// Attempts to receive messages from the gateway.
+    /// Receives available bytes from the gateway and forwards complete messages to the virtual
+    /// machine. This method should only be called when the connection is readable.
     ///
     /// # Returns
     ///
-    /// Upon success, empty is returned. Otherwise, an error is returned instead.
-    ///
-    fn receive(&mut self) -> Result<()> {
-        if let Some(ref mut conn) = self.conn {
-            let mut bytes: [u8; mem::size_of::<Message>()] = [0; mem::size_of::<Message>()];
-            match conn.read_exact(&mut bytes) {
-                Ok(()) => {
-                    let message: Message = match Message::try_from_bytes(bytes) {
-                        Ok(message) => message,
-                        Err(err) => {
-                            let reason: String =
-                                format!("failed to parse message (error={:?})", err);
-                            warn!("receive(): {}", reason);
-                            return Ok(());
-                        },
-                    };
+    /// Upon success, this method returns `true` if the virtual machine is still alive and `false`
+    /// otherwise. If the gateway has disconnected, an error is returned instead.
+    ///
+    fn receive(&mut self) -> Result<bool> {
+        let conn: &mut TcpStream = match self.conn {
+            Some(ref mut conn) => conn,
+            None => return Ok(true),
+        };
 
-                    if let Err(e) = self.gateway_tx.send(message) {
-                        let reason: String =
-                            format!("failed to send message to the microvm (error={:?})", e);
-                        error!("receive(): {}", reason);
-                        anyhow::bail!(reason);
-                    }
-                },
-                Err(e) => match e.kind() {
-                    std::io::ErrorKind::WouldBlock => {
-                        return Ok(());
-                    },
-                    _ => {
-                        let reason: String =
-                            format!("failed to receive message from the gateway (error={:?})", e);
-                        error!("receive(): {}", reason);
-                        anyhow::bail!(reason);
-                    },
-                },
-            }
+        match conn.read(&mut self.partial[self.partial_len..]) {
+            Ok(0) => {
+                let reason: String = "the gateway has disconnected".to_string();
+                error!("receive(): {}", reason);
+                anyhow::bail!(reason);
+            },
+            Ok(n) => self.partial_len += n,
+            Err(e) if matches!(e.kind(), ErrorKind::WouldBlock | ErrorKind::Interrupted) => {
+                return Ok(true);
+            },
+            Err(e) => {
+                let reason: String =
+                    format!("failed to receive message from the gateway (error={:?})", e);
+                error!("receive(): {}", reason);
+                anyhow::bail!(reason);
+            },
         }
-        Ok(())
+
+        // Wait for the rest of the message.
+        if self.partial_len < MESSAGE_SIZE {
+            return Ok(true);
+        }
+        self.partial_len = 0;
+
+        if let Some(ref mut recorder) = self.recorder {
+            recorder.record(Direction::Inbound, &self.partial)?;
+        }
+
+        let message: Message = match Message::try_from_bytes(self.partial) {
+            Ok(message) => message,
+            Err(err) => {
+                let reason: String = format!("failed to parse message (error={:?})", err);
+                warn!("receive(): {}", reason);
+                return Ok(true);
+            },
+        };
+
+        if self.gateway_tx.send(message).is_err() {
+            trace!("receive(): the microvm has disconnected");
+            return Ok(false);
+        }
+
+        Ok(true)
     }
 }
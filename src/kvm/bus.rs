@@ -0,0 +1,663 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # I/O Bus
+//!
+//! This module dispatches port-mapped and memory-mapped I/O accesses of the guest to emulated
+//! devices. Devices implement the [`Device`] trait, and they are attached to ranges of I/O ports
+//! and to ranges of guest physical addresses. Ports are dispatched through a table that maps each
+//! port to its device, and addresses through a binary search over sorted ranges, thus no access
+//! allocates memory.
+//!
+//! Accesses that no device handles are errors, which stop the virtual machine.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::anyhow::Result;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Number of I/O ports.
+const NUM_PORTS: usize = 1 << 16;
+
+/// Maximum number of devices on a bus. Zero marks ports that no device handles.
+const MAX_DEVICES: usize = u8::MAX as usize;
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Outcomes of an emulated I/O access.
+///
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum IoOutcome {
+    /// The virtual processor should be resumed.
+    Resume,
+    /// The virtual processor polled for input that is not available yet. It may be resumed, but
+    /// it will not make progress until input arrives.
+    Blocked,
+    /// The virtual processor should be powered off, with an exit status written by the guest.
+    Poweroff(u32),
+    /// The guest waits for a function invocation, in the buffer at the given address.
+    Function(u32),
+}
+
+///
+/// # Description
+///
+/// An emulated device. Handlers are given the port or the guest physical address that was
+/// accessed, and the data of the access in little endian. Handlers that a device does not
+/// implement fail the access.
+///
+pub trait Device {
+    ///
+    /// # Description
+    ///
+    /// Handles a read from an I/O port of the device.
+    ///
+    fn pio_read(&mut self, port: u16, data: &mut [u8]) -> Result<IoOutcome> {
+        let reason: String = format!("read from unsupported port i/o (port={:#06x})", port);
+        error!("pio_read(): {} (size={})", reason, data.len());
+        anyhow::bail!(reason);
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Handles a write to an I/O port of the device.
+    ///
+    fn pio_write(&mut self, port: u16, data: &[u8]) -> Result<IoOutcome> {
+        let reason: String = format!("write to unsupported port i/o (port={:#06x})", port);
+        error!("pio_write(): {} (size={})", reason, data.len());
+        anyhow::bail!(reason);
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Handles a read from memory-mapped registers of the device.
+    ///
+    fn mmio_read(&mut self, addr: u64, data: &mut [u8]) -> Result<IoOutcome> {
+        let reason: String =
+            format!("read from unsupported memory-mapped i/o (addr={:#010x})", addr);
+        error!("mmio_read(): {} (size={})", reason, data.len());
+        anyhow::bail!(reason);
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Handles a write to memory-mapped registers of the device.
+    ///
+    fn mmio_write(&mut self, addr: u64, data: &[u8]) -> Result<IoOutcome> {
+        let reason: String =
+            format!("write to unsupported memory-mapped i/o (addr={:#010x})", addr);
+        error!("mmio_write(): {} (size={})", reason, data.len());
+        anyhow::bail!(reason);
+    }
+}
+
+///
+/// # Description
+///
+/// A range of guest physical addresses that is handled by a device.
+///
+struct MmioRange {
+    /// First address.
+    base: u64,
+    /// Address past the last one.
+    end: u64,
+    /// Index of the device.
+    device: usize,
+}
+
+///
+/// # Description
+///
+/// A bus that dispatches I/O accesses to devices.
+///
+pub struct IoBus {
+    /// Devices on the bus.
+    devices: Vec<Box<dyn Device>>,
+    /// Device that handles each I/O port, as its index plus one, or zero if there is none.
+    ports: Box<[u8]>,
+    /// Ranges of guest physical addresses that are handled by devices, sorted by base address.
+    mmio: Vec<MmioRange>,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl IoBus {
+    ///
+    /// # Description
+    ///
+    /// Creates a bus with no devices.
+    ///
+    pub fn new() -> Self {
+        Self {
+            devices: Vec::new(),
+            ports: vec![0; NUM_PORTS].into_boxed_slice(),
+            mmio: Vec::new(),
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Adds a device to the bus. The device handles no accesses until ranges are attached to it.
+    ///
+    /// # Parameters
+    ///
+    /// - `device`: Device to add.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the index of the device. Otherwise, it
+    /// returns an error.
+    ///
+    pub fn add_device(&mut self, device: Box<dyn Device>) -> Result<usize> {
+        if self.devices.len() == MAX_DEVICES {
+            let reason: String = "too many devices".to_string();
+            error!("add_device(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        self.devices.push(device);
+        Ok(self.devices.len() - 1)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Attaches a range of I/O ports to a device.
+    ///
+    /// # Parameters
+    ///
+    /// - `device`: Index of the device.
+    /// - `base`: First port.
+    /// - `count`: Number of ports.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn register_pio(&mut self, device: usize, base: u16, count: u16) -> Result<()> {
+        let start: usize = base as usize;
+        let end: usize = start + count as usize;
+        if device >= self.devices.len() || count == 0 || end > NUM_PORTS {
+            let reason: String = "invalid port range".to_string();
+            error!(
+                "register_pio(): {} (device={}, base={:#06x}, count={})",
+                reason, device, base, count
+            );
+            anyhow::bail!(reason);
+        }
+        if self.ports[start..end].iter().any(|port| *port != 0) {
+            let reason: String = "ports are already attached".to_string();
+            error!(
+                "register_pio(): {} (device={}, base={:#06x}, count={})",
+                reason, device, base, count
+            );
+            anyhow::bail!(reason);
+        }
+
+        self.ports[start..end].fill((device + 1) as u8);
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Attaches a range of guest physical addresses to a device. The range must not be backed by
+    /// guest memory, otherwise accesses to it do not exit.
+    ///
+    /// # Parameters
+    ///
+    /// - `device`: Index of the device.
+    /// - `base`: First address.
+    /// - `size`: Size of the range in bytes.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn register_mmio(&mut self, device: usize, base: u64, size: u64) -> Result<()> {
+        let end: Option<u64> = base.checked_add(size);
+        let end: u64 = match end {
+            Some(end) if device < self.devices.len() && size > 0 => end,
+            _ => {
+                let reason: String = "invalid address range".to_string();
+                error!(
+                    "register_mmio(): {} (device={}, base={:#x}, size={:#x})",
+                    reason, device, base, size
+                );
+                anyhow::bail!(reason);
+            },
+        };
+
+        // Ranges are sorted and do not overlap, thus only the next range needs to be checked.
+        let index: usize = self.mmio.partition_point(|range| range.end <= base);
+        if self.mmio.get(index).is_some_and(|range| range.base < end) {
+            let reason: String = "addresses are already attached".to_string();
+            error!(
+                "register_mmio(): {} (device={}, base={:#x}, size={:#x})",
+                reason, device, base, size
+            );
+            anyhow::bail!(reason);
+        }
+
+        self.mmio.insert(index, MmioRange { base, end, device });
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Dispatches a read from an I/O port.
+    ///
+    /// # Parameters
+    ///
+    /// - `port`: Port that was read.
+    /// - `data`: Buffer that receives the data.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the outcome of the access. If no device
+    /// handles the port, or the device fails the access, it returns an error.
+    ///
+    pub fn pio_read(&mut self, port: u16, data: &mut [u8]) -> Result<IoOutcome> {
+        match self.ports[port as usize] {
+            0 => {
+                let reason: String = format!("read from unsupported port i/o (port={:#06x})", port);
+                error!("pio_read(): {} (size={})", reason, data.len());
+                anyhow::bail!(reason);
+            },
+            device => self.devices[device as usize - 1].pio_read(port, data),
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Dispatches a write to an I/O port.
+    ///
+    /// # Parameters
+    ///
+    /// - `port`: Port that was written.
+    /// - `data`: Data that was written.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the outcome of the access. If no device
+    /// handles the port, or the device fails the access, it returns an error.
+    ///
+    pub fn pio_write(&mut self, port: u16, data: &[u8]) -> Result<IoOutcome> {
+        match self.ports[port as usize] {
+            0 => {
+                let reason: String = format!("write to unsupported port i/o (port={:#06x})", port);
+                error!("pio_write(): {} (size={})", reason, data.len());
+                anyhow::bail!(reason);
+            },
+            device => self.devices[device as usize - 1].pio_write(port, data),
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Dispatches a read from a guest physical address that is not backed by guest memory.
+    ///
+    /// # Parameters
+    ///
+    /// - `addr`: Address that was read.
+    /// - `data`: Buffer that receives the data.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the outcome of the access. If no device
+    /// handles the address, or the device fails the access, it returns an error.
+    ///
+    pub fn mmio_read(&mut self, addr: u64, data: &mut [u8]) -> Result<IoOutcome> {
+        match self.find_mmio(addr, data.len()) {
+            Some(device) => self.devices[device].mmio_read(addr, data),
+            None => {
+                let reason: String =
+                    format!("read from unsupported memory-mapped i/o (addr={:#010x})", addr);
+                error!("mmio_read(): {} (size={})", reason, data.len());
+                anyhow::bail!(reason);
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Dispatches a write to a guest physical address that is not backed by guest memory.
+    ///
+    /// # Parameters
+    ///
+    /// - `addr`: Address that was written.
+    /// - `data`: Data that was written.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the outcome of the access. If no device
+    /// handles the address, or the device fails the access, it returns an error.
+    ///
+    pub fn mmio_write(&mut self, addr: u64, data: &[u8]) -> Result<IoOutcome> {
+        match self.find_mmio(addr, data.len()) {
+            Some(device) => self.devices[device].mmio_write(addr, data),
+            None => {
+                let reason: String =
+                    format!("write to unsupported memory-mapped i/o (addr={:#010x})", addr);
+                error!("mmio_write(): {} (size={})", reason, data.len());
+                anyhow::bail!(reason);
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Finds the device that handles an access to guest physical addresses, which must lie within
+    /// a single range.
+    ///
+    /// # Parameters
+    ///
+    /// - `addr`: First address of the access.
+    /// - `len`: Size of the access in bytes.
+    ///
+    /// # Returns
+    ///
+    /// If a device handles the access, its index is returned. Otherwise, `None` is returned.
+    ///
+    fn find_mmio(&self, addr: u64, len: usize) -> Option<usize> {
+        let index: usize = self.mmio.partition_point(|range| range.end <= addr);
+        let range: &MmioRange = self.mmio.get(index)?;
+        if range.base <= addr && addr.checked_add(len as u64)? <= range.end {
+            Some(range.device)
+        } else {
+            None
+        }
+    }
+}
+
+//==================================================================================================
+// Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Decodes the data of an I/O access, in little endian, as an integer.
+///
+/// # Parameters
+///
+/// - `data`: Data of the access, up to four bytes long.
+///
+/// # Returns
+///
+/// The value of the data.
+///
+pub fn value(data: &[u8]) -> u32 {
+    data.iter()
+        .take(4)
+        .enumerate()
+        .fold(0, |value, (i, b)| value | ((*b as u32) << (i * 8)))
+}
+
+//==================================================================================================
+// Unit Tests
+//==================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use ::std::{
+        cell::Cell,
+        rc::Rc,
+    };
+
+    ///
+    /// # Description
+    ///
+    /// A device that records the last port or address that was accessed.
+    ///
+    struct Probe {
+        /// Last port or address that was accessed.
+        last: Rc<Cell<Option<u64>>>,
+    }
+
+    ///
+    /// # Description
+    ///
+    /// A device that implements no handlers.
+    ///
+    struct Unimplemented;
+
+    impl Device for Probe {
+        fn pio_read(&mut self, port: u16, data: &mut [u8]) -> Result<IoOutcome> {
+            self.last.set(Some(port as u64));
+            data.fill(0x5a);
+            Ok(IoOutcome::Resume)
+        }
+
+        fn pio_write(&mut self, port: u16, data: &[u8]) -> Result<IoOutcome> {
+            self.last.set(Some(port as u64));
+            Ok(IoOutcome::Poweroff(value(data)))
+        }
+
+        fn mmio_read(&mut self, addr: u64, data: &mut [u8]) -> Result<IoOutcome> {
+            self.last.set(Some(addr));
+            data.fill(0xa5);
+            Ok(IoOutcome::Resume)
+        }
+
+        fn mmio_write(&mut self, addr: u64, data: &[u8]) -> Result<IoOutcome> {
+            self.last.set(Some(addr));
+            Ok(IoOutcome::Function(value(data)))
+        }
+    }
+
+    impl Device for Unimplemented {}
+
+    ///
+    /// # Description
+    ///
+    /// Adds a probe to a bus.
+    ///
+    fn probe(bus: &mut IoBus) -> (usize, Rc<Cell<Option<u64>>>) {
+        let last: Rc<Cell<Option<u64>>> = Rc::new(Cell::new(None));
+        let device: usize = bus
+            .add_device(Box::new(Probe { last: last.clone() }))
+            .unwrap();
+        (device, last)
+    }
+
+    #[test]
+    fn register_pio_rejects_overlapping_ranges() {
+        let mut bus: IoBus = IoBus::new();
+        let (first, _): (usize, _) = probe(&mut bus);
+        let (second, _): (usize, _) = probe(&mut bus);
+        bus.register_pio(first, 0x10, 4).unwrap();
+
+        assert!(bus.register_pio(second, 0x10, 4).is_err());
+        assert!(bus.register_pio(second, 0x0e, 3).is_err());
+        assert!(bus.register_pio(second, 0x13, 1).is_err());
+        assert!(bus.register_pio(first, 0x11, 1).is_err());
+
+        // Adjacent ranges do not overlap.
+        bus.register_pio(second, 0x0c, 4).unwrap();
+        bus.register_pio(second, 0x14, 1).unwrap();
+    }
+
+    #[test]
+    fn register_pio_rejects_invalid_ranges() {
+        let mut bus: IoBus = IoBus::new();
+        let (device, _): (usize, _) = probe(&mut bus);
+
+        assert!(bus.register_pio(device + 1, 0x10, 1).is_err());
+        assert!(bus.register_pio(device, 0x10, 0).is_err());
+        assert!(bus.register_pio(device, u16::MAX, 2).is_err());
+        bus.register_pio(device, u16::MAX, 1).unwrap();
+    }
+
+    #[test]
+    fn add_device_bounds_devices() {
+        let mut bus: IoBus = IoBus::new();
+        for _ in 0..MAX_DEVICES {
+            bus.add_device(Box::new(Unimplemented)).unwrap();
+        }
+        assert!(bus.add_device(Box::new(Unimplemented)).is_err());
+        bus.register_pio(MAX_DEVICES - 1, 0x10, 1).unwrap();
+    }
+
+    #[test]
+    fn pio_dispatches_to_device() {
+        let mut bus: IoBus = IoBus::new();
+        let (first, first_port): (usize, Rc<Cell<Option<u64>>>) = probe(&mut bus);
+        let (second, second_port): (usize, Rc<Cell<Option<u64>>>) = probe(&mut bus);
+        bus.register_pio(first, 0x10, 2).unwrap();
+        bus.register_pio(second, 0x12, 1).unwrap();
+
+        let mut data: [u8; 2] = [0; 2];
+        assert!(bus.pio_read(0x11, &mut data).unwrap() == IoOutcome::Resume);
+        assert_eq!(data, [0x5a, 0x5a]);
+        assert_eq!(first_port.get(), Some(0x11));
+        assert_eq!(second_port.get(), None);
+
+        assert!(bus.pio_write(0x12, &[0x2a]).unwrap() == IoOutcome::Poweroff(0x2a));
+        assert_eq!(second_port.get(), Some(0x12));
+    }
+
+    #[test]
+    fn pio_fails_unclaimed_ports() {
+        let mut bus: IoBus = IoBus::new();
+        let (device, port): (usize, Rc<Cell<Option<u64>>>) = probe(&mut bus);
+        bus.register_pio(device, 0x10, 1).unwrap();
+
+        let mut data: [u8; 1] = [0; 1];
+        assert!(bus.pio_read(0x11, &mut data).is_err());
+        assert!(bus.pio_write(0x0f, &data).is_err());
+        assert_eq!(port.get(), None);
+    }
+
+    #[test]
+    fn io_fails_unimplemented_handlers() {
+        let mut bus: IoBus = IoBus::new();
+        let device: usize = bus.add_device(Box::new(Unimplemented)).unwrap();
+        bus.register_pio(device, 0x10, 1).unwrap();
+        bus.register_mmio(device, 0x1000, 0x1000).unwrap();
+
+        let mut data: [u8; 1] = [0; 1];
+        assert!(bus.pio_read(0x10, &mut data).is_err());
+        assert!(bus.pio_write(0x10, &data).is_err());
+        assert!(bus.mmio_read(0x1000, &mut data).is_err());
+        assert!(bus.mmio_write(0x1000, &data).is_err());
+    }
+
+    #[test]
+    fn register_mmio_rejects_overlapping_ranges() {
+        let mut bus: IoBus = IoBus::new();
+        let (first, _): (usize, _) = probe(&mut bus);
+        let (second, _): (usize, _) = probe(&mut bus);
+        bus.register_mmio(first, 0x2000, 0x1000).unwrap();
+        bus.register_mmio(first, 0x5000, 0x100).unwrap();
+
+        assert!(bus.register_mmio(second, 0x2000, 0x1000).is_err());
+        assert!(bus.register_mmio(second, 0x1800, 0x900).is_err());
+        assert!(bus.register_mmio(second, 0x2fff, 1).is_err());
+        assert!(bus.register_mmio(second, 0x1000, 0x5000).is_err());
+        assert!(bus.register_mmio(second, 0x50ff, 0x10).is_err());
+
+        // Adjacent ranges do not overlap, and ranges may be attached in any order.
+        bus.register_mmio(second, 0x3000, 0x2000).unwrap();
+        bus.register_mmio(second, 0x1000, 0x1000).unwrap();
+        bus.register_mmio(second, 0x5100, 0x100).unwrap();
+        let bases: Vec<u64> = bus.mmio.iter().map(|range| range.base).collect();
+        assert_eq!(bases, vec![0x1000, 0x2000, 0x3000, 0x5000, 0x5100]);
+    }
+
+    #[test]
+    fn register_mmio_rejects_invalid_ranges() {
+        let mut bus: IoBus = IoBus::new();
+        let (device, _): (usize, _) = probe(&mut bus);
+
+        assert!(bus.register_mmio(device + 1, 0x1000, 0x1000).is_err());
+        assert!(bus.register_mmio(device, 0x1000, 0).is_err());
+        assert!(bus.register_mmio(device, u64::MAX, 2).is_err());
+        bus.register_mmio(device, u64::MAX - 1, 1).unwrap();
+    }
+
+    #[test]
+    fn find_mmio_checks_range_boundaries() {
+        let mut bus: IoBus = IoBus::new();
+        let (first, _): (usize, _) = probe(&mut bus);
+        let (second, _): (usize, _) = probe(&mut bus);
+        bus.register_mmio(first, 0x2000, 0x1000).unwrap();
+        bus.register_mmio(second, 0x3000, 0x1000).unwrap();
+
+        assert_eq!(bus.find_mmio(0x1fff, 1), None);
+        assert_eq!(bus.find_mmio(0x2000, 4), Some(first));
+        assert_eq!(bus.find_mmio(0x2ffc, 4), Some(first));
+        assert_eq!(bus.find_mmio(0x3000, 8), Some(second));
+        assert_eq!(bus.find_mmio(0x3ffc, 4), Some(second));
+        assert_eq!(bus.find_mmio(0x4000, 1), None);
+
+        // Accesses that straddle two ranges, or the end of a range, are not handled.
+        assert_eq!(bus.find_mmio(0x2ffe, 4), None);
+        assert_eq!(bus.find_mmio(0x3ffe, 4), None);
+        assert_eq!(bus.find_mmio(u64::MAX, 2), None);
+    }
+
+    #[test]
+    fn mmio_dispatches_to_device() {
+        let mut bus: IoBus = IoBus::new();
+        let (device, last): (usize, Rc<Cell<Option<u64>>>) = probe(&mut bus);
+        bus.register_mmio(device, 0xfeb0_0000, 0x1000).unwrap();
+
+        let mut data: [u8; 4] = [0; 4];
+        assert!(bus.mmio_read(0xfeb0_0004, &mut data).unwrap() == IoOutcome::Resume);
+        assert_eq!(data, [0xa5; 4]);
+        assert_eq!(last.get(), Some(0xfeb0_0004));
+
+        let outcome: IoOutcome = bus.mmio_write(0xfeb0_0008, &[0x00, 0x10]).unwrap();
+        assert!(outcome == IoOutcome::Function(0x1000));
+        assert_eq!(last.get(), Some(0xfeb0_0008));
+    }
+
+    #[test]
+    fn mmio_fails_unclaimed_addresses() {
+        let mut bus: IoBus = IoBus::new();
+        let (device, last): (usize, Rc<Cell<Option<u64>>>) = probe(&mut bus);
+        bus.register_mmio(device, 0x2000, 0x1000).unwrap();
+
+        let mut data: [u8; 4] = [0; 4];
+        assert!(bus.mmio_read(0x1ffc, &mut data).is_err());
+        assert!(bus.mmio_write(0x3000, &data).is_err());
+        assert!(bus.mmio_write(0x2ffe, &data).is_err());
+        assert_eq!(last.get(), None);
+    }
+
+    #[test]
+    fn value_decodes_little_endian() {
+        assert_eq!(value(&[]), 0);
+        assert_eq!(value(&[0x78]), 0x78);
+        assert_eq!(value(&[0x78, 0x56]), 0x5678);
+        assert_eq!(value(&[0x78, 0x56, 0x34, 0x12]), 0x12345678);
+        assert_eq!(value(&[0xff, 0xff, 0xff, 0xff]), u32::MAX);
+        // Bytes past the fourth one are ignored.
+        assert_eq!(value(&[0x78, 0x56, 0x34, 0x12, 0xff]), 0x12345678);
+    }
+}
@@ -0,0 +1,261 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # CPUID Policy
+//!
+//! This module builds the CPUID that virtual processors expose to guests. It starts from what KVM
+//! supports on the host, so that guests see the instruction set extensions of the host (SSE, AVX,
+//! AVX-512, ...), and filters out features that the virtual machine monitor does not provide, such
+//! as the local APIC, performance monitoring and power management. The frequency of the
+//! time-stamp counter is reported in the timing leaf (`0x40000010`).
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::kvm::partition::VirtualPartition;
+use ::anyhow::Result;
+use ::kvm_bindings::{
+    kvm_cpuid_entry2,
+    CpuId,
+    KVM_MAX_CPUID_ENTRIES,
+};
+use ::std::sync::OnceLock;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Leaf that reports processor features.
+const LEAF_FEATURES: u32 = 0x1;
+/// Leaf that reports thermal and power management features.
+const LEAF_POWER_MANAGEMENT: u32 = 0x6;
+/// Leaf that reports architectural performance monitoring.
+const LEAF_PERFORMANCE_MONITORING: u32 = 0xa;
+/// Leaf that reports the extended topology.
+const LEAF_TOPOLOGY: u32 = 0xb;
+/// Leaf that reports the state components that are managed by `xsave`.
+const LEAF_XSAVE: u32 = 0xd;
+/// Leaf that reports the extended topology, version 2.
+const LEAF_TOPOLOGY_V2: u32 = 0x1f;
+/// Leaf that reports the signature of the hypervisor and its last leaf.
+const LEAF_HYPERVISOR: u32 = 0x4000_0000;
+/// Leaf that reports paravirtual features of KVM.
+const LEAF_KVM_FEATURES: u32 = 0x4000_0001;
+/// Leaf that reports the frequency of the time-stamp counter (in kHz) in the `eax` register.
+const LEAF_TIMING: u32 = 0x4000_0010;
+
+/// Paravirtual feature of KVM for the clock at the new MSRs.
+const KVM_FEATURE_CLOCKSOURCE2: u32 = 1 << 3;
+
+/// Features of the `ecx` register in the features leaf, which the virtual machine monitor does
+/// not provide: 64-bit debug store (2), `monitor`/`mwait` (3), CPL-qualified debug store (4), VMX
+/// (5), SMX (6), enhanced SpeedStep (7), thermal monitor 2 (8), performance capabilities (15),
+/// x2APIC (21) and TSC deadline timer (24).
+const FEATURES_ECX_FILTER: u32 = (1 << 2)
+    | (1 << 3)
+    | (1 << 4)
+    | (1 << 5)
+    | (1 << 6)
+    | (1 << 7)
+    | (1 << 8)
+    | (1 << 15)
+    | (1 << 21)
+    | (1 << 24);
+/// `monitor`/`mwait` bit of the `ecx` register in the features leaf.
+const FEATURES_ECX_MONITOR: u32 = 1 << 3;
+/// Hypervisor bit of the `ecx` register in the features leaf.
+const FEATURES_ECX_HYPERVISOR: u32 = 1 << 31;
+/// Features of the `edx` register in the features leaf, which the virtual machine monitor does
+/// not provide: local APIC (9), debug store (21), thermal monitor and clock control (22), thermal
+/// monitor (29) and pending break enable (31).
+const FEATURES_EDX_FILTER: u32 = (1 << 9) | (1 << 21) | (1 << 22) | (1 << 29) | (1 << 31);
+
+/// Paravirtual features of KVM that deliver interrupts, which the virtual machine monitor does not
+/// provide: asynchronous page faults (4, 10 and 14), end of interrupt (6), spinlock unhalt (7),
+/// TLB flush (9), inter-processor interrupts (11), poll control (12), scheduler yield (13) and
+/// extended MSI destinations (15).
+const KVM_FEATURES_FILTER: u32 = (1 << 4)
+    | (1 << 6)
+    | (1 << 7)
+    | (1 << 9)
+    | (1 << 10)
+    | (1 << 11)
+    | (1 << 12)
+    | (1 << 13)
+    | (1 << 14)
+    | (1 << 15);
+
+/// State components of `xcr0` that are enabled for guests: x87 (0), SSE (1), AVX (2), and the
+/// AVX-512 opmask (5), upper halves of ZMM0-15 (6) and ZMM16-31 (7). Supervisor and deprecated
+/// components, such as MPX, are left disabled.
+const XCR0_USER_STATE: u64 = (1 << 0) | (1 << 1) | (1 << 2) | (1 << 5) | (1 << 6) | (1 << 7);
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/// CPUID that KVM supports, once filtered. It is queried once per process.
+static SUPPORTED: OnceLock<CpuId> = OnceLock::new();
+
+//==================================================================================================
+// Public Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Builds the CPUID of a virtual processor.
+///
+/// # Parameters
+///
+/// - `id`: Identifier of the virtual processor, which is reported as its APIC identifier.
+/// - `tsc_khz`: Frequency of the time-stamp counter (in kHz), if it is known.
+/// - `mwait`: Report `monitor`/`mwait`? This only holds if their exits are disabled.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns the CPUID. Otherwise, it returns an error.
+///
+pub fn build(id: u64, tsc_khz: Option<u32>, mwait: bool) -> Result<CpuId> {
+    let mut cpuid: CpuId = supported()?.clone();
+
+    for entry in cpuid.as_mut_slice() {
+        match entry.function {
+            LEAF_FEATURES => {
+                entry.ebx = (entry.ebx & 0x00ff_ffff) | ((id as u32) << 24);
+                if mwait {
+                    entry.ecx |= FEATURES_ECX_MONITOR;
+                }
+            },
+            LEAF_TOPOLOGY | LEAF_TOPOLOGY_V2 => {
+                entry.edx = id as u32;
+            },
+            LEAF_HYPERVISOR if tsc_khz.is_some() => {
+                entry.eax = entry.eax.max(LEAF_TIMING);
+            },
+            _ => {},
+        }
+    }
+
+    if let Some(tsc_khz) = tsc_khz {
+        let timing: kvm_cpuid_entry2 = kvm_cpuid_entry2 {
+            function: LEAF_TIMING,
+            eax: tsc_khz,
+            ..Default::default()
+        };
+        if let Err(e) = cpuid.push(timing) {
+            let reason: String = format!("failed to add timing leaf (error={:?})", e);
+            error!("build(): {}", reason);
+            anyhow::bail!(reason);
+        }
+    }
+
+    Ok(cpuid)
+}
+
+///
+/// # Description
+///
+/// Checks if KVM provides a paravirtual clock, which it updates in guest memory.
+///
+/// # Returns
+///
+/// Upon successful completion, this function returns `true` if the paravirtual clock is provided,
+/// and `false` otherwise. Otherwise, it returns an error.
+///
+pub fn has_pvclock() -> Result<bool> {
+    Ok(find(supported()?, LEAF_KVM_FEATURES, 0)
+        .is_some_and(|entry| entry.eax & KVM_FEATURE_CLOCKSOURCE2 != 0))
+}
+
+///
+/// # Description
+///
+/// Returns the value of `xcr0` for guests: the user state components that are enabled for them,
+/// among those that the CPUID reports.
+///
+/// # Parameters
+///
+/// - `cpuid`: CPUID of the virtual processor.
+///
+/// # Returns
+///
+/// The value of `xcr0`, or zero if the CPUID does not report `xsave`.
+///
+pub fn xcr0(cpuid: &CpuId) -> u64 {
+    let supported: u64 = match find(cpuid, LEAF_XSAVE, 0) {
+        Some(entry) => (entry.eax as u64) | ((entry.edx as u64) << 32),
+        None => return 0,
+    };
+
+    // AVX-512 components must be enabled all at once.
+    let mut xcr0: u64 = supported & XCR0_USER_STATE;
+    if xcr0 & (7 << 5) != (7 << 5) {
+        xcr0 &= !(7 << 5);
+    }
+
+    xcr0
+}
+
+//==================================================================================================
+// Private Standalone Functions
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Queries the CPUID that KVM supports and filters it, once per process.
+///
+fn supported() -> Result<&'static CpuId> {
+    if let Some(cpuid) = SUPPORTED.get() {
+        return Ok(cpuid);
+    }
+
+    let mut cpuid: CpuId =
+        VirtualPartition::kvm()?.get_supported_cpuid(KVM_MAX_CPUID_ENTRIES as usize)?;
+    for entry in cpuid.as_mut_slice() {
+        filter(entry);
+    }
+
+    // If another thread won the race, its CPUID is used and this one is dropped.
+    Ok(SUPPORTED.get_or_init(|| cpuid))
+}
+
+///
+/// # Description
+///
+/// Filters out of a CPUID entry the features that the virtual machine monitor does not provide.
+///
+fn filter(entry: &mut kvm_cpuid_entry2) {
+    match entry.function {
+        LEAF_FEATURES => {
+            entry.ecx = (entry.ecx & !FEATURES_ECX_FILTER) | FEATURES_ECX_HYPERVISOR;
+            entry.edx &= !FEATURES_EDX_FILTER;
+        },
+        LEAF_POWER_MANAGEMENT | LEAF_PERFORMANCE_MONITORING => {
+            entry.eax = 0;
+            entry.ebx = 0;
+            entry.ecx = 0;
+            entry.edx = 0;
+        },
+        LEAF_KVM_FEATURES => {
+            entry.eax &= !KVM_FEATURES_FILTER;
+        },
+        _ => {},
+    }
+}
+
+///
+/// # Description
+///
+/// Finds an entry of a CPUID.
+///
+fn find(cpuid: &CpuId, function: u32, index: u32) -> Option<&kvm_cpuid_entry2> {
+    cpuid
+        .as_slice()
+        .iter()
+        .find(|entry| entry.function == function && entry.index == index)
+}
@@ -7,6 +7,12 @@
 
 use crate::{
     kvm::{
+        bus::{
+            self,
+            Device,
+            IoBus,
+            IoOutcome,
+        },
         vcpu::VirtualProcessorExitContext,
         vmem::VirtualMemory,
     },
@@ -29,9 +35,21 @@ use ::std::{
 ///
 /// # Description
 ///
-/// A structure that represents an instruction emulator for the virtual machine.
+/// A structure that represents an instruction emulator for the virtual machine. It dispatches I/O
+/// accesses to the devices on its bus.
 ///
 pub struct Emulator {
+    /// Bus on which devices are attached.
+    bus: IoBus,
+}
+
+///
+/// # Description
+///
+/// Console of the guest, at the standard output and standard input ports.
+///
+struct Console {
+    /// Memory of the virtual machine, which the input and output functions access.
     vmem: Rc<RefCell<VirtualMemory>>,
     /// Input function used for emulating I/O port reads.
     input: Box<InputFn>,
@@ -39,6 +57,21 @@ pub struct Emulator {
     output: Box<OutputFn>,
 }
 
+///
+/// # Description
+///
+/// Control ports, through which the guest powers off and waits for function invocations.
+///
+struct Control;
+
+///
+/// # Description
+///
+/// Benchmark port and memory-mapped registers, which the guest accesses to measure the cost of
+/// exits.
+///
+struct Bench;
+
 //==================================================================================================
 // Implementations
 //==================================================================================================
@@ -47,10 +80,12 @@ impl Emulator {
     ///
     /// # Description
     ///
-    /// Creates a new emulator.
+    /// Creates a new emulator, with the built-in devices attached to its bus.
     ///
     /// # Parameters
     ///
+    /// - `vmem`: Memory of the virtual machine.
+    /// - `memory_size`: Size of the memory of the virtual machine.
     /// - `input`: Input function used for emulating I/O port reads.
     /// - `output`: Output function used for emulating I/O port writes.
     ///
@@ -61,76 +96,132 @@ impl Emulator {
     ///
     pub fn new(
         vmem: Rc<RefCell<VirtualMemory>>,
+        memory_size: usize,
         input: Box<InputFn>,
         output: Box<OutputFn>,
     ) -> Result<Self> {
         trace!("new()");
-        Ok(Self {
+        let mut bus: IoBus = IoBus::new();
+
+        let console: usize = bus.add_device(Box::new(Console {
             vmem,
             input,
             output,
-        })
+        }))?;
+        bus.register_pio(console, MicroVm::STDOUT_PORT, 1)?;
+        bus.register_pio(console, MicroVm::STDIN_PORT, 1)?;
+
+        let control: usize = bus.add_device(Box::new(Control))?;
+        bus.register_pio(control, MicroVm::VMM_PORT, 1)?;
+        bus.register_pio(control, MicroVm::FUNCTION_PORT, 1)?;
+
+        let bench: usize = bus.add_device(Box::new(Bench))?;
+        bus.register_pio(bench, MicroVm::BENCH_PORT, 1)?;
+        // Accesses to addresses that are backed by guest memory do not exit.
+        if memory_size as u64 <= MicroVm::BENCH_MMIO_BASE {
+            bus.register_mmio(bench, MicroVm::BENCH_MMIO_BASE, MicroVm::BENCH_MMIO_SIZE)?;
+        }
+
+        Ok(Self { bus })
     }
 
     ///
     /// # Description
     ///
-    /// Emulates an I/O port access.
+    /// Emulates an I/O access.
     ///
     /// # Parameters
     ///
-    /// - `vcpu`: Virtual processor on which the I/O port access occurred.
-    /// - `exit_context`: Context in which the I/O port access occurred.
+    /// - `exit_context`: Context in which the I/O access occurred.
     ///
     /// # Returns
     ///
-    /// Upon successful completion, this method a boolean value that encodes wether the virtual
-    /// processor should be resumed (`true`) or not .(`false`). If an error is encountered, an error
-    /// is returned instead.
+    /// Upon successful completion, this method returns the outcome of the access, which encodes
+    /// whether the virtual processor should be resumed or not. If an error is encountered, an
+    /// error is returned instead.
     ///
-    pub fn handle_pmio_access(
+    pub fn handle_io_access(
         &mut self,
         exit_context: VirtualProcessorExitContext,
-    ) -> Result<bool> {
-        // Parse context.
+    ) -> Result<IoOutcome> {
         match exit_context {
             // Read from an I/O port.
-            VirtualProcessorExitContext::PmioIn(port, _data) => {
-                // Read from an I/O port that is not supported.
-                let reason: String = format!("read from unsupported port i/o (port={:#06x})", port);
-                error!("handle_pmio_access(): {}", reason);
-                anyhow::bail!(reason);
-            },
+            VirtualProcessorExitContext::PmioIn(port, data) => self.bus.pio_read(port, data),
             // Write to an I/O port.
-            VirtualProcessorExitContext::PmioOut(port, data, size) => match port {
-                // Write to standard output.
-                MicroVm::STDOUT_PORT => {
-                    (self.output)(&self.vmem, data, size)?;
-                },
-                // Read from standard input.
-                MicroVm::STDIN_PORT => {
-                    (self.input)(&self.vmem, data, size)?;
-                },
-                // Write to the virtual machine monitor port.
-                MicroVm::VMM_PORT => {
-                    // TODO: check if data matches an expected command.
-                    return Ok(false);
-                },
-                // Write to an I/O port that is not supported.
-                _ => {
-                    let reason: String =
-                        format!("write to unsupported port i/o (port={:#06x})", port);
-                    error!("handle_pmio_access(): {}", reason);
-                    anyhow::bail!(reason);
-                },
+            VirtualProcessorExitContext::PmioOut(port, data) => self.bus.pio_write(port, data),
+            // Read from memory-mapped registers.
+            VirtualProcessorExitContext::MmioRead(addr, data) => self.bus.mmio_read(addr, data),
+            // Write to memory-mapped registers.
+            VirtualProcessorExitContext::MmioWrite(addr, data) => self.bus.mmio_write(addr, data),
+            // Unexpected exit.
+            _ => {
+                // This should never happen, as only I/O accesses are emulated.
+                unreachable!("unexpected i/o access");
             },
-            // Unexpected I/O port access.
+        }
+    }
+}
+
+impl Device for Console {
+    fn pio_write(&mut self, port: u16, data: &[u8]) -> Result<IoOutcome> {
+        match port {
+            // Write to standard output.
+            MicroVm::STDOUT_PORT => {
+                (self.output)(&self.vmem, bus::value(data), data.len())?;
+            },
+            // Read from standard input.
+            MicroVm::STDIN_PORT => {
+                if !(self.input)(&self.vmem, bus::value(data), data.len())? {
+                    return Ok(IoOutcome::Blocked);
+                }
+            },
+            // Write to a port that is not attached to the console.
             _ => {
-                // This should never happen, as all I/O port accesses are emulated above.
-                unreachable!("unexpected i/O port access");
+                let reason: String = format!("write to unsupported port i/o (port={:#06x})", port);
+                error!("pio_write(): {}", reason);
+                anyhow::bail!(reason);
             },
         }
 
-        Ok(true)
+        Ok(IoOutcome::Resume)
+    }
+}
+
+impl Device for Control {
+    fn pio_write(&mut self, port: u16, data: &[u8]) -> Result<IoOutcome> {
+        match port {
+            // The guest is shutting down, and the data is its exit status.
+            MicroVm::VMM_PORT => Ok(IoOutcome::Poweroff(bus::value(data))),
+            // The guest waits for a function invocation.
+            MicroVm::FUNCTION_PORT => Ok(IoOutcome::Function(bus::value(data))),
+            // Write to a port that is not attached to the control device.
+            _ => {
+                let reason: String = format!("write to unsupported port i/o (port={:#06x})", port);
+                error!("pio_write(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        }
+    }
+}
+
+impl Device for Bench {
+    fn pio_read(&mut self, _port: u16, data: &mut [u8]) -> Result<IoOutcome> {
+        data.fill(0);
+        Ok(IoOutcome::Resume)
+    }
+
+    fn pio_write(&mut self, _port: u16, _data: &[u8]) -> Result<IoOutcome> {
+        // Nothing to do.
+        Ok(IoOutcome::Resume)
+    }
+
+    fn mmio_read(&mut self, _addr: u64, data: &mut [u8]) -> Result<IoOutcome> {
+        data.fill(0);
+        Ok(IoOutcome::Resume)
+    }
+
+    fn mmio_write(&mut self, _addr: u64, _data: &[u8]) -> Result<IoOutcome> {
+        // Nothing to do.
+        Ok(IoOutcome::Resume)
     }
 }
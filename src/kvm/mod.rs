@@ -7,7 +7,10 @@
 //! This module provides the backend implementation of MicroVM for Linux KVM.
 //!
 
+pub mod bus;
+pub mod cpuid;
 pub mod emulator;
+pub mod pager;
 pub mod partition;
 pub mod vcpu;
 pub mod vmem;
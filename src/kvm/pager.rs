@@ -0,0 +1,695 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Demand Pager
+//!
+//! This module fills a region of the virtual memory from a file on first access, using
+//! `userfaultfd`. The region is registered for missing-page faults, and a handler thread copies
+//! pages from the file when the guest, KVM or the virtual machine monitor first touches them.
+//! Pages that are never touched are never read from the file, and never consume memory.
+//!
+//! Faults that follow the previous fill are deemed sequential, and the handler then reads ahead,
+//! doubling the number of pages that it fills at once up to the limit given to
+//! [`DemandPager::start`]. A limit of one page disables read-ahead. A fault elsewhere resets the
+//! read-ahead window to a single page. Pages that cannot be filled, and pages of the
+//! region past the end of the file, are filled with zeros, so that no thread waits forever.
+//!
+//! The `libc` crate does not define the structures and requests of `userfaultfd`, thus they are
+//! defined here after `linux/userfaultfd.h`, and request numbers are derived from the structures.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::pal::FileMapping;
+use ::anyhow::Result;
+use ::std::{
+    mem,
+    thread::{
+        self,
+        JoinHandle,
+    },
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of a page.
+const PAGE_SIZE: usize = 4096;
+
+/// Version of the `userfaultfd` API.
+const UFFD_API: u64 = 0xaa;
+
+/// Type of requests to `userfaultfd`.
+const UFFDIO: u32 = 0xaa;
+
+/// Requests to `userfaultfd`.
+const UFFDIO_API: libc::Ioctl = libc::_IOWR::<UffdioApi>(UFFDIO, 0x3f);
+const UFFDIO_REGISTER: libc::Ioctl = libc::_IOWR::<UffdioRegister>(UFFDIO, 0x00);
+const UFFDIO_UNREGISTER: libc::Ioctl = libc::_IOR::<UffdioRange>(UFFDIO, 0x01);
+const UFFDIO_WAKE: libc::Ioctl = libc::_IOR::<UffdioRange>(UFFDIO, 0x02);
+const UFFDIO_COPY: libc::Ioctl = libc::_IOWR::<UffdioCopy>(UFFDIO, 0x03);
+const UFFDIO_ZEROPAGE: libc::Ioctl = libc::_IOWR::<UffdioZeropage>(UFFDIO, 0x04);
+
+/// Registration mode for faults on missing pages.
+const UFFDIO_REGISTER_MODE_MISSING: u64 = 1;
+
+/// Event of faults on missing pages.
+const UFFD_EVENT_PAGEFAULT: u8 = 0x12;
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+/// Handshake with `userfaultfd` (`struct uffdio_api`).
+#[repr(C)]
+struct UffdioApi {
+    api: u64,
+    features: u64,
+    ioctls: u64,
+}
+
+/// Range of memory (`struct uffdio_range`).
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct UffdioRange {
+    start: u64,
+    len: u64,
+}
+
+/// Registration of a range of memory (`struct uffdio_register`).
+#[repr(C)]
+struct UffdioRegister {
+    range: UffdioRange,
+    mode: u64,
+    ioctls: u64,
+}
+
+/// Copy of pages into a range of memory (`struct uffdio_copy`).
+#[repr(C)]
+struct UffdioCopy {
+    dst: u64,
+    src: u64,
+    len: u64,
+    mode: u64,
+    copy: i64,
+}
+
+/// Zeroing of pages in a range of memory (`struct uffdio_zeropage`).
+#[repr(C)]
+struct UffdioZeropage {
+    range: UffdioRange,
+    mode: u64,
+    zeropage: i64,
+}
+
+/// Message read from `userfaultfd` (`struct uffd_msg`), with the layout of page faults.
+#[repr(C)]
+struct UffdMsg {
+    event: u8,
+    reserved1: u8,
+    reserved2: u16,
+    reserved3: u32,
+    flags: u64,
+    address: u64,
+    ptid: u32,
+    padding: u32,
+}
+
+///
+/// # Description
+///
+/// A region of the virtual memory that is filled from a file on first access.
+///
+pub struct DemandPager {
+    /// File descriptor of `userfaultfd`.
+    uffd: libc::c_int,
+    /// File descriptor that wakes up the handler thread when the pager is dropped.
+    stop: libc::c_int,
+    /// Registered range.
+    range: UffdioRange,
+    /// Handler thread, which returns the number of faults and the number of pages filled.
+    handler: Option<JoinHandle<(u64, u64)>>,
+}
+
+///
+/// # Description
+///
+/// State of the handler thread.
+///
+struct Handler {
+    /// File descriptor of `userfaultfd`.
+    uffd: libc::c_int,
+    /// File descriptor that stops the handler thread.
+    stop: libc::c_int,
+    /// Base address of the region.
+    base: u64,
+    /// Number of pages in the region.
+    npages: usize,
+    /// Number of pages in the region that are filled from the file.
+    file_pages: usize,
+    /// File from which pages are filled.
+    file: FileMapping,
+    /// Page that follows the last fill.
+    next: usize,
+    /// Number of pages to fill on the next sequential fault.
+    window: usize,
+    /// Maximum number of pages to fill at once.
+    max_window: usize,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl DemandPager {
+    ///
+    /// # Description
+    ///
+    /// Registers a region of memory to be filled on first access. Faults are not served until
+    /// [`start`](Self::start) is called.
+    ///
+    /// # Parameters
+    ///
+    /// - `base`: Host address of the region, which must be page aligned and have no pages yet.
+    /// - `size`: Size of the region, which is rounded up to the page size.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns the demand pager. Otherwise, it returns
+    /// an error, for instance if `userfaultfd` is not available.
+    ///
+    pub fn new(base: *mut u8, size: usize) -> Result<Self> {
+        trace!("new(): base={:p}, size={:#x}", base, size);
+
+        let uffd: libc::c_int = unsafe {
+            libc::syscall(libc::SYS_userfaultfd, libc::O_CLOEXEC | libc::O_NONBLOCK) as libc::c_int
+        };
+        if uffd < 0 {
+            let reason: String =
+                format!("failed to open userfaultfd (error={})", std::io::Error::last_os_error());
+            error!("new(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        let stop: libc::c_int = unsafe { libc::eventfd(0, libc::EFD_CLOEXEC) };
+        if stop < 0 {
+            unsafe { libc::close(uffd) };
+            let reason: String = "failed to create eventfd".to_string();
+            error!("new(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        let pager: Self = Self {
+            uffd,
+            stop,
+            range: UffdioRange {
+                start: base as u64,
+                len: size.next_multiple_of(PAGE_SIZE) as u64,
+            },
+            handler: None,
+        };
+
+        // Negotiate the API and register the region. If this fails, the destructor closes file
+        // descriptors.
+        let mut api: UffdioApi = UffdioApi {
+            api: UFFD_API,
+            features: 0,
+            ioctls: 0,
+        };
+        pager.ioctl(UFFDIO_API, &mut api as *mut UffdioApi as *mut libc::c_void)?;
+
+        let mut register: UffdioRegister = UffdioRegister {
+            range: pager.range,
+            mode: UFFDIO_REGISTER_MODE_MISSING,
+            ioctls: 0,
+        };
+        pager.ioctl(UFFDIO_REGISTER, &mut register as *mut UffdioRegister as *mut libc::c_void)?;
+
+        Ok(pager)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Starts serving faults from a handler thread, which fills pages from a file.
+    ///
+    /// # Parameters
+    ///
+    /// - `file`: File from which the region is filled. It must not be smaller than the region,
+    ///   once rounded up to the page size.
+    /// - `read_ahead`: Maximum number of pages that are filled at once on sequential faults. One
+    ///   (or zero) disables read-ahead.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+    ///
+    pub fn start(&mut self, file: FileMapping, read_ahead: usize) -> Result<()> {
+        let npages: usize = self.range.len as usize / PAGE_SIZE;
+        let mut handler: Handler = Handler {
+            uffd: self.uffd,
+            stop: self.stop,
+            base: self.range.start,
+            npages,
+            file_pages: file.size().div_ceil(PAGE_SIZE).min(npages),
+            file,
+            next: usize::MAX,
+            window: 1,
+            max_window: read_ahead.max(1),
+        };
+        self.handler = Some(
+            thread::Builder::new()
+                .name("pager".to_string())
+                .spawn(move || handler.run())?,
+        );
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Issues a request to `userfaultfd`.
+    ///
+    fn ioctl(&self, request: libc::Ioctl, arg: *mut libc::c_void) -> Result<()> {
+        if unsafe { libc::ioctl(self.uffd, request, arg) } < 0 {
+            let reason: String = format!(
+                "userfaultfd request failed (request={:#x}, error={})",
+                request,
+                std::io::Error::last_os_error()
+            );
+            error!("ioctl(): {}", reason);
+            anyhow::bail!(reason);
+        }
+        Ok(())
+    }
+}
+
+impl Handler {
+    ///
+    /// # Description
+    ///
+    /// Serves faults until the pager is dropped.
+    ///
+    /// # Returns
+    ///
+    /// This function returns the number of faults that were served and the number of pages that
+    /// were filled.
+    ///
+    fn run(&mut self) -> (u64, u64) {
+        let mut faults: u64 = 0;
+        let mut filled: u64 = 0;
+
+        loop {
+            let mut fds: [libc::pollfd; 2] = [
+                libc::pollfd {
+                    fd: self.uffd,
+                    events: libc::POLLIN,
+                    revents: 0,
+                },
+                libc::pollfd {
+                    fd: self.stop,
+                    events: libc::POLLIN,
+                    revents: 0,
+                },
+            ];
+            let ret: libc::c_int = unsafe { libc::poll(fds.as_mut_ptr(), 2, -1) };
+            if ret < 0 {
+                if std::io::Error::last_os_error().kind() == std::io::ErrorKind::Interrupted {
+                    continue;
+                }
+                error!("run(): failed to poll userfaultfd");
+                break;
+            }
+            if fds[1].revents != 0 {
+                break;
+            }
+
+            let mut msg: UffdMsg = unsafe { mem::zeroed() };
+            let size: isize = unsafe {
+                libc::read(
+                    self.uffd,
+                    &mut msg as *mut UffdMsg as *mut libc::c_void,
+                    mem::size_of::<UffdMsg>(),
+                )
+            };
+            if size != mem::size_of::<UffdMsg>() as isize || msg.event != UFFD_EVENT_PAGEFAULT {
+                continue;
+            }
+
+            faults += 1;
+            let page: usize = match msg.address.checked_sub(self.base) {
+                Some(offset) if offset < (self.npages * PAGE_SIZE) as u64 => {
+                    offset as usize / PAGE_SIZE
+                },
+                _ => {
+                    error!("run(): fault outside of region (address={:#x})", msg.address);
+                    continue;
+                },
+            };
+            if page >= self.file_pages {
+                if let Err(e) = self.zero(page) {
+                    error!("run(): failed to zero page (page={}, error={:?})", page, e);
+                }
+                continue;
+            }
+            match self.fill(page) {
+                Ok(npages) => filled += npages as u64,
+                Err(e) => {
+                    // Zero the page, so that the thread that faulted does not wait forever.
+                    error!("run(): failed to fill page (page={}, error={:?})", page, e);
+                    if let Err(e) = self.zero(page) {
+                        error!("run(): failed to zero page (page={}, error={:?})", page, e);
+                    }
+                },
+            }
+        }
+
+        (faults, filled)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Fills the page that faulted, and the pages that follow it if faults are sequential.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns the number of pages that were filled.
+    /// Otherwise, it returns an error.
+    ///
+    fn fill(&mut self, page: usize) -> Result<usize> {
+        self.window = if page == self.next {
+            (self.window * 2).min(self.max_window)
+        } else {
+            1
+        };
+        let npages: usize = self.window.min(self.file_pages - page);
+
+        let filled: usize = self.copy(page, npages)?;
+
+        self.next = page + npages;
+
+        Ok(filled)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Copies pages from the file into the region, waking up the threads that wait for them.
+    /// Copying stops at the first page that is already there.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns the number of pages that were filled.
+    /// Otherwise, it returns an error.
+    ///
+    fn copy(&self, page: usize, npages: usize) -> Result<usize> {
+        loop {
+            let mut copy: UffdioCopy = UffdioCopy {
+                dst: self.base + (page * PAGE_SIZE) as u64,
+                // The mapping of the file spans whole pages, and its tail reads as zeros.
+                src: self.file.ptr() as u64 + (page * PAGE_SIZE) as u64,
+                len: (npages * PAGE_SIZE) as u64,
+                mode: 0,
+                copy: 0,
+            };
+
+            let ret: libc::c_int = unsafe {
+                libc::ioctl(
+                    self.uffd,
+                    UFFDIO_COPY,
+                    &mut copy as *mut UffdioCopy as *mut libc::c_void,
+                )
+            };
+            if ret == 0 {
+                return Ok(npages);
+            }
+
+            match std::io::Error::last_os_error().raw_os_error() {
+                // The region is changing, thus try again.
+                Some(libc::EAGAIN) if copy.copy <= 0 => continue,
+                // Some page is already there. Pages before it were filled, and threads that wait
+                // for them were woken up.
+                Some(libc::EEXIST) | Some(libc::EAGAIN) if copy.copy > 0 => {
+                    return Ok(copy.copy as usize / PAGE_SIZE)
+                },
+                // The page that faulted is already there, thus only wake up threads.
+                Some(libc::EEXIST) => {
+                    self.wake(page)?;
+                    return Ok(0);
+                },
+                error => anyhow::bail!("failed to copy pages (error={:?})", error),
+            }
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Fills a page with zeros, waking up the threads that wait for it.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+    ///
+    fn zero(&self, page: usize) -> Result<()> {
+        loop {
+            let mut zeropage: UffdioZeropage = UffdioZeropage {
+                range: UffdioRange {
+                    start: self.base + (page * PAGE_SIZE) as u64,
+                    len: PAGE_SIZE as u64,
+                },
+                mode: 0,
+                zeropage: 0,
+            };
+
+            let ret: libc::c_int = unsafe {
+                libc::ioctl(
+                    self.uffd,
+                    UFFDIO_ZEROPAGE,
+                    &mut zeropage as *mut UffdioZeropage as *mut libc::c_void,
+                )
+            };
+            if ret == 0 {
+                return Ok(());
+            }
+
+            match std::io::Error::last_os_error().raw_os_error() {
+                // The region is changing, thus try again.
+                Some(libc::EAGAIN) => continue,
+                // The page is already there, thus only wake up threads.
+                Some(libc::EEXIST) => return self.wake(page),
+                error => anyhow::bail!("failed to zero page (error={:?})", error),
+            }
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Wakes up the threads that wait for a page.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+    ///
+    fn wake(&self, page: usize) -> Result<()> {
+        let mut range: UffdioRange = UffdioRange {
+            start: self.base + (page * PAGE_SIZE) as u64,
+            len: PAGE_SIZE as u64,
+        };
+        let ret: libc::c_int = unsafe {
+            libc::ioctl(self.uffd, UFFDIO_WAKE, &mut range as *mut UffdioRange as *mut libc::c_void)
+        };
+        if ret < 0 {
+            anyhow::bail!("failed to wake up threads");
+        }
+        Ok(())
+    }
+}
+
+//==================================================================================================
+// Trait Implementations
+//==================================================================================================
+
+impl Drop for DemandPager {
+    fn drop(&mut self) {
+        unsafe {
+            if let Some(handler) = self.handler.take() {
+                let one: u64 = 1;
+                if libc::write(self.stop, &one as *const u64 as *const libc::c_void, 8) < 0 {
+                    warn!("drop(): failed to stop handler thread");
+                }
+                match handler.join() {
+                    Ok((faults, filled)) => {
+                        debug!("drop(): faults={}, pages={}", faults, filled);
+                    },
+                    Err(_) => error!("drop(): handler thread panicked"),
+                }
+
+                let mut range: UffdioRange = self.range;
+                if libc::ioctl(
+                    self.uffd,
+                    UFFDIO_UNREGISTER,
+                    &mut range as *mut UffdioRange as *mut libc::c_void,
+                ) < 0
+                {
+                    warn!("drop(): failed to unregister region");
+                }
+            }
+
+            // Closing the file descriptor also unregisters the region, if the handler thread was
+            // not spawned.
+            libc::close(self.stop);
+            libc::close(self.uffd);
+        }
+    }
+}
+
+//==================================================================================================
+// Unit Tests
+//==================================================================================================
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use ::std::{
+        fs,
+        path::PathBuf,
+        slice,
+    };
+
+    #[test]
+    fn derives_request_numbers() {
+        assert_eq!(UFFDIO_API, 0xc018aa3f);
+        assert_eq!(UFFDIO_REGISTER, 0xc020aa00);
+        assert_eq!(UFFDIO_UNREGISTER, 0x8010aa01);
+        assert_eq!(UFFDIO_WAKE, 0x8010aa02);
+        assert_eq!(UFFDIO_COPY, 0xc028aa03);
+        assert_eq!(UFFDIO_ZEROPAGE, 0xc020aa04);
+        assert_eq!(mem::size_of::<UffdMsg>(), 32);
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Writes a file with a name that is unique to the calling test.
+    ///
+    fn write_file(name: &str, data: &[u8]) -> PathBuf {
+        let path: PathBuf = ::std::env::temp_dir().join(format!(
+            "microvm-pager-{}-{}.bin",
+            ::std::process::id(),
+            name
+        ));
+        fs::write(&path, data).unwrap();
+        path
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Maps an anonymous region, and registers it to be filled from a file with the given
+    /// read-ahead limit.
+    ///
+    /// # Returns
+    ///
+    /// This function returns the region and the demand pager, or `None` if `userfaultfd` is not
+    /// available.
+    ///
+    fn map_region(
+        file: FileMapping,
+        size: usize,
+        read_ahead: usize,
+    ) -> Option<(*mut u8, DemandPager)> {
+        let base: *mut u8 = unsafe {
+            libc::mmap(
+                ::std::ptr::null_mut(),
+                size,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_PRIVATE | libc::MAP_ANONYMOUS | libc::MAP_NORESERVE,
+                -1,
+                0,
+            ) as *mut u8
+        };
+        assert_ne!(base as *mut libc::c_void, libc::MAP_FAILED);
+
+        match DemandPager::new(base, size) {
+            Ok(mut pager) => {
+                pager.start(file, read_ahead).unwrap();
+                Some((base, pager))
+            },
+            Err(_) => {
+                eprintln!("userfaultfd is not available, skipping test");
+                unsafe { libc::munmap(base as *mut libc::c_void, size) };
+                None
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Checks that a region is filled from a file with the given read-ahead limit.
+    ///
+    fn check_fill(name: &str, read_ahead: usize) {
+        // The region is larger than the file, whose last page is partial.
+        let data: Vec<u8> = (0..3 * PAGE_SIZE + 100).map(|i| (i % 251) as u8).collect();
+        let path: PathBuf = write_file(name, &data);
+        let file: FileMapping = FileMapping::mmap(path.to_str().unwrap()).unwrap();
+        fs::remove_file(&path).unwrap();
+
+        let size: usize = 8 * PAGE_SIZE;
+        let Some((base, pager)) = map_region(file, size, read_ahead) else {
+            return;
+        };
+
+        // Touch a page in the middle first, so that both random and sequential faults are served.
+        let region: &[u8] = unsafe { slice::from_raw_parts(base, size) };
+        assert_eq!(region[2 * PAGE_SIZE + 1], data[2 * PAGE_SIZE + 1]);
+        assert_eq!(&region[..data.len()], &data[..]);
+        assert!(region[data.len()..].iter().all(|byte| *byte == 0));
+
+        drop(pager);
+        unsafe { libc::munmap(base as *mut libc::c_void, size) };
+    }
+
+    #[test]
+    fn fills_region_from_file() {
+        check_fill("fill", 256);
+    }
+
+    #[test]
+    fn fills_region_without_read_ahead() {
+        check_fill("fill-no-read-ahead", 1);
+    }
+
+    #[test]
+    fn zeroes_pages_that_cannot_be_filled() {
+        // Pages of a file that was truncated after it was mapped cannot be read.
+        let path: PathBuf = write_file("truncated", &[0xff; 2 * PAGE_SIZE]);
+        let file: FileMapping = FileMapping::mmap(path.to_str().unwrap()).unwrap();
+        fs::File::options()
+            .write(true)
+            .open(&path)
+            .unwrap()
+            .set_len(0)
+            .unwrap();
+        fs::remove_file(&path).unwrap();
+
+        let size: usize = 2 * PAGE_SIZE;
+        let Some((base, pager)) = map_region(file, size, 256) else {
+            return;
+        };
+
+        let region: &[u8] = unsafe { slice::from_raw_parts(base, size) };
+        assert!(region.iter().all(|byte| *byte == 0));
+
+        drop(pager);
+        unsafe { libc::munmap(base as *mut libc::c_void, size) };
+    }
+}
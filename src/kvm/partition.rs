@@ -6,10 +6,33 @@
 //==================================================================================================
 
 use ::anyhow::Result;
+use ::kvm_bindings::{
+    kvm_enable_cap,
+    KVM_CAP_X86_DISABLE_EXITS,
+    KVM_X86_DISABLE_EXITS_HLT,
+    KVM_X86_DISABLE_EXITS_MWAIT,
+    KVM_X86_DISABLE_EXITS_PAUSE,
+};
 use ::kvm_ioctls::{
     Kvm,
     VmFd,
 };
+use ::std::sync::OnceLock;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Exits that are disabled on request: the virtual processor then idles and spins in the guest.
+const IDLE_EXITS: u32 =
+    KVM_X86_DISABLE_EXITS_HLT | KVM_X86_DISABLE_EXITS_PAUSE | KVM_X86_DISABLE_EXITS_MWAIT;
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/// Handle to the KVM, shared by all virtual partitions of the process.
+static KVM: OnceLock<Kvm> = OnceLock::new();
 
 //==================================================================================================
 // Structures
@@ -21,10 +44,10 @@ use ::kvm_ioctls::{
 /// A structure that represents a virtual partition.
 ///
 pub struct VirtualPartition {
-    // Handle to the KVM.
-    _kvm: Kvm,
     // Handle to the virtual machine.
     vm: VmFd,
+    // Exits that are disabled, a combination of `KVM_X86_DISABLE_EXITS_*`.
+    disabled_exits: u32,
 }
 
 //==================================================================================================
@@ -37,25 +60,109 @@ impl VirtualPartition {
     ///
     /// Creates a new virtual partition.
     ///
+    /// # Parameters
+    ///
+    /// - `disable_exits`: Disable exits on `hlt`, `pause` and `mwait`? Virtual processors then
+    ///   idle in the guest rather than in the host, which suits virtual processors that have
+    ///   dedicated host cores. The guest must power off through the VMM port, rather than halt.
+    ///
     /// # Returns
     ///
     /// A new virtual partition.
     ///
-    pub fn new() -> Result<Self> {
-        trace!("new()");
+    pub fn new(disable_exits: bool) -> Result<Self> {
+        trace!("new(): disable_exits={}", disable_exits);
         crate::timer!("partition_creation");
-        let kvm: Kvm = Kvm::new()?;
+        let kvm: &Kvm = Self::kvm()?;
         let vm: VmFd = kvm.create_vm()?;
 
+        // Exits must be disabled before virtual processors are created.
+        let disabled_exits: u32 = if disable_exits {
+            Self::disable_idle_exits(kvm, &vm)?
+        } else {
+            0
+        };
+
+        Ok(Self { vm, disabled_exits })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Gets a handle to the KVM. The KVM is opened and checked for required features only once
+    /// per process, so that virtual partitions may be created without reopening it.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns a handle to the KVM. Otherwise, it
+    /// returns an error.
+    ///
+    pub fn kvm() -> Result<&'static Kvm> {
+        if let Some(kvm) = KVM.get() {
+            return Ok(kvm);
+        }
+
+        let kvm: Kvm = Kvm::new()?;
+
         // Check if the KVM supports the required features.
         let has_sync_mmu_support: bool = kvm.check_extension(kvm_ioctls::Cap::SyncMmu);
         if !has_sync_mmu_support {
             let reason: &str = "sync mmu is not supported";
-            error!("new(): {}", reason);
+            error!("kvm(): {}", reason);
+            anyhow::bail!(reason);
+        }
+        let has_xsave_support: bool = kvm.check_extension(kvm_ioctls::Cap::Xsave)
+            && kvm.check_extension(kvm_ioctls::Cap::Xcrs);
+        if !has_xsave_support {
+            let reason: &str = "xsave is not supported";
+            error!("kvm(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        // If another thread won the race, its handle is used and this one is closed.
+        Ok(KVM.get_or_init(|| kvm))
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Disables exits on `hlt`, `pause` and `mwait`, among those that KVM allows to disable.
+    /// Exits on `mwait` are only allowed if the host lets guests use it.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns the exits that were disabled, a
+    /// combination of `KVM_X86_DISABLE_EXITS_*`. Otherwise, it returns an error.
+    ///
+    fn disable_idle_exits(kvm: &Kvm, vm: &VmFd) -> Result<u32> {
+        let allowed: u32 = kvm.check_extension_int(kvm_ioctls::Cap::X86DisableExits) as u32;
+        let exits: u32 = IDLE_EXITS & allowed;
+        if exits & KVM_X86_DISABLE_EXITS_HLT == 0 {
+            let reason: String = format!("cannot disable hlt exits (allowed={:#x})", allowed);
+            error!("disable_idle_exits(): {}", reason);
             anyhow::bail!(reason);
         }
+        if exits != IDLE_EXITS {
+            warn!("disable_idle_exits(): some exits stay enabled (disabled={:#x})", exits);
+        }
+
+        let mut cap: kvm_enable_cap = kvm_enable_cap {
+            cap: KVM_CAP_X86_DISABLE_EXITS,
+            ..Default::default()
+        };
+        cap.args[0] = exits as u64;
+        vm.enable_cap(&cap)?;
 
-        Ok(Self { _kvm: kvm, vm })
+        Ok(exits)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Checks if guests may use `mwait`, which only holds if its exits are disabled.
+    ///
+    pub fn has_mwait(&self) -> bool {
+        self.disabled_exits & KVM_X86_DISABLE_EXITS_MWAIT != 0
     }
 
     ///
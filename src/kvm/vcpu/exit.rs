@@ -13,8 +13,12 @@
 pub enum VirtualProcessorExitReason {
     /// Port-mapped I/O access.
     PmioAccess,
+    /// Memory-mapped I/O access.
+    MmioAccess,
     /// Halt virtual processor.
     Halt,
+    /// Interrupted by the host.
+    Interrupted,
     /// Unknown.
     Unknown,
 }
@@ -28,9 +32,15 @@ pub enum VirtualProcessorExitContext<'a> {
     /// Port-mapped I/O input.
     PmioIn(u16, &'a mut [u8]),
     /// Port-mapped I/O output.
-    PmioOut(u16, u32, usize),
+    PmioOut(u16, &'a [u8]),
+    /// Memory-mapped I/O read.
+    MmioRead(u64, &'a mut [u8]),
+    /// Memory-mapped I/O write.
+    MmioWrite(u64, &'a [u8]),
     /// Halt virtual processor.
     Halt,
+    /// Interrupted by the host.
+    Interrupted,
     /// Unknown.
     Unknown,
 }
@@ -53,11 +63,16 @@ impl VirtualProcessorExitContext<'_> {
         match self {
             // Port-mapped I/O access.
             VirtualProcessorExitContext::PmioIn(_, _)
-            | VirtualProcessorExitContext::PmioOut(_, _, _) => {
-                &VirtualProcessorExitReason::PmioAccess
+            | VirtualProcessorExitContext::PmioOut(_, _) => &VirtualProcessorExitReason::PmioAccess,
+            // Memory-mapped I/O access.
+            VirtualProcessorExitContext::MmioRead(_, _)
+            | VirtualProcessorExitContext::MmioWrite(_, _) => {
+                &VirtualProcessorExitReason::MmioAccess
             },
             // Halt virtual processor..
             VirtualProcessorExitContext::Halt => &VirtualProcessorExitReason::Halt,
+            // Interrupted by the host.
+            VirtualProcessorExitContext::Interrupted => &VirtualProcessorExitReason::Interrupted,
             // Unknown.
             VirtualProcessorExitContext::Unknown => &VirtualProcessorExitReason::Unknown,
         }
@@ -17,21 +17,90 @@ pub use exit::*;
 // Imports
 //==================================================================================================
 
-use crate::kvm::partition::VirtualPartition;
+use crate::kvm::{
+    cpuid,
+    partition::VirtualPartition,
+    vmem::LongModeTables,
+};
 use ::anyhow::Result;
 use ::kvm_bindings::{
+    kvm_msr_entry,
     kvm_regs,
+    kvm_segment,
     kvm_sregs,
+    kvm_xcrs,
+    kvm_xsave,
+    CpuId,
+    Msrs,
+    KVM_SYNC_X86_REGS,
+    KVM_SYNC_X86_SREGS,
 };
 use ::kvm_ioctls::{
+    SyncReg,
     VcpuExit,
     VcpuFd,
 };
 use ::std::{
+    arch::x86_64::__cpuid,
     cell::RefCell,
     rc::Rc,
+    sync::atomic::{
+        AtomicU8,
+        Ordering,
+    },
 };
 
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Protection enable bit of the `cr0` register.
+const CR0_PE: u64 = 1 << 0;
+/// Monitor coprocessor bit of the `cr0` register.
+const CR0_MP: u64 = 1 << 1;
+/// Emulation bit of the `cr0` register.
+const CR0_EM: u64 = 1 << 2;
+/// Numeric error bit of the `cr0` register.
+const CR0_NE: u64 = 1 << 5;
+/// Paging bit of the `cr0` register.
+const CR0_PG: u64 = 1 << 31;
+/// Page size extensions bit of the `cr4` register.
+const CR4_PSE: u64 = 1 << 4;
+/// Physical address extension bit of the `cr4` register.
+const CR4_PAE: u64 = 1 << 5;
+/// FXSAVE and FXRSTOR support bit of the `cr4` register, which enables SSE instructions.
+const CR4_OSFXSR: u64 = 1 << 9;
+/// Unmasked SIMD floating-point exceptions support bit of the `cr4` register.
+const CR4_OSXMMEXCPT: u64 = 1 << 10;
+/// XSAVE and processor extended states enable bit of the `cr4` register.
+const CR4_OSXSAVE: u64 = 1 << 18;
+/// Long mode enable bit of the `efer` register.
+const EFER_LME: u64 = 1 << 8;
+/// Long mode active bit of the `efer` register.
+const EFER_LMA: u64 = 1 << 10;
+
+/// First extended leaf of the `cpuid` instruction, which reports the last extended leaf.
+const CPUID_EXTENDED_BASE: u32 = 0x8000_0000;
+/// Leaf of the `cpuid` instruction that reports advanced power management features.
+const CPUID_ADVANCED_POWER_MANAGEMENT: u32 = 0x8000_0007;
+/// Invariant time-stamp counter bit of the `edx` register, in the advanced power management leaf.
+const CPUID_INVARIANT_TSC: u32 = 1 << 8;
+
+/// Selector of flat code segments.
+const FLAT_CODE_SELECTOR: u16 = 0x08;
+/// Selector of flat data segments.
+const FLAT_DATA_SELECTOR: u16 = 0x10;
+
+/// MSR of KVM that sets the address where the wall-clock time is written.
+const MSR_KVM_WALL_CLOCK_NEW: u32 = 0x4b56_4d00;
+/// MSR of KVM that sets the address of the paravirtual clock of a virtual processor.
+const MSR_KVM_SYSTEM_TIME_NEW: u32 = 0x4b56_4d01;
+/// Enable bit of the paravirtual clock address.
+const KVM_SYSTEM_TIME_ENABLE: u64 = 1 << 0;
+
+/// Registers that are exchanged through the shared run structure, if KVM supports it.
+const SYNC_FIELDS: u32 = KVM_SYNC_X86_REGS | KVM_SYNC_X86_SREGS;
+
 //==================================================================================================
 // Structures
 //==================================================================================================
@@ -48,24 +117,146 @@ pub struct VirtualProcessor {
     fd: VcpuFd,
     // Processor state.
     online: bool,
+    // Immediate exit flag in the shared run structure of the virtual processor.
+    immediate_exit: *mut u8,
+    // Register state at power on.
+    initial_state: VirtualProcessorState,
+    // Address of the paravirtual clock, if it is enabled.
+    pvclock: Option<u64>,
+    // Are registers exchanged through the shared run structure, rather than with ioctls?
+    sync_regs: bool,
+    // General purpose registers, if they are not exchanged through the shared run structure.
+    regs: kvm_regs,
+    // System registers, if they are not exchanged through the shared run structure.
+    sregs: kvm_sregs,
+    // Cache state of general purpose registers.
+    regs_cache: RegisterCache,
+    // Cache state of system registers.
+    sregs_cache: RegisterCache,
 }
 
+///
+/// # Description
+///
+/// Cache state of a set of registers of a virtual processor.
+///
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum RegisterCache {
+    /// Registers must be read from KVM.
+    Invalid,
+    /// Registers hold the values in KVM.
+    Clean,
+    /// Registers were changed, and they are written to KVM when the guest is entered.
+    Dirty,
+}
+
+///
+/// # Description
+///
+/// Register state of a virtual processor. The `xsave` area is boxed, thus moving the state is
+/// cheap.
+///
+pub struct VirtualProcessorState {
+    // General purpose registers.
+    regs: kvm_regs,
+    // System registers.
+    sregs: kvm_sregs,
+    // Extended control registers.
+    xcrs: kvm_xcrs,
+    // Floating-point, SSE and AVX registers, as laid out by `xsave`.
+    xsave: Box<kvm_xsave>,
+}
+
+///
+/// # Description
+///
+/// A handle that forces a virtual processor out of the guest from another thread.
+///
+/// # Notes
+///
+/// Requesting preemption only makes the next entry into the guest fail. A virtual processor that
+/// is already in the guest must also be interrupted with a signal, which is delivered either
+/// before or after it enters the guest, but is never missed.
+///
+#[derive(Clone, Copy)]
+pub struct Preempter {
+    // Immediate exit flag in the shared run structure of the virtual processor.
+    immediate_exit: *mut u8,
+}
+
+// The flag is written atomically and lives in a mapping that is owned by the virtual processor.
+// Whoever requests preemption must make sure that the virtual processor is still alive.
+unsafe impl Send for Preempter {}
+unsafe impl Sync for Preempter {}
+
 impl VirtualProcessor {
     pub fn new(partition: Rc<RefCell<VirtualPartition>>, id: u64) -> Result<Self> {
         trace!("new(): id={}", id);
         crate::timer!("vcpu_creation");
-        let fd: VcpuFd = partition.borrow().vm().create_vcpu(id)?;
+        let mut fd: VcpuFd = partition.borrow().vm().create_vcpu(id)?;
+        // The run structure is memory mapped, thus it does not move along with the handle.
+        let immediate_exit: *mut u8 = &mut fd.get_kvm_run().immediate_exit as *mut u8;
+
+        // Expose the instruction set extensions of the host. This must precede setting control
+        // registers, which KVM checks against the CPUID of the guest.
+        let tsc_khz: Option<u32> = fd.get_tsc_khz().ok().filter(|tsc_khz| *tsc_khz > 0);
+        let mwait: bool = partition.borrow().has_mwait();
+        let vcpu_cpuid: CpuId = cpuid::build(id, tsc_khz, mwait)?;
+        fd.set_cpuid2(&vcpu_cpuid)?;
+
+        // Enable SSE, and AVX along with the state components of the host, so that guests may use
+        // them without setting up the processor.
+        let mut vcpu_sregs: kvm_sregs = fd.get_sregs()?;
+        vcpu_sregs.cr0 = (vcpu_sregs.cr0 & !CR0_EM) | CR0_MP | CR0_NE;
+        vcpu_sregs.cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+        let xcr0: u64 = cpuid::xcr0(&vcpu_cpuid);
+        let mut vcpu_xcrs: kvm_xcrs = fd.get_xcrs()?;
+        if xcr0 != 0 {
+            vcpu_sregs.cr4 |= CR4_OSXSAVE;
+            vcpu_xcrs.nr_xcrs = 1;
+            vcpu_xcrs.xcrs[0].xcr = 0;
+            vcpu_xcrs.xcrs[0].value = xcr0;
+        }
+        fd.set_sregs(&vcpu_sregs)?;
+        fd.set_xcrs(&vcpu_xcrs)?;
+
+        let initial_state: VirtualProcessorState = VirtualProcessorState {
+            regs: fd.get_regs()?,
+            sregs: fd.get_sregs()?,
+            xcrs: fd.get_xcrs()?,
+            xsave: Box::new(fd.get_xsave()?),
+        };
+
+        // Have KVM store registers into the run structure at every exit, and load them from there
+        // when they are changed, which saves ioctls on exits that access registers.
+        let sync_fields: u32 =
+            VirtualPartition::kvm()?.check_extension_int(kvm_ioctls::Cap::SyncRegs) as u32;
+        let sync_regs: bool = sync_fields & SYNC_FIELDS == SYNC_FIELDS;
+        if sync_regs {
+            fd.set_sync_valid_reg(SyncReg::Register);
+            fd.set_sync_valid_reg(SyncReg::SystemRegister);
+        }
+
         Ok(Self {
             _partition: partition,
             fd,
             online: false,
+            immediate_exit,
+            regs: initial_state.regs,
+            sregs: initial_state.sregs,
+            initial_state,
+            pvclock: None,
+            sync_regs,
+            regs_cache: RegisterCache::Invalid,
+            sregs_cache: RegisterCache::Invalid,
         })
     }
 
     ///
     /// # Description
     ///
-    /// Resets the virtual processor.
+    /// Resets the virtual processor. Registers are restored to their power-on state before they
+    /// are set, thus the virtual processor may be reset after it has run a guest.
     ///
     /// # Parameters
     ///
@@ -81,19 +272,172 @@ impl VirtualProcessor {
         trace!("reset(): rip={:#010x}, rax={:#010x}, rbx={:#010x}", rip, rax, rbx);
         crate::timer!("vcpu_reset");
 
-        // Reset system registers.
-        let mut vcpu_sregs: kvm_sregs = self.fd.get_sregs()?;
+        // Start in real mode, with a flat code segment.
+        let mut vcpu_sregs: kvm_sregs = self.initial_state.sregs;
         vcpu_sregs.cs.base = 0;
         vcpu_sregs.cs.selector = 0;
-        self.fd.set_sregs(&vcpu_sregs)?;
+
+        self.load_registers(&vcpu_sregs, rip, rax, rbx)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Resets the virtual processor straight into 64-bit long mode, with paging enabled and flat
+    /// 64-bit segments. Registers are restored to their power-on state before they are set.
+    ///
+    /// # Parameters
+    ///
+    /// - `rip`: Value to set the `rip` register.
+    /// - `rax`: Value to set the `rax` register.
+    /// - `rbx`: Value to set the `rbx` register.
+    /// - `tables`: Page tables and global descriptor table built in guest memory.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn reset_long_mode(
+        &mut self,
+        rip: u64,
+        rax: u64,
+        rbx: u64,
+        tables: &LongModeTables,
+    ) -> Result<()> {
+        trace!("reset_long_mode(): rip={:#018x}, rax={:#010x}, rbx={:#010x}", rip, rax, rbx);
+        crate::timer!("vcpu_reset");
+
+        let mut vcpu_sregs: kvm_sregs = self.initial_state.sregs;
+        Self::load_flat_segments(&mut vcpu_sregs, true);
+        vcpu_sregs.gdt.base = tables.gdt;
+        vcpu_sregs.gdt.limit = tables.gdt_size - 1;
+        vcpu_sregs.cr3 = tables.pml4;
+        vcpu_sregs.cr4 |= CR4_PAE;
+        vcpu_sregs.cr0 |= CR0_PE | CR0_PG;
+        vcpu_sregs.efer |= EFER_LME | EFER_LMA;
+
+        self.load_registers(&vcpu_sregs, rip, rax, rbx)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Resets the virtual processor straight into 32-bit protected mode, with flat 32-bit segments,
+    /// as in the PVH boot protocol. No global descriptor table is loaded, thus the guest must load
+    /// its own before it reloads segment registers. If a page directory is given, paging is
+    /// enabled with page size extensions. Registers are restored to their power-on state before
+    /// they are set.
+    ///
+    /// # Parameters
+    ///
+    /// - `rip`: Value to set the `rip` register.
+    /// - `rax`: Value to set the `rax` register.
+    /// - `rbx`: Value to set the `rbx` register.
+    /// - `page_directory`: Address of the page directory, if paging is enabled.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn reset_protected_mode(
+        &mut self,
+        rip: u64,
+        rax: u64,
+        rbx: u64,
+        page_directory: Option<u64>,
+    ) -> Result<()> {
+        trace!(
+            "reset_protected_mode(): rip={:#010x}, rax={:#010x}, rbx={:#010x}, \
+             page_directory={:x?}",
+            rip,
+            rax,
+            rbx,
+            page_directory
+        );
+        crate::timer!("vcpu_reset");
+
+        let mut vcpu_sregs: kvm_sregs = self.initial_state.sregs;
+        Self::load_flat_segments(&mut vcpu_sregs, false);
+        vcpu_sregs.cr0 |= CR0_PE;
+        if let Some(page_directory) = page_directory {
+            vcpu_sregs.cr3 = page_directory;
+            vcpu_sregs.cr4 |= CR4_PSE;
+            vcpu_sregs.cr0 |= CR0_PG;
+        }
+
+        self.load_registers(&vcpu_sregs, rip, rax, rbx)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Loads flat code and data segments, which span the whole address space, into system
+    /// registers.
+    ///
+    /// # Parameters
+    ///
+    /// - `vcpu_sregs`: System registers.
+    /// - `long_mode`: If set, the code segment is a 64-bit segment. Otherwise, it is a 32-bit one.
+    ///
+    fn load_flat_segments(vcpu_sregs: &mut kvm_sregs, long_mode: bool) {
+        let code: kvm_segment = kvm_segment {
+            base: 0,
+            limit: 0xffffffff,
+            selector: FLAT_CODE_SELECTOR,
+            type_: 0xb,
+            present: 1,
+            s: 1,
+            l: long_mode as u8,
+            db: !long_mode as u8,
+            g: 1,
+            ..Default::default()
+        };
+        let data: kvm_segment = kvm_segment {
+            base: 0,
+            limit: 0xffffffff,
+            selector: FLAT_DATA_SELECTOR,
+            type_: 0x3,
+            present: 1,
+            s: 1,
+            db: 1,
+            g: 1,
+            ..Default::default()
+        };
+
+        vcpu_sregs.cs = code;
+        vcpu_sregs.ds = data;
+        vcpu_sregs.es = data;
+        vcpu_sregs.fs = data;
+        vcpu_sregs.gs = data;
+        vcpu_sregs.ss = data;
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Loads system registers, and general purpose registers from their power-on state, and brings
+    /// the virtual processor online.
+    ///
+    fn load_registers(
+        &mut self,
+        vcpu_sregs: &kvm_sregs,
+        rip: u64,
+        rax: u64,
+        rbx: u64,
+    ) -> Result<()> {
+        // Reset system registers.
+        self.write_sregs(vcpu_sregs)?;
+
+        // Reset floating-point, SSE and AVX registers.
+        Self::set_extended_state(&self.fd, &self.initial_state)?;
 
         // Reset general purpose registers.
-        let mut vcpu_regs: kvm_regs = self.fd.get_regs()?;
+        let mut vcpu_regs: kvm_regs = self.initial_state.regs;
         vcpu_regs.rip = rip;
         vcpu_regs.rax = rax;
         vcpu_regs.rbx = rbx;
         vcpu_regs.rflags = 2;
-        self.fd.set_regs(&vcpu_regs)?;
+        self.write_regs(&vcpu_regs)?;
 
         // Processor is now online.
         self.online = true;
@@ -101,6 +445,311 @@ impl VirtualProcessor {
         Ok(())
     }
 
+    ///
+    /// # Description
+    ///
+    /// Saves the register state of the virtual processor. An I/O access that caused the last exit
+    /// is completed first, thus the virtual processor resumes after the access when the state is
+    /// restored.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the register state. Otherwise, it returns
+    /// an error.
+    ///
+    pub fn save_state(&mut self) -> Result<VirtualProcessorState> {
+        crate::timer!("vcpu_save_state");
+        self.complete_exit()?;
+        Ok(VirtualProcessorState {
+            regs: *self.regs()?,
+            sregs: *self.sregs()?,
+            xcrs: self.fd.get_xcrs()?,
+            xsave: Box::new(self.fd.get_xsave()?),
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Restores the register state of the virtual processor, which is brought online. An I/O
+    /// access that caused the last exit is completed first, so that it does not apply to the
+    /// restored state.
+    ///
+    /// # Parameters
+    ///
+    /// - `state`: Register state to restore.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn restore_state(&mut self, state: &VirtualProcessorState) -> Result<()> {
+        crate::timer!("vcpu_restore_state");
+        self.complete_exit()?;
+        self.write_sregs(&state.sregs)?;
+        Self::set_extended_state(&self.fd, state)?;
+        self.write_regs(&state.regs)?;
+
+        // Guest memory is rewound along with registers, thus have KVM update the clock again.
+        if let Some(pvclock) = self.pvclock {
+            self.write_msrs(&[(MSR_KVM_SYSTEM_TIME_NEW, pvclock | KVM_SYSTEM_TIME_ENABLE)])?;
+        }
+
+        self.online = true;
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the general purpose registers of the virtual processor. If KVM exchanges them
+    /// through the shared run structure, they are read from there after an exit, without an ioctl.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the registers. Otherwise, it returns an
+    /// error.
+    ///
+    pub fn regs(&mut self) -> Result<&kvm_regs> {
+        if self.regs_cache == RegisterCache::Invalid {
+            let vcpu_regs: kvm_regs = self.fd.get_regs()?;
+            *self.cached_regs() = vcpu_regs;
+            self.regs_cache = RegisterCache::Clean;
+        }
+        Ok(self.cached_regs())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the general purpose registers of the virtual processor for changing them. They are
+    /// written to KVM when the guest is next entered.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the registers. Otherwise, it returns an
+    /// error.
+    ///
+    pub fn regs_mut(&mut self) -> Result<&mut kvm_regs> {
+        self.regs()?;
+        self.regs_cache = RegisterCache::Dirty;
+        if self.sync_regs {
+            self.fd.set_sync_dirty_reg(SyncReg::Register);
+        }
+        Ok(self.cached_regs())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the system registers of the virtual processor. If KVM exchanges them through the
+    /// shared run structure, they are read from there after an exit, without an ioctl.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the registers. Otherwise, it returns an
+    /// error.
+    ///
+    pub fn sregs(&mut self) -> Result<&kvm_sregs> {
+        if self.sregs_cache == RegisterCache::Invalid {
+            let vcpu_sregs: kvm_sregs = self.fd.get_sregs()?;
+            *self.cached_sregs() = vcpu_sregs;
+            self.sregs_cache = RegisterCache::Clean;
+        }
+        Ok(self.cached_sregs())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the system registers of the virtual processor for changing them. They are written
+    /// to KVM when the guest is next entered.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the registers. Otherwise, it returns an
+    /// error.
+    ///
+    pub fn sregs_mut(&mut self) -> Result<&mut kvm_sregs> {
+        self.sregs()?;
+        self.sregs_cache = RegisterCache::Dirty;
+        if self.sync_regs {
+            self.fd.set_sync_dirty_reg(SyncReg::SystemRegister);
+        }
+        Ok(self.cached_sregs())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Overwrites the general purpose registers of the virtual processor, which need not be read
+    /// first.
+    ///
+    fn write_regs(&mut self, vcpu_regs: &kvm_regs) -> Result<()> {
+        self.regs_cache = RegisterCache::Clean;
+        *self.regs_mut()? = *vcpu_regs;
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Overwrites the system registers of the virtual processor, which need not be read first.
+    ///
+    fn write_sregs(&mut self, vcpu_sregs: &kvm_sregs) -> Result<()> {
+        self.sregs_cache = RegisterCache::Clean;
+        *self.sregs_mut()? = *vcpu_sregs;
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns where general purpose registers are cached.
+    ///
+    fn cached_regs(&mut self) -> &mut kvm_regs {
+        if self.sync_regs {
+            &mut self.fd.sync_regs_mut().regs
+        } else {
+            &mut self.regs
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns where system registers are cached.
+    ///
+    fn cached_sregs(&mut self) -> &mut kvm_sregs {
+        if self.sync_regs {
+            &mut self.fd.sync_regs_mut().sregs
+        } else {
+            &mut self.sregs
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Writes registers that were changed to KVM before the guest is entered, and sets the cache
+    /// state that they have once it exits. Registers that are exchanged through the shared run
+    /// structure are loaded by KVM on entry, and stored back on exit.
+    ///
+    fn flush_registers(&mut self) -> Result<()> {
+        if self.sync_regs {
+            self.regs_cache = RegisterCache::Clean;
+            self.sregs_cache = RegisterCache::Clean;
+            return Ok(());
+        }
+
+        if self.sregs_cache == RegisterCache::Dirty {
+            self.fd.set_sregs(&self.sregs)?;
+        }
+        if self.regs_cache == RegisterCache::Dirty {
+            self.fd.set_regs(&self.regs)?;
+        }
+        self.regs_cache = RegisterCache::Invalid;
+        self.sregs_cache = RegisterCache::Invalid;
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Enables the paravirtual clock of the virtual processor. KVM writes the wall-clock time at
+    /// which the clock read zero right away, and it updates the clock whenever the guest may
+    /// otherwise observe it drift, such that the guest reads time without exits.
+    ///
+    /// # Parameters
+    ///
+    /// - `wall_clock`: Guest address where the wall-clock time is written.
+    /// - `pvclock`: Guest address of the paravirtual clock, which must be 32-byte aligned.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn enable_pvclock(&mut self, wall_clock: u64, pvclock: u64) -> Result<()> {
+        trace!("enable_pvclock(): wall_clock={:#x}, pvclock={:#x}", wall_clock, pvclock);
+        self.write_msrs(&[
+            (MSR_KVM_WALL_CLOCK_NEW, wall_clock),
+            (MSR_KVM_SYSTEM_TIME_NEW, pvclock | KVM_SYSTEM_TIME_ENABLE),
+        ])?;
+        self.pvclock = Some(pvclock);
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Writes model-specific registers of the virtual processor.
+    ///
+    fn write_msrs(&mut self, values: &[(u32, u64)]) -> Result<()> {
+        let entries: Vec<kvm_msr_entry> = values
+            .iter()
+            .map(|(index, data)| kvm_msr_entry {
+                index: *index,
+                data: *data,
+                ..Default::default()
+            })
+            .collect();
+        let msrs: Msrs = match Msrs::from_entries(&entries) {
+            Ok(msrs) => msrs,
+            Err(e) => {
+                let reason: String = format!("failed to create msrs (error={:?})", e);
+                error!("write_msrs(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+
+        let nwritten: usize = self.fd.set_msrs(&msrs)?;
+        if nwritten != entries.len() {
+            let reason: String =
+                format!("failed to write msr (index={:#x})", entries[nwritten].index);
+            error!("write_msrs(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Sets extended control registers, and then floating-point, SSE and AVX registers, which
+    /// `xcr0` enables.
+    ///
+    fn set_extended_state(fd: &VcpuFd, state: &VirtualProcessorState) -> Result<()> {
+        fd.set_xcrs(&state.xcrs)?;
+        // SAFETY: KVM_CAP_XSAVE2 is not enabled, thus KVM reads the legacy area only.
+        unsafe { fd.set_xsave(&state.xsave)? };
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Completes the instruction that caused the last exit, without entering the guest. KVM only
+    /// finishes emulating I/O accesses when the virtual processor is run again, thus registers
+    /// are not consistent until then.
+    ///
+    fn complete_exit(&mut self) -> Result<()> {
+        self.flush_registers()?;
+        self.fd.set_kvm_immediate_exit(1);
+        let ret: Result<()> = match self.fd.run() {
+            Err(e) if e.errno() == libc::EINTR => Ok(()),
+            Err(e) => Err(e.into()),
+            Ok(_) => Err(anyhow::anyhow!("virtual processor entered the guest")),
+        };
+        self.fd.set_kvm_immediate_exit(0);
+
+        if let Err(ref e) = ret {
+            error!("complete_exit(): {}", e);
+        }
+        ret
+    }
+
     ///
     /// # Description
     ///
@@ -124,6 +773,72 @@ impl VirtualProcessor {
         self.online
     }
 
+    ///
+    /// # Description
+    ///
+    /// Returns the frequency of the time-stamp counter of the virtual processor.
+    ///
+    /// # Returns
+    ///
+    /// If KVM reports the frequency, this method returns it (in kHz). Otherwise, it returns `None`.
+    ///
+    pub fn tsc_khz(&self) -> Option<u32> {
+        match self.fd.get_tsc_khz() {
+            Ok(tsc_khz) if tsc_khz > 0 => Some(tsc_khz),
+            Ok(_) => None,
+            Err(e) => {
+                warn!("tsc_khz(): failed to get frequency (error={:?})", e);
+                None
+            },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Checks if the time-stamp counter of the host runs at a constant rate, regardless of power
+    /// states and frequency changes.
+    ///
+    /// # Returns
+    ///
+    /// If the time-stamp counter is invariant, this function returns `true`. Otherwise, it returns
+    /// `false` instead.
+    ///
+    pub fn has_invariant_tsc() -> bool {
+        let max_leaf: u32 = unsafe { __cpuid(CPUID_EXTENDED_BASE).eax };
+        if max_leaf < CPUID_ADVANCED_POWER_MANAGEMENT {
+            return false;
+        }
+
+        let edx: u32 = unsafe { __cpuid(CPUID_ADVANCED_POWER_MANAGEMENT).edx };
+        edx & CPUID_INVARIANT_TSC != 0
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns a handle that forces the virtual processor out of the guest.
+    ///
+    /// # Notes
+    ///
+    /// The handle must not be used after the virtual processor is dropped.
+    ///
+    pub fn preempter(&self) -> Preempter {
+        Preempter {
+            immediate_exit: self.immediate_exit,
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Withdraws a preemption request that arrived after the virtual processor had last exited.
+    /// This should be called before the virtual processor is given a new time slice.
+    ///
+    pub fn clear_preemption(&mut self) {
+        self.fd.set_kvm_immediate_exit(0);
+    }
+
     ///
     /// # Description
     ///
@@ -137,29 +852,34 @@ impl VirtualProcessor {
     ///
     pub fn run(&mut self) -> Result<VirtualProcessorExitContext> {
         crate::timer!("vcpu_run");
+        self.flush_registers()?;
         // Run the virtual processor and parse exit reason.
-        match self.fd.run()? {
+        let exit: VcpuExit = match self.fd.run() {
+            Ok(exit) => exit,
+            // A signal was delivered to the thread that runs the virtual processor.
+            Err(e) if e.errno() == libc::EINTR => {
+                // Re-arm the virtual processor in case it was preempted. The flag is cleared
+                // through its pointer, because the handle stays borrowed by the exit.
+                let immediate_exit: &AtomicU8 = unsafe { AtomicU8::from_ptr(self.immediate_exit) };
+                immediate_exit.store(0, Ordering::Relaxed);
+                return Ok(VirtualProcessorExitContext::Interrupted);
+            },
+            Err(e) => {
+                self.regs_cache = RegisterCache::Invalid;
+                self.sregs_cache = RegisterCache::Invalid;
+                return Err(e.into());
+            },
+        };
+        match exit {
             // Read from an I/O port.
             VcpuExit::IoIn(port, data) => Ok(VirtualProcessorExitContext::PmioIn(port, data)),
             // Write to an I/O port.
-            VcpuExit::IoOut(port, data) => {
-                let mut value: u32 = 0;
-                for (i, b) in data.iter().enumerate() {
-                    value |= (*b as u32) << (i * 8);
-                }
-                Ok(VirtualProcessorExitContext::PmioOut(port, value, data.len()))
-            },
+            VcpuExit::IoOut(port, data) => Ok(VirtualProcessorExitContext::PmioOut(port, data)),
             // Read from an MMIO region.
-            VcpuExit::MmioRead(addr, data) => {
-                // TODO: handle MMIO read.
-                warn!("run(): mmio read (addr={:#010x}, data.len={})", addr, data.len());
-                Ok(VirtualProcessorExitContext::Unknown)
-            },
+            VcpuExit::MmioRead(addr, data) => Ok(VirtualProcessorExitContext::MmioRead(addr, data)),
             // Write to a MMIO region.
             VcpuExit::MmioWrite(addr, data) => {
-                // TODO: handle MMIO write.
-                warn!("run(): mmio write (addr={:#010x}, data.len={})", addr, data.len());
-                Ok(VirtualProcessorExitContext::Unknown)
+                Ok(VirtualProcessorExitContext::MmioWrite(addr, data))
             },
             // Exception occurred.
             VcpuExit::Exception => {
@@ -220,3 +940,20 @@ impl VirtualProcessor {
         }
     }
 }
+
+impl Preempter {
+    ///
+    /// # Description
+    ///
+    /// Requests the virtual processor to leave the guest at its next entry.
+    ///
+    /// # Safety
+    ///
+    /// The virtual processor must not have been dropped, because the flag lives in its run
+    /// structure, which is unmapped along with it.
+    ///
+    pub unsafe fn request(&self) {
+        let immediate_exit: &AtomicU8 = unsafe { AtomicU8::from_ptr(self.immediate_exit) };
+        immediate_exit.store(1, Ordering::Release);
+    }
+}
@@ -6,21 +6,74 @@
 //==================================================================================================
 
 use crate::{
+    bootinfo::{
+        BootInfo,
+        MemoryRegionType,
+        BOOT_INFO_PAGE_SIZE,
+    },
+    compression,
     config,
-    elf,
-    kvm::partition::VirtualPartition,
+    elf::{
+        ElfClass,
+        Program,
+    },
+    image::KernelImage,
+    kvm::{
+        pager::DemandPager,
+        partition::VirtualPartition,
+    },
     pal::FileMapping,
 };
 use ::anyhow::Result;
-use ::kvm_bindings::kvm_userspace_memory_region;
+use ::kvm_bindings::{
+    kvm_userspace_memory_region,
+    KVM_MEM_LOG_DIRTY_PAGES,
+};
 use ::std::{
     cell::RefCell,
+    io,
+    os::fd::{
+        AsRawFd,
+        FromRawFd,
+        OwnedFd,
+        RawFd,
+    },
     ptr::{
         self,
     },
     rc::Rc,
+    slice,
+    sync::Arc,
 };
 
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of a page, which is the granularity of dirty page tracking.
+const PAGE_SIZE: usize = 4096;
+
+/// Size of a large page that is mapped by a page directory entry in long mode.
+const LARGE_PAGE_SIZE: u64 = 2 * 1024 * 1024;
+
+/// Size of a large page that is mapped by a page directory entry in 32-bit protected mode, with
+/// page size extensions.
+const PSE_PAGE_SIZE: u64 = 4 * 1024 * 1024;
+
+/// Size of the memory that is mapped by a page directory in long mode.
+const PAGE_DIRECTORY_SPAN: u64 = 1024 * 1024 * 1024;
+
+/// Page table entry flags.
+const PTE_PRESENT: u64 = 1 << 0;
+const PTE_WRITABLE: u64 = 1 << 1;
+const PTE_LARGE: u64 = 1 << 7;
+
+/// Limit below which the boot information page is placed, so that 32-bit kernels reach it.
+const BOOT_INFO_LIMIT: u64 = 1 << 32;
+
+/// Global descriptor table for long mode: null, 64-bit code and data segments.
+const LONG_MODE_GDT: [u64; 3] = [0, 0x00af9a000000ffff, 0x00cf92000000ffff];
+
 //==================================================================================================
 // Structures
 //==================================================================================================
@@ -31,8 +84,8 @@ use ::std::{
 /// A structure that represents the memory of a virtual machine.
 ///
 pub struct VirtualMemory {
-    /// Underlying virtual partition.
-    partition: Rc<RefCell<VirtualPartition>>,
+    /// Underlying virtual partition, if the virtual memory is mapped into a virtual machine.
+    _partition: Option<Rc<RefCell<VirtualPartition>>>,
     /// Virtual memory.
     ptr: *mut u8,
     /// Size of the virtual memory.
@@ -40,7 +93,45 @@ pub struct VirtualMemory {
     /// Kernel location and size.
     kernel: Option<(u64, usize)>,
     /// Initial RAM disk location and size.
-    _initrd: Option<(u64, usize)>,
+    initrd: Option<(u64, usize)>,
+    /// Snapshot to which the virtual memory can be rewound, if any.
+    snapshot: Option<Snapshot>,
+    /// Pager that fills the initial RAM disk on first access, if any.
+    pager: Option<DemandPager>,
+}
+
+///
+/// # Description
+///
+/// Structures that the virtual machine monitor builds in guest memory for entering long mode.
+///
+#[derive(Clone, Copy)]
+pub struct LongModeTables {
+    /// Base address of the structures.
+    pub base: u64,
+    /// Address of the top-level page table.
+    pub pml4: u64,
+    /// Address of the global descriptor table.
+    pub gdt: u64,
+    /// Size of the global descriptor table in bytes.
+    pub gdt_size: u16,
+}
+
+///
+/// # Description
+///
+/// A snapshot of the virtual memory. The contents of the virtual memory are moved into a memory
+/// file, which the virtual memory then maps privately: pages are shared with the snapshot until
+/// they are written, and only the pages that are written take up more memory. Pages that are
+/// written after the snapshot is taken are tracked, so that rewinding discards only those pages.
+///
+struct Snapshot {
+    /// Memory file that holds the contents of the virtual memory when the snapshot was taken.
+    /// Pages that were zero are holes, which take up no memory.
+    file: OwnedFd,
+    /// Pages written by the host since the snapshot was taken or last rewound, one bit per page.
+    /// Pages written by the guest are tracked by KVM.
+    host_dirty: Vec<u64>,
 }
 
 //==================================================================================================
@@ -67,8 +158,42 @@ impl VirtualMemory {
         trace!("new(): memory_size={}", memory_size);
         crate::timer!("vmem_creation");
 
+        // Allocate memory. If we fail later on, destructor will free memory.
+        let mut vmem: Self = Self::allocate(memory_size)?;
+
+        // Map memory into virtual machine.
+        let mem_region: kvm_userspace_memory_region = kvm_userspace_memory_region {
+            slot: 0,
+            flags: 0,
+            guest_phys_addr: 0,
+            memory_size: memory_size as u64,
+            userspace_addr: vmem.ptr as u64,
+        };
+        unsafe { partition.borrow().vm().set_user_memory_region(mem_region)? };
+
+        vmem._partition = Some(partition);
+
+        Ok(vmem)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Allocates a new virtual memory without mapping it into a virtual machine. This enables
+    /// host-side code to be exercised without KVM.
+    ///
+    /// # Parameters
+    ///
+    /// - `memory_size`: Size of the virtual memory.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, the function returns the new virtual memory. Otherwise, it
+    /// returns an error.
+    ///
+    pub fn allocate(memory_size: usize) -> Result<Self> {
         // Allocate memory.
-        let ptr: *mut u8 = unsafe {
+        let ptr: *mut libc::c_void = unsafe {
             libc::mmap(
                 ptr::null_mut(),
                 memory_size,
@@ -76,41 +201,172 @@ impl VirtualMemory {
                 libc::MAP_ANONYMOUS | libc::MAP_PRIVATE | libc::MAP_NORESERVE,
                 -1,
                 0,
-            ) as *mut u8
+            )
         };
 
         // Check if we failed to allocate memory for the virtual machine.
-        if ptr.is_null() {
+        if ptr == libc::MAP_FAILED {
             let reason: String = "failed to allocate memory for the virtual machine".to_string();
-            error!("new(): {} (memory_size={:?})", reason, memory_size);
+            error!("allocate(): {} (memory_size={:?})", reason, memory_size);
             return Err(anyhow::anyhow!(reason));
         }
 
-        // Create virtual memory. If we fail, destructor will free memory.
-        let vmem: Self = Self {
-            partition,
-            ptr,
+        Ok(Self {
+            _partition: None,
+            ptr: ptr as *mut u8,
             size: memory_size,
             kernel: None,
-            _initrd: None,
+            initrd: None,
+            snapshot: None,
+            pager: None,
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Clears the virtual memory, so that it can host another kernel. Pages are given back to the
+    /// host, which provides zero-filled pages once they are touched again.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn clear(&mut self) -> Result<()> {
+        crate::timer!("vmem_clear");
+        trace!("clear()");
+
+        // Pages that are discarded must read as zeros, rather than being filled again.
+        self.pager = None;
+
+        let ret: libc::c_int =
+            unsafe { libc::madvise(self.ptr as *mut libc::c_void, self.size, libc::MADV_DONTNEED) };
+        if ret != 0 {
+            let reason: String = "failed to clear virtual memory".to_string();
+            error!("clear(): {} (ret={})", reason, ret);
+            return Err(anyhow::anyhow!(reason));
+        }
+
+        self.kernel = None;
+        self.initrd = None;
+
+        // Discarded pages of a snapshot would read back from it, thus give the memory its own
+        // anonymous pages again.
+        if self.snapshot.take().is_some() {
+            self.remap(None)?;
+        }
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Takes a snapshot of the virtual memory and starts tracking pages that are written from then
+    /// on, so that the virtual memory can later be rewound to the snapshot.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn snapshot(&mut self) -> Result<()> {
+        crate::timer!("vmem_snapshot");
+        trace!("snapshot()");
+
+        let partition: Rc<RefCell<VirtualPartition>> = match self._partition {
+            Some(ref partition) => partition.clone(),
+            None => {
+                let reason: String = "virtual memory is not mapped into a partition".to_string();
+                error!("snapshot(): {}", reason);
+                anyhow::bail!(reason);
+            },
         };
 
-        // Map memory into virtual machine.
+        // Log pages that the guest writes.
         let mem_region: kvm_userspace_memory_region = kvm_userspace_memory_region {
             slot: 0,
-            flags: 0,
+            flags: KVM_MEM_LOG_DIRTY_PAGES,
             guest_phys_addr: 0,
-            memory_size: memory_size as u64,
-            userspace_addr: ptr as u64,
-        };
-        unsafe {
-            vmem.partition
-                .borrow()
-                .vm()
-                .set_user_memory_region(mem_region)?
+            memory_size: self.size as u64,
+            userspace_addr: self.ptr as u64,
         };
+        unsafe { partition.borrow().vm().set_user_memory_region(mem_region)? };
 
-        Ok(vmem)
+        // Move the contents of the virtual memory into a memory file. Pages that the pager has
+        // not filled yet are filled as they are read, and the pager is no longer needed then.
+        let file: OwnedFd = self.write_snapshot_file()?;
+        self.pager = None;
+        self.remap(Some(file.as_raw_fd()))?;
+
+        // Pages that were written before this point are part of the snapshot.
+        partition.borrow().vm().get_dirty_log(0, self.size)?;
+
+        self.snapshot = Some(Snapshot {
+            file,
+            host_dirty: vec![0; self.size.div_ceil(PAGE_SIZE).div_ceil(u64::BITS as usize)],
+        });
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Rewinds the virtual memory to its snapshot. Only pages that were written since the snapshot
+    /// was taken, or since the last rewind, are discarded, and they read back from the snapshot on
+    /// their next access. The cost of this method thus scales with the number of pages touched
+    /// rather than with the size of the virtual memory.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the number of pages that were discarded.
+    /// Otherwise, it returns an error.
+    ///
+    pub fn rewind(&mut self) -> Result<usize> {
+        crate::timer!("vmem_rewind");
+
+        let (partition, snapshot): (&Rc<RefCell<VirtualPartition>>, &mut Snapshot) =
+            match (&self._partition, &mut self.snapshot) {
+                (Some(partition), Some(snapshot)) => (partition, snapshot),
+                _ => {
+                    let reason: String = "virtual memory has no snapshot".to_string();
+                    error!("rewind(): {}", reason);
+                    anyhow::bail!(reason);
+                },
+            };
+
+        // Reading the log also clears it.
+        let guest_dirty: Vec<u64> = partition.borrow().vm().get_dirty_log(0, self.size)?;
+
+        // Discard runs of consecutive pages at once.
+        let mut npages: usize = 0;
+        let mut run: Option<(usize, usize)> = None;
+        for (index, (guest, host)) in guest_dirty
+            .iter()
+            .zip(snapshot.host_dirty.iter_mut())
+            .enumerate()
+        {
+            let mut bits: u64 = *guest | *host;
+            *host = 0;
+            while bits != 0 {
+                let page: usize = index * u64::BITS as usize + bits.trailing_zeros() as usize;
+                bits &= bits - 1;
+                run = match run {
+                    Some((start, end)) if end == page => Some((start, page + 1)),
+                    Some((start, end)) => {
+                        Self::discard(self.ptr, self.size, start, end)?;
+                        Some((page, page + 1))
+                    },
+                    None => Some((page, page + 1)),
+                };
+                npages += 1;
+            }
+        }
+        if let Some((start, end)) = run {
+            Self::discard(self.ptr, self.size, start, end)?;
+        }
+
+        Ok(npages)
     }
 
     ///
@@ -124,20 +380,195 @@ impl VirtualMemory {
     ///
     /// # Returns
     ///
-    /// Upon successful completion, this method returns the entry point of the kernel that was
-    /// loaded into the virtual memory. Otherwise, it returns an error.
+    /// Upon successful completion, this method returns the kernel that was loaded into the
+    /// virtual memory. Otherwise, it returns an error.
     ///
-    pub fn load_kernel(&mut self, kernel_filename: &str) -> Result<u64> {
+    pub fn load_kernel(&mut self, kernel_filename: &str) -> Result<Program> {
         crate::timer!("vmem_load_kernel");
         trace!("load_kernel(): {}", kernel_filename);
 
-        let elf: FileMapping = FileMapping::mmap(kernel_filename)?;
-        let (entry, first_address, size): (usize, usize, usize) =
-            unsafe { elf::load(self.ptr as *mut ::std::ffi::c_void, elf.ptr(), self.size)? };
+        // Kernels are parsed once per process, and their segments are then copied from memory.
+        let image: Arc<KernelImage> = KernelImage::get(kernel_filename, self.size)?;
+        let program: Program = image.program();
+
+        // Check if kernel fits in memory.
+        let end: Option<usize> = program.first_address.checked_add(program.size);
+        if end.is_none_or(|end| end > self.size)
+            || (program.class == ElfClass::Elf64 && program.entry >= self.size)
+            || program.phys32_entry.is_some_and(|entry| entry >= self.size)
+        {
+            let reason: String = "kernel does not fit in memory".to_string();
+            error!(
+                "load_kernel(): {} (first_address={:#010x}, size={:#010x}, memory={:#010x})",
+                reason, program.first_address, program.size, self.size
+            );
+            anyhow::bail!(reason);
+        }
+
+        for (address, contents) in image.segments() {
+            self.write_bytes(address as u64, contents)?;
+        }
+
+        self.kernel = Some((program.first_address as u64, program.size));
+
+        Ok(program)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the address of the boot information page, which is the last page of the virtual
+    /// memory below 4 GB.
+    ///
+    pub fn boot_info_address(&self) -> u64 {
+        ((self.size as u64).min(BOOT_INFO_LIMIT) & !(PAGE_SIZE as u64 - 1))
+            - BOOT_INFO_PAGE_SIZE as u64
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Writes the boot information page into the virtual memory, which must not hold the kernel
+    /// nor the initial RAM disk there. The memory map and the list of modules are filled in
+    /// before.
+    ///
+    /// # Parameters
+    ///
+    /// - `info`: Boot information.
+    /// - `tables`: Base address of the structures that were built for entering the kernel with
+    ///   paging enabled, if any.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the address of the boot information page.
+    /// Otherwise, it returns an error.
+    ///
+    pub fn write_boot_info(&mut self, info: &mut BootInfo, tables: Option<u64>) -> Result<u64> {
+        crate::timer!("vmem_write_boot_info");
+
+        let base: u64 = self.boot_info_address();
+        let end: u64 = base + BOOT_INFO_PAGE_SIZE as u64;
+        self.check_unused(base, end, "no room for boot information")?;
+
+        info.set_memory_size(self.size as u64);
+        if let Some((start, size)) = self.kernel {
+            info.add_region(start, size as u64, MemoryRegionType::Kernel)?;
+        }
+        if let Some((start, size)) = self.initrd {
+            info.add_module(start, size as u64)?;
+        }
+        let reserved: u64 = tables.unwrap_or(base);
+        info.add_region(reserved, end - reserved, MemoryRegionType::Reserved)?;
+
+        let mut page: [u8; BOOT_INFO_PAGE_SIZE] = [0; BOOT_INFO_PAGE_SIZE];
+        page[..info.as_bytes().len()].copy_from_slice(info.as_bytes());
+        self.write_bytes(base, &page)?;
+
+        Ok(base)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Builds the page directory that a 32-bit kernel needs to be entered in protected mode with
+    /// paging enabled. It identity maps the virtual memory below 4 GB with 4 MB pages, and it is
+    /// placed right below the boot information page, which must not hold the kernel nor the
+    /// initial RAM disk.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the address of the page directory.
+    /// Otherwise, it returns an error.
+    ///
+    pub fn build_protected_mode_tables(&mut self) -> Result<u64> {
+        crate::timer!("vmem_build_protected_mode_tables");
+
+        let top: u64 = self.boot_info_address();
+        let base: u64 = match top.checked_sub(PAGE_SIZE as u64) {
+            Some(base) => base,
+            None => {
+                let reason: String = "invalid memory size for paging".to_string();
+                error!("build_protected_mode_tables(): {} (size={:#x})", reason, self.size);
+                anyhow::bail!(reason);
+            },
+        };
+        self.check_unused(base, top, "no room for page tables")?;
 
-        self.kernel = Some((first_address as u64, size));
+        // Pages that are only partially backed by the virtual memory are mapped as well.
+        let npages: u64 = (self.size as u64)
+            .min(BOOT_INFO_LIMIT)
+            .div_ceil(PSE_PAGE_SIZE);
+        let mut page_directory: [u32; PAGE_SIZE / 4] = [0; PAGE_SIZE / 4];
+        for (i, entry) in page_directory.iter_mut().take(npages as usize).enumerate() {
+            *entry = ((i as u64 * PSE_PAGE_SIZE) | PTE_PRESENT | PTE_WRITABLE | PTE_LARGE) as u32;
+        }
 
-        Ok(entry as u64)
+        let bytes: &[u8] = unsafe {
+            ::std::slice::from_raw_parts(page_directory.as_ptr() as *const u8, PAGE_SIZE)
+        };
+        self.write_bytes(base, bytes)?;
+
+        Ok(base)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Builds the structures that a 64-bit kernel needs to be entered in long mode: identity
+    /// page tables that map the whole virtual memory with 2 MB pages, and a global descriptor
+    /// table. They are placed right below the boot information page, which must not hold the
+    /// kernel nor the initial RAM disk.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the location of the structures that were
+    /// built. Otherwise, it returns an error.
+    ///
+    pub fn build_long_mode_tables(&mut self) -> Result<LongModeTables> {
+        crate::timer!("vmem_build_long_mode_tables");
+
+        // One page for the global descriptor table, one for the top-level table, one for the
+        // page directory pointer table, and one for each page directory.
+        let npds: u64 = (self.size as u64).div_ceil(PAGE_DIRECTORY_SPAN);
+        let npages: u64 = 3 + npds;
+        let top: u64 = self.boot_info_address();
+        let base: u64 = match top.checked_sub(npages * PAGE_SIZE as u64) {
+            Some(base) if npds <= 512 => base,
+            _ => {
+                let reason: String = "invalid memory size for long mode".to_string();
+                error!("build_long_mode_tables(): {} (size={:#x})", reason, self.size);
+                anyhow::bail!(reason);
+            },
+        };
+
+        self.check_unused(base, top, "no room for page tables")?;
+
+        let gdt: u64 = base;
+        let pml4: u64 = gdt + PAGE_SIZE as u64;
+        let pdpt: u64 = pml4 + PAGE_SIZE as u64;
+        let pds: u64 = pdpt + PAGE_SIZE as u64;
+
+        let mut tables: Vec<u64> = vec![0; npages as usize * PAGE_SIZE / 8];
+        let entries: usize = PAGE_SIZE / 8;
+        tables[..LONG_MODE_GDT.len()].copy_from_slice(&LONG_MODE_GDT);
+        tables[entries] = pdpt | PTE_PRESENT | PTE_WRITABLE;
+        for i in 0..npds as usize {
+            tables[2 * entries + i] = (pds + (i * PAGE_SIZE) as u64) | PTE_PRESENT | PTE_WRITABLE;
+        }
+        for (i, entry) in tables[3 * entries..].iter_mut().enumerate() {
+            *entry = (i as u64 * LARGE_PAGE_SIZE) | PTE_PRESENT | PTE_WRITABLE | PTE_LARGE;
+        }
+
+        let bytes: &[u8] =
+            unsafe { ::std::slice::from_raw_parts(tables.as_ptr() as *const u8, tables.len() * 8) };
+        self.write_bytes(base, bytes)?;
+
+        Ok(LongModeTables {
+            base,
+            pml4,
+            gdt,
+            gdt_size: (LONG_MODE_GDT.len() * 8) as u16,
+        })
     }
 
     ///
@@ -160,27 +591,122 @@ impl VirtualMemory {
         trace!("load_initrd(): {}", initrd_filename);
 
         let initrd: FileMapping = FileMapping::mmap(initrd_filename)?;
+        let source: &[u8] = unsafe { slice::from_raw_parts(initrd.ptr(), initrd.size()) };
+
+        // Place the initrd right after the kernel, so that it cannot overlap with it.
+        let base: usize = self.initrd_base();
 
-        // Check if initrd would overlap with kernel.
-        if let Some((kernel_base, kernel_size)) = self.kernel {
-            if (initrd.ptr() as usize) < (kernel_base as usize + kernel_size) {
-                let reason: String = "initrd overlaps with kernel".to_string();
-                error!("load_initrd(): {}", reason);
-                return Err(anyhow::anyhow!(reason));
+        let size: usize = if compression::is_compressed(source) {
+            // Decompress the initrd straight into the virtual memory, up to its end.
+            if base >= self.size {
+                let reason: String = "initrd does not fit in memory".to_string();
+                error!("load_initrd(): {} (base={:#x}, size={:#x})", reason, base, self.size);
+                anyhow::bail!(reason);
+            }
+            let destination: &mut [u8] =
+                unsafe { slice::from_raw_parts_mut(self.ptr.add(base), self.size - base) };
+            compression::decompress(source, destination)?
+        } else {
+            let size: usize = initrd.size();
+            if base + size.next_multiple_of(PAGE_SIZE) > self.size {
+                let reason: String = "initrd does not fit in memory".to_string();
+                error!("load_initrd(): {} (base={:#x}, size={:#x})", reason, base, size);
+                anyhow::bail!(reason);
             }
-        }
 
-        unsafe {
-            ptr::copy_nonoverlapping(
-                initrd.ptr(),
-                self.ptr.add(config::INITRD_BASE),
-                initrd.size(),
-            );
+            // Fill the initrd on first access, unless demand paging is disabled. Pages of the
+            // region are discarded first, because only missing pages are filled. If demand paging
+            // is not available, copy it now.
+            self.pager = None;
+            let destination: *mut u8 = unsafe { self.ptr.add(base) };
+            if config::DEMAND_PAGING {
+                let ret: libc::c_int = unsafe {
+                    libc::madvise(
+                        destination as *mut libc::c_void,
+                        size.next_multiple_of(PAGE_SIZE),
+                        libc::MADV_DONTNEED,
+                    )
+                };
+                if ret != 0 {
+                    let reason: String = "failed to discard initrd region".to_string();
+                    error!("load_initrd(): {} (ret={})", reason, ret);
+                    anyhow::bail!(reason);
+                }
+                match DemandPager::new(destination, size) {
+                    Ok(mut pager) => {
+                        pager.start(initrd, config::DEMAND_PAGING_READ_AHEAD)?;
+                        self.pager = Some(pager);
+                    },
+                    Err(e) => {
+                        warn!("load_initrd(): copying initrd (error={:?})", e);
+                        unsafe { ptr::copy_nonoverlapping(initrd.ptr(), destination, size) };
+                    },
+                }
+            } else {
+                unsafe { ptr::copy_nonoverlapping(initrd.ptr(), destination, size) };
+            }
+            size
+        };
+
+        self.initrd = Some((base as u64, size));
+
+        Ok((base as u64, size))
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Computes the smallest memory size that holds a kernel, its initial RAM disk, the structures
+    /// of the virtual machine monitor and some headroom.
+    ///
+    /// # Parameters
+    ///
+    /// - `kernel_filename`: Path to the kernel binary.
+    /// - `initrd_filename`: Path to the initial RAM disk, if any.
+    /// - `headroom`: Memory that is left free for the kernel to use.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns the memory size, which is a multiple of
+    /// 2 MB. Otherwise, it returns an error.
+    ///
+    pub fn required_size(
+        kernel_filename: &str,
+        initrd_filename: Option<&str>,
+        headroom: usize,
+    ) -> Result<usize> {
+        crate::timer!("vmem_required_size");
+
+        // Kernels are parsed once per process, thus loading the kernel later on is free. They lie
+        // below the boot information page, thus below 4 GB.
+        let image: Arc<KernelImage> = KernelImage::get(kernel_filename, BOOT_INFO_LIMIT as usize)?;
+        let program: Program = image.program();
+        let mut size: usize = (program.first_address + program.size).next_multiple_of(PAGE_SIZE);
+
+        if let Some(initrd_filename) = initrd_filename {
+            let initrd: FileMapping = FileMapping::mmap(initrd_filename)?;
+            let source: &[u8] = unsafe { slice::from_raw_parts(initrd.ptr(), initrd.size()) };
+            let initrd_size: usize = if compression::is_compressed(source) {
+                match compression::decompressed_size(source)? {
+                    Some(initrd_size) => initrd_size,
+                    None => {
+                        let reason: String = "size of initrd is not recorded".to_string();
+                        error!("required_size(): {} (path={})", reason, initrd_filename);
+                        anyhow::bail!(reason);
+                    },
+                }
+            } else {
+                initrd.size()
+            };
+            size += initrd_size.next_multiple_of(PAGE_SIZE);
         }
 
-        self._initrd = Some((config::INITRD_BASE as u64, initrd.size()));
+        // One page for the boot information, and the structures for entering long mode.
+        size += headroom;
+        let npds: usize = (size as u64).div_ceil(PAGE_DIRECTORY_SPAN) as usize;
+        size += (4 + npds) * PAGE_SIZE;
 
-        Ok((config::INITRD_BASE as u64, initrd.size()))
+        Ok(size.next_multiple_of(LARGE_PAGE_SIZE as usize))
     }
 
     ///
@@ -199,7 +725,8 @@ impl VirtualMemory {
     ///
     pub fn write_bytes(&mut self, addr: u64, data: &[u8]) -> Result<()> {
         // Check if region lies within the virtual memory.
-        if addr as usize + data.len() > self.size {
+        let end: Option<usize> = (addr as usize).checked_add(data.len());
+        if end.is_none_or(|end| end > self.size) {
             let reason: String = format!("invalid memory access (addr={:#010x})", addr);
             error!("write_bytes(): {}", reason);
             return Err(anyhow::anyhow!(reason));
@@ -209,6 +736,15 @@ impl VirtualMemory {
             ptr::copy_nonoverlapping(data.as_ptr(), self.ptr.offset(addr as isize), data.len());
         }
 
+        // Writes of the host are not logged by KVM.
+        if let Some(ref mut snapshot) = self.snapshot {
+            let start: usize = addr as usize / PAGE_SIZE;
+            let end: usize = (addr as usize + data.len()).div_ceil(PAGE_SIZE);
+            for page in start..end {
+                snapshot.host_dirty[page / u64::BITS as usize] |= 1 << (page % u64::BITS as usize);
+            }
+        }
+
         Ok(())
     }
 
@@ -229,7 +765,8 @@ impl VirtualMemory {
     ///
     pub fn read_bytes(&self, addr: u64, data: &mut [u8]) -> Result<()> {
         // Check if region lies within the virtual memory.
-        if addr as usize + data.len() > self.size {
+        let end: Option<usize> = (addr as usize).checked_add(data.len());
+        if end.is_none_or(|end| end > self.size) {
             let reason: String = format!("invalid memory access (addr={:#010x})", addr);
             error!("read_bytes(): {}", reason);
             return Err(anyhow::anyhow!(reason));
@@ -241,10 +778,191 @@ impl VirtualMemory {
 
         Ok(())
     }
+
+    ///
+    /// # Description
+    ///
+    /// Creates a memory file with the contents of the virtual memory. Pages that are zero are
+    /// left as holes.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the memory file. Otherwise, it returns an
+    /// error.
+    ///
+    fn write_snapshot_file(&self) -> Result<OwnedFd> {
+        let fd: RawFd =
+            unsafe { libc::memfd_create(c"microvm-snapshot".as_ptr(), libc::MFD_CLOEXEC) };
+        if fd < 0 {
+            let reason: String =
+                format!("failed to create snapshot file (error={})", io::Error::last_os_error());
+            error!("write_snapshot_file(): {}", reason);
+            anyhow::bail!(reason);
+        }
+        let file: OwnedFd = unsafe { OwnedFd::from_raw_fd(fd) };
+
+        if unsafe { libc::ftruncate(fd, self.size as libc::off_t) } < 0 {
+            let reason: String =
+                format!("failed to size snapshot file (error={})", io::Error::last_os_error());
+            error!("write_snapshot_file(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        let mut offset: usize = 0;
+        while offset < self.size {
+            let len: usize = PAGE_SIZE.min(self.size - offset);
+            let page: &[u8] = unsafe { slice::from_raw_parts(self.ptr.add(offset), len) };
+            if page.iter().any(|b| *b != 0) {
+                let mut written: usize = 0;
+                while written < len {
+                    let ret: isize = unsafe {
+                        libc::pwrite(
+                            fd,
+                            page[written..].as_ptr() as *const libc::c_void,
+                            len - written,
+                            (offset + written) as libc::off_t,
+                        )
+                    };
+                    if ret < 0 {
+                        let error: io::Error = io::Error::last_os_error();
+                        if error.kind() == io::ErrorKind::Interrupted {
+                            continue;
+                        }
+                        let reason: String =
+                            format!("failed to write snapshot file (error={})", error);
+                        error!("write_snapshot_file(): {}", reason);
+                        anyhow::bail!(reason);
+                    }
+                    written += ret as usize;
+                }
+            }
+            offset += len;
+        }
+
+        Ok(file)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Replaces the pages of the virtual memory, in place, with a private mapping of a memory file
+    /// or with anonymous zero-filled pages. The address of the virtual memory does not change,
+    /// thus it stays mapped into the virtual machine.
+    ///
+    /// # Parameters
+    ///
+    /// - `file`: Memory file to map, or `None` for anonymous pages.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    fn remap(&mut self, file: Option<RawFd>) -> Result<()> {
+        let (flags, fd): (libc::c_int, RawFd) = match file {
+            Some(fd) => (libc::MAP_PRIVATE | libc::MAP_NORESERVE | libc::MAP_FIXED, fd),
+            None => (
+                libc::MAP_PRIVATE | libc::MAP_ANONYMOUS | libc::MAP_NORESERVE | libc::MAP_FIXED,
+                -1,
+            ),
+        };
+        let ptr: *mut libc::c_void = unsafe {
+            libc::mmap(
+                self.ptr as *mut libc::c_void,
+                self.size,
+                libc::PROT_READ | libc::PROT_WRITE,
+                flags,
+                fd,
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            let reason: String =
+                format!("failed to remap virtual memory (error={})", io::Error::last_os_error());
+            error!("remap(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Discards private copies of a range of pages, which then read back from the snapshot.
+    ///
+    /// # Parameters
+    ///
+    /// - `ptr`: Base address of the virtual memory.
+    /// - `size`: Size of the virtual memory.
+    /// - `start`: First page of the range.
+    /// - `end`: Page past the last one of the range.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this function returns empty. Otherwise, it returns an error.
+    ///
+    fn discard(ptr: *mut u8, size: usize, start: usize, end: usize) -> Result<()> {
+        let offset: usize = start * PAGE_SIZE;
+        let len: usize = (end * PAGE_SIZE).min(size) - offset;
+        let ret: libc::c_int = unsafe {
+            libc::madvise(ptr.add(offset) as *mut libc::c_void, len, libc::MADV_DONTNEED)
+        };
+        if ret != 0 {
+            let reason: String =
+                format!("failed to discard pages (error={})", io::Error::last_os_error());
+            error!("discard(): {} (start={}, end={})", reason, start, end);
+            anyhow::bail!(reason);
+        }
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the base address of the initial RAM disk, which is the first page after the kernel.
+    ///
+    fn initrd_base(&self) -> usize {
+        self.kernel
+            .map_or(0, |(start, size)| start as usize + size)
+            .next_multiple_of(PAGE_SIZE)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Checks if a range of the virtual memory holds neither the kernel nor the initial RAM disk.
+    ///
+    /// # Parameters
+    ///
+    /// - `base`: Base address of the range.
+    /// - `end`: End address of the range.
+    /// - `reason`: Reason of the error that is returned if the range is in use.
+    ///
+    /// # Returns
+    ///
+    /// If the range is not in use, this method returns empty. Otherwise, it returns an error.
+    ///
+    fn check_unused(&self, base: u64, end: u64, reason: &str) -> Result<()> {
+        for (start, size) in [self.kernel, self.initrd].into_iter().flatten() {
+            if start < end && start + size as u64 > base {
+                error!(
+                    "check_unused(): {} (start={:#x}, size={:#x}, base={:#x}, end={:#x})",
+                    reason, start, size, base, end
+                );
+                anyhow::bail!(reason.to_string());
+            }
+        }
+
+        Ok(())
+    }
 }
 
 impl Drop for VirtualMemory {
     fn drop(&mut self) {
+        // Stop filling pages before the memory is unmapped.
+        self.pager = None;
+
         unsafe {
             let ret: libc::c_int = libc::munmap(self.ptr as *mut libc::c_void, self.size);
             if ret != 0 {
@@ -14,6 +14,7 @@
 //==================================================================================================
 
 #![deny(clippy::all)]
+#![cfg_attr(test, feature(test))]
 
 //==================================================================================================
 // Macros
@@ -34,12 +35,26 @@ macro_rules! timer {
 //==================================================================================================
 
 mod args;
+#[cfg(target_os = "linux")]
+mod batch;
+mod bootinfo;
+#[cfg(target_os = "linux")]
+mod cgroup;
+#[cfg(target_os = "linux")]
+mod compression;
 mod config;
+#[cfg(target_os = "linux")]
+mod daemon;
 mod elf;
+#[cfg(target_os = "linux")]
+mod image;
 mod io;
 mod logging;
 mod microvm;
 mod pal;
+mod recording;
+#[cfg(target_os = "linux")]
+mod scheduler;
 mod vmm;
 
 #[cfg(feature = "profiler")]
@@ -48,6 +63,9 @@ mod profiler;
 #[cfg(target_os = "linux")]
 mod kvm;
 
+#[cfg(test)]
+mod bench;
+
 //==================================================================================================
 // Imports
 //==================================================================================================
@@ -60,36 +78,128 @@ extern crate log;
 extern crate kvm_bindings;
 #[cfg(target_os = "linux")]
 extern crate kvm_ioctls;
+#[cfg(test)]
+extern crate test;
 
 use crate::{
     args::Args,
-    vmm::Vmm,
+    io::IoReactor,
+    vmm::{
+        BootOptions,
+        Vmm,
+    },
 };
 use ::anyhow::Result;
 use ::std::{
     env,
+    io::{
+        self,
+        BufRead,
+        Write,
+    },
     net::SocketAddr,
+    thread,
 };
 
 //==================================================================================================
 // Standalone Functions
 //==================================================================================================
 
+// The test harness replaces `main()` in unit test and benchmark builds. Keep the code that is only
+// reachable from it alive, so that other dead code is still reported.
+#[cfg_attr(test, allow(dead_code))]
 fn main() -> Result<()> {
     // Initialize logger before doing anything else. If this fails, the program will panic.
     logging::initialize();
 
     let mut args: Args = args::Args::parse(env::args().collect())?;
+
+    // Place the virtual machine monitor in a control group before spawning any threads.
+    #[cfg(target_os = "linux")]
+    if let Some(cgroup_path) = args.take_cgroup() {
+        let limits: cgroup::Limits = cgroup::Limits {
+            cpu_max: args.cpu_max(),
+            cpu_weight: args.cpu_weight(),
+            memory_high: args.memory_high(),
+        };
+        cgroup::setup(&cgroup_path, &limits)?;
+    }
+
+    // Messages exchanged with gateways are forwarded by a single I/O reactor, which is only
+    // spawned once a virtual machine needs it.
+    let reactor: IoReactor = IoReactor::new();
+
+    // Host several virtual machines, if requested.
+    #[cfg(target_os = "linux")]
+    if let Some(socket_path) = args.take_daemon() {
+        let daemon: daemon::Daemon = daemon::Daemon::new(&socket_path, reactor)?;
+        return daemon.run();
+    }
+
+    // Run many short-lived virtual machines, if requested.
+    #[cfg(target_os = "linux")]
+    if let Some(manifest) = args.take_batch() {
+        let nworkers: usize = match args.jobs() {
+            Some(jobs) => jobs,
+            None => thread::available_parallelism()?.get(),
+        };
+        let results: Option<String> = args.take_results();
+        return batch::run(&manifest, results.as_deref(), nworkers, &reactor);
+    }
+
     let kernel_filename: String = args.kernel_filename().to_string();
+    let memory_size: usize = args.memory_size()?;
     let initrd_filename: Option<String> = args.initrd_filename();
-    let memory_size: usize = args.memory_size();
     let stderr: Option<String> = args.take_vm_stderr();
     let gateway_addr: Option<SocketAddr> = args.gateway_addr();
+    let record: Option<String> = args.take_record();
 
-    let mut vmm: Vmm =
-        Vmm::new(memory_size, &kernel_filename, initrd_filename, stderr, gateway_addr)?;
+    let options: BootOptions = BootOptions {
+        kernel_filename: &kernel_filename,
+        initrd_filename: initrd_filename.as_deref(),
+        paging: args.paging(),
+    };
+    let mut vmm: Vmm = Vmm::new(
+        memory_size,
+        args.disable_exits(),
+        &options,
+        stderr,
+        gateway_addr,
+        record,
+        &reactor,
+    )?;
+
+    // The main thread runs the virtual processor.
+    #[cfg(target_os = "linux")]
+    cgroup::join(cgroup::ThreadGroup::Vcpu)?;
+
+    // Serve function invocations, one per line of the standard input, if requested.
+    if args.function() {
+        vmm.prepare_function()?;
+
+        let mut stdout: io::StdoutLock = io::stdout().lock();
+        for payload in io::stdin().lock().lines() {
+            let invocation: vmm::Invocation = vmm.invoke(payload?.as_bytes())?;
+            stdout.write_all(&invocation.output)?;
+            stdout.write_all(b"\n")?;
+            if args.stats() {
+                writeln!(
+                    stdout,
+                    "microvm-invoke: run_ns={} rewind_ns={} pages={}",
+                    invocation.run_ns, invocation.rewind_ns, invocation.pages
+                )?;
+            }
+            stdout.flush()?;
+        }
+
+        return Ok(());
+    }
 
     vmm.run()?;
 
+    if args.stats() {
+        vmm.print_stats();
+    }
+
     Ok(())
 }
@@ -14,21 +14,50 @@
 
 #[cfg(target_os = "linux")]
 use crate::kvm::{
+    bus::IoOutcome,
+    cpuid,
     emulator::Emulator,
     partition::VirtualPartition,
     vcpu::{
+        Preempter,
         VirtualProcessor,
         VirtualProcessorExitContext,
         VirtualProcessorExitReason,
+        VirtualProcessorState,
+    },
+    vmem::{
+        LongModeTables,
+        VirtualMemory,
     },
-    vmem::VirtualMemory,
 };
 
-use crate::config;
+use crate::{
+    bootinfo::{
+        BootInfo,
+        BOOT_INFO_FLAG_INVARIANT_TSC,
+        BOOT_INFO_FLAG_PAGING,
+        BOOT_INFO_PVCLOCK_OFFSET,
+        BOOT_INFO_WALL_CLOCK_OFFSET,
+    },
+    config,
+    elf::{
+        ElfClass,
+        Program,
+    },
+};
 use ::anyhow::Result;
 use ::std::{
     cell::RefCell,
     rc::Rc,
+    sync::{
+        atomic::{
+            AtomicBool,
+            AtomicU64,
+            Ordering,
+        },
+        Arc,
+    },
+    time::Instant,
 };
 
 //==================================================================================================
@@ -49,17 +78,102 @@ pub struct MicroVm {
     vcpu: VirtualProcessor,
     // Emulator of the virtual machine.
     emulator: Emulator,
-    // If present, initial RAM disk location and size.
-    initrd: Option<(u64, usize)>,
+    // Mode in which the kernel that was loaded is entered.
+    entry_mode: EntryMode,
+    // Execution statistics.
+    stats: Arc<Statistics>,
+    // Set to stop the virtual machine at its next exit.
+    stop: Arc<AtomicBool>,
+    // Exit status written by the guest when it shut down, if any.
+    exit_status: Option<u32>,
+    // Register state to which the virtual machine can be rewound, if any.
+    snapshot: Option<VirtualProcessorState>,
+}
+
+///
+/// # Description
+///
+/// Modes in which a kernel is entered.
+///
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum EntryMode {
+    /// 16-bit real mode, at the entry point of the kernel.
+    Real,
+    /// 32-bit protected mode, at the PVH entry point of the kernel.
+    Protected,
+    /// 64-bit long mode, at the entry point of the kernel.
+    Long,
+}
+
+// SAFETY: A MicroVM is not `Send` because of the `Rc<RefCell<_>>` handles to its partition and
+// to its memory, and because of the raw pointers that its virtual processor keeps to the
+// `immediate_exit` flag of its `kvm_run` structure.
+//
+// The pointers refer to a mapping that is owned by the virtual processor, thus it moves along with
+// the MicroVM. The flag is only accessed atomically, and the only copies of the pointer that leave
+// the MicroVM are `Preempter` handles, whose users must make sure that the MicroVM is still alive
+// (see `Preempter::request()`).
+//
+// The reference counts are shared by the virtual processor, the virtual memory and the console
+// device of the emulator, all of which are owned by the MicroVM, and no method hands a clone out:
+// - Methods of the MicroVM only lend references to their fields.
+// - `VirtualMemory` clones its handle to the partition only into locals, which are dropped before
+//   the method returns.
+// - The input and output functions only borrow the memory for the duration of a call, and since
+//   they are `Send`, they cannot keep an `Rc` in their state.
+// - Devices on the bus of the emulator are created in `Emulator::new()`, and only the console
+//   device holds a handle, to the memory.
+// Moving a MicroVM thus moves every owner of these reference counts along with it, and no two
+// threads ever access the same count or `RefCell`.
+unsafe impl Send for MicroVm {}
+
+///
+/// # Description
+///
+/// Reasons for which a MicroVM gives its host thread back.
+///
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum Yield {
+    /// The virtual processor was interrupted by the host.
+    Preempted,
+    /// The guest polled for input that is not available yet.
+    Blocked,
+    /// The virtual processor went offline.
+    PoweredOff,
+    /// The guest waits for a function invocation, in the buffer at the given address.
+    Function(u64),
+}
+
+///
+/// # Description
+///
+/// Execution statistics of a MicroVM. Counters are atomic, so that they can be read by other
+/// threads while the virtual machine runs.
+///
+#[derive(Default)]
+pub struct Statistics {
+    /// Number of exits.
+    pub exits: AtomicU64,
+    /// Number of exits due to port-mapped I/O accesses.
+    pub pmio_exits: AtomicU64,
+    /// Number of exits due to memory-mapped I/O accesses.
+    pub mmio_exits: AtomicU64,
+    /// Number of exits due to halts.
+    pub halt_exits: AtomicU64,
+    /// Number of exits due to host interrupts.
+    pub preemptions: AtomicU64,
+    /// Time spent running the virtual machine (in nanoseconds), updated when it stops.
+    pub run_ns: AtomicU64,
 }
 
 //==================================================================================================
 // Types
 //==================================================================================================
 
-pub type InputFn = dyn FnMut(&Rc<RefCell<VirtualMemory>>, u32, usize) -> Result<()>;
+/// Input function. Returns `false` if no input was available.
+pub type InputFn = dyn FnMut(&Rc<RefCell<VirtualMemory>>, u32, usize) -> Result<bool> + Send;
 
-pub type OutputFn = dyn FnMut(&Rc<RefCell<VirtualMemory>>, u32, usize) -> Result<()>;
+pub type OutputFn = dyn FnMut(&Rc<RefCell<VirtualMemory>>, u32, usize) -> Result<()> + Send;
 
 //==================================================================================================
 // Implementations
@@ -72,6 +186,14 @@ impl MicroVm {
     pub const STDIN_PORT: u16 = config::STDIN_PORT;
     /// I/O port that enables the guest to invoke functionalities of the virtual machine monitor.
     pub const VMM_PORT: u16 = config::VMM_PORT;
+    /// I/O port that is ignored by the virtual machine monitor.
+    pub const BENCH_PORT: u16 = config::BENCH_PORT;
+    /// Base address of the memory-mapped registers that are ignored by the virtual machine monitor.
+    pub const BENCH_MMIO_BASE: u64 = config::BENCH_MMIO_BASE;
+    /// Size of the memory-mapped registers that are ignored by the virtual machine monitor.
+    pub const BENCH_MMIO_SIZE: u64 = config::BENCH_MMIO_SIZE;
+    /// I/O port through which the guest waits for function invocations.
+    pub const FUNCTION_PORT: u16 = config::FUNCTION_PORT;
 
     ///
     /// # Description
@@ -81,6 +203,8 @@ impl MicroVm {
     /// # Parameters
     ///
     /// - `memory_size`: Size of the virtual memory of the virtual machine.
+    /// - `disable_exits`: Disable exits on `hlt`, `pause` and `mwait`? The guest must then power
+    ///   off through [`MicroVm::VMM_PORT`], because halting no longer exits.
     /// - `input`: Input function used for emulating I/O port reads.
     /// - `output`: Output function used for emulating I/O port writes.
     ///
@@ -89,26 +213,35 @@ impl MicroVm {
     /// Upon successful completion, this method returns the MicroVM that was created. Otherwise, it
     /// returns an error.
     ///
-    pub fn new(memory_size: usize, input: Box<InputFn>, output: Box<OutputFn>) -> Result<Self> {
-        trace!("new(): memory_size={}", memory_size);
+    pub fn new(
+        memory_size: usize,
+        disable_exits: bool,
+        input: Box<InputFn>,
+        output: Box<OutputFn>,
+    ) -> Result<Self> {
+        trace!("new(): memory_size={}, disable_exits={}", memory_size, disable_exits);
         crate::timer!("vm_creation");
 
         let partition: Rc<RefCell<VirtualPartition>> =
-            Rc::new(RefCell::new((VirtualPartition::new())?));
+            Rc::new(RefCell::new((VirtualPartition::new(disable_exits))?));
 
         let vmem: Rc<RefCell<VirtualMemory>> =
             Rc::new(RefCell::new(VirtualMemory::new(partition.clone(), memory_size)?));
 
         let vcpu: VirtualProcessor = VirtualProcessor::new(partition.clone(), 0)?;
 
-        let emulator: Emulator = Emulator::new(vmem.clone(), input, output)?;
+        let emulator: Emulator = Emulator::new(vmem.clone(), memory_size, input, output)?;
 
         Ok(Self {
             _partition: partition,
             vmem,
             vcpu,
             emulator,
-            initrd: None,
+            entry_mode: EntryMode::Real,
+            stats: Arc::new(Statistics::default()),
+            stop: Arc::new(AtomicBool::new(false)),
+            exit_status: None,
+            snapshot: None,
         })
     }
 
@@ -129,8 +262,17 @@ impl MicroVm {
     pub fn load_kernel(&mut self, kernel_filename: &str) -> Result<u64> {
         trace!("load_kernel(): {}", kernel_filename);
         crate::timer!("vm_load_kernel");
-        let entry: u64 = self.vmem.borrow_mut().load_kernel(kernel_filename)?;
-        Ok(entry)
+        let program: Program = self.vmem.borrow_mut().load_kernel(kernel_filename)?;
+
+        // A PVH entry point takes precedence, because it skips mode switches in the guest.
+        let (entry_mode, entry): (EntryMode, usize) = match (program.phys32_entry, program.class) {
+            (Some(entry), _) => (EntryMode::Protected, entry),
+            (None, ElfClass::Elf32) => (EntryMode::Real, program.entry),
+            (None, ElfClass::Elf64) => (EntryMode::Long, program.entry),
+        };
+        self.entry_mode = entry_mode;
+
+        Ok(entry as u64)
     }
 
     ///
@@ -149,45 +291,110 @@ impl MicroVm {
     pub fn load_initrd(&mut self, initrd_filename: &str) -> Result<()> {
         trace!("load_initrd(): {}", initrd_filename);
         crate::timer!("vm_load_initrd");
-        let initrd: (u64, usize) = self.vmem.borrow_mut().load_initrd(initrd_filename)?;
-        self.initrd = Some(initrd);
+        self.vmem.borrow_mut().load_initrd(initrd_filename)?;
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Clears the state that a previous run left behind, so that the virtual machine can load and
+    /// run another kernel. The partition, memory and virtual processor are kept.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn clear(&mut self) -> Result<()> {
+        trace!("clear()");
+        crate::timer!("vm_clear");
+
+        self.vmem.borrow_mut().clear()?;
+        self.exit_status = None;
+        self.snapshot = None;
+
+        self.stats.exits.store(0, Ordering::Relaxed);
+        self.stats.pmio_exits.store(0, Ordering::Relaxed);
+        self.stats.mmio_exits.store(0, Ordering::Relaxed);
+        self.stats.halt_exits.store(0, Ordering::Relaxed);
+        self.stats.preemptions.store(0, Ordering::Relaxed);
+        self.stats.run_ns.store(0, Ordering::Relaxed);
+
         Ok(())
     }
 
     ///
     /// # Description
     ///
-    /// Resets the virtual machine.
+    /// Resets the virtual machine. Kernels with a PVH entry point are entered straight in 32-bit
+    /// protected mode. Otherwise, 32-bit kernels are entered in real mode, and 64-bit kernels are
+    /// entered straight in long mode, with identity page tables built by the virtual machine
+    /// monitor. Kernels find the address of the boot information page in the `rbx` register, and
+    /// KVM keeps a paravirtual clock there, if it provides one.
     ///
     /// # Parameters
     ///
     /// - `rip`: Entry point of the virtual machine.
+    /// - `paging`: Enter the kernel with paging enabled? Kernels that are entered in protected
+    ///   mode are then given identity page tables with 4 MB pages. Kernels that are entered in
+    ///   long mode always have paging enabled, and kernels that are entered in real mode cannot.
     ///
     /// # Returns
     ///
     /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
     ///
-    pub fn reset(&mut self, rip: u64) -> Result<()> {
-        trace!("reset(): {:#010x}", rip);
+    pub fn reset(&mut self, rip: u64, paging: bool) -> Result<()> {
+        trace!("reset(): {:#010x}, paging={}", rip, paging);
         crate::timer!("vm_reset");
         let rax: u64 = config::MICROVM_MAGIC as u64;
 
-        // Encode initrd location and size:
-        // - Lower 12 bits encode the size in 4KB pages
-        // - Higher bits encode the base address
-        let (initrd_base, initrd_size): (u64, u64) = match self.initrd {
-            Some((base, size)) => (base, size as u64),
-            None => (0, 0),
+        // Tables are built first, so that the boot information accounts for them.
+        let rbx: u64 = match self.entry_mode {
+            EntryMode::Real if paging => {
+                let reason: String = "paging requires a protected or long mode entry".to_string();
+                error!("reset(): {}", reason);
+                anyhow::bail!(reason);
+            },
+            EntryMode::Real => {
+                let rbx: u64 = self.write_boot_info(None)?;
+                self.vcpu.reset(rip, rax, rbx)?;
+                rbx
+            },
+            EntryMode::Protected => {
+                let page_directory: Option<u64> = if paging {
+                    Some(self.vmem.borrow_mut().build_protected_mode_tables()?)
+                } else {
+                    None
+                };
+                let rbx: u64 = self.write_boot_info(page_directory)?;
+                self.vcpu
+                    .reset_protected_mode(rip, rax, rbx, page_directory)?;
+                rbx
+            },
+            EntryMode::Long => {
+                let tables: LongModeTables = self.vmem.borrow_mut().build_long_mode_tables()?;
+                let rbx: u64 = self.write_boot_info(Some(tables.base))?;
+                self.vcpu.reset_long_mode(rip, rax, rbx, &tables)?;
+                rbx
+            },
         };
-        let rbx: u64 = (initrd_base & 0xfffff000) | ((initrd_size >> 12) & 0xfff);
 
-        self.vcpu.reset(rip, rax, rbx)
+        // The boot information page is written first, because KVM writes the wall-clock time into
+        // it right away.
+        if cpuid::has_pvclock()? {
+            self.vcpu.enable_pvclock(
+                rbx + BOOT_INFO_WALL_CLOCK_OFFSET as u64,
+                rbx + BOOT_INFO_PVCLOCK_OFFSET as u64,
+            )?;
+        }
+
+        Ok(())
     }
 
     ///
     /// # Description
     ///
-    /// Runs the virtual machine.
+    /// Runs the virtual machine until it powers off.
     ///
     /// # Returns
     ///
@@ -197,32 +404,257 @@ impl MicroVm {
         trace!("run()");
         crate::timer!("vm_run");
 
-        // Run the virtual processor until it goes offline.
-        while self.vcpu.is_online() {
+        loop {
+            match self.run_slice()? {
+                Yield::PoweredOff => return Ok(()),
+                Yield::Preempted | Yield::Blocked => {},
+                Yield::Function(_) => {
+                    let reason: String = "guest waits for a function invocation".to_string();
+                    error!("run(): {}", reason);
+                    anyhow::bail!(reason);
+                },
+            }
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Runs the virtual machine until it gives its host thread back, which enables several
+    /// virtual machines to share host threads.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the reason for which the virtual machine
+    /// stopped running. Otherwise, it returns an error.
+    ///
+    pub fn run_slice(&mut self) -> Result<Yield> {
+        let start: Instant = Instant::now();
+        self.vcpu.clear_preemption();
+        let ret: Result<Yield> = self.run_exits();
+        self.stats
+            .run_ns
+            .fetch_add(start.elapsed().as_nanos() as u64, Ordering::Relaxed);
+        ret
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Writes the boot information page into the virtual memory.
+    ///
+    /// # Parameters
+    ///
+    /// - `tables`: Base address of the page tables that were built, if any.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the address of the boot information page.
+    /// Otherwise, it returns an error.
+    ///
+    fn write_boot_info(&mut self, tables: Option<u64>) -> Result<u64> {
+        let mut info: BootInfo = BootInfo::new(1);
+        if let Some(tsc_khz) = self.vcpu.tsc_khz() {
+            info.set_tsc_khz(tsc_khz as u64);
+            if VirtualProcessor::has_invariant_tsc() {
+                info.set_flags(BOOT_INFO_FLAG_INVARIANT_TSC);
+            }
+        }
+        if tables.is_some() {
+            info.set_flags(BOOT_INFO_FLAG_PAGING);
+        }
+        if cpuid::has_pvclock()? {
+            info.set_pvclock(self.vmem.borrow().boot_info_address());
+        }
+
+        self.vmem.borrow_mut().write_boot_info(&mut info, tables)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Runs the virtual processor and handles its exits, until the virtual machine yields.
+    ///
+    fn run_exits(&mut self) -> Result<Yield> {
+        loop {
+            // Check if the host requested the virtual machine to stop.
+            if self.stop.load(Ordering::Relaxed) {
+                self.vcpu.poweroff();
+            }
+            if !self.vcpu.is_online() {
+                return Ok(Yield::PoweredOff);
+            }
+
             let exit_context: VirtualProcessorExitContext = self.vcpu.run()?;
+            self.stats.exits.fetch_add(1, Ordering::Relaxed);
 
             // Parse exit reason.
             match exit_context.reason() {
-                // The guest requested to access an I/O port.
-                VirtualProcessorExitReason::PmioAccess => {
-                    crate::timer!("vm_run_pmio_access");
-                    if !(self.emulator.handle_pmio_access(exit_context)?) {
-                        self.vcpu.poweroff();
+                // The guest requested to access an I/O port or memory-mapped registers.
+                reason @ (VirtualProcessorExitReason::PmioAccess
+                | VirtualProcessorExitReason::MmioAccess) => {
+                    crate::timer!("vm_run_io_access");
+                    match reason {
+                        VirtualProcessorExitReason::PmioAccess => &self.stats.pmio_exits,
+                        _ => &self.stats.mmio_exits,
+                    }
+                    .fetch_add(1, Ordering::Relaxed);
+                    match self.emulator.handle_io_access(exit_context)? {
+                        IoOutcome::Resume => {},
+                        IoOutcome::Blocked => return Ok(Yield::Blocked),
+                        IoOutcome::Poweroff(status) => {
+                            self.exit_status = Some(status);
+                            self.vcpu.poweroff();
+                        },
+                        IoOutcome::Function(buffer) => return Ok(Yield::Function(buffer as u64)),
                     }
                 },
 
-                // The guest requested to halt the virtual processor.
+                // The guest requested to halt the virtual processor. This never happens if exits
+                // on `hlt` are disabled, then the guest powers off through the VMM port.
                 VirtualProcessorExitReason::Halt => {
+                    self.stats.halt_exits.fetch_add(1, Ordering::Relaxed);
                     self.vcpu.poweroff();
                 },
 
+                // The virtual processor was interrupted by the host.
+                VirtualProcessorExitReason::Interrupted => {
+                    self.stats.preemptions.fetch_add(1, Ordering::Relaxed);
+                    if !self.stop.load(Ordering::Relaxed) {
+                        return Ok(Yield::Preempted);
+                    }
+                },
+
                 // Virtual machine exited due to an unknown reason.
                 VirtualProcessorExitReason::Unknown => {
                     return Err(anyhow::anyhow!("unknown exit reason"));
                 },
             }
         }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Takes a snapshot of the virtual machine, to which it can later be rewound. This should be
+    /// called when the virtual machine has yielded.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn snapshot(&mut self) -> Result<()> {
+        trace!("snapshot()");
+        crate::timer!("vm_snapshot");
+
+        self.snapshot = Some(self.vcpu.save_state()?);
+        self.vmem.borrow_mut().snapshot()?;
 
         Ok(())
     }
+
+    ///
+    /// # Description
+    ///
+    /// Rewinds the virtual machine to its snapshot. This should be called when the virtual
+    /// machine has yielded.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the number of pages that were rewound.
+    /// Otherwise, it returns an error.
+    ///
+    pub fn rewind(&mut self) -> Result<usize> {
+        crate::timer!("vm_rewind");
+
+        let state: &VirtualProcessorState = match self.snapshot {
+            Some(ref state) => state,
+            None => {
+                let reason: String = "virtual machine has no snapshot".to_string();
+                error!("rewind(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+
+        self.vcpu.restore_state(state)?;
+        let npages: usize = self.vmem.borrow_mut().rewind()?;
+        self.exit_status = None;
+
+        Ok(npages)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Writes bytes into guest memory.
+    ///
+    /// # Parameters
+    ///
+    /// - `addr`: Guest physical address.
+    /// - `data`: Data to write.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn write_bytes(&mut self, addr: u64, data: &[u8]) -> Result<()> {
+        self.vmem.borrow_mut().write_bytes(addr, data)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Reads bytes from guest memory.
+    ///
+    /// # Parameters
+    ///
+    /// - `addr`: Guest physical address.
+    /// - `data`: Buffer to read into.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn read_bytes(&self, addr: u64, data: &mut [u8]) -> Result<()> {
+        self.vmem.borrow().read_bytes(addr, data)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns a handle that forces the virtual machine out of the guest, so that it yields.
+    ///
+    pub fn preempter(&self) -> Preempter {
+        self.vcpu.preempter()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the exit status that the guest wrote to the virtual machine monitor port when it
+    /// shut down. If the guest halted instead, or it is still running, `None` is returned.
+    ///
+    pub fn exit_status(&self) -> Option<u32> {
+        self.exit_status
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the execution statistics of the virtual machine.
+    ///
+    pub fn stats(&self) -> Arc<Statistics> {
+        self.stats.clone()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns a flag that stops the virtual machine when set. The flag is checked whenever the
+    /// virtual processor exits, thus a thread that sets it should also interrupt the thread that
+    /// runs the virtual machine.
+    ///
+    pub fn stop_flag(&self) -> Arc<AtomicBool> {
+        self.stop.clone()
+    }
 }
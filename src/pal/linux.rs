@@ -6,7 +6,10 @@
 //==================================================================================================
 
 use ::anyhow::Result;
-use ::std::ptr;
+use ::std::{
+    ptr,
+    sync::Once,
+};
 
 //==================================================================================================
 // Structures
@@ -18,6 +21,17 @@ pub struct FileMapping {
     size: usize,
 }
 
+///
+/// # Description
+///
+/// A handle to a thread that can be interrupted with a signal. Interrupting a thread that is
+/// running a virtual processor forces it out of the guest.
+///
+#[derive(Clone, Copy)]
+pub struct ThreadHandle {
+    thread: ::libc::pthread_t,
+}
+
 //==================================================================================================
 // Implementations
 //==================================================================================================
@@ -88,3 +102,84 @@ impl Drop for FileMapping {
         }
     }
 }
+
+// SAFETY: the mapping is private and read-only, and it is owned by the file mapping, which unmaps
+// it when it is dropped. It may thus be read and dropped from any thread.
+unsafe impl Send for FileMapping {}
+
+impl ThreadHandle {
+    ///
+    /// # Description
+    ///
+    /// Returns a handle to the calling thread.
+    ///
+    /// # Returns
+    ///
+    /// A handle to the calling thread.
+    ///
+    pub fn current() -> Self {
+        Self::install_handler();
+        Self {
+            thread: unsafe { ::libc::pthread_self() },
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Interrupts the thread. Blocking system calls that the thread is executing fail with
+    /// `EINTR`.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    /// # Notes
+    ///
+    /// The caller must ensure that the thread has not exited.
+    ///
+    pub fn kick(&self) -> Result<()> {
+        let ret: ::libc::c_int = unsafe { ::libc::pthread_kill(self.thread, Self::signal()) };
+        if ret != 0 {
+            let reason: String = format!("failed to interrupt thread (error={})", ret);
+            error!("kick(): {}", reason);
+            anyhow::bail!(reason);
+        }
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the signal that is used to interrupt threads.
+    ///
+    fn signal() -> ::libc::c_int {
+        ::libc::SIGRTMIN()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Installs a handler for the interrupt signal. Without a handler, the signal would terminate
+    /// the process.
+    ///
+    /// # Notes
+    ///
+    /// The handler is installed without `SA_RESTART`, so that interrupted system calls are not
+    /// restarted.
+    ///
+    fn install_handler() {
+        static INSTALL: Once = Once::new();
+        INSTALL.call_once(|| unsafe {
+            extern "C" fn handle_kick(_signum: ::libc::c_int) {}
+
+            let mut action: ::libc::sigaction = ::std::mem::zeroed();
+            action.sa_sigaction = handle_kick as usize;
+            action.sa_flags = 0;
+            ::libc::sigemptyset(&mut action.sa_mask);
+            if ::libc::sigaction(Self::signal(), &action, ptr::null_mut()) < 0 {
+                warn!("failed to install interrupt handler");
+            }
+        });
+    }
+}
@@ -0,0 +1,255 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Message Recordings
+//!
+//! This module reads and writes recordings of the messages that a MicroVM exchanges with its
+//! gateway. A recording is a binary file with the following layout (integers are little-endian):
+//!
+//! ```text
+//! header:  magic (8 bytes) | version (u32) | message size (u32)
+//! record:  direction (u8) | timestamp in nanoseconds (u64) | message (message size bytes)
+//! ```
+//!
+//! Timestamps are relative to the moment in which the recording was started. This module is
+//! shared with the `replay` tool.
+//!
+
+//==================================================================================================
+// Lint Exceptions
+//==================================================================================================
+
+// Readers and writers are used by different programs.
+#![allow(dead_code)]
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use ::anyhow::Result;
+use ::std::{
+    fs::File,
+    io::{
+        BufReader,
+        BufWriter,
+        ErrorKind,
+        Read,
+        Write,
+    },
+    mem,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+use ::sys::ipc::Message;
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Size of a message.
+pub const MESSAGE_SIZE: usize = mem::size_of::<Message>();
+
+/// Magic value that identifies a recording.
+const MAGIC: [u8; 8] = *b"MVMREC\0\0";
+
+/// Version of the recording format.
+const VERSION: u32 = 1;
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Direction of a message, as seen from the MicroVM.
+///
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+pub enum Direction {
+    /// Message sent from the gateway to the MicroVM.
+    Inbound = 0,
+    /// Message sent from the MicroVM to the gateway.
+    Outbound = 1,
+}
+
+///
+/// # Description
+///
+/// A recorded message.
+///
+pub struct Record {
+    /// Direction of the message.
+    pub direction: Direction,
+    /// Time at which the message was observed, relative to the start of the recording.
+    pub timestamp: Duration,
+    /// Wire representation of the message.
+    pub message: [u8; MESSAGE_SIZE],
+}
+
+///
+/// # Description
+///
+/// Writer of recordings.
+///
+pub struct Recorder {
+    /// Underlying file.
+    writer: BufWriter<File>,
+    /// Start of the recording.
+    start: Instant,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Recorder {
+    ///
+    /// # Description
+    ///
+    /// Creates a new recording.
+    ///
+    /// # Parameters
+    ///
+    /// - `filename`: Path to the recording file. If the file exists, it is truncated.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, a recorder is returned. Otherwise, an error is returned instead.
+    ///
+    pub fn create(filename: &str) -> Result<Self> {
+        let file: File = match File::create(filename) {
+            Ok(file) => file,
+            Err(e) => {
+                let reason: String =
+                    format!("failed to create recording (filename={}, error={:?})", filename, e);
+                error!("create(): {}", reason);
+                anyhow::bail!(reason)
+            },
+        };
+
+        let mut writer: BufWriter<File> = BufWriter::new(file);
+        writer.write_all(&MAGIC)?;
+        writer.write_all(&VERSION.to_le_bytes())?;
+        writer.write_all(&(MESSAGE_SIZE as u32).to_le_bytes())?;
+        writer.flush()?;
+
+        Ok(Self {
+            writer,
+            start: Instant::now(),
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Appends a message to the recording.
+    ///
+    /// # Parameters
+    ///
+    /// - `direction`: Direction of the message.
+    /// - `message`: Wire representation of the message.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, empty is returned. Otherwise, an error is returned instead.
+    ///
+    /// # Notes
+    ///
+    /// The recording is flushed after every message, because the I/O reactor is not joined when
+    /// the virtual machine stops.
+    ///
+    pub fn record(&mut self, direction: Direction, message: &[u8; MESSAGE_SIZE]) -> Result<()> {
+        let timestamp: u64 = self.start.elapsed().as_nanos() as u64;
+        self.writer.write_all(&[direction as u8])?;
+        self.writer.write_all(&timestamp.to_le_bytes())?;
+        self.writer.write_all(message)?;
+        self.writer.flush()?;
+        Ok(())
+    }
+}
+
+///
+/// # Description
+///
+/// Loads a recording.
+///
+/// # Parameters
+///
+/// - `filename`: Path to the recording file.
+///
+/// # Returns
+///
+/// Upon success, the recorded messages are returned in the order that they were observed.
+/// Otherwise, an error is returned instead.
+///
+pub fn load(filename: &str) -> Result<Vec<Record>> {
+    let mut reader: BufReader<File> = BufReader::new(File::open(filename)?);
+
+    // Parse header.
+    let mut magic: [u8; 8] = [0; 8];
+    let mut version: [u8; 4] = [0; 4];
+    let mut message_size: [u8; 4] = [0; 4];
+    reader.read_exact(&mut magic)?;
+    reader.read_exact(&mut version)?;
+    reader.read_exact(&mut message_size)?;
+
+    if magic != MAGIC {
+        let reason: String = format!("invalid recording (filename={})", filename);
+        error!("load(): {}", reason);
+        anyhow::bail!(reason);
+    }
+
+    if u32::from_le_bytes(version) != VERSION {
+        let reason: String =
+            format!("unsupported recording version (version={})", u32::from_le_bytes(version));
+        error!("load(): {}", reason);
+        anyhow::bail!(reason);
+    }
+
+    if u32::from_le_bytes(message_size) as usize != MESSAGE_SIZE {
+        let reason: String = format!(
+            "mismatched message size (expected={}, found={})",
+            MESSAGE_SIZE,
+            u32::from_le_bytes(message_size)
+        );
+        error!("load(): {}", reason);
+        anyhow::bail!(reason);
+    }
+
+    // Parse records.
+    let mut records: Vec<Record> = Vec::new();
+    loop {
+        let mut direction: [u8; 1] = [0; 1];
+        match reader.read_exact(&mut direction) {
+            Ok(()) => {},
+            Err(e) if e.kind() == ErrorKind::UnexpectedEof => break,
+            Err(e) => return Err(e.into()),
+        }
+
+        let direction: Direction = match direction[0] {
+            0 => Direction::Inbound,
+            1 => Direction::Outbound,
+            d => {
+                let reason: String = format!("invalid direction (direction={})", d);
+                error!("load(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+
+        let mut timestamp: [u8; 8] = [0; 8];
+        let mut message: [u8; MESSAGE_SIZE] = [0; MESSAGE_SIZE];
+        reader.read_exact(&mut timestamp)?;
+        reader.read_exact(&mut message)?;
+
+        records.push(Record {
+            direction,
+            timestamp: Duration::from_nanos(u64::from_le_bytes(timestamp)),
+            message,
+        });
+    }
+
+    Ok(records)
+}
@@ -0,0 +1,439 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+//!
+//! # Virtual Processor Scheduler
+//!
+//! This module multiplexes virtual processors over a fixed pool of host threads. Each worker
+//! thread owns a run queue, from which it picks virtual processors and runs them for a time slice.
+//! Newly submitted virtual processors are placed on a global queue, and workers that run out of
+//! work steal half of the run queue of another worker.
+//!
+//! A virtual processor gives its worker back when:
+//!
+//! - Its time slice expires. A ticker thread forces it out of the guest, by requesting it to exit
+//!   immediately and interrupting the worker with a signal.
+//! - It polls for input that is not available yet. If every virtual processor of a worker is in
+//!   this situation, the worker backs off for a while instead of spinning.
+//! - It powers off.
+//!
+
+//==================================================================================================
+// Imports
+//==================================================================================================
+
+use crate::{
+    cgroup::{
+        self,
+        ThreadGroup,
+    },
+    kvm::vcpu::Preempter,
+    pal::ThreadHandle,
+};
+use ::anyhow::Result;
+use ::std::{
+    collections::VecDeque,
+    sync::{
+        Arc,
+        Condvar,
+        Mutex,
+        MutexGuard,
+    },
+    thread,
+    time::{
+        Duration,
+        Instant,
+    },
+};
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/// Number of time slices after which a worker checks the global queue before its own run queue,
+/// so that newly submitted virtual processors are not starved by busy workers.
+const GLOBAL_QUEUE_INTERVAL: usize = 31;
+
+/// Time for which a worker backs off when all of its virtual processors are waiting for input.
+const BLOCKED_BACKOFF: Duration = Duration::from_millis(1);
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+///
+/// # Description
+///
+/// Reasons for which a task gives its worker back.
+///
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum Slice {
+    /// The time slice has expired.
+    Preempted,
+    /// The task waits for input.
+    Blocked,
+    /// The task has finished and should be dropped.
+    Finished,
+}
+
+///
+/// # Description
+///
+/// A virtual processor that can be scheduled.
+///
+pub trait Task: Send {
+    ///
+    /// # Description
+    ///
+    /// Returns a handle that forces the virtual processor out of the guest.
+    ///
+    fn preempter(&self) -> Preempter;
+
+    ///
+    /// # Description
+    ///
+    /// Runs the virtual processor until it gives its worker back.
+    ///
+    fn run(&mut self) -> Slice;
+
+    ///
+    /// # Description
+    ///
+    /// Releases the virtual processor after it has finished. The worker calls this only once the
+    /// ticker can no longer see the preempter of the virtual processor.
+    ///
+    fn finish(self: Box<Self>);
+}
+
+///
+/// # Description
+///
+/// Handle to a scheduler. Worker threads live as long as the process.
+///
+pub struct Scheduler {
+    /// State shared with worker threads.
+    shared: Arc<Shared>,
+}
+
+///
+/// # Description
+///
+/// State of the scheduler that is shared with worker threads.
+///
+struct Shared {
+    /// Queue of virtual processors that were submitted but not yet picked by any worker.
+    global: Mutex<VecDeque<Box<dyn Task>>>,
+    /// Workers.
+    workers: Vec<Worker>,
+    /// Number of workers that are sleeping.
+    sleeping: Mutex<usize>,
+    /// Signaled when there is work for sleeping workers.
+    wakeup: Condvar,
+    /// Time slice.
+    time_slice: Duration,
+}
+
+///
+/// # Description
+///
+/// State of a worker.
+///
+struct Worker {
+    /// Run queue.
+    queue: Mutex<VecDeque<Box<dyn Task>>>,
+    /// Virtual processor that is running, if any.
+    running: Mutex<Option<Running>>,
+}
+
+///
+/// # Description
+///
+/// A virtual processor that is running on a worker.
+///
+struct Running {
+    /// Forces the virtual processor out of the guest.
+    preempter: Preempter,
+    /// Worker thread.
+    thread: ThreadHandle,
+    /// Time at which the time slice expires.
+    deadline: Instant,
+}
+
+//==================================================================================================
+// Implementations
+//==================================================================================================
+
+impl Scheduler {
+    ///
+    /// # Description
+    ///
+    /// Creates a new scheduler.
+    ///
+    /// # Parameters
+    ///
+    /// - `nworkers`:   Number of worker threads.
+    /// - `time_slice`: Time for which a virtual processor runs before it is preempted.
+    ///
+    /// # Returns
+    ///
+    /// Upon success, the scheduler is returned. Otherwise, an error is returned instead.
+    ///
+    pub fn new(nworkers: usize, time_slice: Duration) -> Result<Self> {
+        trace!("new(): nworkers={}, time_slice={:?}", nworkers, time_slice);
+
+        if nworkers == 0 || time_slice.is_zero() {
+            let reason: String = format!(
+                "invalid scheduler parameters (nworkers={}, time_slice={:?})",
+                nworkers, time_slice
+            );
+            error!("new(): {}", reason);
+            anyhow::bail!(reason);
+        }
+
+        let shared: Arc<Shared> = Arc::new(Shared {
+            global: Mutex::new(VecDeque::new()),
+            workers: (0..nworkers)
+                .map(|_| Worker {
+                    queue: Mutex::new(VecDeque::new()),
+                    running: Mutex::new(None),
+                })
+                .collect(),
+            sleeping: Mutex::new(0),
+            wakeup: Condvar::new(),
+            time_slice,
+        });
+
+        for index in 0..nworkers {
+            let shared: Arc<Shared> = shared.clone();
+            thread::Builder::new()
+                .name(format!("vcpu-{}", index))
+                .spawn(move || shared.work(index))?;
+        }
+
+        {
+            let shared: Arc<Shared> = shared.clone();
+            thread::Builder::new()
+                .name("vcpu-ticker".to_string())
+                .spawn(move || shared.tick())?;
+        }
+
+        Ok(Self { shared })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Submits a virtual processor to the scheduler.
+    ///
+    /// # Parameters
+    ///
+    /// - `task`: Virtual processor to run.
+    ///
+    pub fn submit(&self, task: Box<dyn Task>) {
+        self.shared.global.lock().unwrap().push_back(task);
+        self.shared.wake_one();
+    }
+}
+
+impl Shared {
+    ///
+    /// # Description
+    ///
+    /// Runs virtual processors on a worker thread.
+    ///
+    /// # Parameters
+    ///
+    /// - `index`: Index of the worker.
+    ///
+    fn work(&self, index: usize) {
+        let worker: &Worker = &self.workers[index];
+        let thread: ThreadHandle = ThreadHandle::current();
+        if let Err(e) = cgroup::join(ThreadGroup::Vcpu) {
+            warn!("work(): failed to join control group (error={:?})", e);
+        }
+        let mut slices: usize = 0;
+        let mut blocked: usize = 0;
+
+        loop {
+            let mut task: Box<dyn Task> = match self.next(index, slices) {
+                Some(task) => task,
+                None => {
+                    self.sleep(index);
+                    continue;
+                },
+            };
+            slices = slices.wrapping_add(1);
+
+            // Run the virtual processor for a time slice.
+            *worker.running.lock().unwrap() = Some(Running {
+                preempter: task.preempter(),
+                thread,
+                deadline: Instant::now() + self.time_slice,
+            });
+            let slice: Slice = task.run();
+            *worker.running.lock().unwrap() = None;
+
+            if slice == Slice::Finished {
+                task.finish();
+                blocked = 0;
+                continue;
+            }
+
+            let queued: usize = {
+                let mut queue: MutexGuard<VecDeque<Box<dyn Task>>> = worker.queue.lock().unwrap();
+                queue.push_back(task);
+                queue.len()
+            };
+
+            // Let sleeping workers steal surplus work.
+            if queued > 1 {
+                self.wake_one();
+            }
+
+            // Back off if every virtual processor in the run queue waits for input.
+            if slice == Slice::Blocked {
+                blocked += 1;
+                if blocked >= queued {
+                    blocked = 0;
+                    thread::sleep(BLOCKED_BACKOFF);
+                }
+            } else {
+                blocked = 0;
+            }
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Picks the next virtual processor that a worker should run.
+    ///
+    /// # Parameters
+    ///
+    /// - `index`:  Index of the worker.
+    /// - `slices`: Number of time slices that the worker has run.
+    ///
+    /// # Returns
+    ///
+    /// If there is work available, a virtual processor is returned. Otherwise, `None` is returned.
+    ///
+    fn next(&self, index: usize, slices: usize) -> Option<Box<dyn Task>> {
+        if slices.is_multiple_of(GLOBAL_QUEUE_INTERVAL) {
+            if let Some(task) = self.global.lock().unwrap().pop_front() {
+                return Some(task);
+            }
+        }
+
+        if let Some(task) = self.workers[index].queue.lock().unwrap().pop_front() {
+            return Some(task);
+        }
+
+        if let Some(task) = self.global.lock().unwrap().pop_front() {
+            return Some(task);
+        }
+
+        self.steal(index)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Steals half of the run queue of another worker.
+    ///
+    /// # Parameters
+    ///
+    /// - `index`: Index of the thief.
+    ///
+    /// # Returns
+    ///
+    /// If some work was stolen, a virtual processor to run is returned and the remaining stolen
+    /// virtual processors are placed in the run queue of the thief. Otherwise, `None` is returned.
+    ///
+    fn steal(&self, index: usize) -> Option<Box<dyn Task>> {
+        let nworkers: usize = self.workers.len();
+
+        for offset in 1..nworkers {
+            let victim: &Worker = &self.workers[(index + offset) % nworkers];
+            let mut stolen: VecDeque<Box<dyn Task>> = {
+                let mut queue: MutexGuard<VecDeque<Box<dyn Task>>> = victim.queue.lock().unwrap();
+                let len: usize = queue.len();
+                queue.split_off(len - len.div_ceil(2))
+            };
+
+            if let Some(task) = stolen.pop_front() {
+                self.workers[index]
+                    .queue
+                    .lock()
+                    .unwrap()
+                    .append(&mut stolen);
+                return Some(task);
+            }
+        }
+
+        None
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Puts a worker to sleep until there is work available.
+    ///
+    /// # Parameters
+    ///
+    /// - `index`: Index of the worker.
+    ///
+    fn sleep(&self, index: usize) {
+        let mut sleeping: MutexGuard<usize> = self.sleeping.lock().unwrap();
+
+        // Check again while holding the lock, so that no wake up is missed.
+        if !self.global.lock().unwrap().is_empty()
+            || self
+                .workers
+                .iter()
+                .enumerate()
+                .any(|(i, worker)| i != index && !worker.queue.lock().unwrap().is_empty())
+        {
+            return;
+        }
+
+        *sleeping += 1;
+        sleeping = self.wakeup.wait(sleeping).unwrap();
+        *sleeping -= 1;
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Wakes up one sleeping worker, if any.
+    ///
+    fn wake_one(&self) {
+        if *self.sleeping.lock().unwrap() > 0 {
+            self.wakeup.notify_one();
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Preempts virtual processors whose time slice has expired.
+    ///
+    fn tick(&self) {
+        loop {
+            thread::sleep(self.time_slice / 2);
+
+            let now: Instant = Instant::now();
+            for worker in &self.workers {
+                if let Some(ref running) = *worker.running.lock().unwrap() {
+                    if now >= running.deadline {
+                        // SAFETY: Workers unpublish a virtual processor, under this lock, before
+                        // they release it.
+                        unsafe { running.preempter.request() };
+                        if let Err(e) = running.thread.kick() {
+                            warn!("tick(): failed to preempt virtual processor (error={:?})", e);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -11,11 +11,21 @@ extern crate kvm_bindings;
 extern crate kvm_ioctls;
 
 use crate::{
-    io::IoThread,
-    kvm::vmem::VirtualMemory,
+    cgroup,
+    config,
+    io::{
+        IoReactor,
+        Outbox,
+    },
+    kvm::{
+        vcpu::Preempter,
+        vmem::VirtualMemory,
+    },
     microvm::{
         self,
         MicroVm,
+        Statistics,
+        Yield,
     },
 };
 use ::anyhow::Result;
@@ -27,15 +37,17 @@ use ::std::{
     net::SocketAddr,
     rc::Rc,
     sync::{
-        mpsc,
+        atomic::{
+            AtomicBool,
+            Ordering,
+        },
         mpsc::{
             Receiver,
-            Sender,
             TryRecvError,
         },
+        Arc,
     },
-    thread::JoinHandle,
-    time::Duration,
+    time::Instant,
 };
 use ::sys::ipc::{
     Message,
@@ -48,6 +60,38 @@ use ::sys::ipc::{
 
 pub struct Vmm {
     microvm: MicroVm,
+    /// Invocation buffer of the guest, once it is ready to serve function invocations.
+    function_buffer: Option<u64>,
+}
+
+///
+/// # Description
+///
+/// What a virtual machine monitor boots.
+///
+pub struct BootOptions<'a> {
+    /// Path to the kernel binary.
+    pub kernel_filename: &'a str,
+    /// Path to the initial RAM disk, if any.
+    pub initrd_filename: Option<&'a str>,
+    /// Enter the kernel with paging enabled?
+    pub paging: bool,
+}
+
+///
+/// # Description
+///
+/// Result of a function invocation.
+///
+pub struct Invocation {
+    /// Output of the function.
+    pub output: Vec<u8>,
+    /// Time spent running the function (in nanoseconds).
+    pub run_ns: u64,
+    /// Time spent rewinding the virtual machine afterwards (in nanoseconds).
+    pub rewind_ns: u64,
+    /// Number of pages that were rewound.
+    pub pages: usize,
 }
 
 //==================================================================================================
@@ -55,40 +99,130 @@ pub struct Vmm {
 //==================================================================================================
 
 impl Vmm {
+    /// Size of the data in an invocation buffer, which follows a 32-bit length header.
+    const FUNCTION_DATA_SIZE: usize = config::FUNCTION_BUFFER_SIZE - 4;
+
     pub fn new(
         memory_size: usize,
-        kernel_filename: &str,
-        initrd_filename: Option<String>,
+        disable_exits: bool,
+        options: &BootOptions,
         stderr: Option<String>,
         gateway_addr: Option<SocketAddr>,
+        record: Option<String>,
+        reactor: &IoReactor,
     ) -> Result<Self> {
         crate::timer!("vmm_creation");
 
-        let (vm_tx, gateway_rx) = mpsc::channel::<Message>();
-        let (gateway_tx, vm_rx) = mpsc::channel::<Message>();
-        let read_timeout: Duration = Duration::from_millis(1);
+        let mut vmm: Self = Self::with_console(
+            memory_size,
+            disable_exits,
+            Self::get_stderr_writer(stderr)?,
+            gateway_addr,
+            record,
+            reactor,
+        )?;
+        vmm.boot(options)?;
 
-        // Spawn I/O thread.
-        let _io_thread: JoinHandle<Result<()>> =
-            IoThread::spawn(gateway_addr, gateway_rx, gateway_tx, read_timeout);
+        Ok(vmm)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Creates a virtual machine monitor with no kernel loaded. A kernel must be booted before the
+    /// virtual machine is run.
+    ///
+    /// # Parameters
+    ///
+    /// - `memory_size`:   Size of the virtual memory of the virtual machine.
+    /// - `disable_exits`: Disable exits on `hlt`, `pause` and `mwait`?
+    /// - `console`:       Writer for the standard error device of the virtual machine.
+    /// - `gateway_addr`:  Address of the gateway, if any.
+    /// - `record`:        Message recording file, if any.
+    /// - `reactor`:       I/O reactor that forwards messages of the virtual machine.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the virtual machine monitor. Otherwise, it
+    /// returns an error.
+    ///
+    pub fn with_console(
+        memory_size: usize,
+        disable_exits: bool,
+        console: Box<dyn Write + Send>,
+        gateway_addr: Option<SocketAddr>,
+        record: Option<String>,
+        reactor: &IoReactor,
+    ) -> Result<Self> {
+        // Attach to the I/O reactor.
+        let (outbox, vm_rx) = reactor.register(gateway_addr, record)?;
 
         // Input function used for emulating I/O port reads.
         let input: Box<microvm::InputFn> = Self::build_input_fn(vm_rx);
 
         // Output function used for emulating I/O port writes.
-        let output: Box<microvm::OutputFn> =
-            Self::build_output_fn(Self::get_stderr_writer(stderr.clone())?, vm_tx);
+        let output: Box<microvm::OutputFn> = Self::build_output_fn(console, outbox);
 
-        let mut microvm: MicroVm = MicroVm::new(memory_size, input, output)?;
+        let microvm: MicroVm = MicroVm::new(memory_size, disable_exits, input, output)?;
 
-        let rip: u64 = microvm.load_kernel(kernel_filename)?;
-        if let Some(ref initrd_filename) = initrd_filename {
-            microvm.load_initrd(initrd_filename)?;
+        Ok(Self {
+            microvm,
+            function_buffer: None,
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Loads a kernel and, optionally, an initial RAM disk into the virtual machine, and resets
+    /// the virtual processor to the entry point of the kernel.
+    ///
+    /// # Parameters
+    ///
+    /// - `options`: Kernel, initial RAM disk and options to boot.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn boot(&mut self, options: &BootOptions) -> Result<()> {
+        let rip: u64 = self.microvm.load_kernel(options.kernel_filename)?;
+        if let Some(initrd_filename) = options.initrd_filename {
+            self.microvm.load_initrd(initrd_filename)?;
         }
 
-        microvm.reset(rip)?;
+        self.microvm.reset(rip, options.paging)
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Boots another kernel in a virtual machine that has already run, reusing its partition,
+    /// memory and virtual processor. Guest memory is zeroed and the virtual processor is restored
+    /// to its power-on state, thus nothing leaks from the previous run.
+    ///
+    /// # Parameters
+    ///
+    /// - `options`: Kernel, initial RAM disk and options to boot.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn reboot(&mut self, options: &BootOptions) -> Result<()> {
+        crate::timer!("vmm_reboot");
+        self.microvm.clear()?;
+        self.function_buffer = None;
+        self.boot(options)
+    }
 
-        Ok(Self { microvm })
+    ///
+    /// # Description
+    ///
+    /// Returns the exit status that the guest wrote to the virtual machine monitor port, if any.
+    ///
+    pub fn exit_status(&self) -> Option<u32> {
+        self.microvm.exit_status()
     }
 
     ///
@@ -105,6 +239,198 @@ impl Vmm {
         Ok(())
     }
 
+    ///
+    /// # Description
+    ///
+    /// Runs the guest until it has initialized and waits for its first function invocation, and
+    /// takes a snapshot of the virtual machine at that point. After each invocation, the virtual
+    /// machine is rewound to this snapshot.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns empty. Otherwise, it returns an error.
+    ///
+    pub fn prepare_function(&mut self) -> Result<()> {
+        crate::timer!("vmm_prepare_function");
+
+        let buffer: u64 = self.run_until_function()?;
+        self.microvm.snapshot()?;
+        self.function_buffer = Some(buffer);
+
+        Ok(())
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Invokes the function that the guest serves. The payload is placed in the invocation buffer
+    /// of the guest, which places its output in the same buffer once it is done. The virtual
+    /// machine is then rewound to the state that it had before the first invocation.
+    ///
+    /// # Parameters
+    ///
+    /// - `payload`: Input of the function.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the result of the invocation. Otherwise, it
+    /// returns an error.
+    ///
+    pub fn invoke(&mut self, payload: &[u8]) -> Result<Invocation> {
+        crate::timer!("vmm_invoke");
+
+        let buffer: u64 = match self.function_buffer {
+            Some(buffer) => buffer,
+            None => {
+                let reason: String = "guest is not ready for function invocations".to_string();
+                error!("invoke(): {}", reason);
+                anyhow::bail!(reason);
+            },
+        };
+
+        // Place the payload in the invocation buffer.
+        if payload.len() > Self::FUNCTION_DATA_SIZE {
+            let reason: String = format!("payload is too large (len={})", payload.len());
+            error!("invoke(): {}", reason);
+            anyhow::bail!(reason);
+        }
+        self.microvm
+            .write_bytes(buffer, &(payload.len() as u32).to_le_bytes())?;
+        self.microvm.write_bytes(buffer + 4, payload)?;
+
+        let start: Instant = Instant::now();
+        let result: u64 = match self.run_until_function() {
+            Ok(result) => result,
+            Err(e) => {
+                // The guest did not reach the point at which it was snapshot, thus it cannot
+                // serve further invocations.
+                self.function_buffer = None;
+                return Err(e);
+            },
+        };
+        let run_ns: u64 = start.elapsed().as_nanos() as u64;
+
+        // Collect the output from the invocation buffer.
+        let mut len: [u8; 4] = [0; 4];
+        self.microvm.read_bytes(result, &mut len)?;
+        let len: usize = u32::from_le_bytes(len) as usize;
+        if len > Self::FUNCTION_DATA_SIZE {
+            let reason: String = format!("output is too large (len={})", len);
+            error!("invoke(): {}", reason);
+            anyhow::bail!(reason);
+        }
+        let mut output: Vec<u8> = vec![0; len];
+        self.microvm.read_bytes(result + 4, &mut output)?;
+
+        let start: Instant = Instant::now();
+        let pages: usize = self.microvm.rewind()?;
+        let rewind_ns: u64 = start.elapsed().as_nanos() as u64;
+
+        Ok(Invocation {
+            output,
+            run_ns,
+            rewind_ns,
+            pages,
+        })
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Runs the virtual machine until the guest waits for a function invocation.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the address of the invocation buffer of
+    /// the guest. Otherwise, it returns an error.
+    ///
+    fn run_until_function(&mut self) -> Result<u64> {
+        loop {
+            match self.microvm.run_slice()? {
+                Yield::Function(buffer) => return Ok(buffer),
+                Yield::Preempted | Yield::Blocked => {},
+                Yield::PoweredOff => {
+                    let reason: String = "guest powered off".to_string();
+                    error!("run_until_function(): {}", reason);
+                    anyhow::bail!(reason);
+                },
+            }
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Runs the virtual machine until it gives its host thread back.
+    ///
+    /// # Returns
+    ///
+    /// Upon successful completion, this method returns the reason for which the virtual machine
+    /// stopped running. Otherwise, it returns an error.
+    ///
+    pub fn run_slice(&mut self) -> Result<Yield> {
+        self.microvm.run_slice()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns a handle that forces the virtual machine out of the guest.
+    ///
+    pub fn preempter(&self) -> Preempter {
+        self.microvm.preempter()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Prints execution statistics of the virtual machine to the standard output, in a
+    /// `key=value` format that is meant to be parsed by tools.
+    ///
+    pub fn print_stats(&self) {
+        let stats: Arc<Statistics> = self.microvm.stats();
+        println!(
+            "microvm-stats: exits={} pmio_exits={} mmio_exits={} halt_exits={} preemptions={} \
+             run_ns={}",
+            stats.exits.load(Ordering::Relaxed),
+            stats.pmio_exits.load(Ordering::Relaxed),
+            stats.mmio_exits.load(Ordering::Relaxed),
+            stats.halt_exits.load(Ordering::Relaxed),
+            stats.preemptions.load(Ordering::Relaxed),
+            stats.run_ns.load(Ordering::Relaxed)
+        );
+
+        if let Some(stats) = cgroup::stats() {
+            println!(
+                "microvm-cgroup: usage_usec={} nr_throttled={} throttled_usec={} \
+                 memory_current={} memory_high_events={}",
+                stats.usage_usec,
+                stats.nr_throttled,
+                stats.throttled_usec,
+                stats.memory_current,
+                stats.memory_high_events
+            );
+        }
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns the execution statistics of the virtual machine.
+    ///
+    pub fn stats(&self) -> Arc<Statistics> {
+        self.microvm.stats()
+    }
+
+    ///
+    /// # Description
+    ///
+    /// Returns a flag that stops the virtual machine when set.
+    ///
+    pub fn stop_flag(&self) -> Arc<AtomicBool> {
+        self.microvm.stop_flag()
+    }
+
     ///
     /// # Description
     ///
@@ -120,9 +446,9 @@ impl Vmm {
     ///
     /// On success, the function returns a buffered writer for the virtual machine's standard error
     ///
-    fn get_stderr_writer(vm_stderr: Option<String>) -> Result<Box<dyn Write>> {
+    fn get_stderr_writer(vm_stderr: Option<String>) -> Result<Box<dyn Write + Send>> {
         // Obtain a buffered writer for the virtual machine's standard error device.
-        let file_writer: Box<dyn Write> = if let Some(vm_stderr) = vm_stderr {
+        let file_writer: Box<dyn Write + Send> = if let Some(vm_stderr) = vm_stderr {
             // Standard error was set to a file. Attempt to open file and create a writer.
             let file = File::options()
                 .read(false)
@@ -140,7 +466,7 @@ impl Vmm {
 
     fn build_input_fn(input_queue: Receiver<Message>) -> Box<microvm::InputFn> {
         // Input function used for emulating I/O port reads.
-        let input = move |vm: &Rc<RefCell<VirtualMemory>>, data, size| -> Result<()> {
+        let input = move |vm: &Rc<RefCell<VirtualMemory>>, data, size| -> Result<bool> {
             // Check for invalid operand size.
             if size != 4 {
                 let reason: String = format!("invalid operand size (size={:?})", size);
@@ -152,12 +478,14 @@ impl Vmm {
                 Ok(mut msg) => {
                     msg.message_type = MessageType::Ikc;
                     vm.borrow_mut().write_bytes(data as u64, &msg.to_bytes())?;
+                    Ok(true)
                 },
                 // No message available.
                 Err(TryRecvError::Empty) => {
                     let empty_message = Message::default();
                     vm.borrow_mut()
                         .write_bytes(data as u64, &empty_message.to_bytes())?;
+                    Ok(false)
                 },
                 // Channel has disconnected.
                 Err(TryRecvError::Disconnected) => {
@@ -166,16 +494,14 @@ impl Vmm {
                     anyhow::bail!(reason);
                 },
             }
-
-            Ok(())
         };
 
         Box::new(input)
     }
 
     fn build_output_fn(
-        mut file_writer: Box<dyn Write>,
-        queue: Sender<Message>,
+        mut file_writer: Box<dyn Write + Send>,
+        outbox: Outbox,
     ) -> Box<microvm::OutputFn> {
         // Output function used for emulating I/O port writes.
         let output = move |vm: &Rc<RefCell<VirtualMemory>>, data, size| -> Result<()> {
@@ -214,13 +540,7 @@ impl Vmm {
                     },
                 };
 
-                if let Err(e) = queue.send(message) {
-                    let reason: String = format!("failed to send message: {:?}", e);
-                    error!("output(): {}", reason);
-                    anyhow::bail!(reason);
-                }
-
-                Ok(())
+                outbox.send(message)
             }
         };
 
@@ -0,0 +1,113 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#include "bench.h"
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/**
+ * @brief Magic value that identifies benchmark parameters.
+ */
+#define PARAMS_MAGIC 0x636f6e73
+
+/**
+ * @brief Default number of bytes to write.
+ */
+#define DEFAULT_BYTES (1024 * 1024)
+
+/**
+ * @brief Default minimum line length, including the line terminator.
+ */
+#define DEFAULT_MIN_LINE 1
+
+/**
+ * @brief Default maximum line length, including the line terminator.
+ */
+#define DEFAULT_MAX_LINE 120
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+/**
+ * @brief Benchmark parameters, passed by the host in the initial RAM disk.
+ */
+struct params {
+    uint32_t magic;    /** Magic value. */
+    uint32_t bytes;    /** Number of bytes to write. */
+    uint32_t min_line; /** Minimum line length. */
+    uint32_t max_line; /** Maximum line length. */
+};
+
+//==================================================================================================
+// Helper Functions
+//==================================================================================================
+
+/**
+ * @brief Generates a pseudo-random number.
+ *
+ * @param state State of the generator.
+ *
+ * @return A pseudo-random number.
+ */
+static uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x);
+}
+
+//==================================================================================================
+// Main Function
+//==================================================================================================
+
+/**
+ * @brief Writes a configurable volume of console output with varied line lengths.
+ *
+ * @note Nothing else is written to the console, so that the host can attribute every exit and
+ * every byte of output to the benchmark.
+ */
+void kmain(uint32_t magic, uint32_t info)
+{
+    const struct params *params = initrd_base(magic, info);
+
+    uint32_t bytes = DEFAULT_BYTES;
+    uint32_t min_line = DEFAULT_MIN_LINE;
+    uint32_t max_line = DEFAULT_MAX_LINE;
+
+    // Use parameters provided by the host, if any.
+    if ((params != NULL) && (params->magic == PARAMS_MAGIC)) {
+        bytes = params->bytes;
+        min_line = params->min_line;
+        max_line = params->max_line;
+    }
+
+    // Check for invalid parameters.
+    if ((min_line == 0) || (max_line < min_line)) {
+        print("console-bench: invalid parameters\n");
+        return;
+    }
+
+    uint32_t state = 0x2545f491;
+    uint32_t written = 0;
+    while (written < bytes) {
+        uint32_t length = min_line + (xorshift32(&state) % (max_line - min_line + 1));
+
+        // Truncate the last line.
+        if (length > (bytes - written)) {
+            length = bytes - written;
+        }
+
+        for (uint32_t i = 1; i < length; i++) {
+            outb(STDOUT_PORT, (uint8_t)('a' + ((written + i) % 26)));
+        }
+        outb(STDOUT_PORT, '\n');
+
+        written += length;
+    }
+}
@@ -0,0 +1,26 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#include "bench.h"
+
+//==================================================================================================
+// Main Function
+//==================================================================================================
+
+/**
+ * @brief Announces that the guest has booted and then idles until the host kills the virtual
+ * machine.
+ *
+ * @note The virtual machine monitor powers off on halt, so the guest idles in a pause loop,
+ * without causing exits.
+ */
+void kmain(void)
+{
+    report_begin("density-bench");
+    report_str("state", "ready");
+    report_end();
+
+    for (;;) {
+        __asm__ __volatile__("pause");
+    }
+}
@@ -0,0 +1,150 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#include "bench.h"
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/**
+ * @brief Number of exits that are measured in each benchmark.
+ */
+#define NR_EXITS 100000
+
+/**
+ * @brief Number of exits that are issued before measuring.
+ */
+#define NR_WARMUP 1000
+
+//==================================================================================================
+// Reporting
+//==================================================================================================
+
+/**
+ * @brief Reports the results of a benchmark to the host.
+ *
+ * @param name   Name of the benchmark.
+ * @param exits  Number of exits that were measured.
+ * @param cycles Number of cycles that were spent.
+ */
+static void report(const char *name, uint32_t exits, uint64_t cycles)
+{
+    report_begin("exit-bench");
+    report_str("name", name);
+    report_num("exits", exits);
+    report_num("cycles", cycles);
+    report_end();
+}
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+/**
+ * @brief Buffer for messages exchanged with the virtual machine monitor.
+ */
+static uint8_t message[4096] __attribute__((aligned(4096)));
+
+/**
+ * @brief Writes a byte to the benchmark port.
+ */
+static void bench_pio_out_bench(void)
+{
+    outb(BENCH_PORT, 0);
+}
+
+/**
+ * @brief Reads a byte from the benchmark port.
+ */
+static void bench_pio_in_bench(void)
+{
+    (void)inb(BENCH_PORT);
+}
+
+/**
+ * @brief Writes to the benchmark memory-mapped registers.
+ */
+static void bench_mmio_write_bench(void)
+{
+    *(volatile uint32_t *)BENCH_MMIO_BASE = 0;
+}
+
+/**
+ * @brief Reads from the benchmark memory-mapped registers.
+ */
+static void bench_mmio_read_bench(void)
+{
+    (void)*(volatile uint32_t *)BENCH_MMIO_BASE;
+}
+
+/**
+ * @brief Writes a byte to the standard output device.
+ */
+static void bench_pio_out_stdout_byte(void)
+{
+    outb(STDOUT_PORT, 0);
+}
+
+/**
+ * @brief Receives a message from the standard input device.
+ */
+static void bench_pio_out_stdin_message(void)
+{
+    outl(STDIN_PORT, (uint32_t)message);
+}
+
+/**
+ * @brief Sends a message to the standard output device.
+ */
+static void bench_pio_out_stdout_message(void)
+{
+    outl(STDOUT_PORT, (uint32_t)message);
+}
+
+/**
+ * @brief Runs a benchmark.
+ *
+ * @param name Name of the benchmark.
+ * @param fn   Function that issues exactly one exit.
+ */
+static void run(const char *name, void (*fn)(void))
+{
+    for (uint32_t i = 0; i < NR_WARMUP; i++) {
+        fn();
+    }
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < NR_EXITS; i++) {
+        fn();
+    }
+    uint64_t end = rdtsc();
+
+    report(name, NR_EXITS, end - start);
+}
+
+//==================================================================================================
+// Main Function
+//==================================================================================================
+
+/**
+ * @brief Measures the cost of each kind of exit that the virtual machine monitor handles.
+ *
+ * @note Writes to the VMM port and halts power off the virtual machine, thus they cannot be
+ * measured in a loop. Memory-mapped registers are only measured if guest memory lies below them.
+ */
+void kmain(uint32_t magic, uint32_t info)
+{
+    const struct boot_info *boot = boot_info(magic, info);
+
+    run("pio-out-bench", bench_pio_out_bench);
+    run("pio-in-bench", bench_pio_in_bench);
+    if ((boot != NULL) && (boot->memory_size <= BENCH_MMIO_BASE)) {
+        run("mmio-write-bench", bench_mmio_write_bench);
+        run("mmio-read-bench", bench_mmio_read_bench);
+    }
+    run("pio-out-stdout-byte", bench_pio_out_stdout_byte);
+    // NOTE: must come before sending messages, as it fills the buffer with a valid message.
+    run("pio-out-stdin-message", bench_pio_out_stdin_message);
+    run("pio-out-stdout-message", bench_pio_out_stdout_message);
+}
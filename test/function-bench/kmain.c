@@ -0,0 +1,96 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#include "bench.h"
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/**
+ * @brief Number of scratch pages that an invocation may touch.
+ */
+#define NR_SCRATCH_PAGES 64
+
+/**
+ * @brief Size of a page.
+ */
+#define PAGE_SIZE 4096
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/**
+ * @brief Invocation buffer.
+ */
+static struct function_buffer buffer __attribute__((aligned(4096)));
+
+/**
+ * @brief Lookup table that converts characters to upper case, built at initialization.
+ */
+static uint8_t upper[256];
+
+/**
+ * @brief Number of invocations served since the snapshot. It is always one when it is reported,
+ * because the virtual machine is rewound after each invocation.
+ */
+static uint32_t invocations;
+
+/**
+ * @brief Scratch pages.
+ */
+static uint8_t scratch[NR_SCRATCH_PAGES * PAGE_SIZE] __attribute__((aligned(4096)));
+
+//==================================================================================================
+// Function
+//==================================================================================================
+
+/**
+ * @brief Converts the input to upper case, and appends the number of invocations served since
+ * the snapshot. One scratch page is touched per byte of input, so that the cost of rewinding the
+ * virtual machine can be measured against the number of pages touched.
+ */
+static void handle(void)
+{
+    uint32_t length = buffer.length;
+
+    invocations++;
+
+    for (uint32_t i = 0; i < length; i++) {
+        buffer.data[i] = upper[buffer.data[i]];
+        if (i < NR_SCRATCH_PAGES) {
+            scratch[i * PAGE_SIZE] = buffer.data[i];
+        }
+    }
+
+    // Append the number of invocations.
+    if (length + 3 <= sizeof(buffer.data)) {
+        buffer.data[length++] = ' ';
+        buffer.data[length++] = '#';
+        buffer.data[length++] = "0123456789abcdef"[invocations & 0xf];
+    }
+
+    buffer.length = length;
+}
+
+//==================================================================================================
+// Main Function
+//==================================================================================================
+
+/**
+ * @brief Initializes and then serves function invocations forever.
+ */
+void kmain(void)
+{
+    for (uint32_t c = 0; c < 256; c++) {
+        upper[c] = ((c >= 'a') && (c <= 'z')) ? (c - 'a' + 'A') : c;
+    }
+
+    buffer.length = 0;
+
+    for (;;) {
+        function_wait(&buffer);
+        handle();
+    }
+}
@@ -0,0 +1,288 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#include "bench.h"
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/**
+ * @brief Magic value that identifies benchmark parameters.
+ */
+#define PARAMS_MAGIC 0x67776270
+
+/**
+ * @brief Send messages and wait for them to be echoed back.
+ */
+#define MODE_ROUNDTRIP 0
+
+/**
+ * @brief Send messages only.
+ */
+#define MODE_SEND 1
+
+/**
+ * @brief Receive messages only.
+ */
+#define MODE_RECV 2
+
+/**
+ * @brief Maximum number of messages that may be in flight.
+ */
+#define MAX_DEPTH 1024
+
+/**
+ * @brief Maximum number of latency samples.
+ */
+#define MAX_SAMPLES 65536
+
+/**
+ * @brief Size of message buffers.
+ */
+#define BUFFER_SIZE 4096
+
+//==================================================================================================
+// Structures
+//==================================================================================================
+
+/**
+ * @brief Benchmark parameters, passed by the host in the initial RAM disk.
+ */
+struct params {
+    uint32_t magic;        /** Magic value. */
+    uint32_t mode;         /** Benchmark mode. */
+    uint32_t message_size; /** Size of a message. */
+    uint32_t depth;        /** Number of messages in flight. */
+    uint32_t count;        /** Number of messages to exchange. */
+};
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/**
+ * @brief Buffer for outgoing messages.
+ */
+static uint8_t tx[BUFFER_SIZE] __attribute__((aligned(4096)));
+
+/**
+ * @brief Buffer for incoming messages.
+ */
+static uint8_t rx[BUFFER_SIZE] __attribute__((aligned(4096)));
+
+/**
+ * @brief Timestamps of messages in flight.
+ */
+static uint64_t sent_at[MAX_DEPTH];
+
+/**
+ * @brief Round-trip latencies in cycles.
+ */
+static uint32_t latencies[MAX_SAMPLES];
+
+/**
+ * @brief Size of a message.
+ */
+static uint32_t message_size;
+
+//==================================================================================================
+// Messaging
+//==================================================================================================
+
+/**
+ * @brief Sends a message whose last four bytes carry a sequence number.
+ *
+ * @param seq Sequence number (non-zero).
+ */
+static void send(uint32_t seq)
+{
+    *(uint32_t *)&tx[message_size - sizeof(uint32_t)] = seq;
+    outl(STDOUT_PORT, (uint32_t)tx);
+}
+
+/**
+ * @brief Polls for a message.
+ *
+ * @returns The sequence number of the message that was received, or zero if no message is
+ * available. Empty messages carry zeros in their payload.
+ */
+static uint32_t receive(void)
+{
+    outl(STDIN_PORT, (uint32_t)rx);
+    return (*(uint32_t *)&rx[message_size - sizeof(uint32_t)]);
+}
+
+//==================================================================================================
+// Statistics
+//==================================================================================================
+
+/**
+ * @brief Sorts latency samples.
+ *
+ * @param n Number of samples.
+ */
+static void sort(uint32_t n)
+{
+    for (uint32_t gap = n / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            uint32_t tmp = latencies[i];
+            uint32_t j = i;
+            for (; j >= gap && latencies[j - gap] > tmp; j -= gap) {
+                latencies[j] = latencies[j - gap];
+            }
+            latencies[j] = tmp;
+        }
+    }
+}
+
+/**
+ * @brief Gets a percentile of sorted latency samples.
+ *
+ * @param n        Number of samples.
+ * @param permille Percentile in thousandths.
+ *
+ * @returns The requested percentile.
+ */
+static uint32_t percentile(uint32_t n, uint32_t permille)
+{
+    return (latencies[((n - 1) * permille) / 1000]);
+}
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+/**
+ * @brief Keeps up to @p depth messages in flight and measures their round-trip latency.
+ *
+ * @param depth  Number of messages in flight.
+ * @param count  Number of messages to exchange.
+ * @param errors Store location for the number of out-of-order messages.
+ *
+ * @returns The number of latency samples.
+ */
+static uint32_t roundtrip(uint32_t depth, uint32_t count, uint32_t *errors)
+{
+    uint32_t sent = 0;
+    uint32_t received = 0;
+
+    while ((sent < depth) && (sent < count)) {
+        sent_at[sent % depth] = rdtsc();
+        send(++sent);
+    }
+
+    while (received < count) {
+        uint32_t seq = receive();
+        if (seq == 0) {
+            continue;
+        }
+        uint64_t latency = rdtsc() - sent_at[received % depth];
+
+        if (seq != received + 1) {
+            (*errors)++;
+        }
+        if (received < MAX_SAMPLES) {
+            latencies[received] = (latency > 0xffffffff) ? 0xffffffff : (uint32_t)latency;
+        }
+        received++;
+
+        if (sent < count) {
+            sent_at[sent % depth] = rdtsc();
+            send(++sent);
+        }
+    }
+
+    return ((count < MAX_SAMPLES) ? count : MAX_SAMPLES);
+}
+
+/**
+ * @brief Sends messages as fast as possible.
+ *
+ * @param count Number of messages to send.
+ */
+static void send_only(uint32_t count)
+{
+    for (uint32_t seq = 1; seq <= count; seq++) {
+        send(seq);
+    }
+}
+
+/**
+ * @brief Receives messages as fast as possible.
+ *
+ * @param count  Number of messages to receive.
+ * @param errors Store location for the number of out-of-order messages.
+ */
+static void receive_only(uint32_t count, uint32_t *errors)
+{
+    uint32_t received = 0;
+
+    while (received < count) {
+        uint32_t seq = receive();
+        if (seq == 0) {
+            continue;
+        }
+        if (seq != received + 1) {
+            (*errors)++;
+        }
+        received++;
+    }
+}
+
+//==================================================================================================
+// Main Function
+//==================================================================================================
+
+void kmain(uint32_t magic, uint32_t info)
+{
+    const struct params *params = initrd_base(magic, info);
+
+    // Check for invalid parameters.
+    if ((params == NULL) || (params->magic != PARAMS_MAGIC) ||
+        (params->message_size < sizeof(uint32_t)) || (params->message_size > BUFFER_SIZE) ||
+        (params->depth == 0) || (params->depth > MAX_DEPTH)) {
+        print("gateway-bench: invalid parameters\n");
+        return;
+    }
+
+    message_size = params->message_size;
+
+    // Obtain a well-formed message to use as template for outgoing messages.
+    if (params->mode != MODE_RECV) {
+        outl(STDIN_PORT, (uint32_t)tx);
+    }
+
+    uint32_t errors = 0;
+    uint32_t samples = 0;
+    uint64_t start = rdtsc();
+    switch (params->mode) {
+        case MODE_ROUNDTRIP:
+            samples = roundtrip(params->depth, params->count, &errors);
+            break;
+        case MODE_SEND:
+            send_only(params->count);
+            break;
+        case MODE_RECV:
+            receive_only(params->count, &errors);
+            break;
+        default:
+            print("gateway-bench: invalid mode\n");
+            return;
+    }
+    uint64_t end = rdtsc();
+
+    report_begin("gateway-bench");
+    report_num("messages", params->count);
+    report_num("cycles", end - start);
+    report_num("errors", errors);
+    if (samples > 0) {
+        sort(samples);
+        report_num("p50", percentile(samples, 500));
+        report_num("p90", percentile(samples, 900));
+        report_num("p99", percentile(samples, 990));
+        report_num("p999", percentile(samples, 999));
+        report_num("max", latencies[samples - 1]);
+    }
+    report_end();
+}
@@ -0,0 +1,464 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/**
+ * @brief Magic value that identifies the virtual machine monitor and its boot protocol, in which
+ * the ebx register holds the address of the boot information page.
+ */
+#define MICROVM_MAGIC 0x0decaf02
+
+/**
+ * @brief I/O port that is connected to the standard output of the virtual machine.
+ */
+#define STDOUT_PORT 0xe9
+
+/**
+ * @brief I/O port that is connected to the standard input of the virtual machine.
+ */
+#define STDIN_PORT 0xea
+
+/**
+ * @brief I/O port that is ignored by the virtual machine monitor.
+ */
+#define BENCH_PORT 0xeb
+
+/**
+ * @brief Memory-mapped registers that are ignored by the virtual machine monitor. They are only
+ * attached if guest memory lies below them.
+ */
+#define BENCH_MMIO_BASE 0xfeb00000
+
+/**
+ * @brief I/O port that enables the guest to invoke functionalities of the virtual machine monitor.
+ */
+#define VMM_PORT 0x604
+
+/**
+ * @brief I/O port through which the guest waits for function invocations.
+ */
+#define FUNCTION_PORT 0xec
+
+/**
+ * @brief Size of an invocation buffer.
+ */
+#define FUNCTION_BUFFER_SIZE 4096
+
+//==================================================================================================
+// Low-Level Functions
+//==================================================================================================
+
+static inline void outb(uint16_t port, uint8_t value)
+{
+    __asm__ __volatile__("outb %0,%1"
+                         : /* empty */
+                         : "a"(value), "Nd"(port)
+                         : "memory");
+}
+
+static inline void outl(uint16_t port, uint32_t value)
+{
+    __asm__ __volatile__("outl %0,%1"
+                         : /* empty */
+                         : "a"(value), "Nd"(port)
+                         : "memory");
+}
+
+static inline uint8_t inb(uint16_t port)
+{
+    uint8_t value;
+    __asm__ __volatile__("inb %1,%0" : "=a"(value) : "Nd"(port) : "memory");
+    return (value);
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return (((uint64_t)hi << 32) | lo);
+}
+
+//==================================================================================================
+// Boot Information
+//==================================================================================================
+
+/**
+ * @brief Version of the layout of the boot information page. Later versions only append fields.
+ */
+#define BOOT_INFO_VERSION 2
+
+/**
+ * @brief Maximum number of regions in the memory map.
+ */
+#define BOOT_INFO_MAX_REGIONS 16
+
+/**
+ * @brief Maximum number of modules.
+ */
+#define BOOT_INFO_MAX_MODULES 8
+
+/**
+ * @brief The kernel was entered with paging enabled.
+ */
+#define BOOT_INFO_FLAG_PAGING (1 << 0)
+
+/**
+ * @brief The time-stamp counter runs at a constant rate.
+ */
+#define BOOT_INFO_FLAG_INVARIANT_TSC (1 << 1)
+
+/**
+ * @brief KVM keeps a paravirtual clock in the boot information page.
+ */
+#define BOOT_INFO_FLAG_PVCLOCK (1 << 2)
+
+/**
+ * @brief Types of the regions in the memory map.
+ */
+#define MEMORY_REGION_USABLE 1   /** Free memory.                        */
+#define MEMORY_REGION_RESERVED 2 /** Used by the virtual machine monitor. */
+#define MEMORY_REGION_KERNEL 3   /** Holds the kernel.                   */
+#define MEMORY_REGION_MODULE 4   /** Holds a module.                     */
+
+/**
+ * @brief A region of the memory map.
+ */
+struct memory_region
+{
+    uint64_t base;     /** Base address. */
+    uint64_t size;     /** Size.         */
+    uint32_t type;     /** Type.         */
+    uint32_t _padding; /** Padding.      */
+};
+
+/**
+ * @brief A module that was loaded along with the kernel.
+ */
+struct module
+{
+    uint64_t base; /** Base address. */
+    uint64_t size; /** Size.         */
+};
+
+/**
+ * @brief Wall-clock time at which the paravirtual clock read zero, written by KVM.
+ */
+struct pvclock_wall_clock
+{
+    uint32_t version; /** Odd while KVM writes the structure. */
+    uint32_t sec;     /** Seconds since the epoch.            */
+    uint32_t nsec;    /** Nanoseconds.                        */
+} __attribute__((packed));
+
+/**
+ * @brief Paravirtual clock of a virtual processor, updated by KVM.
+ */
+struct pvclock_vcpu_time_info
+{
+    uint32_t version;           /** Odd while KVM updates the structure. */
+    uint32_t _padding0;         /** Padding.                             */
+    uint64_t tsc_timestamp;     /** TSC at the last update.              */
+    uint64_t system_time;       /** Nanoseconds at the last update.      */
+    uint32_t tsc_to_system_mul; /** TSC to nanoseconds multiplier.       */
+    int8_t tsc_shift;           /** TSC to nanoseconds shift.            */
+    uint8_t flags;              /** Flags.                               */
+    uint8_t _padding1[2];       /** Padding.                             */
+} __attribute__((packed));
+
+/**
+ * @brief Boot information page, whose address the kernel finds in the ebx register at boot.
+ */
+struct boot_info
+{
+    uint32_t magic;                                        /** Magic value.                 */
+    uint32_t version;                                      /** Version of the layout.       */
+    uint32_t size;                                         /** Size of the structure.       */
+    uint32_t flags;                                        /** Flags.                       */
+    uint64_t memory_size;                                  /** Size of memory.              */
+    uint64_t tsc_khz;                                      /** TSC frequency, or zero.      */
+    uint32_t vcpus;                                        /** Number of processors.        */
+    uint32_t nregions;                                     /** Number of memory regions.    */
+    uint32_t nmodules;                                     /** Number of modules.           */
+    uint32_t _padding;                                     /** Padding.                     */
+    struct memory_region regions[BOOT_INFO_MAX_REGIONS]; /** Memory map, sorted by base.  */
+    struct module modules[BOOT_INFO_MAX_MODULES];        /** Modules. The first is initrd. */
+    uint64_t wall_clock;                                   /** Wall-clock time, or zero.    */
+    uint64_t pvclock;                                      /** Paravirtual clock, or zero.  */
+};
+
+/**
+ * @brief Gets the boot information page.
+ *
+ * @param magic Value of the eax register at boot.
+ * @param info  Value of the ebx register at boot.
+ *
+ * @returns If the kernel was booted by the virtual machine monitor, the boot information page is
+ * returned. Otherwise, NULL is returned instead.
+ */
+static inline const struct boot_info *boot_info(uint32_t magic, uint32_t info)
+{
+    const struct boot_info *boot = (const struct boot_info *)(uintptr_t)info;
+
+    if ((magic != MICROVM_MAGIC) || (boot == NULL) || (boot->magic != MICROVM_MAGIC) ||
+        (boot->version < BOOT_INFO_VERSION)) {
+        return (NULL);
+    }
+
+    return (boot);
+}
+
+/**
+ * @brief Gets the base address of the initial RAM disk.
+ *
+ * @param magic Value of the eax register at boot.
+ * @param info  Value of the ebx register at boot.
+ *
+ * @returns If an initial RAM disk was loaded, its base address is returned. Otherwise, NULL is
+ * returned instead.
+ */
+static inline const void *initrd_base(uint32_t magic, uint32_t info)
+{
+    const struct boot_info *boot = boot_info(magic, info);
+
+    if ((boot == NULL) || (boot->nmodules == 0)) {
+        return (NULL);
+    }
+
+    return ((const void *)(uintptr_t)boot->modules[0].base);
+}
+
+/**
+ * @brief Finds the largest block of usable memory below a limit.
+ *
+ * @param boot  Boot information page.
+ * @param align Alignment of the block, a power of two.
+ * @param limit Address past the last one that the block may cover.
+ * @param size  Location where the size of the block is stored.
+ *
+ * @returns The base address of the block is returned. If no usable memory is found, the size of
+ * the block is zero.
+ */
+static inline void *memory_find(const struct boot_info *boot, uint64_t align, uint64_t limit,
+                                uint64_t *size)
+{
+    uint64_t best_base = 0, best_size = 0;
+
+    for (uint32_t i = 0; (boot != NULL) && (i < boot->nregions); i++) {
+        const struct memory_region *region = &boot->regions[i];
+        uint64_t base = (region->base + align - 1) & ~(align - 1);
+        uint64_t end = region->base + region->size;
+
+        if (region->type != MEMORY_REGION_USABLE) {
+            continue;
+        }
+        if (end > limit) {
+            end = limit;
+        }
+        if ((base < end) && (end - base > best_size)) {
+            best_base = base;
+            best_size = end - base;
+        }
+    }
+
+    *size = best_size;
+
+    return ((void *)(uintptr_t)best_base);
+}
+
+/**
+ * @brief Reads the paravirtual clock, without exiting to the virtual machine monitor.
+ *
+ * @param boot Boot information page.
+ *
+ * @returns If KVM keeps a paravirtual clock, the number of nanoseconds since it read zero is
+ * returned. Otherwise, zero is returned instead.
+ */
+static inline uint64_t pvclock_ns(const struct boot_info *boot)
+{
+    const volatile struct pvclock_vcpu_time_info *time;
+    uint32_t version;
+    uint64_t delta, ns;
+
+    if ((boot == NULL) || !(boot->flags & BOOT_INFO_FLAG_PVCLOCK)) {
+        return (0);
+    }
+
+    time = (const volatile struct pvclock_vcpu_time_info *)(uintptr_t)boot->pvclock;
+
+    // Retry while KVM updates the clock.
+    do {
+        version = time->version;
+        __asm__ __volatile__("" ::: "memory");
+        delta = rdtsc() - time->tsc_timestamp;
+        if (time->tsc_shift < 0) {
+            delta >>= -time->tsc_shift;
+        } else {
+            delta <<= time->tsc_shift;
+        }
+        // Scale as (delta * mul) >> 32, without 128-bit arithmetic.
+        ns = time->system_time + (((delta & 0xffffffff) * time->tsc_to_system_mul) >> 32) +
+             ((delta >> 32) * time->tsc_to_system_mul);
+        __asm__ __volatile__("" ::: "memory");
+    } while ((version & 1) || (version != time->version));
+
+    return (ns);
+}
+
+/**
+ * @brief Reads the wall-clock time, without exiting to the virtual machine monitor.
+ *
+ * @param boot Boot information page.
+ *
+ * @returns If KVM keeps a paravirtual clock, the number of nanoseconds since the epoch is
+ * returned. Otherwise, zero is returned instead.
+ */
+static inline uint64_t wall_clock_ns(const struct boot_info *boot)
+{
+    const volatile struct pvclock_wall_clock *wall;
+    uint32_t version;
+    uint64_t ns;
+
+    if ((boot == NULL) || !(boot->flags & BOOT_INFO_FLAG_PVCLOCK)) {
+        return (0);
+    }
+
+    wall = (const volatile struct pvclock_wall_clock *)(uintptr_t)boot->wall_clock;
+
+    do {
+        version = wall->version;
+        __asm__ __volatile__("" ::: "memory");
+        ns = (uint64_t)wall->sec * 1000000000ULL + wall->nsec;
+        __asm__ __volatile__("" ::: "memory");
+    } while ((version & 1) || (version != wall->version));
+
+    return (ns + pvclock_ns(boot));
+}
+
+//==================================================================================================
+// Reporting
+//==================================================================================================
+
+/**
+ * @brief Writes a string to the standard output device.
+ *
+ * @param str Target string.
+ */
+static inline void print(const char *str)
+{
+    for (const char *p = str; *p != '\0'; p++) {
+        outb(STDOUT_PORT, *p);
+    }
+}
+
+/**
+ * @brief Writes a number in hexadecimal to the standard output device.
+ *
+ * @param x Target number.
+ *
+ * @note Hexadecimal is used because 64-bit division is not available without libgcc.
+ */
+static inline void printhex(uint64_t x)
+{
+    print("0x");
+    for (int i = 60; i >= 0; i -= 4) {
+        outb(STDOUT_PORT, "0123456789abcdef"[(x >> i) & 0xf]);
+    }
+}
+
+/**
+ * @brief Starts a report line. Reports are parsed by the host-side benchmark runner.
+ *
+ * @param tag Tag of the report.
+ */
+static inline void report_begin(const char *tag)
+{
+    // Start on a fresh line, in case the benchmark wrote to the console.
+    print("\n");
+    print(tag);
+    print(":");
+}
+
+/**
+ * @brief Adds a string field to the current report line.
+ *
+ * @param key   Name of the field.
+ * @param value Value of the field.
+ */
+static inline void report_str(const char *key, const char *value)
+{
+    print(" ");
+    print(key);
+    print("=");
+    print(value);
+}
+
+/**
+ * @brief Adds a numeric field to the current report line.
+ *
+ * @param key   Name of the field.
+ * @param value Value of the field.
+ */
+static inline void report_num(const char *key, uint64_t value)
+{
+    print(" ");
+    print(key);
+    print("=");
+    printhex(value);
+}
+
+/**
+ * @brief Ends the current report line.
+ */
+static inline void report_end(void)
+{
+    print("\n");
+}
+
+/**
+ * @brief Powers off the virtual machine, reporting an exit status to the virtual machine monitor.
+ *
+ * @param status Exit status.
+ */
+static inline void shutdown(uint32_t status)
+{
+    outl(VMM_PORT, status);
+}
+
+//==================================================================================================
+// Function Invocations
+//==================================================================================================
+
+/**
+ * @brief Buffer through which the input and the output of a function invocation are exchanged.
+ */
+struct function_buffer
+{
+    uint32_t length;                                        /** Length of data. */
+    uint8_t data[FUNCTION_BUFFER_SIZE - sizeof(uint32_t)]; /** Data.           */
+};
+
+/**
+ * @brief Waits for a function invocation.
+ *
+ * @param buf Invocation buffer. On entry, it holds the output of the previous invocation, if any.
+ * On return, it holds the input of the next invocation.
+ *
+ * @note The virtual machine monitor takes a snapshot when this function is first called, and
+ * rewinds the virtual machine to it after each invocation. Thus, this function returns to its
+ * first caller on every invocation.
+ */
+static inline void function_wait(struct function_buffer *buf)
+{
+    outl(FUNCTION_PORT, (uint32_t)buf);
+}
+
+#endif // BENCH_H_
@@ -0,0 +1,233 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#include "bench.h"
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/**
+ * @brief Largest memory region that is benchmarked.
+ */
+#define MAX_REGION_SIZE (64 * 1024 * 1024)
+
+/**
+ * @brief Address past the last one that the benchmarked region may cover.
+ */
+#define REGION_LIMIT 0x100000000ULL
+
+/**
+ * @brief Smallest working set that is benchmarked.
+ */
+#define MIN_WORKING_SET (4 * 1024)
+
+/**
+ * @brief Number of bytes that are streamed in each bandwidth measurement.
+ */
+#define STREAM_BYTES (256 * 1024 * 1024)
+
+/**
+ * @brief Size of a cache line.
+ */
+#define LINE_SIZE 64
+
+/**
+ * @brief Number of dependent loads in each latency measurement.
+ */
+#define NR_LOADS (1 << 20)
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/**
+ * @brief Memory region that is benchmarked, carved out of usable guest memory at boot.
+ */
+static uint32_t *region;
+
+/**
+ * @brief Prevents reads from being optimized away.
+ */
+static volatile uint32_t sink;
+
+/**
+ * @brief Next random number.
+ */
+static uint32_t next = 1;
+
+//==================================================================================================
+// Random Number Generator
+//==================================================================================================
+
+/**
+ * @brief Returns a random number (xorshift32).
+ */
+static uint32_t urand(void)
+{
+    next ^= next << 13;
+    next ^= next >> 17;
+    next ^= next << 5;
+    return (next);
+}
+
+//==================================================================================================
+// Reporting
+//==================================================================================================
+
+/**
+ * @brief Reports the results of a benchmark to the host.
+ *
+ * @param test     Name of the test.
+ * @param size     Working set size in bytes.
+ * @param accesses Number of bytes transferred (bandwidth) or loads issued (latency).
+ * @param cycles   Number of cycles that were spent.
+ */
+static void report(const char *test, uint32_t size, uint32_t accesses, uint64_t cycles)
+{
+    report_begin("mem-bench");
+    report_str("test", test);
+    report_num("size", size);
+    report_num("accesses", accesses);
+    report_num("cycles", cycles);
+    report_end();
+}
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+/**
+ * @brief Streams reads over a working set.
+ *
+ * @param size   Working set size in bytes.
+ * @param rounds Number of passes over the working set.
+ *
+ * @returns The number of cycles that were spent.
+ */
+static uint64_t stream_read(uint32_t size, uint32_t rounds)
+{
+    const volatile uint32_t *p = region;
+    const uint32_t n = size / sizeof(uint32_t);
+    uint32_t sum = 0;
+
+    uint64_t start = rdtsc();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < n; i += 8) {
+            sum += p[i] + p[i + 1] + p[i + 2] + p[i + 3];
+            sum += p[i + 4] + p[i + 5] + p[i + 6] + p[i + 7];
+        }
+    }
+    uint64_t end = rdtsc();
+
+    sink = sum;
+
+    return (end - start);
+}
+
+/**
+ * @brief Streams writes over a working set.
+ *
+ * @param size   Working set size in bytes.
+ * @param rounds Number of passes over the working set.
+ *
+ * @returns The number of cycles that were spent.
+ */
+static uint64_t stream_write(uint32_t size, uint32_t rounds)
+{
+    volatile uint32_t *p = region;
+    const uint32_t n = size / sizeof(uint32_t);
+
+    uint64_t start = rdtsc();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < n; i += 8) {
+            p[i] = r;
+            p[i + 1] = r;
+            p[i + 2] = r;
+            p[i + 3] = r;
+            p[i + 4] = r;
+            p[i + 5] = r;
+            p[i + 6] = r;
+            p[i + 7] = r;
+        }
+    }
+    uint64_t end = rdtsc();
+
+    return (end - start);
+}
+
+/**
+ * @brief Chases pointers through a random cyclic permutation of the cache lines in a working set.
+ *
+ * @param size Working set size in bytes.
+ *
+ * @returns The number of cycles that were spent.
+ */
+static uint64_t chase(uint32_t size)
+{
+    const uint32_t nlines = size / LINE_SIZE;
+    const uint32_t stride = LINE_SIZE / sizeof(uint32_t);
+
+    // Build a single cycle with Sattolo's algorithm.
+    for (uint32_t i = 0; i < nlines; i++) {
+        region[i * stride] = i;
+    }
+    for (uint32_t i = nlines - 1; i > 0; i--) {
+        uint32_t j = urand() % i;
+        uint32_t tmp = region[i * stride];
+        region[i * stride] = region[j * stride];
+        region[j * stride] = tmp;
+    }
+    for (uint32_t i = 0; i < nlines; i++) {
+        region[i * stride] = (uint32_t)&region[region[i * stride] * stride];
+    }
+
+    uint32_t *p = region;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < NR_LOADS; i++) {
+        p = (uint32_t *)*p;
+    }
+    uint64_t end = rdtsc();
+
+    sink = (uint32_t)p;
+
+    return (end - start);
+}
+
+//==================================================================================================
+// Main Function
+//==================================================================================================
+
+/**
+ * @brief Measures streaming bandwidth and random-access latency across working-set sizes.
+ *
+ * @note The first pass over the region pays for host page faults, so it is reported separately.
+ * It quantifies the benefit of prefaulting guest memory.
+ */
+void kmain(uint32_t magic, uint32_t info)
+{
+    uint64_t available = 0;
+    uint32_t region_size = MAX_REGION_SIZE;
+
+    // Use the largest power of two that fits in usable guest memory.
+    region = memory_find(boot_info(magic, info), LINE_SIZE, REGION_LIMIT, &available);
+    while (region_size > available) {
+        region_size >>= 1;
+    }
+    if (region_size < MIN_WORKING_SET) {
+        print("mem-bench: not enough memory\n");
+        return;
+    }
+
+    report("write-first-touch", region_size, region_size, stream_write(region_size, 1));
+
+    for (uint32_t size = MIN_WORKING_SET; size <= region_size; size *= 4) {
+        const uint32_t rounds = STREAM_BYTES / size;
+        report("read", size, STREAM_BYTES, stream_read(size, rounds));
+        report("write", size, STREAM_BYTES, stream_write(size, rounds));
+    }
+
+    for (uint32_t size = MIN_WORKING_SET; size <= region_size; size *= 4) {
+        report("latency", size, NR_LOADS, chase(size));
+    }
+}
@@ -0,0 +1,260 @@
+// Copyright(c) The Maintainers of Nanvix.
+// Licensed under the MIT License.
+
+#include "bench.h"
+
+//==================================================================================================
+// Constants
+//==================================================================================================
+
+/**
+ * @brief Largest memory region that is benchmarked.
+ */
+#define MAX_REGION_SIZE (64 * 1024 * 1024)
+
+/**
+ * @brief Amount of memory that is identity mapped. The benchmarked region lies below it.
+ */
+#define MAPPED_SIZE (128 * 1024 * 1024)
+
+/**
+ * @brief Size of a page.
+ */
+#define PAGE_SIZE 4096
+
+/**
+ * @brief Size of a large page.
+ */
+#define LARGE_PAGE_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief Size of a cache line.
+ */
+#define LINE_SIZE 64
+
+/**
+ * @brief Smallest number of pages that is benchmarked.
+ */
+#define MIN_PAGES 16
+
+/**
+ * @brief Number of dependent loads in each measurement.
+ */
+#define NR_LOADS (1 << 20)
+
+/**
+ * @brief Page table entry flags.
+ */
+#define PTE_PRESENT (1 << 0)
+#define PTE_WRITE (1 << 1)
+#define PDE_PS (1 << 7)
+
+/**
+ * @brief Control register bits.
+ */
+#define CR0_PG (1 << 31)
+#define CR4_PSE (1 << 4)
+
+//==================================================================================================
+// Global Variables
+//==================================================================================================
+
+/**
+ * @brief Memory region that is benchmarked, carved out of usable guest memory at boot.
+ */
+static uint8_t *region;
+
+/**
+ * @brief Page directory that maps memory with small pages.
+ */
+static uint32_t pgdir_small[PAGE_SIZE / sizeof(uint32_t)] __attribute__((aligned(PAGE_SIZE)));
+
+/**
+ * @brief Page directory that maps memory with large pages.
+ */
+static uint32_t pgdir_large[PAGE_SIZE / sizeof(uint32_t)] __attribute__((aligned(PAGE_SIZE)));
+
+/**
+ * @brief Page tables for the small-page directory.
+ */
+static uint32_t pgtab[MAPPED_SIZE / LARGE_PAGE_SIZE][PAGE_SIZE / sizeof(uint32_t)]
+    __attribute__((aligned(PAGE_SIZE)));
+
+/**
+ * @brief Prevents loads from being optimized away.
+ */
+static volatile uint32_t sink;
+
+/**
+ * @brief Next random number.
+ */
+static uint32_t next = 1;
+
+//==================================================================================================
+// Paging
+//==================================================================================================
+
+/**
+ * @brief Builds identity-mapped page directories.
+ */
+static void paging_setup(void)
+{
+    for (uint32_t i = 0; i < MAPPED_SIZE / LARGE_PAGE_SIZE; i++) {
+        for (uint32_t j = 0; j < PAGE_SIZE / sizeof(uint32_t); j++) {
+            pgtab[i][j] = (i * LARGE_PAGE_SIZE + j * PAGE_SIZE) | PTE_WRITE | PTE_PRESENT;
+        }
+        pgdir_small[i] = (uint32_t)pgtab[i] | PTE_WRITE | PTE_PRESENT;
+        pgdir_large[i] = (i * LARGE_PAGE_SIZE) | PDE_PS | PTE_WRITE | PTE_PRESENT;
+    }
+}
+
+/**
+ * @brief Enables paging.
+ *
+ * @param pgdir Page directory to use.
+ * @param large Enable large pages?
+ */
+static void paging_enable(uint32_t *pgdir, int large)
+{
+    uint32_t cr0, cr4;
+
+    __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+    cr4 = large ? (cr4 | CR4_PSE) : (cr4 & ~CR4_PSE);
+    __asm__ __volatile__("mov %0, %%cr4" : : "r"(cr4) : "memory");
+    __asm__ __volatile__("mov %0, %%cr3" : : "r"(pgdir) : "memory");
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0 | CR0_PG) : "memory");
+}
+
+/**
+ * @brief Disables paging.
+ */
+static void paging_disable(void)
+{
+    uint32_t cr0;
+
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(cr0 & ~CR0_PG) : "memory");
+}
+
+//==================================================================================================
+// Benchmarks
+//==================================================================================================
+
+/**
+ * @brief Returns a random number (xorshift32).
+ */
+static uint32_t urand(void)
+{
+    next ^= next << 13;
+    next ^= next >> 17;
+    next ^= next << 5;
+    return (next);
+}
+
+/**
+ * @brief Returns the address that is accessed in a page. Offsets are staggered across pages, so
+ * that accesses do not contend for the same cache sets.
+ */
+static uint32_t *slot(uint32_t page)
+{
+    return ((uint32_t *)&region[page * PAGE_SIZE + (page * LINE_SIZE) % PAGE_SIZE]);
+}
+
+/**
+ * @brief Links pages into a random cycle with Sattolo's algorithm.
+ *
+ * @param npages Number of pages.
+ */
+static void link(uint32_t npages)
+{
+    for (uint32_t i = 0; i < npages; i++) {
+        *slot(i) = i;
+    }
+    for (uint32_t i = npages - 1; i > 0; i--) {
+        uint32_t j = urand() % i;
+        uint32_t tmp = *slot(i);
+        *slot(i) = *slot(j);
+        *slot(j) = tmp;
+    }
+    for (uint32_t i = 0; i < npages; i++) {
+        *slot(i) = (uint32_t)slot(*slot(i));
+    }
+}
+
+/**
+ * @brief Chases pointers that touch one cache line per page.
+ *
+ * @returns The number of cycles that were spent.
+ */
+static uint64_t chase(void)
+{
+    uint32_t *p = slot(0);
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < NR_LOADS; i++) {
+        p = (uint32_t *)*p;
+    }
+    uint64_t end = rdtsc();
+
+    sink = (uint32_t)p;
+
+    return (end - start);
+}
+
+/**
+ * @brief Reports the results of a benchmark to the host.
+ *
+ * @param paging Paging mode.
+ * @param npages Number of pages in the working set.
+ * @param cycles Number of cycles that were spent.
+ */
+static void report(const char *paging, uint32_t npages, uint64_t cycles)
+{
+    report_begin("tlb-bench");
+    report_str("paging", paging);
+    report_num("pages", npages);
+    report_num("loads", NR_LOADS);
+    report_num("cycles", cycles);
+    report_end();
+}
+
+//==================================================================================================
+// Main Function
+//==================================================================================================
+
+/**
+ * @brief Measures page-walk cost by comparing the latency of one access per page with paging
+ * disabled, with small pages and with large pages.
+ */
+void kmain(uint32_t magic, uint32_t info)
+{
+    uint64_t available = 0;
+    uint32_t region_size = MAX_REGION_SIZE;
+
+    // Use the largest power of two that fits in usable guest memory.
+    region = memory_find(boot_info(magic, info), PAGE_SIZE, MAPPED_SIZE, &available);
+    while (region_size > available) {
+        region_size >>= 1;
+    }
+    if (region_size < MIN_PAGES * PAGE_SIZE) {
+        print("tlb-bench: not enough memory\n");
+        return;
+    }
+
+    paging_setup();
+
+    for (uint32_t npages = MIN_PAGES; npages <= region_size / PAGE_SIZE; npages *= 4) {
+        link(npages);
+
+        report("none", npages, chase());
+
+        paging_enable(pgdir_small, 0);
+        report("4k", npages, chase());
+        paging_disable();
+
+        paging_enable(pgdir_large, 1);
+        report("4m", npages, chase());
+        paging_disable();
+    }
+}